@@ -107,6 +107,13 @@ unix:!macx {
             CONFIG += libdrm
         }
 
+        packagesExist(vulkan) {
+            # The Vulkan renderer's shaders are compiled to SPIR-V at build time
+            system(glslc --version > /dev/null 2>&1) {
+                CONFIG += libvulkan
+            }
+        }
+
         packagesExist(ffnvcodec) {
             PKGCONFIG += ffnvcodec
             CONFIG += cuda
@@ -174,8 +181,10 @@ SOURCES += \
     streaming/input/keyboard.cpp \
     streaming/input/mouse.cpp \
     streaming/input/reltouch.cpp \
+    streaming/replay.cpp \
     streaming/session.cpp \
     streaming/audio/audio.cpp \
+    streaming/audio/jitterbuffer.cpp \
     streaming/audio/renderers/sdlaud.cpp \
     gui/computermodel.cpp \
     gui/appmodel.cpp \
@@ -184,6 +193,7 @@ SOURCES += \
     path.cpp \
     settings/mappingmanager.cpp \
     gui/sdlgamepadkeynavigation.cpp \
+    streaming/video/decoderprobecache.cpp \
     streaming/video/overlaymanager.cpp \
     backend/systemproperties.cpp \
     wm.cpp
@@ -216,12 +226,15 @@ HEADERS += \
     cli/startstream.h \
     settings/streamingpreferences.h \
     streaming/input/input.h \
+    streaming/replay.h \
     streaming/session.h \
+    streaming/audio/jitterbuffer.h \
     streaming/audio/renderers/renderer.h \
     streaming/audio/renderers/sdl.h \
     gui/computermodel.h \
     gui/appmodel.h \
     streaming/video/decoder.h \
+    streaming/video/decoderprobecache.h \
     streaming/streamutils.h \
     backend/autoupdatechecker.h \
     path.h \
@@ -238,13 +251,17 @@ ffmpeg {
     SOURCES += \
         streaming/video/ffmpeg.cpp \
         streaming/video/ffmpeg-renderers/sdlvid.cpp \
-        streaming/video/ffmpeg-renderers/pacer/pacer.cpp
+        streaming/video/ffmpeg-renderers/nullvid.cpp \
+        streaming/video/ffmpeg-renderers/pacer/pacer.cpp \
+        streaming/video/ffmpeg-renderers/pacer/simulatedvsyncsource.cpp
 
     HEADERS += \
         streaming/video/ffmpeg.h \
         streaming/video/ffmpeg-renderers/renderer.h \
         streaming/video/ffmpeg-renderers/sdlvid.h \
-        streaming/video/ffmpeg-renderers/pacer/pacer.h
+        streaming/video/ffmpeg-renderers/nullvid.h \
+        streaming/video/ffmpeg-renderers/pacer/pacer.h \
+        streaming/video/ffmpeg-renderers/pacer/simulatedvsyncsource.h
 }
 libva {
     message(VAAPI renderer selected)
@@ -290,8 +307,12 @@ libdrm {
     message(DRM renderer selected)
 
     DEFINES += HAVE_DRM
-    SOURCES += streaming/video/ffmpeg-renderers/drm.cpp
-    HEADERS += streaming/video/ffmpeg-renderers/drm.h
+    SOURCES += \
+        streaming/video/ffmpeg-renderers/drm.cpp \
+        streaming/video/ffmpeg-renderers/pacer/drmvsyncsource.cpp
+    HEADERS += \
+        streaming/video/ffmpeg-renderers/drm.h \
+        streaming/video/ffmpeg-renderers/pacer/drmvsyncsource.h
 
     linux {
         message(Master hooks enabled)
@@ -313,8 +334,26 @@ config_EGL {
     DEFINES += HAVE_EGL
     SOURCES += \
         streaming/video/ffmpeg-renderers/eglvid.cpp \
-        streaming/video/ffmpeg-renderers/egl_extensions.cpp
-    HEADERS += streaming/video/ffmpeg-renderers/eglvid.h
+        streaming/video/ffmpeg-renderers/egl_extensions.cpp \
+        streaming/video/ffmpeg-renderers/swframe.cpp
+    HEADERS += \
+        streaming/video/ffmpeg-renderers/eglvid.h \
+        streaming/video/ffmpeg-renderers/swframe.h
+}
+libvulkan:libdrm {
+    message(Vulkan renderer selected)
+
+    DEFINES += HAVE_VULKAN
+    PKGCONFIG += vulkan
+    SOURCES += streaming/video/ffmpeg-renderers/vulkanvid.cpp
+    HEADERS += streaming/video/ffmpeg-renderers/vulkanvid.h
+
+    VULKAN_SHADERS += shaders/vk_yuv.comp
+    glslc.input = VULKAN_SHADERS
+    glslc.output = ${QMAKE_FILE_BASE}.spv.h
+    glslc.commands = glslc -mfmt=num -o ${QMAKE_FILE_OUT} ${QMAKE_FILE_NAME}
+    glslc.CONFIG += no_link target_predeps
+    QMAKE_EXTRA_COMPILERS += glslc
 }
 config_SL {
     message(Steam Link build configuration selected)
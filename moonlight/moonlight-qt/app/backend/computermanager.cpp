@@ -14,18 +14,21 @@
 
 #define SER_HOSTS "hosts"
 
-class PcMonitorThread : public QThread
-{
-    Q_OBJECT
-
 #define TRIES_BEFORE_OFFLINING 2
 #define POLLS_PER_APPLIST_FETCH 10
+#define POLL_INTERVAL_MS 3000
+#define MAX_OFFLINE_POLL_INTERVAL_MS 30000
+#define MAX_CONCURRENT_POLLS 4
 
+class PcPollTask : public QRunnable
+{
 public:
-    PcMonitorThread(NvComputer* computer)
-        : m_Computer(computer)
+    PcPollTask(ComputerPollingScheduler* scheduler, NvComputer* computer, int pollsSinceLastAppListFetch)
+        : m_Scheduler(scheduler),
+          m_Computer(computer),
+          m_PollsSinceLastAppListFetch(pollsSinceLastAppListFetch)
     {
-        setObjectName("Polling thread for " + computer->name);
+
     }
 
 private:
@@ -72,77 +75,262 @@ private:
         return true;
     }
 
-    void run() override
+    ComputerPollingScheduler::PollResult poll()
     {
-        // Always fetch the applist the first time
-        int pollsSinceLastAppListFetch = POLLS_PER_APPLIST_FETCH;
-        while (!isInterruptionRequested()) {
-            bool stateChanged = false;
-            bool online = false;
-            bool wasOnline = m_Computer->state == NvComputer::CS_ONLINE;
-            for (int i = 0; i < (wasOnline ? TRIES_BEFORE_OFFLINING : 1) && !online; i++) {
-                for (auto& address : m_Computer->uniqueAddresses()) {
-                    if (isInterruptionRequested()) {
-                        return;
-                    }
+        bool stateChanged = false;
+        bool online = false;
+        bool wasOnline = m_Computer->state == NvComputer::CS_ONLINE;
+        for (int i = 0; i < (wasOnline ? TRIES_BEFORE_OFFLINING : 1) && !online; i++) {
+            for (auto& address : m_Computer->uniqueAddresses()) {
+                if (m_Scheduler->shouldAbortPoll(m_Computer)) {
+                    return ComputerPollingScheduler::PR_ABORTED;
+                }
 
-                    if (tryPollComputer(address, stateChanged)) {
-                        if (!wasOnline) {
-                            qInfo() << m_Computer->name << "is now online at" << m_Computer->activeAddress.toString();
-                        }
-                        online = true;
-                        break;
+                if (tryPollComputer(address, stateChanged)) {
+                    if (!wasOnline) {
+                        qInfo() << m_Computer->name << "is now online at" << m_Computer->activeAddress.toString();
                     }
+                    online = true;
+                    break;
                 }
             }
+        }
 
-            // Check if we failed after all retry attempts
-            // Note: we don't need to acquire the read lock here,
-            // because we're on the writing thread.
-            if (!online && m_Computer->state != NvComputer::CS_OFFLINE) {
-                qInfo() << m_Computer->name << "is now offline";
-                m_Computer->state = NvComputer::CS_OFFLINE;
-                stateChanged = true;
-            }
-
-            // Grab the applist if it's empty or it's been long enough that we need to refresh
-            pollsSinceLastAppListFetch++;
-            if (m_Computer->state == NvComputer::CS_ONLINE &&
-                    m_Computer->pairState == NvComputer::PS_PAIRED &&
-                    (m_Computer->appList.isEmpty() || pollsSinceLastAppListFetch >= POLLS_PER_APPLIST_FETCH)) {
-                // Notify prior to the app list poll since it may take a while, and we don't
-                // want to delay onlining of a machine, especially if we already have a cached list.
-                if (stateChanged) {
-                    emit computerStateChanged(m_Computer);
-                    stateChanged = false;
-                }
-
-                if (updateAppList(stateChanged)) {
-                    pollsSinceLastAppListFetch = 0;
-                }
-            }
+        // Check if we failed after all retry attempts
+        // Note: we don't need to acquire the read lock here,
+        // because only one poll of this computer runs at a time.
+        if (!online && m_Computer->state != NvComputer::CS_OFFLINE) {
+            qInfo() << m_Computer->name << "is now offline";
+            m_Computer->state = NvComputer::CS_OFFLINE;
+            stateChanged = true;
+        }
 
+        // Grab the applist if it's empty or it's been long enough that we need to refresh
+        m_PollsSinceLastAppListFetch++;
+        if (m_Computer->state == NvComputer::CS_ONLINE &&
+                m_Computer->pairState == NvComputer::PS_PAIRED &&
+                (m_Computer->appList.isEmpty() || m_PollsSinceLastAppListFetch >= POLLS_PER_APPLIST_FETCH)) {
+            // Notify prior to the app list poll since it may take a while, and we don't
+            // want to delay onlining of a machine, especially if we already have a cached list.
             if (stateChanged) {
-                // Tell anyone listening that we've changed state
-                emit computerStateChanged(m_Computer);
+                emit m_Scheduler->computerStateChanged(m_Computer);
+                stateChanged = false;
             }
 
-            // Wait a bit to poll again, but do it in 100 ms chunks
-            // so we can be interrupted reasonably quickly.
-            // FIXME: QWaitCondition would be better.
-            for (int i = 0; i < 30 && !isInterruptionRequested(); i++) {
-                QThread::msleep(100);
+            if (updateAppList(stateChanged)) {
+                m_PollsSinceLastAppListFetch = 0;
             }
         }
+
+        if (stateChanged) {
+            // Tell anyone listening that we've changed state
+            emit m_Scheduler->computerStateChanged(m_Computer);
+        }
+
+        return online ? ComputerPollingScheduler::PR_ONLINE : ComputerPollingScheduler::PR_OFFLINE;
     }
 
-signals:
-   void computerStateChanged(NvComputer* computer);
+    void run() override
+    {
+        ComputerPollingScheduler::PollResult result = poll();
+        m_Scheduler->completePoll(m_Computer, result, m_PollsSinceLastAppListFetch);
+    }
 
-private:
+    ComputerPollingScheduler* m_Scheduler;
     NvComputer* m_Computer;
+    int m_PollsSinceLastAppListFetch;
 };
 
+ComputerPollingScheduler::ComputerPollingScheduler()
+    : m_RandomEngine(std::random_device()())
+{
+    setObjectName("CM Polling Scheduler");
+
+    m_PollPool.setMaxThreadCount(MAX_CONCURRENT_POLLS);
+    m_Clock.start();
+}
+
+ComputerPollingScheduler::~ComputerPollingScheduler()
+{
+    removeAllComputers();
+
+    // Wake the scheduler thread and wait for it to terminate
+    requestInterruption();
+    {
+        QMutexLocker locker(&m_Mutex);
+        m_Condition.wakeAll();
+    }
+    wait();
+
+    // Polls in progress will see they've been removed and abort
+    m_PollPool.waitForDone();
+}
+
+void ComputerPollingScheduler::run()
+{
+    QMutexLocker locker(&m_Mutex);
+
+    while (!isInterruptionRequested()) {
+        qint64 now = m_Clock.elapsed();
+        qint64 nextPollTimeMs = -1;
+
+        // Start the most overdue polls first, up to our limit
+        while (m_InFlight.size() < MAX_CONCURRENT_POLLS) {
+            PollingEntry* dueEntry = nullptr;
+
+            for (PollingEntry& entry : m_Entries) {
+                if (!m_InFlight.contains(entry.computer) &&
+                        entry.nextPollTimeMs <= now &&
+                        (dueEntry == nullptr || entry.nextPollTimeMs < dueEntry->nextPollTimeMs)) {
+                    dueEntry = &entry;
+                }
+            }
+
+            if (dueEntry == nullptr) {
+                break;
+            }
+
+            m_InFlight.insert(dueEntry->computer);
+            m_PollPool.start(new PcPollTask(this, dueEntry->computer, dueEntry->pollsSinceLastAppListFetch));
+        }
+
+        // If we're at the limit, completePoll() will wake us up
+        if (m_InFlight.size() < MAX_CONCURRENT_POLLS) {
+            for (const PollingEntry& entry : m_Entries) {
+                if (!m_InFlight.contains(entry.computer) &&
+                        (nextPollTimeMs < 0 || entry.nextPollTimeMs < nextPollTimeMs)) {
+                    nextPollTimeMs = entry.nextPollTimeMs;
+                }
+            }
+        }
+
+        if (nextPollTimeMs < 0) {
+            m_Condition.wait(&m_Mutex);
+        }
+        else if (nextPollTimeMs > now) {
+            m_Condition.wait(&m_Mutex, (unsigned long)(nextPollTimeMs - now));
+        }
+    }
+}
+
+// Spread polls out by +/- 25% so hosts added at the same time don't stay in lockstep
+qint64 ComputerPollingScheduler::getJitteredInterval(qint64 intervalMs)
+{
+    std::uniform_int_distribution<qint64> dist(intervalMs * 3 / 4, intervalMs * 5 / 4);
+    return dist(m_RandomEngine);
+}
+
+void ComputerPollingScheduler::addComputer(NvComputer* computer)
+{
+    QMutexLocker locker(&m_Mutex);
+
+    if (m_Entries.contains(computer->uuid)) {
+        return;
+    }
+
+    PollingEntry entry;
+    entry.computer = computer;
+    entry.nextPollTimeMs = m_Clock.elapsed();
+    entry.consecutiveFailures = 0;
+
+    // Always fetch the applist the first time
+    entry.pollsSinceLastAppListFetch = POLLS_PER_APPLIST_FETCH;
+    entry.wakeRequested = false;
+
+    m_Entries.insert(computer->uuid, entry);
+    m_Condition.wakeAll();
+}
+
+void ComputerPollingScheduler::removeComputer(NvComputer* computer)
+{
+    QMutexLocker locker(&m_Mutex);
+
+    m_Entries.remove(computer->uuid);
+
+    while (m_InFlight.contains(computer)) {
+        m_Condition.wait(&m_Mutex);
+    }
+}
+
+void ComputerPollingScheduler::removeAllComputers()
+{
+    QMutexLocker locker(&m_Mutex);
+
+    m_Entries.clear();
+    m_Condition.wakeAll();
+}
+
+void ComputerPollingScheduler::wakeComputer(NvComputer* computer)
+{
+    QMutexLocker locker(&m_Mutex);
+
+    auto it = m_Entries.find(computer->uuid);
+    if (it == m_Entries.end()) {
+        return;
+    }
+
+    it->consecutiveFailures = 0;
+    if (m_InFlight.contains(computer)) {
+        // The poll in progress may have started before the host came up
+        it->wakeRequested = true;
+    }
+    else {
+        it->nextPollTimeMs = m_Clock.elapsed();
+        m_Condition.wakeAll();
+    }
+}
+
+bool ComputerPollingScheduler::shouldAbortPoll(NvComputer* computer)
+{
+    QMutexLocker locker(&m_Mutex);
+
+    return isInterruptionRequested() || !m_Entries.contains(computer->uuid);
+}
+
+void ComputerPollingScheduler::completePoll(NvComputer* computer, PollResult result, int pollsSinceLastAppListFetch)
+{
+    QMutexLocker locker(&m_Mutex);
+
+    m_InFlight.remove(computer);
+
+    auto it = m_Entries.find(computer->uuid);
+    if (result == PR_ABORTED) {
+        // We learned nothing about the host, so leave its backoff alone. The
+        // entry is still due, so a wake request has nothing left to do.
+        if (it != m_Entries.end() && it->computer == computer) {
+            it->wakeRequested = false;
+        }
+    }
+    else if (it != m_Entries.end() && it->computer == computer) {
+        qint64 intervalMs = POLL_INTERVAL_MS;
+
+        it->pollsSinceLastAppListFetch = pollsSinceLastAppListFetch;
+
+        if (result == PR_ONLINE) {
+            it->consecutiveFailures = 0;
+        }
+        else {
+            // Back off exponentially while the host stays offline
+            it->consecutiveFailures++;
+            for (int i = 1; i < it->consecutiveFailures && intervalMs < MAX_OFFLINE_POLL_INTERVAL_MS; i++) {
+                intervalMs *= 2;
+            }
+            intervalMs = qMin(intervalMs, (qint64)MAX_OFFLINE_POLL_INTERVAL_MS);
+        }
+
+        if (it->wakeRequested) {
+            it->wakeRequested = false;
+            it->nextPollTimeMs = m_Clock.elapsed();
+        }
+        else {
+            it->nextPollTimeMs = m_Clock.elapsed() + getJitteredInterval(intervalMs);
+        }
+    }
+
+    // Wake the scheduler and anyone waiting in removeComputer()
+    m_Condition.wakeAll();
+}
+
 ComputerManager::ComputerManager(QObject *parent)
     : QObject(parent),
       m_PollingRef(0),
@@ -168,6 +356,12 @@ ComputerManager::ComputerManager(QObject *parent)
     m_DelayedFlushThread = new DelayedFlushThread(this);
     m_DelayedFlushThread->start();
 
+    // Start the polling scheduler. It sits idle until polling starts.
+    m_PollScheduler = new ComputerPollingScheduler();
+    connect(m_PollScheduler, &ComputerPollingScheduler::computerStateChanged,
+            this, &ComputerManager::handleComputerStateChanged);
+    m_PollScheduler->start();
+
     // To quit in a timely manner, we must block additional requests
     // after we receive the aboutToQuit() signal. This is neccessary
     // because NvHTTP uses aboutToQuit() to abort requests in progres
@@ -206,15 +400,8 @@ ComputerManager::~ComputerManager()
     delete m_MdnsBrowser;
     m_MdnsBrowser = nullptr;
 
-    // Interrupt polling
-    for (ComputerPollingEntry* entry : m_PollEntries) {
-        entry->interrupt();
-    }
-
-    // Delete all polling entries (and associated threads)
-    for (ComputerPollingEntry* entry : m_PollEntries) {
-        delete entry;
-    }
+    // Stop polling and wait for polls in progress to finish
+    delete m_PollScheduler;
 
     // Destroy all NvComputer objects now that polling is halted
     for (NvComputer* computer : m_KnownHosts) {
@@ -349,22 +536,7 @@ void ComputerManager::startPollingComputer(NvComputer* computer)
         return;
     }
 
-    ComputerPollingEntry* pollingEntry;
-
-    if (!m_PollEntries.contains(computer->uuid)) {
-        pollingEntry = m_PollEntries[computer->uuid] = new ComputerPollingEntry();
-    }
-    else {
-        pollingEntry = m_PollEntries[computer->uuid];
-    }
-
-    if (!pollingEntry->isActive()) {
-        PcMonitorThread* thread = new PcMonitorThread(computer);
-        connect(thread, &PcMonitorThread::computerStateChanged,
-                this, &ComputerManager::handleComputerStateChanged);
-        pollingEntry->setActiveThread(thread);
-        thread->start();
-    }
+    m_PollScheduler->addComputer(computer);
 }
 
 void ComputerManager::handleMdnsServiceResolved(MdnsPendingComputer* computer,
@@ -373,6 +545,21 @@ void ComputerManager::handleMdnsServiceResolved(MdnsPendingComputer* computer,
     QHostAddress v6Global = getBestGlobalAddressV6(addresses);
     bool added = false;
 
+    // If this is a host we already know, poll it now. It may have been
+    // backing off while offline and just announced that it's back.
+    {
+        QReadLocker lock(&m_Lock);
+
+        for (NvComputer* knownHost : m_KnownHosts) {
+            for (const NvAddress& knownAddress : knownHost->uniqueAddresses()) {
+                if (addresses.contains(QHostAddress(knownAddress.address()))) {
+                    m_PollScheduler->wakeComputer(knownHost);
+                    break;
+                }
+            }
+        }
+    }
+
     // Add the host using the IPv4 address
     for (const QHostAddress& address : addresses) {
         if (address.protocol() == QAbstractSocket::IPv4Protocol) {
@@ -434,23 +621,19 @@ public:
 
     void run()
     {
-        ComputerPollingEntry* pollingEntry;
-
         // Only do the minimum amount of work while holding the writer lock.
         // We must release it before calling saveHosts().
         {
             QWriteLocker lock(&m_ComputerManager->m_Lock);
 
-            pollingEntry = m_ComputerManager->m_PollEntries.take(m_Computer->uuid);
-
             m_ComputerManager->m_KnownHosts.remove(m_Computer->uuid);
         }
 
         // Persist the new host list
         m_ComputerManager->saveHosts();
 
-        // Delete the polling entry first. This will stop all polling threads too.
-        delete pollingEntry;
+        // Stop polling first. This waits for a poll in progress to finish.
+        m_ComputerManager->m_PollScheduler->removeComputer(m_Computer);
 
         // Delete cached box art
         BoxArtManager::deleteBoxArt(m_Computer);
@@ -498,11 +681,9 @@ void ComputerManager::handleAboutToQuit()
 {
     QReadLocker lock(&m_Lock);
 
-    // Interrupt polling threads immediately, so they
+    // Stop polling immediately, so polls in progress
     // avoid making additional requests while quitting
-    for (ComputerPollingEntry* entry : m_PollEntries) {
-        entry->interrupt();
-    }
+    m_PollScheduler->removeAllComputers();
 }
 
 class PendingPairingTask : public QObject, public QRunnable
@@ -650,10 +831,8 @@ void ComputerManager::stopPollingAsync()
     delete m_MdnsBrowser;
     m_MdnsBrowser = nullptr;
 
-    // Interrupt all threads, but don't wait for them to terminate
-    for (ComputerPollingEntry* entry : m_PollEntries) {
-        entry->interrupt();
-    }
+    // Stop polling, but don't wait for polls in progress to finish
+    m_PollScheduler->removeAllComputers();
 }
 
 void ComputerManager::addNewHostManually(QString address)
@@ -17,6 +17,11 @@
 #include <QTimer>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QSet>
+
+#include <random>
 
 class ComputerManager;
 
@@ -108,77 +113,64 @@ private:
     QVector<QHostAddress> m_Addresses;
 };
 
-class ComputerPollingEntry
+// Polls every known host from a single thread. Each poll runs on a small
+// thread pool, which bounds the number of requests in flight at once.
+// Offline hosts are polled less often the longer they stay offline.
+class ComputerPollingScheduler : public QThread
 {
+    Q_OBJECT
+
 public:
-    ComputerPollingEntry()
-        : m_ActiveThread(nullptr)
+    enum PollResult
     {
+        PR_ONLINE,
+        PR_OFFLINE,
+        PR_ABORTED
+    };
 
-    }
+    ComputerPollingScheduler();
 
-    virtual ~ComputerPollingEntry()
-    {
-        interrupt();
+    virtual ~ComputerPollingScheduler();
 
-        // interrupt() should have taken care of this
-        Q_ASSERT(m_ActiveThread == nullptr);
+    void run();
 
-        for (QThread* thread : m_InactiveList) {
-            thread->wait();
-            delete thread;
-        }
-    }
+    // Starts polling the computer right away if it isn't already being polled
+    void addComputer(NvComputer* computer);
 
-    bool isActive()
-    {
-        cleanInactiveList();
+    // Blocks until any poll of the computer that is in progress completes
+    void removeComputer(NvComputer* computer);
 
-        return m_ActiveThread != nullptr;
-    }
+    // Stops polling all computers without waiting for polls in progress
+    void removeAllComputers();
 
-    void setActiveThread(QThread* thread)
-    {
-        cleanInactiveList();
+    // Polls the computer as soon as possible and resets its backoff
+    void wakeComputer(NvComputer* computer);
 
-        Q_ASSERT(!isActive());
-        m_ActiveThread = thread;
-    }
+    bool shouldAbortPoll(NvComputer* computer);
 
-    void interrupt()
-    {
-        cleanInactiveList();
+    void completePoll(NvComputer* computer, PollResult result, int pollsSinceLastAppListFetch);
 
-        if (m_ActiveThread != nullptr) {
-            // Interrupt the active thread
-            m_ActiveThread->requestInterruption();
-
-            // Place it on the inactive list awaiting death
-            m_InactiveList.append(m_ActiveThread);
-
-            m_ActiveThread = nullptr;
-        }
-    }
+signals:
+    void computerStateChanged(NvComputer* computer);
 
 private:
-    void cleanInactiveList()
-    {
-        QMutableListIterator<QThread*> i(m_InactiveList);
-
-        // Reap any threads that have finished
-        while (i.hasNext()) {
-            i.next();
-
-            QThread* thread = i.value();
-            if (thread->isFinished()) {
-                delete thread;
-                i.remove();
-            }
-        }
-    }
-
-    QThread* m_ActiveThread;
-    QList<QThread*> m_InactiveList;
+    struct PollingEntry {
+        NvComputer* computer;
+        qint64 nextPollTimeMs;
+        int consecutiveFailures;
+        int pollsSinceLastAppListFetch;
+        bool wakeRequested;
+    };
+
+    qint64 getJitteredInterval(qint64 intervalMs);
+
+    QMutex m_Mutex;
+    QWaitCondition m_Condition;
+    QMap<QString, PollingEntry> m_Entries;
+    QSet<NvComputer*> m_InFlight;
+    QThreadPool m_PollPool;
+    QElapsedTimer m_Clock;
+    std::mt19937 m_RandomEngine;
 };
 
 class ComputerManager : public QObject
@@ -244,7 +236,7 @@ private:
     int m_PollingRef;
     QReadWriteLock m_Lock;
     QMap<QString, NvComputer*> m_KnownHosts;
-    QMap<QString, ComputerPollingEntry*> m_PollEntries;
+    ComputerPollingScheduler* m_PollScheduler;
     QMdnsEngine::Server m_MdnsServer;
     QMdnsEngine::Browser* m_MdnsBrowser;
     QMdnsEngine::Cache m_MdnsCache;
@@ -10,7 +10,7 @@
 
 class NvComputer
 {
-    friend class PcMonitorThread;
+    friend class PcPollTask;
     friend class ComputerManager;
     friend class PendingQuitTask;
 
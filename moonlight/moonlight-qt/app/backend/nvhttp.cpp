@@ -4,13 +4,19 @@
 #include <QDebug>
 #include <QUuid>
 #include <QtNetwork/QNetworkReply>
-#include <QEventLoop>
 #include <QTimer>
 #include <QXmlStreamReader>
 #include <QSslKey>
 #include <QImageReader>
 #include <QtEndian>
 #include <QNetworkProxy>
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QUrlQuery>
+
+#include <climits>
 
 #define FAST_FAIL_TIMEOUT_MS 2000
 #define REQUEST_TIMEOUT_MS 5000
@@ -26,12 +32,6 @@ NvHTTP::NvHTTP(NvAddress address, uint16_t httpsPort, QSslCertificate serverCert
 
     setAddress(address);
     setHttpsPort(httpsPort);
-
-    // Never use a proxy server
-    QNetworkProxy noProxy(QNetworkProxy::NoProxy);
-    m_Nam.setProxy(noProxy);
-
-    connect(&m_Nam, &QNetworkAccessManager::sslErrors, this, &NvHTTP::handleSslErrors);
 }
 
 NvHTTP::NvHTTP(NvComputer* computer) :
@@ -368,16 +368,15 @@ NvHTTP::verifyResponseStatus(QString xml)
 QImage
 NvHTTP::getBoxArt(int appId)
 {
-    QNetworkReply* reply = openConnection(m_BaseUrlHttps,
-                                          "appasset",
-                                          "appid="+QString::number(appId)+
-                                          "&AssetType=2&AssetIdx=0",
-                                          REQUEST_TIMEOUT_MS,
-                                          NvLogLevel::NVLL_VERBOSE);
-    QImage image = QImageReader(reply).read();
-    delete reply;
-
-    return image;
+    QByteArray data = openConnection(m_BaseUrlHttps,
+                                     "appasset",
+                                     "appid="+QString::number(appId)+
+                                     "&AssetType=2&AssetIdx=0",
+                                     REQUEST_TIMEOUT_MS,
+                                     NvLogLevel::NVLL_VERBOSE);
+    QBuffer buffer(&data);
+
+    return QImageReader(&buffer).read();
 }
 
 QByteArray
@@ -415,28 +414,6 @@ NvHTTP::getXmlString(QString xml,
     return nullptr;
 }
 
-void NvHTTP::handleSslErrors(QNetworkReply* reply, const QList<QSslError>& errors)
-{
-    bool ignoreErrors = true;
-
-    if (m_ServerCert.isNull()) {
-        // We should never make an HTTPS request without a cert
-        Q_ASSERT(!m_ServerCert.isNull());
-        return;
-    }
-
-    for (const QSslError& error : errors) {
-        if (m_ServerCert != error.certificate()) {
-            ignoreErrors = false;
-            break;
-        }
-    }
-
-    if (ignoreErrors) {
-        reply->ignoreSslErrors(errors);
-    }
-}
-
 QString
 NvHTTP::openConnectionToString(QUrl baseUrl,
                                QString command,
@@ -444,10 +421,10 @@ NvHTTP::openConnectionToString(QUrl baseUrl,
                                int timeoutMs,
                                NvLogLevel logLevel)
 {
-    QNetworkReply* reply = openConnection(baseUrl, command, arguments, timeoutMs, logLevel);
+    QByteArray data = openConnection(baseUrl, command, arguments, timeoutMs, logLevel);
     QString ret;
 
-    QTextStream stream(reply);
+    QTextStream stream(data);
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     stream.setEncoding(QStringConverter::Utf8);
@@ -456,12 +433,12 @@ NvHTTP::openConnectionToString(QUrl baseUrl,
 #endif
 
     ret = stream.readAll();
-    delete reply;
 
     return ret;
 }
 
-QNetworkReply*
+
+QByteArray
 NvHTTP::openConnection(QUrl baseUrl,
                        QString command,
                        QString arguments,
@@ -482,76 +459,331 @@ NvHTTP::openConnection(QUrl baseUrl,
                  QUuid::createUuid().toRfc4122().toHex() +
                  ((arguments != nullptr) ? ("&" + arguments) : ""));
 
-    QNetworkRequest request(url);
+    if (logLevel >= NvLogLevel::NVLL_VERBOSE) {
+        qInfo() << "Executing request:" << url.toString();
+    }
+
+    // serverinfo is polled from several threads at once, so
+    // concurrent requests for it can share a single response.
+    NvHTTPConnectionPool::Response response =
+            NvHTTPConnectionPool::get()->execute(url, m_ServerCert, timeoutMs, command == "serverinfo");
 
-    // Add our client certificate
-    request.setSslConfiguration(IdentityManager::get()->getSslConfig());
+    // Handle error
+    if (response.error != QNetworkReply::NoError)
+    {
+        if (response.error == QNetworkReply::OperationCanceledError && logLevel >= NvLogLevel::NVLL_ERROR) {
+            qWarning() << "Aborting timed out request for" << url.toString();
+        }
 
-#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
-    // Disable HTTP/2 (GFE 3.22 doesn't like it) and Qt 6 enables it by default
-    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
-#endif
+        if (logLevel >= NvLogLevel::NVLL_ERROR) {
+            qWarning() << command << "request failed with error:" << response.error;
+        }
 
-#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0) && QT_VERSION < QT_VERSION_CHECK(5, 15, 1) && !defined(QT_NO_BEARERMANAGEMENT)
-    // HACK: Set network accessibility to work around QTBUG-80947 (introduced in Qt 5.14.0 and fixed in Qt 5.15.1)
-    QT_WARNING_PUSH
-    QT_WARNING_DISABLE_DEPRECATED
-    m_Nam.setNetworkAccessible(QNetworkAccessManager::Accessible);
-    QT_WARNING_POP
-#endif
+        if (response.error == QNetworkReply::SslHandshakeFailedError) {
+            // This will trigger falling back to HTTP for the serverinfo query
+            // then pairing again to get the updated certificate.
+            throw GfeHttpResponseException(401, "Server certificate mismatch");
+        }
+        else if (response.error == QNetworkReply::OperationCanceledError) {
+            throw QtNetworkReplyException(QNetworkReply::TimeoutError, "Request timed out");
+        }
+        else {
+            throw QtNetworkReplyException(response.error, response.errorString);
+        }
+    }
+
+    return response.body;
+}
+
+NvHTTPConnectionPool*
+NvHTTPConnectionPool::get()
+{
+    static NvHTTPConnectionPool* s_Pool = new NvHTTPConnectionPool();
+    return s_Pool;
+}
+
+NvHTTPConnectionPool::NvHTTPConnectionPool()
+    : m_ShuttingDown(false)
+{
+    m_Thread.setObjectName("NvHTTP connection pool");
+    moveToThread(&m_Thread);
+    m_Thread.start();
+
+    // Abort requests in progress and stop our thread while quitting.
+    // This runs on the main thread, so it can wait for the pool thread.
+    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit,
+            QCoreApplication::instance(), [this]() {
+        shutdown();
+    });
+}
+
+void
+NvHTTPConnectionPool::shutdown()
+{
+    {
+        QMutexLocker lock(&m_Lock);
 
-    QNetworkReply* reply = m_Nam.get(request);
+        // Fail any requests that haven't been sent yet
+        m_ShuttingDown = true;
+        while (!m_QueuedRequests.isEmpty()) {
+            QSharedPointer<PendingRequest> request = m_QueuedRequests.dequeue();
 
-    // Run the request with a timeout if requested
-    QEventLoop loop;
-    connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, &loop, &QEventLoop::quit);
-    if (timeoutMs) {
-        QTimer::singleShot(timeoutMs, &loop, &QEventLoop::quit);
+            if (!request->coalescingKey.isEmpty()) {
+                m_CoalescedRequests.remove(request->coalescingKey);
+            }
+
+            request->response.error = QNetworkReply::OperationCanceledError;
+            request->response.errorString = "Application is quitting";
+            request->finished = true;
+        }
+        m_RequestFinished.wakeAll();
     }
-    if (logLevel >= NvLogLevel::NVLL_VERBOSE) {
-        qInfo() << "Executing request:" << url.toString();
+
+    // The QNAMs and their replies must be destroyed on the thread that owns them
+    QMetaObject::invokeMethod(this, "abortAllRequests", Qt::BlockingQueuedConnection);
+    QMetaObject::invokeMethod(this, "destroyHosts", Qt::BlockingQueuedConnection);
+
+    m_Thread.quit();
+    m_Thread.wait();
+}
+
+NvHTTPConnectionPool::Response
+NvHTTPConnectionPool::execute(QUrl url, QSslCertificate serverCert, int timeoutMs, bool coalesce)
+{
+    QSharedPointer<PendingRequest> request;
+    QElapsedTimer waitTimer;
+
+    // We'd never get a response if we blocked the pool thread
+    Q_ASSERT(QThread::currentThread() != &m_Thread);
+
+    // Connections are only shared between requests for the same server cert,
+    // so one that was validated against an old cert is never reused.
+    QString hostKey = QString("%1:%2/%3")
+            .arg(url.host())
+            .arg(url.port())
+            .arg(QString(serverCert.digest(QCryptographicHash::Sha256).toHex()));
+
+    QMutexLocker lock(&m_Lock);
+
+    if (m_ShuttingDown) {
+        Response response;
+        response.error = QNetworkReply::OperationCanceledError;
+        response.errorString = "Application is quitting";
+        return response;
     }
-    loop.exec(QEventLoop::ExcludeUserInputEvents);
 
-    // Abort the request if it timed out
-    if (!reply->isFinished())
-    {
-        if (logLevel >= NvLogLevel::NVLL_ERROR) {
-            qWarning() << "Aborting timed out request for" << url.toString();
+    if (coalesce) {
+        // The uuid parameter is unique to each request, so leave it out of the key
+        QUrlQuery query(url);
+        query.removeAllQueryItems("uuid");
+
+        QString coalescingKey = hostKey + url.path() + "?" + query.toString();
+        request = m_CoalescedRequests.value(coalescingKey);
+        if (request.isNull()) {
+            request.reset(new PendingRequest());
+            request->coalescingKey = coalescingKey;
+            m_CoalescedRequests.insert(coalescingKey, request);
         }
-        reply->abort();
+    }
+    else {
+        request.reset(new PendingRequest());
     }
 
-    // We must clear out cached authentication and connections or
-    // GFE will puke next time
-    m_Nam.clearAccessCache();
+    // Queue the request if we didn't join one that's already in flight
+    if (request->url.isEmpty()) {
+        request->url = url;
+        request->hostKey = hostKey;
+        request->serverCert = serverCert;
+        request->timeoutMs = timeoutMs;
+        request->finished = false;
 
-    // Handle error
-    if (reply->error() != QNetworkReply::NoError)
-    {
-        if (logLevel >= NvLogLevel::NVLL_ERROR) {
-            qWarning() << command << "request failed with error:" << reply->error();
+        m_QueuedRequests.enqueue(request);
+        QMetaObject::invokeMethod(this, "startQueuedRequests", Qt::QueuedConnection);
+    }
+
+    // Wait for our own timeout, even if we joined a request with a longer one
+    waitTimer.start();
+    while (!request->finished) {
+        unsigned long waitTimeMs = ULONG_MAX;
+
+        if (timeoutMs) {
+            if (waitTimer.elapsed() >= timeoutMs) {
+                Response response;
+                response.error = QNetworkReply::OperationCanceledError;
+                response.errorString = "Request timed out";
+                return response;
+            }
+
+            waitTimeMs = timeoutMs - waitTimer.elapsed();
         }
 
-        if (reply->error() == QNetworkReply::SslHandshakeFailedError) {
-            // This will trigger falling back to HTTP for the serverinfo query
-            // then pairing again to get the updated certificate.
-            GfeHttpResponseException exception(401, "Server certificate mismatch");
-            delete reply;
-            throw exception;
+        m_RequestFinished.wait(&m_Lock, waitTimeMs);
+    }
+
+    return request->response;
+}
+
+NvHTTPConnectionPool::Host&
+NvHTTPConnectionPool::getHost(const QString& hostKey, const QSslCertificate& serverCert)
+{
+    auto it = m_Hosts.find(hostKey);
+    if (it != m_Hosts.end()) {
+        return *it;
+    }
+
+    Host host;
+    host.nam = new QNetworkAccessManager(this);
+    host.activeRequests = 0;
+    host.keepAlive = false;
+
+    // Never use a proxy server
+    QNetworkProxy noProxy(QNetworkProxy::NoProxy);
+    host.nam->setProxy(noProxy);
+
+    connect(host.nam, &QNetworkAccessManager::sslErrors, this,
+            [serverCert](QNetworkReply* reply, const QList<QSslError>& errors) {
+        bool ignoreErrors = true;
+
+        if (serverCert.isNull()) {
+            // We should never make an HTTPS request without a cert
+            Q_ASSERT(!serverCert.isNull());
+            return;
+        }
+
+        for (const QSslError& error : errors) {
+            if (serverCert != error.certificate()) {
+                ignoreErrors = false;
+                break;
+            }
         }
-        else if (reply->error() == QNetworkReply::OperationCanceledError) {
-            QtNetworkReplyException exception(QNetworkReply::TimeoutError, "Request timed out");
-            delete reply;
-            throw exception;
+
+        if (ignoreErrors) {
+            reply->ignoreSslErrors(errors);
+        }
+    });
+
+    return *m_Hosts.insert(hostKey, host);
+}
+
+void
+NvHTTPConnectionPool::startQueuedRequests()
+{
+    for (;;) {
+        QSharedPointer<PendingRequest> request;
+
+        {
+            QMutexLocker lock(&m_Lock);
+            if (m_QueuedRequests.isEmpty()) {
+                break;
+            }
+            request = m_QueuedRequests.dequeue();
+        }
+
+        Host& host = getHost(request->hostKey, request->serverCert);
+
+        QNetworkRequest networkRequest(request->url);
+
+        // Add our client certificate
+        QSslConfiguration sslConfig = IdentityManager::get()->getSslConfig();
+        if (host.keepAlive) {
+            // Resume the last TLS session when a new connection is needed
+            sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+            sslConfig.setSessionTicket(host.sessionTicket);
         }
         else {
-            QtNetworkReplyException exception(reply->error(), reply->errorString());
-            delete reply;
-            throw exception;
+            // Don't let this connection be reused by another request. Clearing
+            // the access cache can't close connections that are still busy.
+            networkRequest.setRawHeader("Connection", "close");
+        }
+        networkRequest.setSslConfiguration(sslConfig);
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        // Disable HTTP/2 (GFE 3.22 doesn't like it) and Qt 6 enables it by default
+        networkRequest.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
+#endif
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0) && QT_VERSION < QT_VERSION_CHECK(5, 15, 1) && !defined(QT_NO_BEARERMANAGEMENT)
+        // HACK: Set network accessibility to work around QTBUG-80947 (introduced in Qt 5.14.0 and fixed in Qt 5.15.1)
+        QT_WARNING_PUSH
+        QT_WARNING_DISABLE_DEPRECATED
+        host.nam->setNetworkAccessible(QNetworkAccessManager::Accessible);
+        QT_WARNING_POP
+#endif
+
+        QNetworkReply* reply = host.nam->get(networkRequest);
+        host.activeRequests++;
+        m_ActiveReplies.insert(reply);
+
+        connect(reply, &QNetworkReply::finished, this, [this, request, reply]() {
+            completeRequest(request, reply);
+        });
+
+        // Run the request with a timeout if requested
+        if (request->timeoutMs) {
+            QTimer::singleShot(request->timeoutMs, reply, &QNetworkReply::abort);
+        }
+    }
+}
+
+void
+NvHTTPConnectionPool::completeRequest(QSharedPointer<PendingRequest> request, QNetworkReply* reply)
+{
+    Host& host = m_Hosts[request->hostKey];
+    Response response;
+
+    response.error = reply->error();
+    response.errorString = reply->errorString();
+    response.body = reply->readAll();
+
+    if (response.error == QNetworkReply::NoError && request->url.path() == "/serverinfo") {
+        QString state = NvHTTP::getXmlString(QString::fromUtf8(response.body), "state");
+        if (!state.isNull()) {
+            host.keepAlive = !state.contains("MJOLNIR");
         }
     }
 
-    return reply;
+    if (host.keepAlive) {
+        QByteArray sessionTicket = reply->sslConfiguration().sessionTicket();
+        if (!sessionTicket.isEmpty()) {
+            host.sessionTicket = sessionTicket;
+        }
+    }
+
+    m_ActiveReplies.remove(reply);
+    reply->deleteLater();
+
+    // We must clear out cached authentication and connections or
+    // GFE will puke next time. The connection itself was already
+    // closed by the Connection: close header.
+    if (--host.activeRequests == 0 && !host.keepAlive) {
+        host.nam->clearAccessCache();
+    }
+
+    QMutexLocker lock(&m_Lock);
+
+    if (!request->coalescingKey.isEmpty()) {
+        m_CoalescedRequests.remove(request->coalescingKey);
+    }
+
+    request->response = response;
+    request->finished = true;
+    m_RequestFinished.wakeAll();
+}
+
+void
+NvHTTPConnectionPool::abortAllRequests()
+{
+    // Aborting emits finished() synchronously, which removes the reply from the set
+    for (QNetworkReply* reply : m_ActiveReplies.values()) {
+        reply->abort();
+    }
+}
+
+void
+NvHTTPConnectionPool::destroyHosts()
+{
+    for (const Host& host : m_Hosts) {
+        delete host.nam;
+    }
+    m_Hosts.clear();
 }
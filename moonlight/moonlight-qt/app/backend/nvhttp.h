@@ -9,6 +9,13 @@
 #include <QUrl>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThread>
+#include <QWaitCondition>
 
 class NvComputer;
 
@@ -185,10 +192,7 @@ public:
     QUrl m_BaseUrlHttp;
     QUrl m_BaseUrlHttps;
 private:
-    void
-    handleSslErrors(QNetworkReply* reply, const QList<QSslError>& errors);
-
-    QNetworkReply*
+    QByteArray
     openConnection(QUrl baseUrl,
                    QString command,
                    QString arguments,
@@ -196,6 +200,87 @@ private:
                    NvLogLevel logLevel);
 
     NvAddress m_Address;
-    QNetworkAccessManager m_Nam;
     QSslCertificate m_ServerCert;
 };
+
+// Runs the requests for every NvHTTP object on a single thread, with one
+// QNetworkAccessManager per (host, port, server cert). This lets requests from
+// any thread reuse the connections and TLS sessions of earlier ones.
+class NvHTTPConnectionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Response {
+        QNetworkReply::NetworkError error;
+        QString errorString;
+        QByteArray body;
+    };
+
+    static
+    NvHTTPConnectionPool*
+    get();
+
+    // Performs a GET request and blocks until it completes or times out.
+    // If coalesce is set, this shares the response of an identical request
+    // that is already in flight instead of sending another one.
+    Response
+    execute(QUrl url, QSslCertificate serverCert, int timeoutMs, bool coalesce);
+
+private slots:
+    void
+    startQueuedRequests();
+
+    void
+    abortAllRequests();
+
+    void
+    destroyHosts();
+
+private:
+    struct PendingRequest {
+        QUrl url;
+        QString hostKey;
+        QString coalescingKey;
+        QSslCertificate serverCert;
+        int timeoutMs;
+
+        // Protected by m_Lock
+        bool finished;
+        Response response;
+    };
+
+    struct Host {
+        QNetworkAccessManager* nam;
+        int activeRequests;
+
+        // GFE breaks if connections are reused, so this is only
+        // set after serverinfo tells us the host isn't running it.
+        bool keepAlive;
+        QByteArray sessionTicket;
+    };
+
+    NvHTTPConnectionPool();
+
+    Host&
+    getHost(const QString& hostKey, const QSslCertificate& serverCert);
+
+    void
+    completeRequest(QSharedPointer<PendingRequest> request, QNetworkReply* reply);
+
+    void
+    shutdown();
+
+    QThread m_Thread;
+
+    // Protects the request state shared with the calling threads
+    QMutex m_Lock;
+    QWaitCondition m_RequestFinished;
+    QQueue<QSharedPointer<PendingRequest>> m_QueuedRequests;
+    QHash<QString, QSharedPointer<PendingRequest>> m_CoalescedRequests;
+    bool m_ShuttingDown;
+
+    // Only accessed on m_Thread
+    QHash<QString, Host> m_Hosts;
+    QSet<QNetworkReply*> m_ActiveReplies;
+};
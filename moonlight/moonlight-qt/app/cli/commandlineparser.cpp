@@ -1,6 +1,9 @@
 #include "commandlineparser.h"
 
+#include <Limelight.h>
+
 #include <QCommandLineParser>
+#include <QFileInfo>
 #include <QRegularExpression>
 
 #if defined(Q_OS_WIN)
@@ -168,6 +171,7 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
         "  quit            Quit the currently running app\n"
         "  stream          Start streaming an app\n"
         "  pair            Pair a new host\n"
+        "  replay          Replay a recorded video stream to benchmark decoding\n"
         "\n"
         "See 'moonlight <action> --help' for help of specific action."
     );
@@ -199,6 +203,8 @@ GlobalCommandLineParser::ParseResult GlobalCommandLineParser::parse(const QStrin
                 return PairRequested;
             } else if (action == "list") {
                 return ListRequested;
+            } else if (action == "replay") {
+                return ReplayRequested;
             }
         }
 
@@ -366,6 +372,7 @@ void StreamCommandLineParser::parse(const QStringList &args, StreamingPreference
     parser.addToggleOption("game-optimization", "game optimizations");
     parser.addToggleOption("audio-on-host", "audio on host PC");
     parser.addToggleOption("frame-pacing", "frame pacing");
+    parser.addValueOption("frame-pacing-latency", "frame pacing queue latency target in ms (0 uses the default pacing)");
     parser.addToggleOption("mute-on-focus-loss", "mute audio when Moonlight window loses focus");
     parser.addToggleOption("background-gamepad", "background gamepad input");
     parser.addToggleOption("reverse-scroll-direction", "inverted scroll direction");
@@ -470,6 +477,14 @@ void StreamCommandLineParser::parse(const QStringList &args, StreamingPreference
     // Resolve --frame-pacing and --no-frame-pacing options
     preferences->framePacing = parser.getToggleOptionValue("frame-pacing", preferences->framePacing);
 
+    // Resolve --frame-pacing-latency option
+    if (parser.isSet("frame-pacing-latency")) {
+        preferences->framePacingLatency = parser.getIntOption("frame-pacing-latency");
+        if (!inRange(preferences->framePacingLatency, 0, 100)) {
+            parser.showError("Frame pacing latency must be in range: 0 - 100");
+        }
+    }
+
     // Resolve --mute-on-focus-loss and --no-mute-on-focus-loss options
     preferences->muteOnFocusLoss = parser.getToggleOptionValue("mute-on-focus-loss", preferences->muteOnFocusLoss);
 
@@ -585,3 +600,281 @@ bool ListCommandLineParser::isVerbose() const
 {
     return m_Verbose;
 }
+
+ReplayCommandLineParser::ReplayCommandLineParser()
+{
+    VIDEO_REPLAY_CONFIGURATION defaultConfig;
+
+    LiInitializeVideoReplayConfiguration(&defaultConfig);
+    m_VideoFormat = VIDEO_FORMAT_H264;
+    m_FecPercentage = defaultConfig.fecPercentage;
+    m_SpeedPercent = defaultConfig.speedPercent;
+    m_Impairment = defaultConfig.impairment;
+    m_AudioPacketDuration = defaultConfig.audioPacketDuration;
+    m_NullRenderer = false;
+    m_VsyncRate = 0;
+    m_TestFrameCount = 0;
+
+    m_VideoFormatMap = {
+        {"H.264",       VIDEO_FORMAT_H264},
+        {"HEVC",        VIDEO_FORMAT_H265},
+        {"HEVC-Main10", VIDEO_FORMAT_H265_MAIN10},
+    };
+    m_VideoDecoderMap = {
+        {"auto",     StreamingPreferences::VDS_AUTO},
+        {"software", StreamingPreferences::VDS_FORCE_SOFTWARE},
+        {"hardware", StreamingPreferences::VDS_FORCE_HARDWARE},
+    };
+}
+
+ReplayCommandLineParser::~ReplayCommandLineParser()
+{
+}
+
+void ReplayCommandLineParser::parse(const QStringList &args, StreamingPreferences *preferences)
+{
+    CommandLineParser parser;
+    parser.setupCommonOptions();
+    parser.setApplicationDescription(
+        "\n"
+        "Replay a video stream recorded by a LC_DEBUG_RECORD_MODE build through the\n"
+        "depacketizer, decoder, and renderer and print the per-frame latencies.\n"
+        "\n"
+        "The codec, resolution, and FPS are taken from the timing file if there is one.\n"
+        "\n"
+        "With --test-frames, the built-in test frame for --video-codec is decoded\n"
+        "repeatedly instead of a recorded stream.\n"
+        "\n"
+        "With EGL_SOFTWARE_FRAMES=1 and --video-decoder software, the EGL renderer\n"
+        "logs its average software frame copy and GPU wait times when it exits."
+    );
+    parser.addPositionalArgument("replay", "Replay recorded stream");
+    parser.addPositionalArgument("file", "Recorded video stream", "[<file>]");
+
+    parser.addValueOption("timing", "timing file (defaults to <file>.timing if it exists)");
+    parser.addChoiceOption("video-codec", "video codec of a stream without a timing file", m_VideoFormatMap.keys());
+    parser.addValueOption("resolution", "<width>x<height> resolution of a stream without a timing file");
+    parser.addValueOption("fps", "FPS of a stream without a timing file");
+    parser.addValueOption("packet-size", "video packet size");
+    parser.addValueOption("fec", "FEC percentage");
+    parser.addValueOption("speed", "replay speed as a percentage of the recorded pace (0 is unpaced)");
+    parser.addValueOption("packet-loss", "percentage of packets to drop");
+    parser.addValueOption("burst-length", "mean length of a burst of dropped packets");
+    parser.addValueOption("reorder", "percentage of packets to deliver out of order");
+    parser.addValueOption("reorder-depth", "maximum number of packets a reordered packet is held back");
+    parser.addValueOption("duplicate", "percentage of packets to deliver twice");
+    parser.addValueOption("seed", "packet impairment random seed");
+    parser.addValueOption("audio-packet-duration", "duration in ms of synthetic audio packets to send alongside the video (0 is no audio)");
+    parser.addChoiceOption("video-decoder", "video decoder", m_VideoDecoderMap.keys());
+    parser.addFlagOption("null-renderer", "decode without presenting frames or creating a visible window");
+    parser.addValueOption("vsync-rate", "pace frames to a simulated display at this refresh rate");
+    parser.addValueOption("test-frames", "number of built-in test frames to decode instead of a stream file");
+
+    if (!parser.parse(args)) {
+        parser.showError(parser.errorText());
+    }
+
+    parser.handleUnknownOptions();
+
+    // This method will not return and terminates the process if --version or
+    // --help is specified
+    parser.handleHelpAndVersionOptions();
+
+    // Resolve --test-frames option
+    if (parser.isSet("test-frames")) {
+        m_TestFrameCount = parser.getIntOption("test-frames");
+        if (!inRange(m_TestFrameCount, 1, 100000)) {
+            parser.showError("Test frame count must be in range: 1 - 100000");
+        }
+        if (parser.isSet("timing")) {
+            parser.showError("Test frames have no timing file");
+        }
+
+        // The test frames are all 720p
+        preferences->width = 1280;
+        preferences->height = 720;
+    }
+
+    // Verify that the stream file has been provided
+    auto posArgs = parser.positionalArguments();
+    if (m_TestFrameCount == 0) {
+        if (posArgs.length() < 2) {
+            parser.showError("Stream file not provided");
+        }
+        m_StreamFile = posArgs.at(1);
+    }
+    else if (posArgs.length() >= 2) {
+        parser.showError("Stream file and test frames are mutually exclusive");
+    }
+
+    // Resolve --timing option
+    if (parser.isSet("timing")) {
+        m_TimingFile = parser.value("timing");
+    }
+    else if (QFileInfo::exists(m_StreamFile + ".timing")) {
+        m_TimingFile = m_StreamFile + ".timing";
+    }
+
+    // Resolve --video-codec option
+    if (parser.isSet("video-codec")) {
+        m_VideoFormat = mapValue(m_VideoFormatMap, parser.getChoiceOptionValue("video-codec"));
+    }
+
+    // Resolve --resolution option
+    if (parser.isSet("resolution") && m_TestFrameCount == 0) {
+        auto resolution = parser.getResolutionOptionValue("resolution");
+        preferences->width  = resolution.first;
+        preferences->height = resolution.second;
+    }
+
+    // Resolve --fps option
+    if (parser.isSet("fps")) {
+        preferences->fps = parser.getIntOption("fps");
+        if (!inRange(preferences->fps, 30, 240)) {
+            parser.showError("FPS must be in range: 30 - 240");
+        }
+    }
+
+    // Resolve --packet-size option
+    if (parser.isSet("packet-size")) {
+        preferences->packetSize = parser.getIntOption("packet-size");
+        if (preferences->packetSize < 1024) {
+            parser.showError("Packet size must be greater than 1024 bytes");
+        }
+    }
+
+    // Resolve --fec option
+    if (parser.isSet("fec")) {
+        m_FecPercentage = parser.getIntOption("fec");
+        if (!inRange(m_FecPercentage, 0, 255)) {
+            parser.showError("FEC percentage must be in range: 0 - 255");
+        }
+    }
+
+    // Resolve --speed option
+    if (parser.isSet("speed")) {
+        m_SpeedPercent = parser.getIntOption("speed");
+        if (!inRange(m_SpeedPercent, 0, 1000)) {
+            parser.showError("Speed must be in range: 0 - 1000");
+        }
+    }
+
+    // Resolve --packet-loss option
+    if (parser.isSet("packet-loss")) {
+        m_Impairment.lossPercent = parser.getIntOption("packet-loss");
+        if (!inRange(m_Impairment.lossPercent, 0, 100)) {
+            parser.showError("Packet loss must be in range: 0 - 100");
+        }
+    }
+
+    // Resolve --burst-length option
+    if (parser.isSet("burst-length")) {
+        m_Impairment.burstLength = parser.getIntOption("burst-length");
+        if (!inRange(m_Impairment.burstLength, 1, 1000)) {
+            parser.showError("Burst length must be in range: 1 - 1000");
+        }
+    }
+
+    // Resolve --reorder option
+    if (parser.isSet("reorder")) {
+        m_Impairment.reorderPercent = parser.getIntOption("reorder");
+        if (!inRange(m_Impairment.reorderPercent, 0, 100)) {
+            parser.showError("Reorder percentage must be in range: 0 - 100");
+        }
+    }
+
+    // Resolve --reorder-depth option
+    if (parser.isSet("reorder-depth")) {
+        m_Impairment.reorderDepth = parser.getIntOption("reorder-depth");
+        if (!inRange(m_Impairment.reorderDepth, 1, 64)) {
+            parser.showError("Reorder depth must be in range: 1 - 64");
+        }
+    }
+
+    // Resolve --duplicate option
+    if (parser.isSet("duplicate")) {
+        m_Impairment.duplicatePercent = parser.getIntOption("duplicate");
+        if (!inRange(m_Impairment.duplicatePercent, 0, 100)) {
+            parser.showError("Duplicate percentage must be in range: 0 - 100");
+        }
+    }
+
+    // Resolve --seed option
+    if (parser.isSet("seed")) {
+        m_Impairment.seed = (unsigned int)parser.getIntOption("seed");
+    }
+
+    // Resolve --audio-packet-duration option
+    if (parser.isSet("audio-packet-duration")) {
+        m_AudioPacketDuration = parser.getIntOption("audio-packet-duration");
+        if (!inRange(m_AudioPacketDuration, 0, 20)) {
+            parser.showError("Audio packet duration must be in range: 0 - 20");
+        }
+    }
+
+    // Resolve --video-decoder option
+    if (parser.isSet("video-decoder")) {
+        preferences->videoDecoderSelection = mapValue(m_VideoDecoderMap, parser.getChoiceOptionValue("video-decoder"));
+    }
+
+    // Resolve --null-renderer option
+    m_NullRenderer = parser.isSet("null-renderer");
+
+    // Resolve --vsync-rate option
+    if (parser.isSet("vsync-rate")) {
+        m_VsyncRate = parser.getIntOption("vsync-rate");
+        if (!inRange(m_VsyncRate, 1, 1000)) {
+            parser.showError("V-sync rate must be in range: 1 - 1000");
+        }
+    }
+}
+
+QString ReplayCommandLineParser::getStreamFile() const
+{
+    return m_StreamFile;
+}
+
+QString ReplayCommandLineParser::getTimingFile() const
+{
+    return m_TimingFile;
+}
+
+int ReplayCommandLineParser::getVideoFormat() const
+{
+    return m_VideoFormat;
+}
+
+int ReplayCommandLineParser::getFecPercentage() const
+{
+    return m_FecPercentage;
+}
+
+int ReplayCommandLineParser::getSpeedPercent() const
+{
+    return m_SpeedPercent;
+}
+
+PACKET_IMPAIRMENT_CONFIGURATION ReplayCommandLineParser::getImpairment() const
+{
+    return m_Impairment;
+}
+
+int ReplayCommandLineParser::getAudioPacketDuration() const
+{
+    return m_AudioPacketDuration;
+}
+
+bool ReplayCommandLineParser::getNullRenderer() const
+{
+    return m_NullRenderer;
+}
+
+int ReplayCommandLineParser::getVsyncRate() const
+{
+    return m_VsyncRate;
+}
+
+int ReplayCommandLineParser::getTestFrameCount() const
+{
+    return m_TestFrameCount;
+}
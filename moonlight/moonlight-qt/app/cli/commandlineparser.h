@@ -2,6 +2,8 @@
 
 #include "settings/streamingpreferences.h"
 
+#include <Limelight.h>
+
 #include <QMap>
 #include <QString>
 
@@ -14,6 +16,7 @@ public:
         QuitRequested,
         PairRequested,
         ListRequested,
+        ReplayRequested,
     };
 
     GlobalCommandLineParser();
@@ -91,3 +94,37 @@ private:
     bool m_PrintCSV;
     bool m_Verbose;
 };
+
+class ReplayCommandLineParser
+{
+public:
+    ReplayCommandLineParser();
+    virtual ~ReplayCommandLineParser();
+
+    void parse(const QStringList &args, StreamingPreferences *preferences);
+
+    QString getStreamFile() const;
+    QString getTimingFile() const;
+    int getVideoFormat() const;
+    int getFecPercentage() const;
+    int getSpeedPercent() const;
+    PACKET_IMPAIRMENT_CONFIGURATION getImpairment() const;
+    int getAudioPacketDuration() const;
+    bool getNullRenderer() const;
+    int getVsyncRate() const;
+    int getTestFrameCount() const;
+
+private:
+    QString m_StreamFile;
+    QString m_TimingFile;
+    int m_VideoFormat;
+    int m_FecPercentage;
+    int m_SpeedPercent;
+    PACKET_IMPAIRMENT_CONFIGURATION m_Impairment;
+    int m_AudioPacketDuration;
+    bool m_NullRenderer;
+    int m_VsyncRate;
+    int m_TestFrameCount;
+    QMap<QString, int> m_VideoFormatMap;
+    QMap<QString, StreamingPreferences::VideoDecoderSelection> m_VideoDecoderMap;
+};
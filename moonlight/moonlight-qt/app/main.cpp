@@ -41,6 +41,7 @@
 #include "backend/computermanager.h"
 #include "backend/systemproperties.h"
 #include "streaming/session.h"
+#include "streaming/replay.h"
 #include "settings/streamingpreferences.h"
 #include "gui/sdlgamepadkeynavigation.h"
 
@@ -495,6 +496,7 @@ int main(int argc, char *argv[])
     GlobalCommandLineParser::ParseResult commandLineParserResult = parser.parse(app.arguments());
     switch (commandLineParserResult) {
     case GlobalCommandLineParser::ListRequested:
+    case GlobalCommandLineParser::ReplayRequested:
 #ifdef USE_CUSTOM_LOGGER
         // Don't log to the console since it will jumble the command output
         s_SuppressVerboseOutput = true;
@@ -697,6 +699,15 @@ int main(int argc, char *argv[])
             hasGUI = false;
             break;
         }
+    case GlobalCommandLineParser::ReplayRequested:
+        {
+            // The replay runs to completion on this thread without the Qt event loop
+            StreamingPreferences* preferences = new StreamingPreferences(&app);
+            ReplayCommandLineParser replayParser;
+            replayParser.parse(app.arguments(), preferences);
+            ReplaySession replay(replayParser, preferences);
+            return replay.exec();
+        }
     }
 
     if (hasGUI) {
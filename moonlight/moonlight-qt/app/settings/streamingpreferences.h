@@ -162,6 +162,7 @@ public:
     bool swapFaceButtons;
     bool keepAwake;
     int packetSize;
+    int framePacingLatency;
     AudioConfig audioConfig;
     VideoCodecConfig videoCodecConfig;
     VideoDecoderSelection videoDecoderSelection;
@@ -0,0 +1,22 @@
+#version 300 es
+precision mediump float;
+out vec4 FragColor;
+
+in vec2 vTextCoord;
+
+uniform mat3 yuvmat;
+uniform vec3 offset;
+uniform sampler2D plane1;
+uniform sampler2D plane2;
+uniform sampler2D plane3;
+
+void main() {
+	vec3 YCbCr = vec3(
+		texture(plane1, vTextCoord)[0],
+		texture(plane2, vTextCoord)[0],
+		texture(plane3, vTextCoord)[0]
+	);
+
+	YCbCr -= offset;
+	FragColor = vec4(clamp(yuvmat * YCbCr, 0.0, 1.0), 1.0f);
+}
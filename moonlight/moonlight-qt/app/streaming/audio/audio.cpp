@@ -21,6 +21,110 @@
     delete __renderer;                                 \
 }
 
+// Skips an Opus frame length field (RFC 6716 section 3.2.1)
+static bool skipOpusFrameLength(const unsigned char*& data, const unsigned char* end)
+{
+    if (data >= end) {
+        return false;
+    }
+
+    data += (*data < 252) ? 1 : 2;
+    return data <= end;
+}
+
+// Returns true if the first Opus packet in this multistream packet carries
+// LBRR data for the previous frame, which is what FEC decoding recovers.
+// CELT-only packets never do, so libopus just conceals the frame instead.
+// See opus_packet_has_lbrr() in libopus 1.5 for the equivalent logic.
+static bool opusPacketHasLbrr(const unsigned char* data, int length, bool selfDelimited)
+{
+    const unsigned char* end = data + length;
+    int config, frameMs, silkFrames;
+    bool stereo;
+
+    if (length < 1) {
+        return false;
+    }
+
+    config = data[0] >> 3;
+    stereo = (data[0] & 0x4) != 0;
+
+    if (config < 12) {
+        // SILK-only: 10, 20, 40, or 60 ms
+        static const int silkFrameMs[] = { 10, 20, 40, 60 };
+        frameMs = silkFrameMs[config & 0x3];
+    }
+    else if (config < 16) {
+        // Hybrid: 10 or 20 ms
+        frameMs = (config & 0x1) ? 20 : 10;
+    }
+    else {
+        // CELT-only
+        return false;
+    }
+
+    // There's one SILK frame per 20 ms, and 10 ms frames count as one
+    silkFrames = frameMs > 20 ? frameMs / 20 : 1;
+
+    // Find the start of the first frame
+    switch (data[0] & 0x3) {
+    case 0:
+    case 1:
+        data++;
+        if (selfDelimited && !skipOpusFrameLength(data, end)) {
+            return false;
+        }
+        break;
+    case 2:
+        data++;
+        if (!skipOpusFrameLength(data, end) ||
+                (selfDelimited && !skipOpusFrameLength(data, end))) {
+            return false;
+        }
+        break;
+    case 3:
+    {
+        if (length < 2) {
+            return false;
+        }
+
+        bool vbr = (data[1] & 0x80) != 0;
+        bool padding = (data[1] & 0x40) != 0;
+        int frameCount = data[1] & 0x3F;
+        int lengthFields;
+
+        data += 2;
+        if (padding) {
+            // Each 255 byte means another padding length byte follows
+            while (data < end && *data == 255) {
+                data++;
+            }
+            data++;
+        }
+
+        lengthFields = (vbr ? frameCount - 1 : 0) + (selfDelimited ? 1 : 0);
+        for (int i = 0; i < lengthFields; i++) {
+            if (!skipOpusFrameLength(data, end)) {
+                return false;
+            }
+        }
+        break;
+    }
+    }
+
+    if (data >= end) {
+        return false;
+    }
+
+    // The LBRR flags are coded with uniform probability right after the
+    // VAD flag of each SILK frame, so they're bits of the first byte.
+    if ((data[0] >> (7 - silkFrames)) & 0x1) {
+        return true;
+    }
+
+    return stereo && ((data[0] >> (6 - 2 * silkFrames)) & 0x1);
+}
+
 IAudioRenderer* Session::createAudioRenderer(const POPUS_MULTISTREAM_CONFIGURATION opusConfig)
 {
     // Handle explicit ML_AUDIO setting and fail if the requested backend fails
@@ -153,10 +257,59 @@ void Session::arCleanup()
     s_ActiveSession->m_OpusDecoder = nullptr;
 }
 
-void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
+void Session::decodeAudioFrame(const unsigned char* sampleData, int sampleLength, bool decodeFec)
 {
     int samplesDecoded;
 
+    if (m_AudioRenderer == nullptr) {
+        return;
+    }
+
+    int desiredSize = sizeof(short) * m_AudioConfig.samplesPerFrame * m_AudioConfig.channelCount;
+    void* buffer = m_AudioRenderer->getAudioBuffer(&desiredSize);
+    if (buffer == nullptr) {
+        return;
+    }
+
+    // A NULL buffer invokes packet loss concealment in libopus. If decodeFec is set,
+    // libopus decodes the previous frame using the FEC data in this packet instead
+    // (or falls back to packet loss concealment if it doesn't have any).
+    samplesDecoded = opus_multistream_decode(m_OpusDecoder,
+                                             sampleData,
+                                             sampleLength,
+                                             (short*)buffer,
+                                             desiredSize / sizeof(short) / m_AudioConfig.channelCount,
+                                             decodeFec ? 1 : 0);
+
+    // Update desiredSize with the number of bytes actually populated by the decoding operation
+    if (samplesDecoded > 0) {
+        SDL_assert(desiredSize >= (int)(sizeof(short) * samplesDecoded * m_AudioConfig.channelCount));
+        desiredSize = sizeof(short) * samplesDecoded * m_AudioConfig.channelCount;
+    }
+    else {
+        desiredSize = 0;
+    }
+
+    if (!m_AudioRenderer->submitAudio(desiredSize)) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Reinitializing audio renderer after failure");
+
+        delete m_AudioRenderer;
+        m_AudioRenderer = nullptr;
+
+        SDL_AtomicSet(&m_AudioCurrentLatencyMs, -1);
+        SDL_AtomicSet(&m_AudioTargetLatencyMs, -1);
+        return;
+    }
+
+    // The stats overlay can't safely call into the renderer from
+    // the decoder thread, so publish its latency here instead.
+    SDL_AtomicSet(&m_AudioCurrentLatencyMs, m_AudioRenderer->getCurrentLatencyMs());
+    SDL_AtomicSet(&m_AudioTargetLatencyMs, m_AudioRenderer->getTargetLatencyMs());
+}
+
+void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
+{
 #ifndef STEAM_LINK
     // Set this thread to high priority to reduce the chance of missing
     // our sample delivery time. On Steam Link, this causes starvation
@@ -182,6 +335,7 @@ void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
         }
         else {
             // We're still in the drop window
+            s_ActiveSession->m_AudioFramePending = false;
             return;
         }
     }
@@ -190,39 +344,35 @@ void Session::arDecodeAndPlaySample(char* sampleData, int sampleLength)
 
     // If audio is muted, don't decode or play the audio
     if (s_ActiveSession->m_AudioMuted) {
+        s_ActiveSession->m_AudioFramePending = false;
         return;
     }
 
-    if (s_ActiveSession->m_AudioRenderer != nullptr) {
-        int desiredSize = sizeof(short) * s_ActiveSession->m_AudioConfig.samplesPerFrame * s_ActiveSession->m_AudioConfig.channelCount;
-        void* buffer = s_ActiveSession->m_AudioRenderer->getAudioBuffer(&desiredSize);
-        if (buffer == nullptr) {
-            return;
+    if (sampleData == nullptr) {
+        // This packet was lost. Rather than concealing it now, we wait for the next
+        // packet since it may carry in-band FEC data that can reconstruct this one.
+        // Only one lost frame is held back, so any before it are concealed right away.
+        if (s_ActiveSession->m_AudioFramePending) {
+            s_ActiveSession->decodeAudioFrame(nullptr, 0, false);
+            SDL_AtomicIncRef(&s_ActiveSession->m_AudioConcealedFrames);
         }
 
-        samplesDecoded = opus_multistream_decode(s_ActiveSession->m_OpusDecoder,
-                                                 (unsigned char*)sampleData,
-                                                 sampleLength,
-                                                 (short*)buffer,
-                                                 desiredSize / sizeof(short) / s_ActiveSession->m_AudioConfig.channelCount,
-                                                 0);
-
-        // Update desiredSize with the number of bytes actually populated by the decoding operation
-        if (samplesDecoded > 0) {
-            SDL_assert(desiredSize >= (int)(sizeof(short) * samplesDecoded * s_ActiveSession->m_AudioConfig.channelCount));
-            desiredSize = sizeof(short) * samplesDecoded * s_ActiveSession->m_AudioConfig.channelCount;
-        }
-        else {
-            desiredSize = 0;
+        s_ActiveSession->m_AudioFramePending = true;
+    }
+    else {
+        if (s_ActiveSession->m_AudioFramePending) {
+            // Recover the previous lost frame using this packet before we play it.
+            // libopus falls back to concealment if there's no LBRR data in it.
+            s_ActiveSession->decodeAudioFrame((unsigned char*)sampleData, sampleLength, true);
+            SDL_AtomicIncRef(&s_ActiveSession->m_AudioConcealedFrames);
+            if (opusPacketHasLbrr((unsigned char*)sampleData, sampleLength,
+                                  s_ActiveSession->m_AudioConfig.streams > 1)) {
+                SDL_AtomicIncRef(&s_ActiveSession->m_AudioFecRecoveredFrames);
+            }
+            s_ActiveSession->m_AudioFramePending = false;
         }
 
-        if (!s_ActiveSession->m_AudioRenderer->submitAudio(desiredSize)) {
-            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
-                        "Reinitializing audio renderer after failure");
-
-            delete s_ActiveSession->m_AudioRenderer;
-            s_ActiveSession->m_AudioRenderer = nullptr;
-        }
+        s_ActiveSession->decodeAudioFrame((unsigned char*)sampleData, sampleLength, false);
     }
 
     // Only try to recreate the audio renderer every 200 samples (1 second)
@@ -0,0 +1,187 @@
+#include "jitterbuffer.h"
+
+#include <QtGlobal>
+
+#include <cmath>
+
+// The buffered amount fluctuates with packet arrival and device callback
+// timing, so we steer based on an average over roughly the last second.
+#define FILL_SMOOTHING_FACTOR 0.02
+
+// Resampling ratio change per second of error from the target latency.
+// A 10 ms error results in a 0.2% rate change which is inaudible, yet
+// more than enough to absorb any real clock drift.
+#define CORRECTION_GAIN 0.2
+
+// The integral term removes the steady state error that the proportional
+// term alone would leave from a constant clock drift.
+#define DRIFT_GAIN 0.01
+
+// Beyond this, the pitch shift starts to become noticeable
+#define MAX_CORRECTION 0.005
+
+// Audio beyond the target that we'll buffer before dropping samples,
+// since resampling can't drain a large backlog in a reasonable time.
+#define MAX_EXCESS_LATENCY_MS 50
+
+AudioJitterBuffer::AudioJitterBuffer(int channelCount, int sampleRate, int targetLatencyMs)
+    : m_ChannelCount(channelCount),
+      m_SampleRate(sampleRate),
+      m_TargetFrames(sampleRate * targetLatencyMs / 1000),
+      m_MaxFrames(sampleRate * (targetLatencyMs + MAX_EXCESS_LATENCY_MS) / 1000),
+      m_Capacity(m_MaxFrames + 1),
+      m_Buffer(nullptr),
+      m_DroppedFrames(0),
+      m_Buffering(true),
+      m_ReadPosition(0),
+      m_SmoothedFrames(0),
+      m_DriftCorrection(0),
+      m_MinRatio(1.0),
+      m_MaxRatio(1.0),
+      m_Underruns(0)
+{
+    SDL_AtomicSet(&m_WriteIndex, 0);
+    SDL_AtomicSet(&m_ReadIndex, 0);
+}
+
+AudioJitterBuffer::~AudioJitterBuffer()
+{
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Audio jitter buffer: %d underruns, %d frames dropped, resampling ratio range: %f - %f",
+                m_Underruns,
+                m_DroppedFrames,
+                m_MinRatio,
+                m_MaxRatio);
+
+    SDL_free(m_Buffer);
+}
+
+int AudioJitterBuffer::getTargetLatencyFromEnvironment()
+{
+    bool ok;
+    int targetLatencyMs = qEnvironmentVariableIntValue("AUDIO_JITTER_BUFFER_MS", &ok);
+    return ok ? qMax(0, targetLatencyMs) : 0;
+}
+
+bool AudioJitterBuffer::initialize()
+{
+    m_Buffer = (short*)SDL_malloc(m_Capacity * m_ChannelCount * sizeof(short));
+    if (m_Buffer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to allocate audio jitter buffer");
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Audio jitter buffer target latency: %d ms",
+                getTargetLatencyMs());
+
+    return true;
+}
+
+int AudioJitterBuffer::getBufferedFrames()
+{
+    return (SDL_AtomicGet(&m_WriteIndex) - SDL_AtomicGet(&m_ReadIndex) + m_Capacity) % m_Capacity;
+}
+
+int AudioJitterBuffer::getCurrentLatencyMs()
+{
+    return getBufferedFrames() * 1000 / m_SampleRate;
+}
+
+int AudioJitterBuffer::getTargetLatencyMs()
+{
+    return m_TargetFrames * 1000 / m_SampleRate;
+}
+
+bool AudioJitterBuffer::write(const short* samples, int frameCount)
+{
+    int writeIndex = SDL_AtomicGet(&m_WriteIndex);
+
+    if (getBufferedFrames() + frameCount > m_MaxFrames) {
+        if (m_DroppedFrames == 0) {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Audio jitter buffer overflowed - dropping samples");
+        }
+
+        m_DroppedFrames += frameCount;
+        return false;
+    }
+
+    // Copy up to the end of the buffer then wrap around to the start
+    int firstFrames = qMin(frameCount, m_Capacity - writeIndex);
+    SDL_memcpy(&m_Buffer[writeIndex * m_ChannelCount],
+               samples,
+               firstFrames * m_ChannelCount * sizeof(short));
+    SDL_memcpy(m_Buffer,
+               &samples[firstFrames * m_ChannelCount],
+               (frameCount - firstFrames) * m_ChannelCount * sizeof(short));
+
+    // Publish the new samples to the reader
+    SDL_AtomicSet(&m_WriteIndex, (writeIndex + frameCount) % m_Capacity);
+    return true;
+}
+
+void AudioJitterBuffer::read(short* output, int frameCount)
+{
+    int bufferedFrames = getBufferedFrames();
+    int framesWritten = 0;
+
+    if (m_Buffering) {
+        // Wait until we've built up to our target before starting playback
+        if (bufferedFrames < m_TargetFrames) {
+            SDL_memset(output, 0, frameCount * m_ChannelCount * sizeof(short));
+            return;
+        }
+
+        m_Buffering = false;
+        m_ReadPosition = 0;
+        m_SmoothedFrames = bufferedFrames;
+    }
+
+    // Play slightly faster when we're above the target and slightly slower below it
+    m_SmoothedFrames += (bufferedFrames - m_SmoothedFrames) * FILL_SMOOTHING_FACTOR;
+    double error = (m_SmoothedFrames - m_TargetFrames) / m_SampleRate;
+    m_DriftCorrection = qBound(-MAX_CORRECTION,
+                               m_DriftCorrection + error * DRIFT_GAIN * frameCount / m_SampleRate,
+                               MAX_CORRECTION);
+    double ratio = 1.0 + qBound(-MAX_CORRECTION,
+                                error * CORRECTION_GAIN + m_DriftCorrection,
+                                MAX_CORRECTION);
+    m_MinRatio = qMin(m_MinRatio, ratio);
+    m_MaxRatio = qMax(m_MaxRatio, ratio);
+
+    int readIndex = SDL_AtomicGet(&m_ReadIndex);
+    for (; framesWritten < frameCount; framesWritten++) {
+        int offset = (int)m_ReadPosition;
+
+        // We need the frames on both sides of our read position to interpolate
+        if (offset + 1 >= bufferedFrames) {
+            break;
+        }
+
+        float fraction = (float)(m_ReadPosition - offset);
+        const short* frame0 = &m_Buffer[((readIndex + offset) % m_Capacity) * m_ChannelCount];
+        const short* frame1 = &m_Buffer[((readIndex + offset + 1) % m_Capacity) * m_ChannelCount];
+        short* out = &output[framesWritten * m_ChannelCount];
+
+        for (int ch = 0; ch < m_ChannelCount; ch++) {
+            out[ch] = (short)lrintf(frame0[ch] + (frame1[ch] - frame0[ch]) * fraction);
+        }
+
+        m_ReadPosition += ratio;
+    }
+
+    // Release the frames we've moved past back to the writer
+    int framesConsumed = (int)m_ReadPosition;
+    m_ReadPosition -= framesConsumed;
+    SDL_AtomicSet(&m_ReadIndex, (readIndex + framesConsumed) % m_Capacity);
+
+    if (framesWritten < frameCount) {
+        // We ran dry, so fill the rest with silence and rebuffer
+        SDL_memset(&output[framesWritten * m_ChannelCount], 0,
+                   (frameCount - framesWritten) * m_ChannelCount * sizeof(short));
+        m_Buffering = true;
+        m_Underruns++;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <SDL.h>
+
+// A single-producer single-consumer buffer between the audio decoding
+// thread and the audio device that holds a target amount of audio.
+// Rather than dropping samples when the host and client audio clocks
+// drift apart, the output is resampled by a fraction of a percent to
+// keep the amount of buffered audio near the target. This is opt-in
+// by setting AUDIO_JITTER_BUFFER_MS to the target latency.
+class AudioJitterBuffer
+{
+public:
+    AudioJitterBuffer(int channelCount, int sampleRate, int targetLatencyMs);
+    ~AudioJitterBuffer();
+
+    // Returns 0 if the jitter buffer is disabled
+    static int getTargetLatencyFromEnvironment();
+
+    bool initialize();
+
+    // Called by the audio decoding thread. Returns false if the
+    // samples were dropped because the buffer is too far over target.
+    bool write(const short* samples, int frameCount);
+
+    // Called by the audio device. This always fills the output buffer,
+    // inserting silence if we've run out of audio.
+    void read(short* output, int frameCount);
+
+    int getCurrentLatencyMs();
+
+    int getTargetLatencyMs();
+
+private:
+    int getBufferedFrames();
+
+    int m_ChannelCount;
+    int m_SampleRate;
+    int m_TargetFrames;
+    int m_MaxFrames;
+    int m_Capacity;
+    short* m_Buffer;
+
+    // Written only by the producer and consumer respectively
+    SDL_atomic_t m_WriteIndex;
+    SDL_atomic_t m_ReadIndex;
+
+    // Producer state
+    int m_DroppedFrames;
+
+    // Consumer state
+    bool m_Buffering;
+    double m_ReadPosition;
+    double m_SmoothedFrames;
+    double m_DriftCorrection;
+    double m_MinRatio;
+    double m_MaxRatio;
+    int m_Underruns;
+};
@@ -16,6 +16,16 @@ public:
 
     virtual int getCapabilities() = 0;
 
+    // Latency of audio buffered by the renderer before the device, or -1 if unknown
+    virtual int getCurrentLatencyMs() {
+        return -1;
+    }
+
+    // Latency the renderer is trying to maintain, or -1 if it has no target
+    virtual int getTargetLatencyMs() {
+        return -1;
+    }
+
     virtual void remapChannels(POPUS_MULTISTREAM_CONFIGURATION) {
         // Use default channel mapping:
         // 0 - Front Left
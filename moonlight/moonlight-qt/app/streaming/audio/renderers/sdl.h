@@ -1,6 +1,7 @@
 #pragma once
 
 #include "renderer.h"
+#include "../jitterbuffer.h"
 #include <SDL.h>
 
 class SdlAudioRenderer : public IAudioRenderer
@@ -18,8 +19,16 @@ public:
 
     virtual int getCapabilities();
 
+    virtual int getCurrentLatencyMs();
+
+    virtual int getTargetLatencyMs();
+
 private:
+    static void SDLCALL audioCallback(void* userdata, Uint8* stream, int len);
+
     SDL_AudioDeviceID m_AudioDevice;
+    AudioJitterBuffer* m_JitterBuffer;
     void* m_AudioBuffer;
     int m_FrameSize;
+    int m_ChannelCount;
 };
@@ -5,6 +5,7 @@
 
 SdlAudioRenderer::SdlAudioRenderer()
     : m_AudioDevice(0),
+      m_JitterBuffer(nullptr),
       m_AudioBuffer(nullptr)
 {
     SDL_assert(!SDL_WasInit(SDL_INIT_AUDIO));
@@ -32,6 +33,21 @@ bool SdlAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATION*
     want.samples = SDL_max(480, opusConfig->samplesPerFrame);
 
     m_FrameSize = opusConfig->samplesPerFrame * sizeof(short) * opusConfig->channelCount;
+    m_ChannelCount = opusConfig->channelCount;
+
+    int jitterBufferLatencyMs = AudioJitterBuffer::getTargetLatencyFromEnvironment();
+    if (jitterBufferLatencyMs > 0) {
+        m_JitterBuffer = new AudioJitterBuffer(opusConfig->channelCount,
+                                               opusConfig->sampleRate,
+                                               jitterBufferLatencyMs);
+        if (!m_JitterBuffer->initialize()) {
+            return false;
+        }
+
+        // SDL pulls audio from the jitter buffer rather than us queuing it
+        want.callback = audioCallback;
+        want.userdata = this;
+    }
 
     m_AudioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
     if (m_AudioDevice == 0) {
@@ -72,6 +88,10 @@ SdlAudioRenderer::~SdlAudioRenderer()
         SDL_CloseAudioDevice(m_AudioDevice);
     }
 
+    // Must be destroyed after the device is closed
+    // or we could still get audioCallback() calls.
+    delete m_JitterBuffer;
+
     if (m_AudioBuffer != nullptr) {
         SDL_free(m_AudioBuffer);
     }
@@ -98,6 +118,13 @@ bool SdlAudioRenderer::submitAudio(int bytesWritten)
         return true;
     }
 
+    if (m_JitterBuffer != nullptr) {
+        // The jitter buffer manages latency itself, so we don't need
+        // to drop samples or provide backpressure here.
+        m_JitterBuffer->write((short*)m_AudioBuffer, bytesWritten / (int)(sizeof(short) * m_ChannelCount));
+        return true;
+    }
+
     // Don't queue if there's already more than 30 ms of audio data waiting
     // in Moonlight's audio queue.
     if (LiGetPendingAudioDuration() > 30) {
@@ -124,3 +151,20 @@ int SdlAudioRenderer::getCapabilities()
     // Direct submit can't be used because we use LiGetPendingAudioDuration()
     return CAPABILITY_SUPPORTS_ARBITRARY_AUDIO_DURATION;
 }
+
+int SdlAudioRenderer::getCurrentLatencyMs()
+{
+    return m_JitterBuffer != nullptr ? m_JitterBuffer->getCurrentLatencyMs() : -1;
+}
+
+int SdlAudioRenderer::getTargetLatencyMs()
+{
+    return m_JitterBuffer != nullptr ? m_JitterBuffer->getTargetLatencyMs() : -1;
+}
+
+void SDLCALL SdlAudioRenderer::audioCallback(void* userdata, Uint8* stream, int len)
+{
+    auto me = reinterpret_cast<SdlAudioRenderer*>(userdata);
+
+    me->m_JitterBuffer->read((short*)stream, len / (int)(sizeof(short) * me->m_ChannelCount));
+}
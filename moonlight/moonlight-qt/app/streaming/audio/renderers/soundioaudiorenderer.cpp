@@ -10,6 +10,9 @@ SoundIoAudioRenderer::SoundIoAudioRenderer()
       m_Device(nullptr),
       m_OutputStream(nullptr),
       m_RingBuffer(nullptr),
+      m_JitterBuffer(nullptr),
+      m_JitterBufferInput(nullptr),
+      m_JitterBufferOutput(nullptr),
       m_AudioPacketDuration(0),
       m_Latency(0),
       m_Errored(false)
@@ -33,6 +36,10 @@ SoundIoAudioRenderer::~SoundIoAudioRenderer()
         soundio_ring_buffer_destroy(m_RingBuffer);
     }
 
+    delete m_JitterBuffer;
+    SDL_free(m_JitterBufferInput);
+    SDL_free(m_JitterBufferOutput);
+
     if (m_Device != nullptr) {
         soundio_device_unref(m_Device);
     }
@@ -268,6 +275,26 @@ bool SoundIoAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATI
         return false;
     }
 
+    int jitterBufferLatencyMs = AudioJitterBuffer::getTargetLatencyFromEnvironment();
+    if (jitterBufferLatencyMs > 0) {
+        m_JitterBuffer = new AudioJitterBuffer(m_OpusChannelCount,
+                                               opusConfig->sampleRate,
+                                               jitterBufferLatencyMs);
+        if (!m_JitterBuffer->initialize()) {
+            return false;
+        }
+
+        // Opus decodes into this buffer and sioWriteCallback() resamples into the
+        // other. The output buffer must hold the most frames we'll write at once.
+        m_JitterBufferInput = (short*)SDL_malloc(opusConfig->samplesPerFrame * m_OpusChannelCount * sizeof(short));
+        m_JitterBufferOutput = (short*)SDL_malloc(getMaxWriteFrames(opusConfig->sampleRate) * m_OpusChannelCount * sizeof(short));
+        if (m_JitterBufferInput == nullptr || m_JitterBufferOutput == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to allocate jitter buffer staging buffers");
+            return false;
+        }
+    }
+
     err = soundio_outstream_start(m_OutputStream);
     if (err != SoundIoErrorNone) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -286,6 +313,11 @@ bool SoundIoAudioRenderer::prepareForPlayback(const OPUS_MULTISTREAM_CONFIGURATI
 
 void* SoundIoAudioRenderer::getAudioBuffer(int* size)
 {
+    if (m_JitterBuffer != nullptr) {
+        // The jitter buffer handles its own overflow
+        return m_JitterBufferInput;
+    }
+
     // We must always write a full frame of audio. If we don't,
     // the reader will get out of sync with the writer and our
     // channels will get all mixed up. To ensure this is always
@@ -311,8 +343,13 @@ bool SoundIoAudioRenderer::submitAudio(int bytesWritten)
     // Flush events to update with new device arrivals
     soundio_flush_events(m_SoundIo);
 
-    // Advance the write pointer
-    soundio_ring_buffer_advance_write_ptr(m_RingBuffer, bytesWritten);
+    if (m_JitterBuffer != nullptr) {
+        m_JitterBuffer->write(m_JitterBufferInput, bytesWritten / (m_OpusChannelCount * m_OutputStream->bytes_per_sample));
+    }
+    else {
+        // Advance the write pointer
+        soundio_ring_buffer_advance_write_ptr(m_RingBuffer, bytesWritten);
+    }
 
     return true;
 }
@@ -323,6 +360,23 @@ int SoundIoAudioRenderer::getCapabilities()
     return CAPABILITY_DIRECT_SUBMIT /* | CAPABILITY_SUPPORTS_ARBITRARY_AUDIO_DURATION */;
 }
 
+int SoundIoAudioRenderer::getCurrentLatencyMs()
+{
+    return m_JitterBuffer != nullptr ? m_JitterBuffer->getCurrentLatencyMs() : -1;
+}
+
+int SoundIoAudioRenderer::getTargetLatencyMs()
+{
+    return m_JitterBuffer != nullptr ? m_JitterBuffer->getTargetLatencyMs() : -1;
+}
+
+int SoundIoAudioRenderer::getMaxWriteFrames(int sampleRate)
+{
+    // Clamp to at least 2 packets or 20 ms to stop our latency from growing if audio packets lag.
+    // This makes sure that we never increase our latency far beyond what the sink is consuming.
+    return (int)(sampleRate * qMax(m_AudioPacketDuration * 2, 0.020));
+}
+
 void SoundIoAudioRenderer::sioErrorCallback(SoundIoOutStream* stream, int err)
 {
     auto me = reinterpret_cast<SoundIoAudioRenderer*>(stream->userdata);
@@ -382,9 +436,8 @@ void SoundIoAudioRenderer::sioDevicesChanged(SoundIo* soundio)
 void SoundIoAudioRenderer::sioWriteCallback(SoundIoOutStream* stream, int frameCountMin, int frameCountMax)
 {
     auto me = reinterpret_cast<SoundIoAudioRenderer*>(stream->userdata);
-    char* readPtr = soundio_ring_buffer_read_ptr(me->m_RingBuffer);
-    int framesLeft = soundio_ring_buffer_fill_count(me->m_RingBuffer) /
-            (me->m_OpusChannelCount * stream->bytes_per_sample);
+    char* readPtr;
+    int framesLeft;
     int bytesRead = 0;
 
     // Ensure we always write at least a buffer, even if it's silence, to avoid
@@ -392,13 +445,24 @@ void SoundIoAudioRenderer::sioWriteCallback(SoundIoOutStream* stream, int frameC
     // us from starving the output device.
     frameCountMin = qMax(frameCountMin, (int)(stream->sample_rate * me->m_AudioPacketDuration));
 
-    // Clamp frameCountMax to at least 2 packets or 20 ms to stop our latency from growing if audio packets lag.
-    // This makes sure that we never increase our latency far beyond what the sink is consuming.
-    frameCountMax = qMin(frameCountMax, (int)(stream->sample_rate * qMax(me->m_AudioPacketDuration * 2, 0.020)));
+    frameCountMax = qMin(frameCountMax, me->getMaxWriteFrames(stream->sample_rate));
     frameCountMin = qMin(frameCountMin, frameCountMax);
 
-    // Clamp framesLeft to frameCountMax
-    framesLeft = qMin(framesLeft, frameCountMax);
+    if (me->m_JitterBuffer != nullptr) {
+        // The jitter buffer holds our latency, so only write what the device needs.
+        // It always produces the requested frames, inserting silence on underrun.
+        framesLeft = frameCountMin;
+        me->m_JitterBuffer->read(me->m_JitterBufferOutput, framesLeft);
+        readPtr = (char*)me->m_JitterBufferOutput;
+    }
+    else {
+        readPtr = soundio_ring_buffer_read_ptr(me->m_RingBuffer);
+        framesLeft = soundio_ring_buffer_fill_count(me->m_RingBuffer) /
+                (me->m_OpusChannelCount * stream->bytes_per_sample);
+
+        // Clamp framesLeft to frameCountMax
+        framesLeft = qMin(framesLeft, frameCountMax);
+    }
 
     // Track latency on queueing-based backends
     if (me->m_SoundIo->current_backend != SoundIoBackendCoreAudio && me->m_SoundIo->current_backend != SoundIoBackendJack) {
@@ -478,5 +542,7 @@ void SoundIoAudioRenderer::sioWriteCallback(SoundIoOutStream* stream, int frameC
         }
     }
 
-    soundio_ring_buffer_advance_read_ptr(me->m_RingBuffer, bytesRead);
+    if (me->m_JitterBuffer == nullptr) {
+        soundio_ring_buffer_advance_read_ptr(me->m_RingBuffer, bytesRead);
+    }
 }
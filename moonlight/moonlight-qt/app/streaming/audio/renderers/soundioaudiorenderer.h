@@ -1,6 +1,7 @@
 #pragma once
 
 #include "renderer.h"
+#include "../jitterbuffer.h"
 
 #include <soundio/soundio.h>
 
@@ -19,7 +20,13 @@ public:
 
     virtual int getCapabilities();
 
+    virtual int getCurrentLatencyMs();
+
+    virtual int getTargetLatencyMs();
+
 private:
+    int getMaxWriteFrames(int sampleRate);
+
     int scoreChannelLayout(const struct SoundIoChannelLayout* layout, const OPUS_MULTISTREAM_CONFIGURATION* opusConfig);
 
     static void sioErrorCallback(struct SoundIoOutStream* stream, int err);
@@ -35,6 +42,9 @@ private:
     struct SoundIoDevice* m_Device;
     struct SoundIoOutStream* m_OutputStream;
     struct SoundIoRingBuffer* m_RingBuffer;
+    AudioJitterBuffer* m_JitterBuffer;
+    short* m_JitterBufferInput;
+    short* m_JitterBufferOutput;
     struct SoundIoChannelLayout m_EffectiveLayout;
     double m_AudioPacketDuration;
     double m_Latency;
@@ -123,6 +123,11 @@ SdlInputHandler::SdlInputHandler(StreamingPreferences& prefs, NvComputer* comput
     m_SpecialKeyCombos[KeyComboTogglePointerRegionLock].scanCode = SDL_SCANCODE_L;
     m_SpecialKeyCombos[KeyComboTogglePointerRegionLock].enabled = true;
 
+    m_SpecialKeyCombos[KeyComboSaveFrameTrace].keyCombo = KeyComboSaveFrameTrace;
+    m_SpecialKeyCombos[KeyComboSaveFrameTrace].keyCode = SDLK_t;
+    m_SpecialKeyCombos[KeyComboSaveFrameTrace].scanCode = SDL_SCANCODE_T;
+    m_SpecialKeyCombos[KeyComboSaveFrameTrace].enabled = true;
+
     m_OldIgnoreDevices = SDL_GetHint(SDL_HINT_GAMECONTROLLER_IGNORE_DEVICES);
     m_OldIgnoreDevicesExcept = SDL_GetHint(SDL_HINT_GAMECONTROLLER_IGNORE_DEVICES_EXCEPT);
 
@@ -1,8 +1,12 @@
 #include "streaming/session.h"
+#include "path.h"
 
 #include <Limelight.h>
 #include <SDL.h>
 
+#include <QDateTime>
+#include <QDir>
+
 #define VK_0 0x30
 #define VK_A 0x41
 
@@ -139,6 +143,34 @@ void SdlInputHandler::performSpecialKeyCombo(KeyCombo combo)
         updatePointerRegionLock();
         break;
 
+    case KeyComboSaveFrameTrace:
+    {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Detected save frame trace combo");
+
+        // Chrome trace JSON is the default since it can be opened directly
+        // in chrome://tracing or Perfetto.
+        bool binary = qgetenv("FRAME_TRACE_FORMAT") == "binary";
+        QDir logDir(Path::getLogDir());
+        QString fileName = QDir::toNativeSeparators(
+                    logDir.filePath(QString("Moonlight-FrameTrace-%1.%2")
+                                    .arg(QDateTime::currentSecsSinceEpoch())
+                                    .arg(binary ? "mlft" : "json")));
+
+        if (LiWriteVideoFrameTrace(fileName.toUtf8().constData(),
+                                   binary ? FRAME_TRACE_FORMAT_BINARY : FRAME_TRACE_FORMAT_CHROME_JSON) == 0) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Saved frame trace to %s",
+                        qPrintable(fileName));
+        }
+        else {
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                        "Failed to save frame trace to %s",
+                        qPrintable(fileName));
+        }
+        break;
+    }
+
     default:
         Q_UNREACHABLE();
     }
@@ -0,0 +1,395 @@
+#include "replay.h"
+#include "streamutils.h"
+
+#ifdef HAVE_FFMPEG
+#include "video/ffmpeg.h"
+#endif
+
+#include <Limelight.h>
+#include <SDL.h>
+
+#include <QTemporaryFile>
+
+#include <algorithm>
+
+ReplaySession* ReplaySession::s_ActiveReplay;
+
+ReplaySession::ReplaySession(const ReplayCommandLineParser& arguments, StreamingPreferences* preferences)
+    : m_Arguments(arguments),
+      m_Preferences(preferences),
+      m_Session(new Session(nullptr, m_App, preferences)),
+      m_Capabilities(0)
+{
+}
+
+ReplaySession::~ReplaySession()
+{
+    delete m_Session;
+}
+
+bool ReplaySession::probeDecoderCapabilities()
+{
+    IVideoDecoder* decoder;
+
+    // The decoder capabilities must be passed to LiStartVideoReplay() before
+    // we know the actual stream parameters, so use a test decoder like
+    // Session::populateDecoderProperties() does.
+    SDL_Window* testWindow = SDL_CreateWindow("", 0, 0, 1280, 720,
+                                              SDL_WINDOW_HIDDEN | StreamUtils::getPlatformWindowFlags());
+    if (!testWindow) {
+        testWindow = SDL_CreateWindow("", 0, 0, 1280, 720, SDL_WINDOW_HIDDEN);
+        if (!testWindow) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to create window for decoder test: %s",
+                         SDL_GetError());
+            return false;
+        }
+    }
+
+    if (!Session::chooseDecoder(m_Preferences->videoDecoderSelection,
+                                testWindow, m_Arguments.getVideoFormat(),
+                                m_Preferences->width, m_Preferences->height, m_Preferences->fps,
+                                false, false, 0, true, decoder)) {
+        SDL_DestroyWindow(testWindow);
+        return false;
+    }
+
+    m_Capabilities = decoder->getDecoderCapabilities();
+
+    delete decoder;
+    SDL_DestroyWindow(testWindow);
+    return true;
+}
+
+int ReplaySession::drSetup(int videoFormat, int width, int height, int frameRate, void* context, int drFlags)
+{
+    ReplaySession* replay = s_ActiveReplay;
+    Session* session = replay->m_Session;
+
+    Session::drSetup(videoFormat, width, height, frameRate, context, drFlags);
+
+    // LiStartVideoReplay() calls us on the main thread, so we can create the
+    // window and decoder right away. The window stays hidden because we only
+    // care about how long the decoder and renderer take.
+    Uint32 windowFlags = SDL_WINDOW_HIDDEN | SDL_WINDOW_ALLOW_HIGHDPI;
+    if (!replay->m_Arguments.getNullRenderer()) {
+        windowFlags |= SDL_WINDOW_OPENGL;
+    }
+    session->m_Window = SDL_CreateWindow("Moonlight",
+                                         SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                         width, height,
+                                         windowFlags | StreamUtils::getPlatformWindowFlags());
+    if (!session->m_Window) {
+        session->m_Window = SDL_CreateWindow("Moonlight",
+                                             SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                             width, height, windowFlags);
+        if (!session->m_Window) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_CreateWindow() failed: %s",
+                         SDL_GetError());
+            return -1;
+        }
+    }
+
+    // V-sync and frame pacing would only measure the display refresh rate,
+    // so we only pace frames to a simulated display if one was requested.
+    if (!Session::chooseDecoder(replay->m_Preferences->videoDecoderSelection,
+                                session->m_Window, videoFormat, width, height, frameRate,
+                                false, replay->m_Arguments.getVsyncRate() > 0, 0, false,
+                                session->m_VideoDecoder)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to initialize video decoder for replay");
+        return -1;
+    }
+
+    // The library has already been told whether we pull frames or have them pushed
+    if ((session->m_VideoDecoder->getDecoderCapabilities() ^ replay->m_Capabilities) & CAPABILITY_PULL_RENDERER) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Replay decoder does not match the tested decoder");
+        delete session->m_VideoDecoder;
+        session->m_VideoDecoder = nullptr;
+        return -1;
+    }
+
+    return 0;
+}
+
+static uint64_t percentile(QVector<uint64_t>& values, int percent)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * percent / 100];
+}
+
+static void printStageLatency(const char* name, const QVector<FRAME_TRACE_RECORD>& trace, int startStage, int endStage)
+{
+    QVector<uint64_t> latenciesUs;
+
+    for (const FRAME_TRACE_RECORD& record : trace) {
+        if (record.stageTimeUs[startStage] != 0 && record.stageTimeUs[endStage] >= record.stageTimeUs[startStage]) {
+            latenciesUs.append(record.stageTimeUs[endStage] - record.stageTimeUs[startStage]);
+        }
+    }
+
+    uint64_t p50 = percentile(latenciesUs, 50);
+    uint64_t p95 = percentile(latenciesUs, 95);
+    uint64_t p99 = percentile(latenciesUs, 99);
+    fprintf(stdout, "%-12s %8d %9.2f %9.2f %9.2f\n", name, (int)latenciesUs.size(),
+            p50 / 1000.0, p95 / 1000.0, p99 / 1000.0);
+}
+
+void ReplaySession::printResults(const QVector<FRAME_TRACE_RECORD>& trace)
+{
+    VIDEO_REPLAY_STATS stats;
+
+    LiGetVideoReplayStats(&stats);
+
+    fprintf(stdout, "Frames sent: %u\n", stats.framesSent);
+    fprintf(stdout, "Packets sent: %u (%u dropped, %u reordered, %u duplicated)\n",
+            stats.packetsSent, stats.packetsDropped, stats.packetsReordered, stats.packetsDuplicated);
+    fprintf(stdout, "IDR frames resent: %u\n", stats.idrFramesResent);
+    fprintf(stdout, "Frames delivered: %u (%u recovered from lost packets)\n",
+            stats.framesDelivered, stats.framesRecovered);
+    if (stats.framesDelivered != 0) {
+        fprintf(stdout, "Added latency: %.2f ms average, %.2f ms max\n",
+                stats.totalAddedLatencyUs / 1000.0 / stats.framesDelivered,
+                stats.maxAddedLatencyUs / 1000.0);
+    }
+    if (stats.packetsSent > stats.packetsDropped) {
+        fprintf(stdout, "Queue time: %.2f us per packet\n",
+                (double)stats.totalQueueTimeUs / (stats.packetsSent - stats.packetsDropped));
+    }
+    if (stats.audioPacketsSent != 0) {
+        fprintf(stdout, "Audio packets sent: %u (%u dropped)\n",
+                stats.audioPacketsSent, stats.audioPacketsDropped);
+        fprintf(stdout, "Audio packets delivered: %u (%u recovered, %u corrupted), %u lost\n",
+                stats.audioPacketsDelivered, stats.audioPacketsRecovered,
+                stats.audioPacketsCorrupted, stats.audioPacketsLost);
+        if (stats.audioPacketsDelivered != 0) {
+            fprintf(stdout, "Audio added latency: %.2f ms average, %.2f ms max\n",
+                    stats.audioTotalAddedLatencyUs / 1000.0 / stats.audioPacketsDelivered,
+                    stats.audioMaxAddedLatencyUs / 1000.0);
+        }
+        if (stats.audioPacketsSent > stats.audioPacketsDropped) {
+            fprintf(stdout, "Audio queue time: %.2f us per packet\n",
+                    (double)stats.audioTotalQueueTimeUs / (stats.audioPacketsSent - stats.audioPacketsDropped));
+        }
+    }
+    fprintf(stdout, "Frames traced: %d\n", (int)trace.size());
+
+    int decodedFrames = 0;
+    int presentedFrames = 0;
+    uint64_t firstSubmitUs = 0;
+    uint64_t lastDecodeUs = 0;
+    uint64_t firstPresentUs = 0;
+    uint64_t lastPresentUs = 0;
+    for (const FRAME_TRACE_RECORD& record : trace) {
+        uint64_t submitUs = record.stageTimeUs[FRAME_TRACE_STAGE_SUBMITTED];
+        uint64_t decodeUs = record.stageTimeUs[FRAME_TRACE_STAGE_DECODED];
+        uint64_t presentUs = record.stageTimeUs[FRAME_TRACE_STAGE_PRESENTED];
+
+        if (submitUs != 0 && (firstSubmitUs == 0 || submitUs < firstSubmitUs)) {
+            firstSubmitUs = submitUs;
+        }
+        if (decodeUs != 0) {
+            decodedFrames++;
+            lastDecodeUs = qMax(lastDecodeUs, decodeUs);
+        }
+        if (presentUs != 0) {
+            presentedFrames++;
+            if (firstPresentUs == 0 || presentUs < firstPresentUs) {
+                firstPresentUs = presentUs;
+            }
+            lastPresentUs = qMax(lastPresentUs, presentUs);
+        }
+    }
+
+    // Frames are dropped between decoding and presentation by the Pacer
+    fprintf(stdout, "Frames decoded: %d, presented: %d, dropped: %d\n",
+            decodedFrames, presentedFrames, decodedFrames - presentedFrames);
+    if (decodedFrames != 0 && lastDecodeUs > firstSubmitUs) {
+        fprintf(stdout, "Decode throughput: %.1f FPS\n",
+                decodedFrames * 1000000.0 / (lastDecodeUs - firstSubmitUs));
+    }
+    if (presentedFrames > 1 && lastPresentUs > firstPresentUs) {
+        fprintf(stdout, "Presentation rate: %.1f FPS\n",
+                (presentedFrames - 1) * 1000000.0 / (lastPresentUs - firstPresentUs));
+    }
+    fprintf(stdout, "\n%-12s %8s %9s %9s %9s\n", "Stage", "Frames", "p50 ms", "p95 ms", "p99 ms");
+    printStageLatency("Network", trace, FRAME_TRACE_STAGE_RECEIVED, FRAME_TRACE_STAGE_DEPACKETIZED);
+    printStageLatency("Decode", trace, FRAME_TRACE_STAGE_SUBMITTED, FRAME_TRACE_STAGE_DECODED);
+    printStageLatency("Render", trace, FRAME_TRACE_STAGE_DECODED, FRAME_TRACE_STAGE_PRESENTED);
+    printStageLatency("Total", trace, FRAME_TRACE_STAGE_RECEIVED, FRAME_TRACE_STAGE_PRESENTED);
+}
+
+int ReplaySession::exec()
+{
+    VIDEO_REPLAY_CONFIGURATION replayConfig;
+    DECODER_RENDERER_CALLBACKS drCallbacks;
+    QVector<FRAME_TRACE_RECORD> trace;
+    bool aborted = false;
+
+    if (m_Arguments.getNullRenderer()) {
+        // Nothing is presented, so we don't need a real display
+        qputenv("NULL_RENDERER", "1");
+        qputenv("SDL_VIDEODRIVER", "dummy");
+    }
+
+    if (m_Arguments.getVsyncRate() > 0) {
+        qputenv("SIMULATED_VSYNC_HZ", QByteArray::number(m_Arguments.getVsyncRate()));
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_InitSubSystem(SDL_INIT_VIDEO) failed: %s",
+                     SDL_GetError());
+        return 1;
+    }
+
+    if (!probeDecoderCapabilities()) {
+        fprintf(stderr, "No decoder available for the replay stream\n");
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return 1;
+    }
+
+    QTemporaryFile testFrameFile;
+    QByteArray streamFile = m_Arguments.getStreamFile().toLocal8Bit();
+
+    if (m_Arguments.getTestFrameCount() > 0) {
+        const uint8_t* testFrameData = nullptr;
+        int testFrameSize = 0;
+
+#ifdef HAVE_FFMPEG
+        FFmpegVideoDecoder::getTestFrame(m_Arguments.getVideoFormat(), &testFrameData, &testFrameSize);
+#endif
+
+        if (testFrameData == nullptr) {
+            fprintf(stderr, "No test frame available for the video codec\n");
+            SDL_QuitSubSystem(SDL_INIT_VIDEO);
+            return 1;
+        }
+
+        // Each test frame is a complete IDR frame with parameter sets,
+        // so we can replay them back to back as an untimed stream.
+        if (!testFrameFile.open()) {
+            fprintf(stderr, "Failed to create test frame stream\n");
+            SDL_QuitSubSystem(SDL_INIT_VIDEO);
+            return 1;
+        }
+        for (int i = 0; i < m_Arguments.getTestFrameCount(); i++) {
+            testFrameFile.write((const char*)testFrameData, testFrameSize);
+        }
+        testFrameFile.close();
+
+        streamFile = testFrameFile.fileName().toLocal8Bit();
+    }
+
+    QByteArray timingFile = m_Arguments.getTimingFile().toLocal8Bit();
+
+    LiInitializeVideoReplayConfiguration(&replayConfig);
+    replayConfig.streamFile = streamFile.constData();
+    replayConfig.timingFile = timingFile.isEmpty() ? nullptr : timingFile.constData();
+    replayConfig.videoFormat = m_Arguments.getVideoFormat();
+    replayConfig.width = m_Preferences->width;
+    replayConfig.height = m_Preferences->height;
+    replayConfig.fps = m_Preferences->fps;
+    if (m_Preferences->packetSize != 0) {
+        replayConfig.packetSize = m_Preferences->packetSize;
+    }
+    replayConfig.fecPercentage = m_Arguments.getFecPercentage();
+    replayConfig.speedPercent = m_Arguments.getSpeedPercent();
+    replayConfig.impairment = m_Arguments.getImpairment();
+    replayConfig.audioPacketDuration = m_Arguments.getAudioPacketDuration();
+
+    LiInitializeVideoCallbacks(&drCallbacks);
+    drCallbacks.setup = drSetup;
+    drCallbacks.capabilities = m_Capabilities;
+    if (!(m_Capabilities & CAPABILITY_PULL_RENDERER)) {
+        drCallbacks.submitDecodeUnit = Session::drSubmitDecodeUnit;
+    }
+
+    // The renderers find the overlay manager through the active session
+    Session::s_ActiveSessionSemaphore.acquire();
+    Session::s_ActiveSession = m_Session;
+    s_ActiveReplay = this;
+
+    if (LiStartVideoReplay(&replayConfig, &Session::k_ConnCallbacks, &drCallbacks, nullptr, 0) != 0) {
+        fprintf(stderr, "Failed to start replay of %s\n", streamFile.constData());
+
+        SDL_AtomicLock(&m_Session->m_DecoderLock);
+        delete m_Session->m_VideoDecoder;
+        m_Session->m_VideoDecoder = nullptr;
+        SDL_AtomicUnlock(&m_Session->m_DecoderLock);
+
+        if (m_Session->m_Window != nullptr) {
+            SDL_DestroyWindow(m_Session->m_Window);
+            m_Session->m_Window = nullptr;
+        }
+
+        s_ActiveReplay = nullptr;
+        Session::s_ActiveSession = nullptr;
+        Session::s_ActiveSessionSemaphore.release();
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+        return 1;
+    }
+
+    // Act as the SDL main thread for renderers that render there
+    while (!aborted && !LiIsVideoReplayFinished()) {
+        SDL_Event event;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        if (!SDL_WaitEventTimeout(&event, 100)) {
+            continue;
+        }
+#else
+        if (!SDL_PollEvent(&event)) {
+            SDL_Delay(1);
+            continue;
+        }
+#endif
+
+        switch (event.type) {
+        case SDL_QUIT:
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Quit event received");
+            aborted = true;
+            break;
+
+        case SDL_USEREVENT:
+            if (event.user.code == SDL_CODE_FRAME_READY) {
+                m_Session->m_VideoDecoder->renderFrameOnMainThread();
+            }
+            break;
+        }
+    }
+
+    // Grab the trace before the replay is stopped and the trace is freed
+    trace.resize(FRAME_TRACE_SIZE);
+    trace.resize(LiGetVideoFrameTrace(trace.data(), trace.size()));
+    if (!aborted) {
+        printResults(trace);
+    }
+
+    // NB: This must happen before LiStopVideoReplay() for pull-based decoders.
+    SDL_AtomicLock(&m_Session->m_DecoderLock);
+    delete m_Session->m_VideoDecoder;
+    m_Session->m_VideoDecoder = nullptr;
+    SDL_AtomicUnlock(&m_Session->m_DecoderLock);
+
+    LiStopVideoReplay();
+
+    // This must be called after the decoder is deleted, because
+    // the renderer may want to interact with the window
+    SDL_DestroyWindow(m_Session->m_Window);
+    m_Session->m_Window = nullptr;
+
+    s_ActiveReplay = nullptr;
+    Session::s_ActiveSession = nullptr;
+    Session::s_ActiveSessionSemaphore.release();
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+
+    return aborted ? 1 : 0;
+}
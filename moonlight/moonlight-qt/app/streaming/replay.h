@@ -0,0 +1,35 @@
+#pragma once
+
+#include "session.h"
+#include "cli/commandlineparser.h"
+
+#include <QVector>
+
+// Replays a recorded video stream through the decoder and renderer
+// that a streaming session would use and prints the frame latencies.
+// This runs on the main thread in place of the Qt event loop.
+class ReplaySession
+{
+public:
+    ReplaySession(const ReplayCommandLineParser& arguments, StreamingPreferences* preferences);
+    ~ReplaySession();
+
+    // Returns the process exit code
+    int exec();
+
+private:
+    bool probeDecoderCapabilities();
+
+    void printResults(const QVector<FRAME_TRACE_RECORD>& trace);
+
+    static
+    int drSetup(int videoFormat, int width, int height, int frameRate, void*, int);
+
+    const ReplayCommandLineParser& m_Arguments;
+    StreamingPreferences* m_Preferences;
+    NvApp m_App;
+    Session* m_Session;
+    int m_Capabilities;
+
+    static ReplaySession* s_ActiveReplay;
+};
@@ -54,7 +54,7 @@
 
 CONNECTION_LISTENER_CALLBACKS Session::k_ConnCallbacks = {
     Session::clStageStarting,
-    nullptr,
+    Session::clStageComplete,
     Session::clStageFailed,
     nullptr,
     Session::clConnectionTerminated,
@@ -75,6 +75,17 @@ void Session::clStageStarting(int stage)
     emit s_ActiveSession->stageStarting(QString::fromLocal8Bit(LiGetStageName(stage)));
 }
 
+void Session::clStageComplete(int stage)
+{
+    uint64_t startTimeUs, completeTimeUs;
+
+    LiGetStageTimes(stage, &startTimeUs, &completeTimeUs);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Connection stage '%s' took %.1f ms",
+                LiGetStageName(stage),
+                (completeTimeUs - startTimeUs) / 1000.0);
+}
+
 void Session::clStageFailed(int stage, int errorCode)
 {
     // Perform the port test now, while we're on the async connection thread and not blocking the UI.
@@ -216,7 +227,8 @@ void Session::clSetHdrMode(bool enabled)
 
 bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
                             SDL_Window* window, int videoFormat, int width, int height,
-                            int frameRate, bool enableVsync, bool enableFramePacing, bool testOnly, IVideoDecoder*& chosenDecoder)
+                            int frameRate, bool enableVsync, bool enableFramePacing, int framePacingLatency,
+                            bool testOnly, IVideoDecoder*& chosenDecoder)
 {
     DECODER_PARAMETERS params;
 
@@ -232,6 +244,7 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     params.window = window;
     params.enableVsync = enableVsync;
     params.enableFramePacing = enableFramePacing;
+    params.framePacingLatency = framePacingLatency;
     params.testOnly = testOnly;
     params.vds = vds;
 
@@ -277,6 +290,42 @@ bool Session::chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
     return false;
 }
 
+void Session::runDecoderProbe(SDL_Window* window, const DECODER_PROBE_KEY& key,
+                              DECODER_PROBE_RESULT& result)
+{
+    IVideoDecoder* decoder;
+
+    if (chooseDecoder(key.vds, window, key.videoFormat, key.width, key.height, key.frameRate,
+                      false, false, 0, true, decoder)) {
+        DecoderProbeCache::getDecoderProperties(decoder, result);
+        delete decoder;
+    }
+    else {
+        result = {};
+        result.available = false;
+    }
+}
+
+bool Session::probeDecoder(SDL_Window* window, const DECODER_PROBE_KEY& key,
+                           bool useCachedFailure, DECODER_PROBE_RESULT& result)
+{
+    if (DecoderProbeCache::lookup(key, result) &&
+            (result.available || useCachedFailure)) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using cached decoder probe for format 0x%x (%dx%dx%d): %s",
+                    key.videoFormat, key.width, key.height, key.frameRate,
+                    result.available ? (result.isHardwareAccelerated ? "hardware" : "software") : "unavailable");
+
+        // Probe this again once we're streaming
+        DecoderProbeCache::markUsed(key);
+        return result.available;
+    }
+
+    runDecoderProbe(window, key, result);
+    DecoderProbeCache::store(key, result);
+    return result.available;
+}
+
 int Session::drSetup(int videoFormat, int width, int height, int frameRate, void *, int)
 {
     s_ActiveSession->m_ActiveVideoFormat = videoFormat;
@@ -327,17 +376,16 @@ void Session::getDecoderInfo(SDL_Window* window,
                              bool& isHardwareAccelerated, bool& isFullScreenOnly,
                              bool& isHdrSupported, QSize& maxResolution)
 {
-    IVideoDecoder* decoder;
+    DECODER_PROBE_RESULT result;
 
     // Try an HEVC Main10 decoder first to see if we have HDR support
-    if (chooseDecoder(StreamingPreferences::VDS_FORCE_HARDWARE,
-                      window, VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60,
-                      false, false, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        isHdrSupported = decoder->isHdrSupported();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
+    if (probeDecoder(window,
+                     { StreamingPreferences::VDS_FORCE_HARDWARE, VIDEO_FORMAT_H265_MAIN10, 1920, 1080, 60 },
+                     true, result)) {
+        isHardwareAccelerated = result.isHardwareAccelerated;
+        isFullScreenOnly = result.isAlwaysFullScreen;
+        isHdrSupported = result.isHdrSupported;
+        maxResolution = result.maxResolution;
 
         return;
     }
@@ -347,26 +395,24 @@ void Session::getDecoderInfo(SDL_Window* window,
     isHdrSupported = false;
 
     // Try a regular hardware accelerated HEVC decoder now
-    if (chooseDecoder(StreamingPreferences::VDS_FORCE_HARDWARE,
-                      window, VIDEO_FORMAT_H265, 1920, 1080, 60,
-                      false, false, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
+    if (probeDecoder(window,
+                     { StreamingPreferences::VDS_FORCE_HARDWARE, VIDEO_FORMAT_H265, 1920, 1080, 60 },
+                     true, result)) {
+        isHardwareAccelerated = result.isHardwareAccelerated;
+        isFullScreenOnly = result.isAlwaysFullScreen;
+        maxResolution = result.maxResolution;
 
         return;
     }
 
     // If we still didn't find a hardware decoder, try H.264 now.
     // This will fall back to software decoding, so it should always work.
-    if (chooseDecoder(StreamingPreferences::VDS_AUTO,
-                      window, VIDEO_FORMAT_H264, 1920, 1080, 60,
-                      false, false, true, decoder)) {
-        isHardwareAccelerated = decoder->isHardwareAccelerated();
-        isFullScreenOnly = decoder->isAlwaysFullScreen();
-        maxResolution = decoder->getDecoderMaxResolution();
-        delete decoder;
+    if (probeDecoder(window,
+                     { StreamingPreferences::VDS_AUTO, VIDEO_FORMAT_H264, 1920, 1080, 60 },
+                     false, result)) {
+        isHardwareAccelerated = result.isHardwareAccelerated;
+        isFullScreenOnly = result.isAlwaysFullScreen;
+        maxResolution = result.maxResolution;
 
         return;
     }
@@ -379,35 +425,32 @@ bool Session::isHardwareDecodeAvailable(SDL_Window* window,
                                         StreamingPreferences::VideoDecoderSelection vds,
                                         int videoFormat, int width, int height, int frameRate)
 {
-    IVideoDecoder* decoder;
+    DECODER_PROBE_RESULT result;
 
-    if (!chooseDecoder(vds, window, videoFormat, width, height, frameRate, false, false, true, decoder)) {
+    if (!probeDecoder(window, { vds, videoFormat, width, height, frameRate }, true, result)) {
         return false;
     }
 
-    bool ret = decoder->isHardwareAccelerated();
-
-    delete decoder;
-
-    return ret;
+    return result.isHardwareAccelerated;
 }
 
 bool Session::populateDecoderProperties(SDL_Window* window)
 {
-    IVideoDecoder* decoder;
-
-    if (!chooseDecoder(m_Preferences->videoDecoderSelection,
-                       window,
-                       m_StreamConfig.enableHdr ? VIDEO_FORMAT_H265_MAIN10 :
-                            (m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264),
-                       m_StreamConfig.width,
-                       m_StreamConfig.height,
-                       m_StreamConfig.fps,
-                       false, false, true, decoder)) {
+    DECODER_PROBE_RESULT result;
+
+    // Don't trust a cached failure here, since failing will abort the stream
+    if (!probeDecoder(window,
+                      { m_Preferences->videoDecoderSelection,
+                        m_StreamConfig.enableHdr ? VIDEO_FORMAT_H265_MAIN10 :
+                             (m_StreamConfig.supportsHevc ? VIDEO_FORMAT_H265 : VIDEO_FORMAT_H264),
+                        m_StreamConfig.width,
+                        m_StreamConfig.height,
+                        m_StreamConfig.fps },
+                      false, result)) {
         return false;
     }
 
-    m_VideoCallbacks.capabilities = decoder->getDecoderCapabilities();
+    m_VideoCallbacks.capabilities = result.capabilities;
     if (m_VideoCallbacks.capabilities & CAPABILITY_PULL_RENDERER) {
         // It is an error to pass a push callback when in pull mode
         m_VideoCallbacks.submitDecodeUnit = nullptr;
@@ -426,7 +469,7 @@ bool Session::populateDecoderProperties(SDL_Window* window)
                         m_StreamConfig.colorSpace);
         }
         else {
-            m_StreamConfig.colorSpace = decoder->getDecoderColorspace();
+            m_StreamConfig.colorSpace = result.colorspace;
         }
 
         m_StreamConfig.colorRange = qEnvironmentVariableIntValue("COLOR_RANGE_OVERRIDE", &ok);
@@ -436,16 +479,14 @@ bool Session::populateDecoderProperties(SDL_Window* window)
                         m_StreamConfig.colorRange);
         }
         else {
-            m_StreamConfig.colorRange = decoder->getDecoderColorRange();
+            m_StreamConfig.colorRange = result.colorRange;
         }
     }
 
-    if (decoder->isAlwaysFullScreen()) {
+    if (result.isAlwaysFullScreen) {
         m_IsFullScreen = true;
     }
 
-    delete decoder;
-
     return true;
 }
 
@@ -470,8 +511,13 @@ Session::Session(NvComputer* computer, NvApp& app, StreamingPreferences *prefere
       m_OpusDecoder(nullptr),
       m_AudioRenderer(nullptr),
       m_AudioSampleCount(0),
-      m_DropAudioEndTime(0)
+      m_DropAudioEndTime(0),
+      m_AudioFramePending(false)
 {
+    SDL_AtomicSet(&m_AudioConcealedFrames, 0);
+    SDL_AtomicSet(&m_AudioFecRecoveredFrames, 0);
+    SDL_AtomicSet(&m_AudioCurrentLatencyMs, -1);
+    SDL_AtomicSet(&m_AudioTargetLatencyMs, -1);
 }
 
 bool Session::initialize()
@@ -520,6 +566,10 @@ bool Session::initialize()
     m_StreamConfig.encryptionFlags = ENCFLG_AUDIO;
 #endif
 
+    // Send independent RTSP requests back to back during the handshake.
+    // This is opt-in until more hosts have been tested with it.
+    m_StreamConfig.pipelineRtspHandshake = qgetenv("RTSP_PIPELINING") == "1";
+
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                 "Video bitrate: %d kbps",
                 m_StreamConfig.bitrate);
@@ -849,6 +899,63 @@ bool Session::validateLaunch(SDL_Window* testWindow)
 }
 
 
+class DecoderProbeRevalidationTask : public QRunnable
+{
+public:
+    DecoderProbeRevalidationTask(QVector<DECODER_PROBE_KEY> keys) :
+        m_Keys(keys) {}
+
+private:
+    void run() override
+    {
+        // Creating a window off the main thread is only safe on X11 and Wayland
+        // (see SystemProperties::querySdlVideoInfo()). Elsewhere, just drop the
+        // entries so the next launch probes them again.
+        if (!WMUtils::isRunningX11() && !WMUtils::isRunningWayland()) {
+            for (const DECODER_PROBE_KEY& key : m_Keys) {
+                DecoderProbeCache::invalidate(key);
+            }
+            return;
+        }
+
+        if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "SDL_InitSubSystem(SDL_INIT_VIDEO) failed: %s",
+                         SDL_GetError());
+            return;
+        }
+
+        SDL_Window* testWindow = SDL_CreateWindow("", 0, 0, 1280, 720,
+                                                  SDL_WINDOW_HIDDEN | StreamUtils::getPlatformWindowFlags());
+        if (!testWindow) {
+            testWindow = SDL_CreateWindow("", 0, 0, 1280, 720, SDL_WINDOW_HIDDEN);
+        }
+
+        if (testWindow) {
+            for (const DECODER_PROBE_KEY& key : m_Keys) {
+                DECODER_PROBE_RESULT result;
+
+                Session::runDecoderProbe(testWindow, key, result);
+                DecoderProbeCache::revalidate(key, result);
+            }
+
+            SDL_DestroyWindow(testWindow);
+        }
+        else {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to create window for decoder probe revalidation: %s",
+                         SDL_GetError());
+            for (const DECODER_PROBE_KEY& key : m_Keys) {
+                DecoderProbeCache::invalidate(key);
+            }
+        }
+
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    }
+
+    QVector<DECODER_PROBE_KEY> m_Keys;
+};
+
 class DeferredSessionCleanupTask : public QRunnable
 {
 public:
@@ -1789,6 +1896,7 @@ void Session::execInternal()
                                    m_ActiveVideoHeight, m_ActiveVideoFrameRate,
                                    enableVsync,
                                    enableVsync && m_Preferences->framePacing,
+                                   m_Preferences->framePacingLatency,
                                    false,
                                    s_ActiveSession->m_VideoDecoder)) {
                     SDL_AtomicUnlock(&m_DecoderLock);
@@ -1818,6 +1926,16 @@ void Session::execInternal()
             m_InputHandler->updatePointerRegionLock();
 
             SDL_AtomicUnlock(&m_DecoderLock);
+
+            {
+                // Now that the real decoder is up, check that every cached probe
+                // we used to get here is still accurate. This runs in the background
+                // because each probe creates a full decoder and renderer.
+                QVector<DECODER_PROBE_KEY> usedProbes = DecoderProbeCache::takeUsedEntries();
+                if (!usedProbes.isEmpty()) {
+                    QThreadPool::globalInstance()->start(new DecoderProbeRevalidationTask(usedProbes));
+                }
+            }
             break;
 
         case SDL_KEYUP:
@@ -7,6 +7,7 @@
 #include "settings/streamingpreferences.h"
 #include "input/input.h"
 #include "video/decoder.h"
+#include "video/decoderprobecache.h"
 #include "audio/renderers/renderer.h"
 #include "video/overlaymanager.h"
 
@@ -16,8 +17,10 @@ class Session : public QObject
 
     friend class SdlInputHandler;
     friend class DeferredSessionCleanupTask;
+    friend class DecoderProbeRevalidationTask;
     friend class AsyncConnectionStartThread;
     friend class ExecThread;
+    friend class ReplaySession;
 
 public:
     explicit Session(NvComputer* computer, NvApp& app, StreamingPreferences *preferences = nullptr);
@@ -43,6 +46,23 @@ public:
         return m_OverlayManager;
     }
 
+    // Lost audio frames that were concealed, and how many of those were
+    // decoded using in-band FEC data from the following packet. libopus
+    // falls back to packet loss concealment if the host didn't send any.
+    void getAudioConcealmentStats(int& concealedFrames, int& fecRecoveredFrames)
+    {
+        concealedFrames = SDL_AtomicGet(&m_AudioConcealedFrames);
+        fecRecoveredFrames = SDL_AtomicGet(&m_AudioFecRecoveredFrames);
+    }
+
+    // Latency of the audio renderer's jitter buffer as of the last
+    // submitted frame, or -1 if it doesn't have one
+    void getAudioLatencyStats(int& currentLatencyMs, int& targetLatencyMs)
+    {
+        currentLatencyMs = SDL_AtomicGet(&m_AudioCurrentLatencyMs);
+        targetLatencyMs = SDL_AtomicGet(&m_AudioTargetLatencyMs);
+    }
+
     void flushWindowEvents();
 
 signals:
@@ -96,16 +116,27 @@ private:
                                    StreamingPreferences::VideoDecoderSelection vds,
                                    int videoFormat, int width, int height, int frameRate);
 
+    static
+    void runDecoderProbe(SDL_Window* window, const DECODER_PROBE_KEY& key,
+                         DECODER_PROBE_RESULT& result);
+
+    static
+    bool probeDecoder(SDL_Window* window, const DECODER_PROBE_KEY& key,
+                      bool useCachedFailure, DECODER_PROBE_RESULT& result);
+
     static
     bool chooseDecoder(StreamingPreferences::VideoDecoderSelection vds,
                        SDL_Window* window, int videoFormat, int width, int height,
                        int frameRate, bool enableVsync, bool enableFramePacing,
-                       bool testOnly,
+                       int framePacingLatency, bool testOnly,
                        IVideoDecoder*& chosenDecoder);
 
     static
     void clStageStarting(int stage);
 
+    static
+    void clStageComplete(int stage);
+
     static
     void clStageFailed(int stage, int errorCode);
 
@@ -135,6 +166,8 @@ private:
     static
     void arDecodeAndPlaySample(char* sampleData, int sampleLength);
 
+    void decodeAudioFrame(const unsigned char* sampleData, int sampleLength, bool decodeFec);
+
     static
     int drSetup(int videoFormat, int width, int height, int frameRate, void*, int);
 
@@ -178,6 +211,11 @@ private:
     OPUS_MULTISTREAM_CONFIGURATION m_AudioConfig;
     int m_AudioSampleCount;
     Uint32 m_DropAudioEndTime;
+    bool m_AudioFramePending;
+    SDL_atomic_t m_AudioConcealedFrames;
+    SDL_atomic_t m_AudioFecRecoveredFrames;
+    SDL_atomic_t m_AudioCurrentLatencyMs;
+    SDL_atomic_t m_AudioTargetLatencyMs;
 
     Overlay::OverlayManager m_OverlayManager;
 
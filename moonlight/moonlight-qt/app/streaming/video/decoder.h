@@ -6,7 +6,7 @@
 
 #define SDL_CODE_FRAME_READY 0
 
-#define MAX_SLICES 4
+#define MAX_SLICES 8
 
 typedef struct _VIDEO_STATS {
     uint32_t receivedFrames;
@@ -17,8 +17,10 @@ typedef struct _VIDEO_STATS {
     uint32_t pacerDroppedFrames;
     uint32_t totalReassemblyTime;
     uint32_t totalDecodeTime;
+    uint64_t totalDecoderTimeUs;
     uint32_t totalPacerTime;
     uint32_t totalRenderTime;
+    uint64_t totalRenderBlockedTimeUs;
     uint32_t lastRtt;
     uint32_t lastRttVariance;
     float totalFps;
@@ -38,6 +40,7 @@ typedef struct _DECODER_PARAMETERS {
     int frameRate;
     bool enableVsync;
     bool enableFramePacing;
+    int framePacingLatency;
     bool testOnly;
 } DECODER_PARAMETERS, *PDECODER_PARAMETERS;
 
@@ -0,0 +1,329 @@
+#include "decoderprobecache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QSettings>
+#include <QSysInfo>
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+}
+#endif
+
+#ifdef Q_OS_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <dxgi.h>
+#endif
+
+#define SER_DECODERPROBES "decoderprobes"
+#define SER_FINGERPRINT "fingerprint"
+#define SER_PROBETIME "probetime"
+#define SER_AVAILABLE "available"
+#define SER_HWACCEL "hwaccel"
+#define SER_FULLSCREENONLY "fullscreenonly"
+#define SER_HDR "hdr"
+#define SER_CAPABILITIES "capabilities"
+#define SER_COLORSPACE "colorspace"
+#define SER_COLORRANGE "colorrange"
+#define SER_MAXRESOLUTION "maxresolution"
+
+// Re-probe periodically even if nothing we can see has changed,
+// since things like Mesa updates don't show up in the fingerprint.
+#define MAX_PROBE_AGE_SECS (7 * 24 * 60 * 60)
+
+static QMutex s_UsedEntriesLock;
+static QMap<QString, DECODER_PROBE_KEY> s_UsedEntries;
+
+bool DecoderProbeCache::isEnabled()
+{
+    return qgetenv("DECODER_PROBE_CACHE") != "0";
+}
+
+QString DecoderProbeCache::getEntryKey(const DECODER_PROBE_KEY& key)
+{
+    return QString("%1-%2-%3x%4x%5")
+            .arg(key.vds)
+            .arg(key.videoFormat, 0, 16)
+            .arg(key.width)
+            .arg(key.height)
+            .arg(key.frameRate);
+}
+
+QString DecoderProbeCache::getGpuFingerprint()
+{
+    QStringList components;
+
+#if defined(Q_OS_WIN32)
+    IDXGIFactory1* factory;
+    if (SUCCEEDED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory))) {
+        IDXGIAdapter1* adapter;
+        for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; i++) {
+            DXGI_ADAPTER_DESC1 desc;
+            LARGE_INTEGER umdVersion = {};
+
+            if (SUCCEEDED(adapter->GetDesc1(&desc))) {
+                // This is the documented way to get the user-mode driver version
+                adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umdVersion);
+
+                components.append(QString("%1 %2:%3 %4")
+                                  .arg(QString::fromWCharArray(desc.Description))
+                                  .arg(desc.VendorId, 0, 16)
+                                  .arg(desc.DeviceId, 0, 16)
+                                  .arg(umdVersion.QuadPart, 0, 16));
+            }
+
+            adapter->Release();
+        }
+
+        factory->Release();
+    }
+#elif defined(Q_OS_LINUX)
+    QDir drmDir("/sys/class/drm");
+    for (const QString& card : drmDir.entryList(QStringList("card*"), QDir::AllEntries | QDir::NoDotAndDotDot, QDir::Name)) {
+        // Skip connectors like card0-HDMI-A-1
+        if (card.contains('-')) {
+            continue;
+        }
+
+        QFile uevent(drmDir.filePath(card + "/device/uevent"));
+        if (!uevent.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        for (const QByteArray& line : uevent.readAll().split('\n')) {
+            if (line.startsWith("DRIVER=") || line.startsWith("PCI_ID=") || line.startsWith("OF_COMPATIBLE_0=")) {
+                components.append(card + ": " + QString::fromUtf8(line));
+
+                // Out of tree drivers like NVIDIA's report their version here
+                if (line.startsWith("DRIVER=")) {
+                    QFile moduleVersion("/sys/module/" + QString::fromUtf8(line.mid(7)) + "/version");
+                    if (moduleVersion.open(QIODevice::ReadOnly)) {
+                        components.append(QString::fromUtf8(moduleVersion.readAll().trimmed()));
+                    }
+                }
+            }
+        }
+    }
+#endif
+
+    return components.join('\n');
+}
+
+QString DecoderProbeCache::getFingerprint()
+{
+    // Enumerating GPUs is relatively expensive, so only do it once
+    static const QString gpuFingerprint = getGpuFingerprint();
+
+    // These environment variables affect which decoder and renderer we pick
+    static const char* const decoderEnvironmentVariables[] = {
+        "D3D11VA_ENABLED",
+        "DECODER_CAPS",
+        "DRM_ATOMIC",
+        "DRM_DEV",
+        "DRM_FORCE_DIRECT",
+        "DRM_FORCE_EGL",
+        "DRM_KMS_SCANOUT",
+        "DXVA2_DISABLE_DECODER_BLACKLIST",
+        "DXVA2_ENABLED",
+        "DXVA2_QUIRK_FLAGS",
+        "EGL_SOFTWARE_FRAMES",
+        "FORCE_VAAPI",
+        "H264_DECODER_HINT",
+        "HEVC_DECODER_HINT",
+        "LIBVA_DRIVERS_PATH",
+        "LIBVA_DRIVER_NAME",
+        "MMAL_DISABLE_SUPPORT_CHECK",
+        "NULL_RENDERER",
+        "RPI_ALLOW_COPYBACK_RENDER",
+        "RPI_ALLOW_EGL_RENDER",
+        "SIMULATED_VSYNC_HZ",
+        "SOFTWARE_DECODE_THREADS",
+        "VAAPI_FORCE_DIRECT",
+        "VAAPI_FORCE_INDIRECT",
+        "VDPAU_DRIVER",
+        "VDPAU_DRIVER_PATH",
+        "VDPAU_XWAYLAND",
+        "VULKAN_RENDERER",
+    };
+
+    QStringList components;
+    SDL_version sdlVersion;
+
+    components.append(VERSION_STR);
+
+    SDL_GetVersion(&sdlVersion);
+    components.append(QString("SDL %1.%2.%3 (%4)")
+                      .arg(sdlVersion.major)
+                      .arg(sdlVersion.minor)
+                      .arg(sdlVersion.patch)
+                      .arg(SDL_GetCurrentVideoDriver()));
+
+#ifdef HAVE_FFMPEG
+    components.append(QString("FFmpeg %1 (libavcodec %2)")
+                      .arg(av_version_info())
+                      .arg(avcodec_version()));
+#endif
+
+    components.append(QSysInfo::kernelType() + " " + QSysInfo::kernelVersion());
+    components.append(QSysInfo::prettyProductName());
+    components.append(QString("CPU cores: %1").arg(SDL_GetCPUCount()));
+    components.append(gpuFingerprint);
+
+    for (int i = 0; i < SDL_GetNumVideoDisplays(); i++) {
+        SDL_DisplayMode mode;
+
+        if (SDL_GetDesktopDisplayMode(i, &mode) == 0) {
+            components.append(QString("%1: %2x%3x%4")
+                              .arg(SDL_GetDisplayName(i))
+                              .arg(mode.w)
+                              .arg(mode.h)
+                              .arg(mode.refresh_rate));
+        }
+    }
+
+    for (const char* variable : decoderEnvironmentVariables) {
+        if (qEnvironmentVariableIsSet(variable)) {
+            components.append(QString("%1=%2").arg(variable, QString::fromUtf8(qgetenv(variable))));
+        }
+    }
+
+    return QCryptographicHash::hash(components.join('\n').toUtf8(), QCryptographicHash::Sha256).toHex();
+}
+
+void DecoderProbeCache::getDecoderProperties(IVideoDecoder* decoder, DECODER_PROBE_RESULT& result)
+{
+    result.available = true;
+    result.isHardwareAccelerated = decoder->isHardwareAccelerated();
+    result.isAlwaysFullScreen = decoder->isAlwaysFullScreen();
+    result.isHdrSupported = decoder->isHdrSupported();
+    result.capabilities = decoder->getDecoderCapabilities();
+    result.colorspace = decoder->getDecoderColorspace();
+    result.colorRange = decoder->getDecoderColorRange();
+    result.maxResolution = decoder->getDecoderMaxResolution();
+}
+
+bool DecoderProbeCache::lookup(const DECODER_PROBE_KEY& key, DECODER_PROBE_RESULT& result)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    QSettings settings;
+    QString entryKey = getEntryKey(key);
+
+    settings.beginGroup(SER_DECODERPROBES);
+    if (!settings.childGroups().contains(entryKey) ||
+            settings.value(SER_FINGERPRINT).toString() != getFingerprint()) {
+        return false;
+    }
+
+    settings.beginGroup(entryKey);
+    if (QDateTime::currentSecsSinceEpoch() - settings.value(SER_PROBETIME).toLongLong() > MAX_PROBE_AGE_SECS) {
+        return false;
+    }
+
+    result.available = settings.value(SER_AVAILABLE).toBool();
+    result.isHardwareAccelerated = settings.value(SER_HWACCEL).toBool();
+    result.isAlwaysFullScreen = settings.value(SER_FULLSCREENONLY).toBool();
+    result.isHdrSupported = settings.value(SER_HDR).toBool();
+    result.capabilities = settings.value(SER_CAPABILITIES).toInt();
+    result.colorspace = settings.value(SER_COLORSPACE).toInt();
+    result.colorRange = settings.value(SER_COLORRANGE).toInt();
+    result.maxResolution = settings.value(SER_MAXRESOLUTION).toSize();
+    return true;
+}
+
+void DecoderProbeCache::store(const DECODER_PROBE_KEY& key, const DECODER_PROBE_RESULT& result)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QSettings settings;
+    QString fingerprint = getFingerprint();
+
+    settings.beginGroup(SER_DECODERPROBES);
+    if (settings.value(SER_FINGERPRINT).toString() != fingerprint) {
+        // Drop all probes from the old configuration
+        settings.remove("");
+        settings.setValue(SER_FINGERPRINT, fingerprint);
+    }
+
+    settings.beginGroup(getEntryKey(key));
+    settings.setValue(SER_PROBETIME, QDateTime::currentSecsSinceEpoch());
+    settings.setValue(SER_AVAILABLE, result.available);
+    settings.setValue(SER_HWACCEL, result.isHardwareAccelerated);
+    settings.setValue(SER_FULLSCREENONLY, result.isAlwaysFullScreen);
+    settings.setValue(SER_HDR, result.isHdrSupported);
+    settings.setValue(SER_CAPABILITIES, result.capabilities);
+    settings.setValue(SER_COLORSPACE, result.colorspace);
+    settings.setValue(SER_COLORRANGE, result.colorRange);
+    settings.setValue(SER_MAXRESOLUTION, result.maxResolution);
+}
+
+void DecoderProbeCache::markUsed(const DECODER_PROBE_KEY& key)
+{
+    QMutexLocker locker(&s_UsedEntriesLock);
+    s_UsedEntries.insert(getEntryKey(key), key);
+}
+
+QVector<DECODER_PROBE_KEY> DecoderProbeCache::takeUsedEntries()
+{
+    QMutexLocker locker(&s_UsedEntriesLock);
+    QVector<DECODER_PROBE_KEY> entries;
+
+    for (const DECODER_PROBE_KEY& key : s_UsedEntries) {
+        entries.append(key);
+    }
+
+    s_UsedEntries.clear();
+    return entries;
+}
+
+void DecoderProbeCache::invalidate(const DECODER_PROBE_KEY& key)
+{
+    QSettings settings;
+
+    settings.beginGroup(SER_DECODERPROBES);
+    settings.remove(getEntryKey(key));
+}
+
+void DecoderProbeCache::revalidate(const DECODER_PROBE_KEY& key, const DECODER_PROBE_RESULT& actual)
+{
+    DECODER_PROBE_RESULT cached;
+
+    if (lookup(key, cached)) {
+        if (cached.available == actual.available &&
+                cached.isHardwareAccelerated == actual.isHardwareAccelerated &&
+                cached.isAlwaysFullScreen == actual.isAlwaysFullScreen &&
+                cached.isHdrSupported == actual.isHdrSupported &&
+                cached.capabilities == actual.capabilities &&
+                cached.colorspace == actual.colorspace &&
+                cached.colorRange == actual.colorRange &&
+                cached.maxResolution == actual.maxResolution) {
+            // Still accurate
+            return;
+        }
+
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Cached decoder probe for %s was stale",
+                    qPrintable(getEntryKey(key)));
+    }
+
+    // We revalidate while the stream still holds the decoder, so the probe may
+    // have failed or fallen back to software only because the hardware was busy.
+    // Don't cache that. Drop the entry and let the next launch probe for real.
+    if (!actual.available || !actual.isHardwareAccelerated) {
+        invalidate(key);
+        return;
+    }
+
+    store(key, actual);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "decoder.h"
+
+#include <QSize>
+#include <QVector>
+
+typedef struct _DECODER_PROBE_RESULT {
+    bool available;
+    bool isHardwareAccelerated;
+    bool isAlwaysFullScreen;
+    bool isHdrSupported;
+    int capabilities;
+    int colorspace;
+    int colorRange;
+    QSize maxResolution;
+} DECODER_PROBE_RESULT, *PDECODER_PROBE_RESULT;
+
+// The inputs of a test-only decoder probe, which identify its cache entry
+typedef struct _DECODER_PROBE_KEY {
+    StreamingPreferences::VideoDecoderSelection vds;
+    int videoFormat;
+    int width;
+    int height;
+    int frameRate;
+} DECODER_PROBE_KEY, *PDECODER_PROBE_KEY;
+
+// Persists the results of test-only decoder probes across launches, since
+// each probe creates a full decoder and renderer and decodes a test frame.
+// Entries are invalidated whenever the fingerprint of the GPU, driver, FFmpeg,
+// SDL, or display configuration changes. Any cached result that was used is
+// probed again in the background once a stream starts, so a stale result is
+// only ever used once. Set DECODER_PROBE_CACHE=0 to disable it.
+class DecoderProbeCache
+{
+public:
+    static
+    bool lookup(const DECODER_PROBE_KEY& key, DECODER_PROBE_RESULT& result);
+
+    static
+    void store(const DECODER_PROBE_KEY& key, const DECODER_PROBE_RESULT& result);
+
+    // Records that a cached result was used instead of probing
+    static
+    void markUsed(const DECODER_PROBE_KEY& key);
+
+    // Returns the entries passed to markUsed() since the last call
+    static
+    QVector<DECODER_PROBE_KEY> takeUsedEntries();
+
+    // Drops a cached probe, so the next lookup will miss
+    static
+    void invalidate(const DECODER_PROBE_KEY& key);
+
+    // Replaces the cached probe with a fresh result, if they differ. A result
+    // without a hardware decoder only drops the entry, since the probe may have
+    // run while the decoder was busy.
+    static
+    void revalidate(const DECODER_PROBE_KEY& key, const DECODER_PROBE_RESULT& actual);
+
+    static
+    void getDecoderProperties(IVideoDecoder* decoder, DECODER_PROBE_RESULT& result);
+
+private:
+    static
+    bool isEnabled();
+
+    static
+    QString getEntryKey(const DECODER_PROBE_KEY& key);
+
+    static
+    QString getGpuFingerprint();
+
+    static
+    QString getFingerprint();
+};
@@ -23,6 +23,9 @@ extern "C" {
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
 
 #include "streaming/streamutils.h"
 #include "streaming/session.h"
@@ -55,8 +58,17 @@ DrmRenderer::DrmRenderer(IFFmpegRenderer *backendRenderer)
       m_ColorEncodingProp(nullptr),
       m_ColorRangeProp(nullptr),
       m_HdrOutputMetadataProp(nullptr),
-      m_HdrOutputMetadataBlobId(0)
+      m_HdrOutputMetadataBlobId(0),
+      m_UseAtomic(false),
+      m_CrtcOutFencePtrPropId(0),
+      m_PendingFlipFenceFd(-1),
+      m_PendingFbId(0),
+      m_PendingFrame(av_frame_alloc()),
+      m_DisplayedFrame(av_frame_alloc())
 {
+    SDL_zero(m_OutputRect);
+    SDL_zero(m_PlanePropIds);
+
 #ifdef HAVE_EGL
     m_EGLExtDmaBuf = false;
     m_eglCreateImage = nullptr;
@@ -71,10 +83,25 @@ DrmRenderer::~DrmRenderer()
     // Ensure we're out of HDR mode
     setHdrMode(false);
 
+    // Let any outstanding flip finish before we tear down the buffers
+    waitForPendingFlip();
+
+    if (m_PendingFlipFenceFd >= 0) {
+        close(m_PendingFlipFenceFd);
+    }
+
+    if (m_PendingFbId != 0) {
+        drmModeRmFB(m_DrmFd, m_PendingFbId);
+    }
+
     if (m_CurrentFbId != 0) {
         drmModeRmFB(m_DrmFd, m_CurrentFbId);
     }
 
+    // These can only be freed once the FBs are gone and nothing is scanning them out
+    av_frame_free(&m_PendingFrame);
+    av_frame_free(&m_DisplayedFrame);
+
     if (m_HdrOutputMetadataBlobId != 0) {
         drmModeDestroyPropertyBlob(m_DrmFd, m_HdrOutputMetadataBlobId);
     }
@@ -114,10 +141,356 @@ bool DrmRenderer::prepareDecoderContext(AVCodecContext* context, AVDictionary**
     return true;
 }
 
+bool DrmRenderer::isKmsScanoutEnabled()
+{
+    return qgetenv("DRM_KMS_SCANOUT") == "1";
+}
+
 bool DrmRenderer::initialize(PDECODER_PARAMETERS params)
 {
-    return false;
+    // Scanning frames out on a plane bypasses the GL composition pass that draws
+    // our overlays, so this is opt-in for kiosk setups that don't need them.
+    if (!isKmsScanoutEnabled()) {
+        return false;
+    }
+
+    m_Main10Hdr = (params->videoFormat & VIDEO_FORMAT_MASK_10BIT);
+
+    SDL_SysWMinfo info;
+    SDL_VERSION(&info.version);
+    if (!SDL_GetWindowWMInfo(params->window, &info)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_GetWindowWMInfo() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+#if SDL_VERSION_ATLEAST(2, 0, 15) && defined(SDL_VIDEO_DRIVER_KMSDRM)
+    if (info.subsystem == SDL_SYSWM_KMSDRM) {
+        // Share SDL's DRM master FD so we can drive the planes ourselves
+        SDL_assert(info.info.kmsdrm.drm_fd >= 0);
+        m_DrmFd = info.info.kmsdrm.drm_fd;
+        m_SdlOwnsDrmFd = true;
+        m_SupportsDirectRendering = true;
+    }
+    else
+#endif
+    {
+        const char* device = SDL_getenv("DRM_DEV");
+        if (device == nullptr) {
+            device = "/dev/dri/card0";
+        }
+
+        m_DrmFd = open(device, O_RDWR | O_CLOEXEC);
+        if (m_DrmFd < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Failed to open DRM device %s: %d",
+                         device,
+                         errno);
+            return false;
+        }
+
+        // Without DRM master we can only export frames to another renderer
+        m_SupportsDirectRendering = drmIsMaster(m_DrmFd);
+    }
+
+    // Frontend renderers have nothing to display if they can't drive a plane
+    if (m_BackendRenderer != nullptr && !m_SupportsDirectRendering) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "DRM master is required for KMS scanout");
+        return false;
+    }
+
+    if (m_BackendRenderer == nullptr) {
+        m_HwContext = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_DRM);
+        if (m_HwContext == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_hwdevice_ctx_alloc(DRM) failed");
+            return false;
+        }
+
+        // FFmpeg doesn't close FDs that it didn't open itself
+        AVHWDeviceContext* deviceContext = (AVHWDeviceContext*)m_HwContext->data;
+        AVDRMDeviceContext* drmDeviceContext = (AVDRMDeviceContext*)deviceContext->hwctx;
+        drmDeviceContext->fd = m_DrmFd;
+
+        int err = av_hwdevice_ctx_init(m_HwContext);
+        if (err < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "av_hwdevice_ctx_init(DRM) failed: %d",
+                         err);
+            return false;
+        }
+    }
+
+    if (!m_SupportsDirectRendering) {
+        // We can still export DRM PRIME frames for EGLRenderer
+        return true;
+    }
+
+    drmModeRes* resources = drmModeGetResources(m_DrmFd);
+    if (resources == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeGetResources() failed: %d",
+                     errno);
+        return false;
+    }
+
+    // Look for a connected connector and get the associated encoder
+    for (int i = 0; i < resources->count_connectors && m_EncoderId == 0; i++) {
+        drmModeConnector* connector = drmModeGetConnector(m_DrmFd, resources->connectors[i]);
+        if (connector != nullptr) {
+            if (connector->connection == DRM_MODE_CONNECTED && connector->count_modes > 0) {
+                m_ConnectorId = resources->connectors[i];
+                m_EncoderId = connector->encoder_id;
+            }
+
+            drmModeFreeConnector(connector);
+        }
+    }
+
+    if (m_EncoderId == 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "No connected displays found!");
+        drmModeFreeResources(resources);
+        return false;
+    }
+
+    // Now find the CRTC from the encoder
+    drmModeEncoder* encoder = drmModeGetEncoder(m_DrmFd, m_EncoderId);
+    if (encoder != nullptr) {
+        m_CrtcId = encoder->crtc_id;
+        drmModeFreeEncoder(encoder);
+    }
+
+    int crtcIndex = -1;
+    for (int i = 0; i < resources->count_crtcs; i++) {
+        if (resources->crtcs[i] == m_CrtcId) {
+            drmModeCrtc* crtc = drmModeGetCrtc(m_DrmFd, m_CrtcId);
+            if (crtc != nullptr) {
+                crtcIndex = i;
+                m_OutputRect.w = crtc->width;
+                m_OutputRect.h = crtc->height;
+                drmModeFreeCrtc(crtc);
+            }
+            break;
+        }
+    }
+
+    drmModeFreeResources(resources);
+
+    if (crtcIndex < 0 || m_OutputRect.w == 0 || m_OutputRect.h == 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to find an active CRTC for connector %u",
+                     m_ConnectorId);
+        return false;
+    }
+
+    // Overlay planes are invisible without universal planes, but we'll use
+    // the primary plane too if it's the only one that can scan out video.
+    drmSetClientCap(m_DrmFd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
+    drmModePlaneRes* planeRes = drmModeGetPlaneResources(m_DrmFd);
+    if (planeRes == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeGetPlaneResources() failed: %d",
+                     errno);
+        return false;
+    }
+
+    // Find a plane on our CRTC that can scan out our decoded format directly,
+    // preferring a free overlay plane over the primary plane.
+    uint32_t primaryPlaneId = 0;
+    for (uint32_t i = 0; i < planeRes->count_planes && m_PlaneId == 0; i++) {
+        drmModePlane* plane = drmModeGetPlane(m_DrmFd, planeRes->planes[i]);
+        if (plane == nullptr) {
+            continue;
+        }
+
+        bool matchingFormat = false;
+        for (uint32_t j = 0; j < plane->count_formats && !matchingFormat; j++) {
+            if (m_Main10Hdr) {
+                switch (plane->formats[j]) {
+                case DRM_FORMAT_P010:
+                case DRM_FORMAT_P030:
+                case DRM_FORMAT_NV12_10:
+                    matchingFormat = true;
+                    break;
+                }
+            }
+            else {
+                matchingFormat = plane->formats[j] == DRM_FORMAT_NV12;
+            }
+        }
+
+        if (matchingFormat && (plane->possible_crtcs & (1 << crtcIndex))) {
+            drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, plane->plane_id, DRM_MODE_OBJECT_PLANE);
+            if (props != nullptr) {
+                for (uint32_t j = 0; j < props->count_props; j++) {
+                    drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[j]);
+                    if (prop != nullptr) {
+                        if (!strcmp(prop->name, "type")) {
+                            if (props->prop_values[j] == DRM_PLANE_TYPE_OVERLAY && plane->crtc_id == 0) {
+                                m_PlaneId = plane->plane_id;
+                            }
+                            else if (props->prop_values[j] == DRM_PLANE_TYPE_PRIMARY && primaryPlaneId == 0) {
+                                primaryPlaneId = plane->plane_id;
+                            }
+                        }
+
+                        drmModeFreeProperty(prop);
+                    }
+                }
 
+                drmModeFreeObjectProperties(props);
+            }
+        }
+
+        drmModeFreePlane(plane);
+    }
+
+    drmModeFreePlaneResources(planeRes);
+
+    if (m_PlaneId == 0) {
+        m_PlaneId = primaryPlaneId;
+    }
+
+    if (m_PlaneId == 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Failed to find a suitable plane for %s video",
+                     m_Main10Hdr ? "10-bit" : "8-bit");
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Selected DRM plane %u on CRTC %u (%dx%d)",
+                m_PlaneId,
+                m_CrtcId,
+                m_OutputRect.w,
+                m_OutputRect.h);
+
+    // Look up the optional color properties of the plane
+    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, m_PlaneId, DRM_MODE_OBJECT_PLANE);
+    if (props != nullptr) {
+        for (uint32_t i = 0; i < props->count_props; i++) {
+            drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[i]);
+            if (prop != nullptr) {
+                if (!strcmp(prop->name, "COLOR_ENCODING")) {
+                    m_ColorEncodingProp = prop;
+                }
+                else if (!strcmp(prop->name, "COLOR_RANGE")) {
+                    m_ColorRangeProp = prop;
+                }
+                else {
+                    drmModeFreeProperty(prop);
+                }
+            }
+        }
+
+        drmModeFreeObjectProperties(props);
+    }
+
+    // And the HDR metadata property of the connector
+    props = drmModeObjectGetProperties(m_DrmFd, m_ConnectorId, DRM_MODE_OBJECT_CONNECTOR);
+    if (props != nullptr) {
+        for (uint32_t i = 0; i < props->count_props; i++) {
+            drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[i]);
+            if (prop != nullptr) {
+                if (!strcmp(prop->name, "HDR_OUTPUT_METADATA")) {
+                    m_HdrOutputMetadataProp = prop;
+                }
+                else {
+                    drmModeFreeProperty(prop);
+                }
+            }
+        }
+
+        drmModeFreeObjectProperties(props);
+    }
+
+    m_UseAtomic = initializeAtomic();
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using %s KMS presentation",
+                m_UseAtomic ? "atomic" : "legacy");
+
+    return true;
+}
+
+uint32_t DrmRenderer::getPropertyId(drmModeObjectPropertiesPtr props, const char* name)
+{
+    uint32_t propId = 0;
+
+    for (uint32_t i = 0; i < props->count_props && propId == 0; i++) {
+        drmModePropertyPtr prop = drmModeGetProperty(m_DrmFd, props->props[i]);
+        if (prop != nullptr) {
+            if (!strcmp(prop->name, name)) {
+                propId = prop->prop_id;
+            }
+
+            drmModeFreeProperty(prop);
+        }
+    }
+
+    return propId;
+}
+
+bool DrmRenderer::initializeAtomic()
+{
+    if (qgetenv("DRM_ATOMIC") == "0") {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Atomic modesetting disabled due to environment variable");
+        return false;
+    }
+
+    if (drmSetClientCap(m_DrmFd, DRM_CLIENT_CAP_ATOMIC, 1) < 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Atomic modesetting is not supported by this driver");
+        return false;
+    }
+
+    drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(m_DrmFd, m_PlaneId, DRM_MODE_OBJECT_PLANE);
+    if (props == nullptr) {
+        return false;
+    }
+
+    m_PlanePropIds.fbId = getPropertyId(props, "FB_ID");
+    m_PlanePropIds.crtcId = getPropertyId(props, "CRTC_ID");
+    m_PlanePropIds.srcX = getPropertyId(props, "SRC_X");
+    m_PlanePropIds.srcY = getPropertyId(props, "SRC_Y");
+    m_PlanePropIds.srcW = getPropertyId(props, "SRC_W");
+    m_PlanePropIds.srcH = getPropertyId(props, "SRC_H");
+    m_PlanePropIds.crtcX = getPropertyId(props, "CRTC_X");
+    m_PlanePropIds.crtcY = getPropertyId(props, "CRTC_Y");
+    m_PlanePropIds.crtcW = getPropertyId(props, "CRTC_W");
+    m_PlanePropIds.crtcH = getPropertyId(props, "CRTC_H");
+
+    // Optional - the kernel still waits for implicit fences without it
+    m_PlanePropIds.inFenceFd = getPropertyId(props, "IN_FENCE_FD");
+
+    drmModeFreeObjectProperties(props);
+
+    props = drmModeObjectGetProperties(m_DrmFd, m_CrtcId, DRM_MODE_OBJECT_CRTC);
+    if (props == nullptr) {
+        return false;
+    }
+
+    // We need the out fence to tell when each flip has completed
+    m_CrtcOutFencePtrPropId = getPropertyId(props, "OUT_FENCE_PTR");
+
+    drmModeFreeObjectProperties(props);
+
+    if (m_PlanePropIds.fbId == 0 || m_PlanePropIds.crtcId == 0 ||
+            m_PlanePropIds.srcX == 0 || m_PlanePropIds.srcY == 0 ||
+            m_PlanePropIds.srcW == 0 || m_PlanePropIds.srcH == 0 ||
+            m_PlanePropIds.crtcX == 0 || m_PlanePropIds.crtcY == 0 ||
+            m_PlanePropIds.crtcW == 0 || m_PlanePropIds.crtcH == 0 ||
+            m_CrtcOutFencePtrPropId == 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Missing required plane or CRTC properties for atomic modesetting");
+        return false;
+    }
+
+    return true;
 }
 
 enum AVPixelFormat DrmRenderer::getPreferredPixelFormat(int videoFormat)
@@ -219,12 +592,11 @@ void DrmRenderer::setHdrMode(bool enabled)
                     "HDR_OUTPUT_METADATA is unavailable on this display. Unable to enter HDR mode!");
     }
 }
-#include <QDebug>
 void DrmRenderer::renderFrame(AVFrame* frame)
 {
     AVDRMFrameDescriptor mappedFrame;
     AVDRMFrameDescriptor* drmFrame;
-    qDebug()<<"1";
+
     // If we are acting as the frontend renderer, we'll need to have the backend
     // map this frame into a DRM PRIME descriptor that we can render.
     if (m_BackendRenderer != nullptr) {
@@ -285,17 +657,17 @@ void DrmRenderer::renderFrame(AVFrame* frame)
         }
     }
 
-    // Remember the last FB object we created so we can free it
-    // when we are finished rendering this one (if successful).
-    uint32_t lastFbId = m_CurrentFbId;
+    // Grab the decoder's fence while we still hold the DMA-BUF
+    int inFenceFd = m_UseAtomic ? exportFrameFence(drmFrame) : -1;
 
     // Create a frame buffer object from the PRIME buffer
     // NB: It is an error to pass modifiers without DRM_MODE_FB_MODIFIERS set.
+    uint32_t fbId;
     err = drmModeAddFB2WithModifiers(m_DrmFd, frame->width, frame->height,
                                      drmFrame->layers[0].format,
                                      handles, pitches, offsets,
                                      (flags & DRM_MODE_FB_MODIFIERS) ? modifiers : NULL,
-                                     &m_CurrentFbId, flags);
+                                     &fbId, flags);
 
     if (m_BackendRenderer != nullptr) {
         SDL_assert(drmFrame == &mappedFrame);
@@ -306,10 +678,16 @@ void DrmRenderer::renderFrame(AVFrame* frame)
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "drmModeAddFB2WithModifiers() failed: %d",
                      errno);
-        m_CurrentFbId = lastFbId;
+        if (inFenceFd >= 0) {
+            close(inFenceFd);
+        }
         return;
     }
 
+    // With atomic modesetting, property changes are applied in the same
+    // commit as the frame that needs them.
+    drmModeAtomicReqPtr req = m_UseAtomic ? drmModeAtomicAlloc() : nullptr;
+
     int colorspace = getFrameColorspace(frame);
     bool fullRange = isFrameFullRange(frame);
 
@@ -323,8 +701,7 @@ void DrmRenderer::renderFrame(AVFrame* frame)
 
             for (i = 0; i < m_ColorRangeProp->count_enums; i++) {
                 if (!strcmp(desiredValue, m_ColorRangeProp->enums[i].name)) {
-                    err = drmModeObjectSetProperty(m_DrmFd, m_PlaneId, DRM_MODE_OBJECT_PLANE,
-                                                   m_ColorRangeProp->prop_id, m_ColorRangeProp->enums[i].value);
+                    err = setPlaneProperty(req, m_ColorRangeProp, m_ColorRangeProp->enums[i].value);
                     if (err == 0) {
                         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                                     "%s: %s",
@@ -333,7 +710,7 @@ void DrmRenderer::renderFrame(AVFrame* frame)
                     }
                     else {
                         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                                     "drmModeObjectSetProperty(%s) failed: %d",
+                                     "Failed to set %s: %d",
                                      m_ColorRangeProp->name,
                                      errno);
                         // Non-fatal
@@ -365,8 +742,7 @@ void DrmRenderer::renderFrame(AVFrame* frame)
 
             for (i = 0; i < m_ColorEncodingProp->count_enums; i++) {
                 if (!strcmp(desiredValue, m_ColorEncodingProp->enums[i].name)) {
-                    err = drmModeObjectSetProperty(m_DrmFd, m_PlaneId, DRM_MODE_OBJECT_PLANE,
-                                                   m_ColorEncodingProp->prop_id, m_ColorEncodingProp->enums[i].value);
+                    err = setPlaneProperty(req, m_ColorEncodingProp, m_ColorEncodingProp->enums[i].value);
                     if (err == 0) {
                         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                                     "%s: %s",
@@ -375,7 +751,7 @@ void DrmRenderer::renderFrame(AVFrame* frame)
                     }
                     else {
                         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                                     "drmModeObjectSetProperty(%s) failed: %d",
+                                     "Failed to set %s: %d",
                                      m_ColorEncodingProp->name,
                                      errno);
                         // Non-fatal
@@ -399,8 +775,21 @@ void DrmRenderer::renderFrame(AVFrame* frame)
         m_LastColorSpace = colorspace;
     }
 
+    if (req != nullptr) {
+        bool committed = commitFrameAtomic(req, frame, fbId, dst, inFenceFd);
+        drmModeAtomicFree(req);
+
+        if (!committed) {
+            drmModeRmFB(m_DrmFd, fbId);
+
+            // Make sure the color properties go out with the next commit
+            m_LastColorSpace = -1;
+        }
+        return;
+    }
+
     // Update the overlay
-    err = drmModeSetPlane(m_DrmFd, m_PlaneId, m_CrtcId, m_CurrentFbId, 0,
+    err = drmModeSetPlane(m_DrmFd, m_PlaneId, m_CrtcId, fbId, 0,
                           dst.x, dst.y,
                           dst.w, dst.h,
                           0, 0,
@@ -410,13 +799,168 @@ void DrmRenderer::renderFrame(AVFrame* frame)
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                      "drmModeSetPlane() failed: %d",
                      errno);
+        drmModeRmFB(m_DrmFd, fbId);
+        return;
+    }
+
+    // Free the previous FB object which has now been superseded
+    if (m_CurrentFbId != 0) {
         drmModeRmFB(m_DrmFd, m_CurrentFbId);
-        m_CurrentFbId = lastFbId;
+    }
+    m_CurrentFbId = fbId;
+}
+
+int DrmRenderer::setPlaneProperty(drmModeAtomicReqPtr req, drmModePropertyPtr prop, uint64_t value)
+{
+    if (req != nullptr) {
+        int err = drmModeAtomicAddProperty(req, m_PlaneId, prop->prop_id, value);
+        if (err < 0) {
+            errno = -err;
+            return err;
+        }
+
+        return 0;
+    }
+    else {
+        return drmModeObjectSetProperty(m_DrmFd, m_PlaneId, DRM_MODE_OBJECT_PLANE, prop->prop_id, value);
+    }
+}
+
+int DrmRenderer::exportFrameFence(AVDRMFrameDescriptor* drmFrame)
+{
+#ifdef DMA_BUF_IOCTL_EXPORT_SYNC_FILE
+    if (m_PlanePropIds.inFenceFd == 0) {
+        return -1;
+    }
+
+    // Composed layers live in a single object that the decoder
+    // writes all at once, so its fence covers every plane.
+    struct dma_buf_export_sync_file exportSyncFile = {};
+    exportSyncFile.flags = DMA_BUF_SYNC_READ;
+    exportSyncFile.fd = -1;
+    if (ioctl(drmFrame->objects[0].fd, DMA_BUF_IOCTL_EXPORT_SYNC_FILE, &exportSyncFile) < 0) {
+        // This requires Linux 6.0, so don't keep trying if it's unsupported
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Unable to export DMA-BUF fence: %d",
+                    errno);
+        m_PlanePropIds.inFenceFd = 0;
+        return -1;
+    }
+
+    return exportSyncFile.fd;
+#else
+    Q_UNUSED(drmFrame);
+    return -1;
+#endif
+}
+
+bool DrmRenderer::commitFrameAtomic(drmModeAtomicReqPtr req, AVFrame* frame, uint32_t fbId, const SDL_Rect& dst, int inFenceFd)
+{
+    int32_t outFenceFd = -1;
+
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.fbId, fbId);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.crtcId, m_CrtcId);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.srcX, 0);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.srcY, 0);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.srcW, (uint64_t)frame->width << 16);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.srcH, (uint64_t)frame->height << 16);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.crtcX, dst.x);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.crtcY, dst.y);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.crtcW, dst.w);
+    drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.crtcH, dst.h);
+    if (inFenceFd >= 0) {
+        drmModeAtomicAddProperty(req, m_PlaneId, m_PlanePropIds.inFenceFd, inFenceFd);
+    }
+    drmModeAtomicAddProperty(req, m_CrtcId, m_CrtcOutFencePtrPropId, (uint64_t)(uintptr_t)&outFenceFd);
+
+    // Only one flip may be pending at a time. This is normally a no-op
+    // because waitToRender() already waited for the last one.
+    waitForPendingFlip();
+    if (m_PendingFbId != 0) {
+        // The last flip never completed, so drop this frame rather than pile up behind it
+        return false;
+    }
+
+    int err = drmModeAtomicCommit(m_DrmFd, req, DRM_MODE_ATOMIC_NONBLOCK, nullptr);
+    if (err < 0 && errno == EBUSY) {
+        // Someone else has a flip queued on our CRTC, so wait our turn
+        err = drmModeAtomicCommit(m_DrmFd, req, 0, nullptr);
+    }
+
+    // The kernel holds its own reference to the in fence
+    if (inFenceFd >= 0) {
+        close(inFenceFd);
+    }
+
+    if (err < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeAtomicCommit() failed: %d",
+                     errno);
+        if (outFenceFd >= 0) {
+            close(outFenceFd);
+        }
+        return false;
+    }
+
+    // Keep the decoded surface alive while it's being scanned out
+    if (av_frame_ref(m_PendingFrame, frame) < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "av_frame_ref() failed. The decoder may overwrite this frame while it's on screen.");
+    }
+
+    m_PendingFbId = fbId;
+    m_PendingFlipFenceFd = outFenceFd;
+    return true;
+}
+
+// The out fence of an atomic commit signals when the flip has latched at V-sync,
+// which is also when the buffers from the frame before it stop being scanned out.
+void DrmRenderer::waitForPendingFlip()
+{
+    if (m_PendingFbId == 0) {
         return;
     }
 
+    if (m_PendingFlipFenceFd >= 0) {
+        struct pollfd pfd = {};
+        pfd.fd = m_PendingFlipFenceFd;
+        pfd.events = POLLIN;
+
+        int err;
+        do {
+            err = poll(&pfd, 1, 1000);
+        } while (err < 0 && errno == EINTR);
+
+        if (err == 0) {
+            // Don't leave the flip pending forever, or every later frame would
+            // be dropped in commitFrameAtomic(). Treat it as done so the next
+            // commit can replace it, even if that glitches the screen briefly.
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                         "Timed out waiting for page flip. Assuming it completed.");
+        }
+
+        close(m_PendingFlipFenceFd);
+        m_PendingFlipFenceFd = -1;
+    }
+
     // Free the previous FB object which has now been superseded
-    drmModeRmFB(m_DrmFd, lastFbId);
+    if (m_CurrentFbId != 0) {
+        drmModeRmFB(m_DrmFd, m_CurrentFbId);
+    }
+    m_CurrentFbId = m_PendingFbId;
+    m_PendingFbId = 0;
+
+    av_frame_unref(m_DisplayedFrame);
+    av_frame_move_ref(m_DisplayedFrame, m_PendingFrame);
+}
+
+void DrmRenderer::waitToRender()
+{
+    // Wait for the last frame to reach the screen before the Pacer picks
+    // the next one, so we always flip to the newest frame available.
+    if (m_UseAtomic) {
+        waitForPendingFlip();
+    }
 }
 
 bool DrmRenderer::needsTestFrame()
@@ -450,6 +994,11 @@ bool DrmRenderer::isDirectRenderingSupported()
     return m_SupportsDirectRendering;
 }
 
+uint32_t DrmRenderer::getDrmCrtcId()
+{
+    return m_CrtcId;
+}
+
 const char* DrmRenderer::getDrmColorEncodingValue(AVFrame* frame)
 {
     switch (getFrameColorspace(frame)) {
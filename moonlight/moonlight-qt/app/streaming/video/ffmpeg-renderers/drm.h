@@ -53,8 +53,10 @@ public:
     virtual int getRendererAttributes() override;
     virtual bool needsTestFrame() override;
     virtual bool testRenderFrame(AVFrame* frame) override;
+    virtual void waitToRender() override;
     virtual bool isDirectRenderingSupported() override;
     virtual void setHdrMode(bool enabled) override;
+    virtual uint32_t getDrmCrtcId() override;
 #ifdef HAVE_EGL
     virtual bool canExportEGL() override;
     virtual AVPixelFormat getEGLImagePixelFormat() override;
@@ -63,9 +65,18 @@ public:
     virtual void freeEGLImages(EGLDisplay dpy, EGLImage[EGL_MAX_PLANES]) override;
 #endif
 
+    // Returns true if DRM_KMS_SCANOUT is set to present frames directly on a plane
+    static bool isKmsScanoutEnabled();
+
 private:
     const char* getDrmColorEncodingValue(AVFrame* frame);
     const char* getDrmColorRangeValue(AVFrame* frame);
+    uint32_t getPropertyId(drmModeObjectPropertiesPtr props, const char* name);
+    bool initializeAtomic();
+    int setPlaneProperty(drmModeAtomicReqPtr req, drmModePropertyPtr prop, uint64_t value);
+    int exportFrameFence(AVDRMFrameDescriptor* drmFrame);
+    bool commitFrameAtomic(drmModeAtomicReqPtr req, AVFrame* frame, uint32_t fbId, const SDL_Rect& dst, int inFenceFd);
+    void waitForPendingFlip();
 
     IFFmpegRenderer* m_BackendRenderer;
     AVBufferRef* m_HwContext;
@@ -86,6 +97,22 @@ private:
     uint32_t m_HdrOutputMetadataBlobId;
     SDL_Rect m_OutputRect;
 
+    // Atomic modesetting state. Only one page flip can be in flight at a time, and
+    // the previous frame must stay alive until the flip that replaces it completes.
+    bool m_UseAtomic;
+    struct {
+        uint32_t fbId;
+        uint32_t crtcId;
+        uint32_t srcX, srcY, srcW, srcH;
+        uint32_t crtcX, crtcY, crtcW, crtcH;
+        uint32_t inFenceFd;
+    } m_PlanePropIds;
+    uint32_t m_CrtcOutFencePtrPropId;
+    int m_PendingFlipFenceFd;
+    uint32_t m_PendingFbId;
+    AVFrame* m_PendingFrame;
+    AVFrame* m_DisplayedFrame;
+
 #ifdef HAVE_EGL
     bool m_EGLExtDmaBuf;
     PFNEGLCREATEIMAGEPROC m_eglCreateImage;
@@ -33,6 +33,47 @@
 #define GL_UNPACK_ROW_LENGTH_EXT 0x0CF2
 #endif
 
+// These are core in OpenGL ES 3.0, but we only have the GLES 2.0 headers
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT_EXT
+#define GL_MAP_PERSISTENT_BIT_EXT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT_EXT
+#define GL_MAP_COHERENT_BIT_EXT 0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED 0x911D
+#endif
+
 typedef struct _OVERLAY_VERTEX
 {
     float x, y;
@@ -41,7 +82,6 @@ typedef struct _OVERLAY_VERTEX
 
 /* TODO:
  *  - handle more pixel formats
- *  - handle software decoding
  */
 
 /* DOC/misc:
@@ -81,6 +121,10 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         m_VAO(0),
         m_BlockingSwapBuffers(false),
         m_LastRenderSync(EGL_NO_SYNC),
+        m_AsyncFrameSync(false),
+        m_FrameEGLSyncs{},
+        m_FrameGLSyncs{},
+        m_FrameSyncIndex(0),
         m_LastFrame(av_frame_alloc()),
         m_glEGLImageTargetTexture2DOES(nullptr),
         m_glGenVertexArraysOES(nullptr),
@@ -90,9 +134,26 @@ EGLRenderer::EGLRenderer(IFFmpegRenderer *backendRenderer)
         m_eglCreateSyncKHR(nullptr),
         m_eglDestroySync(nullptr),
         m_eglClientWaitSync(nullptr),
+        m_glMapBufferRange(nullptr),
+        m_glUnmapBuffer(nullptr),
+        m_glBufferStorageEXT(nullptr),
+        m_glTexStorage2D(nullptr),
+        m_glFenceSync(nullptr),
+        m_glClientWaitSync(nullptr),
+        m_glDeleteSync(nullptr),
         m_GlesMajorVersion(0),
         m_GlesMinorVersion(0),
         m_HasExtUnpackSubimage(false),
+        m_UploadRing{},
+        m_UploadRingIndex(0),
+        m_UploadWidth(0),
+        m_UploadHeight(0),
+        m_UploadLinesize{},
+        m_UploadOffsets{},
+        m_UploadSize(0),
+        m_TotalUploadCopyTimeUs(0),
+        m_TotalUploadFenceWaitTimeUs(0),
+        m_UploadedFrames(0),
         m_DummyRenderer(nullptr)
 {
     SDL_assert(backendRenderer);
@@ -122,6 +183,14 @@ EGLRenderer::~EGLRenderer()
             SDL_assert(m_eglDestroySync != nullptr);
             m_eglDestroySync(m_EGLDisplay, m_LastRenderSync);
         }
+        for (int i = 0; i < EGL_MAX_FRAMES_IN_FLIGHT; i++) {
+            if (m_FrameEGLSyncs[i] != EGL_NO_SYNC) {
+                m_eglDestroySync(m_EGLDisplay, m_FrameEGLSyncs[i]);
+            }
+            if (m_FrameGLSyncs[i] != nullptr) {
+                m_glDeleteSync(m_FrameGLSyncs[i]);
+            }
+        }
         if (m_ShaderProgram) {
             glDeleteProgram(m_ShaderProgram);
         }
@@ -132,6 +201,7 @@ EGLRenderer::~EGLRenderer()
             SDL_assert(m_glDeleteVertexArraysOES != nullptr);
             m_glDeleteVertexArraysOES(1, &m_VAO);
         }
+        destroyUploadRing();
         for (int i = 0; i < EGL_MAX_PLANES; i++) {
             if (m_Textures[i] != 0) {
                 glDeleteTextures(1, &m_Textures[i]);
@@ -148,6 +218,13 @@ EGLRenderer::~EGLRenderer()
         SDL_GL_DeleteContext(m_Context);
     }
 
+    if (m_UploadedFrames != 0) {
+        EGL_LOG(Info, "Average software frame upload time: %.3f ms copying, %.3f ms waiting for the GPU (%u frames)",
+                m_TotalUploadCopyTimeUs / 1000.0 / m_UploadedFrames,
+                m_TotalUploadFenceWaitTimeUs / 1000.0 / m_UploadedFrames,
+                m_UploadedFrames);
+    }
+
     if (m_DummyRenderer) {
         SDL_DestroyRenderer(m_DummyRenderer);
     }
@@ -427,6 +504,18 @@ bool EGLRenderer::compileShaders() {
         m_ShaderProgramParams[NV12_PARAM_PLANE1] = glGetUniformLocation(m_ShaderProgram, "plane1");
         m_ShaderProgramParams[NV12_PARAM_PLANE2] = glGetUniformLocation(m_ShaderProgram, "plane2");
     }
+    else if (m_EGLImagePixelFormat == AV_PIX_FMT_YUV420P) {
+        m_ShaderProgram = compileShader("egl_nv12.vert", "egl_yuv420p.frag");
+        if (!m_ShaderProgram) {
+            return false;
+        }
+
+        m_ShaderProgramParams[NV12_PARAM_YUVMAT] = glGetUniformLocation(m_ShaderProgram, "yuvmat");
+        m_ShaderProgramParams[NV12_PARAM_OFFSET] = glGetUniformLocation(m_ShaderProgram, "offset");
+        m_ShaderProgramParams[NV12_PARAM_PLANE1] = glGetUniformLocation(m_ShaderProgram, "plane1");
+        m_ShaderProgramParams[NV12_PARAM_PLANE2] = glGetUniformLocation(m_ShaderProgram, "plane2");
+        m_ShaderProgramParams[YUV420P_PARAM_PLANE3] = glGetUniformLocation(m_ShaderProgram, "plane3");
+    }
     else if (m_EGLImagePixelFormat == AV_PIX_FMT_DRM_PRIME) {
         m_ShaderProgram = compileShader("egl_opaque.vert", "egl_opaque.frag");
         if (!m_ShaderProgram) {
@@ -644,6 +733,28 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
+    // Pixel buffer objects, immutable textures, and fences are all part of
+    // OpenGL ES 3.0. Persistent mappings additionally need GL_EXT_buffer_storage.
+    if (m_GlesMajorVersion >= 3) {
+        m_glMapBufferRange = (typeof(m_glMapBufferRange))eglGetProcAddress("glMapBufferRange");
+        m_glUnmapBuffer = (typeof(m_glUnmapBuffer))eglGetProcAddress("glUnmapBuffer");
+        m_glTexStorage2D = (typeof(m_glTexStorage2D))eglGetProcAddress("glTexStorage2D");
+        m_glFenceSync = (typeof(m_glFenceSync))eglGetProcAddress("glFenceSync");
+        m_glClientWaitSync = (typeof(m_glClientWaitSync))eglGetProcAddress("glClientWaitSync");
+        m_glDeleteSync = (typeof(m_glDeleteSync))eglGetProcAddress("glDeleteSync");
+
+        if (SDL_GL_ExtensionSupported("GL_EXT_buffer_storage")) {
+            m_glBufferStorageEXT = (typeof(m_glBufferStorageEXT))eglGetProcAddress("glBufferStorageEXT");
+        }
+    }
+
+    if (m_Backend->getEGLImagePixelFormat() == AV_PIX_FMT_YUV420P &&
+            (!m_glMapBufferRange || !m_glUnmapBuffer || !m_glTexStorage2D ||
+             !m_glFenceSync || !m_glClientWaitSync || !m_glDeleteSync)) {
+        EGL_LOG(Error, "Software frame upload requires OpenGL ES 3.0");
+        return false;
+    }
+
     // EGL_KHR_fence_sync is an extension for EGL 1.1+
     if (eglExtensions.isSupported("EGL_KHR_fence_sync")) {
         // eglCreateSyncKHR() has a slightly different prototype to eglCreateSync()
@@ -668,6 +779,18 @@ bool EGLRenderer::initialize(PDECODER_PARAMETERS params)
         m_eglClientWaitSync = nullptr;
     }
 
+    if (qgetenv("EGL_ASYNC_FENCES") == "1") {
+        // Prefer EGL fences, but GL fences from OpenGL ES 3.0 work too
+        if (m_eglClientWaitSync != nullptr || (m_glFenceSync && m_glClientWaitSync && m_glDeleteSync)) {
+            EGL_LOG(Info, "Using asynchronous frame fences (%s)",
+                    m_eglClientWaitSync != nullptr ? "EGL" : "GL");
+            m_AsyncFrameSync = true;
+        }
+        else {
+            EGL_LOG(Warn, "Asynchronous frame fences are not supported");
+        }
+    }
+
     /* Compute the video region size in order to keep the aspect ratio of the
      * video stream.
      */
@@ -874,6 +997,224 @@ bool EGLRenderer::specialize() {
     return err == GL_NO_ERROR;
 }
 
+bool EGLRenderer::initializeUploadRing(const AVFrame* frame)
+{
+    SDL_assert(m_glMapBufferRange != nullptr);
+    SDL_assert(m_glTexStorage2D != nullptr);
+
+    int chromaHeight = (frame->height + 1) / 2;
+
+    m_UploadWidth = frame->width;
+    m_UploadHeight = frame->height;
+    for (int i = 0; i < 3; i++) {
+        m_UploadLinesize[i] = frame->linesize[i];
+    }
+
+    // All 3 planes are packed into a single buffer using the decoder's pitch,
+    // so each plane is a single memcpy() and GL_UNPACK_ROW_LENGTH skips the padding.
+    m_UploadOffsets[0] = 0;
+    m_UploadOffsets[1] = m_UploadOffsets[0] + (size_t)frame->linesize[0] * frame->height;
+    m_UploadOffsets[2] = m_UploadOffsets[1] + (size_t)frame->linesize[1] * chromaHeight;
+    m_UploadSize = m_UploadOffsets[2] + (size_t)frame->linesize[2] * chromaHeight;
+
+    for (int i = 0; i < EGL_UPLOAD_RING_SIZE; i++) {
+        glGenBuffers(1, &m_UploadRing[i].pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_UploadRing[i].pbo);
+
+        if (m_glBufferStorageEXT != nullptr) {
+            // Map the buffer once for its entire lifetime. The fence on each
+            // slot is what keeps us from writing while the GPU is reading it.
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+            m_glBufferStorageEXT(GL_PIXEL_UNPACK_BUFFER, m_UploadSize, nullptr, flags);
+            m_UploadRing[i].mapping = m_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_UploadSize, flags);
+            if (m_UploadRing[i].mapping == nullptr) {
+                EGL_LOG(Error, "Failed to persistently map upload buffer: %d", glGetError());
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return false;
+            }
+        }
+        else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_UploadSize, nullptr, GL_STREAM_DRAW);
+        }
+
+        // Immutable textures are allocated once and then only updated
+        // with glTexSubImage2D(), which avoids reallocation on each frame.
+        glGenTextures(3, m_UploadRing[i].textures);
+        for (int j = 0; j < 3; j++) {
+            glBindTexture(GL_TEXTURE_2D, m_UploadRing[i].textures[j]);
+            m_glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8,
+                             j == 0 ? frame->width : (frame->width + 1) / 2,
+                             j == 0 ? frame->height : chromaHeight);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    EGL_LOG(Info, "Allocated %d %zu byte upload buffers (%s mapping)",
+            EGL_UPLOAD_RING_SIZE, m_UploadSize,
+            m_glBufferStorageEXT != nullptr ? "persistent" : "per-frame");
+
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        EGL_LOG(Error, "OpenGL error: %d", err);
+    }
+
+    return err == GL_NO_ERROR;
+}
+
+void EGLRenderer::destroyUploadRing()
+{
+    for (int i = 0; i < EGL_UPLOAD_RING_SIZE; i++) {
+        if (m_UploadRing[i].fence != nullptr) {
+            m_glDeleteSync(m_UploadRing[i].fence);
+        }
+        if (m_UploadRing[i].mapping != nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_UploadRing[i].pbo);
+            m_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        if (m_UploadRing[i].pbo != 0) {
+            glDeleteBuffers(1, &m_UploadRing[i].pbo);
+        }
+        for (int j = 0; j < 3; j++) {
+            if (m_UploadRing[i].textures[j] != 0) {
+                glDeleteTextures(1, &m_UploadRing[i].textures[j]);
+            }
+        }
+    }
+
+    SDL_zero(m_UploadRing);
+    m_UploadRingIndex = 0;
+    m_UploadWidth = m_UploadHeight = 0;
+    SDL_zero(m_UploadLinesize);
+    m_UploadSize = 0;
+}
+
+bool EGLRenderer::uploadSoftwareFrame(const AVFrame* frame)
+{
+    if (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P) {
+        EGL_LOG(Error, "Unsupported software frame format: %d", frame->format);
+        return false;
+    }
+
+    // Reallocate the ring if the frame geometry has changed
+    if (frame->width != m_UploadWidth || frame->height != m_UploadHeight ||
+            memcmp(frame->linesize, m_UploadLinesize, sizeof(m_UploadLinesize)) != 0) {
+        destroyUploadRing();
+        if (!initializeUploadRing(frame)) {
+            destroyUploadRing();
+            return false;
+        }
+    }
+
+    auto& slot = m_UploadRing[m_UploadRingIndex];
+    uint64_t startTimeUs = LiGetMicroseconds();
+
+    // Wait for the GPU to finish the last draw from this slot. With a
+    // ring of 3, this fence has almost always signalled by the time we
+    // come back around to it, so we rarely block here.
+    if (slot.fence != nullptr) {
+        if (m_glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL) == GL_WAIT_FAILED) {
+            EGL_LOG(Warn, "glClientWaitSync() failed: %d", glGetError());
+        }
+        m_glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    // Time the stall separately, since it depends on the GPU rather than our copy
+    uint64_t copyStartTimeUs = LiGetMicroseconds();
+    m_TotalUploadFenceWaitTimeUs += copyStartTimeUs - startTimeUs;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+
+    uint8_t* buffer = (uint8_t*)slot.mapping;
+    if (buffer == nullptr) {
+        // Without persistent mappings, map the whole buffer each frame. This
+        // is still unsynchronized because the fence has already been waited.
+        buffer = (uint8_t*)m_glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_UploadSize,
+                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (buffer == nullptr) {
+            EGL_LOG(Error, "Failed to map upload buffer: %d", glGetError());
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        size_t planeSize = (i + 1 < 3 ? m_UploadOffsets[i + 1] : m_UploadSize) - m_UploadOffsets[i];
+        memcpy(buffer + m_UploadOffsets[i], frame->data[i], planeSize);
+    }
+
+    if (slot.mapping == nullptr) {
+        m_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    // These copies from the PBO are queued and executed asynchronously by the GPU
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, slot.textures[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, frame->linesize[i]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                        i == 0 ? frame->width : (frame->width + 1) / 2,
+                        i == 0 ? frame->height : (frame->height + 1) / 2,
+                        GL_RED, GL_UNSIGNED_BYTE, (void*)m_UploadOffsets[i]);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_TotalUploadCopyTimeUs += LiGetMicroseconds() - copyStartTimeUs;
+    m_UploadedFrames++;
+
+    return true;
+}
+
+void EGLRenderer::insertFrameSync()
+{
+    // waitToRender() normally leaves this slot free, but it isn't called
+    // if the Pacer isn't using a render thread.
+    waitForFrameSync(m_FrameSyncIndex);
+
+    if (m_eglClientWaitSync != nullptr) {
+        if (m_eglCreateSync != nullptr) {
+            m_FrameEGLSyncs[m_FrameSyncIndex] = m_eglCreateSync(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
+        }
+        else {
+            SDL_assert(m_eglCreateSyncKHR != nullptr);
+            m_FrameEGLSyncs[m_FrameSyncIndex] = m_eglCreateSyncKHR(m_EGLDisplay, EGL_SYNC_FENCE, nullptr);
+        }
+    }
+    else {
+        m_FrameGLSyncs[m_FrameSyncIndex] = m_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    m_FrameSyncIndex = (m_FrameSyncIndex + 1) % EGL_MAX_FRAMES_IN_FLIGHT;
+}
+
+void EGLRenderer::waitForFrameSync(int index)
+{
+    if (m_FrameEGLSyncs[index] != EGL_NO_SYNC) {
+        m_eglClientWaitSync(m_EGLDisplay, m_FrameEGLSyncs[index], EGL_SYNC_FLUSH_COMMANDS_BIT, EGL_FOREVER);
+        m_eglDestroySync(m_EGLDisplay, m_FrameEGLSyncs[index]);
+        m_FrameEGLSyncs[index] = EGL_NO_SYNC;
+    }
+    else if (m_FrameGLSyncs[index] != nullptr) {
+        GLenum result;
+        do {
+            result = m_glClientWaitSync(m_FrameGLSyncs[index], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        if (result == GL_WAIT_FAILED) {
+            EGL_LOG(Warn, "glClientWaitSync() failed: %d", glGetError());
+        }
+        m_glDeleteSync(m_FrameGLSyncs[index]);
+        m_FrameGLSyncs[index] = nullptr;
+    }
+}
+
 void EGLRenderer::cleanupRenderContext()
 {
     // Detach the context from the render thread so the destructor can attach it
@@ -886,9 +1227,14 @@ void EGLRenderer::waitToRender()
     // See comment in renderFrame() for more details.
     SDL_GL_MakeCurrent(m_Window, m_Context);
 
+    if (m_AsyncFrameSync) {
+        // Only wait for the oldest frame still in flight, since we're about to reuse
+        // its buffer. The newer frames can keep running on the GPU in the meantime.
+        waitForFrameSync(m_FrameSyncIndex);
+    }
     // Wait for the previous buffer swap to finish before picking the next frame to render.
     // This way we'll get the latest available frame and render it without blocking.
-    if (m_BlockingSwapBuffers) {
+    else if (m_BlockingSwapBuffers) {
         // Try to use eglClientWaitSync() if the driver supports it
         if (m_LastRenderSync != EGL_NO_SYNC) {
             SDL_assert(m_eglClientWaitSync != nullptr);
@@ -951,13 +1297,20 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         }
     }
 
-    ssize_t plane_count = m_Backend->exportEGLImages(frame, m_EGLDisplay, imgs);
-    if (plane_count < 0)
-        return;
-    for (ssize_t i = 0; i < plane_count; ++i) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
-        m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, imgs[i]);
+    if (m_EGLImagePixelFormat == AV_PIX_FMT_YUV420P) {
+        // Software frames are uploaded by us rather than imported as EGLImages
+        if (!uploadSoftwareFrame(frame))
+            return;
+    }
+    else {
+        ssize_t plane_count = m_Backend->exportEGLImages(frame, m_EGLDisplay, imgs);
+        if (plane_count < 0)
+            return;
+        for (ssize_t i = 0; i < plane_count; ++i) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_EXTERNAL_OES, m_Textures[i]);
+            m_glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, imgs[i]);
+        }
     }
 
     //if(m_ImguiInited){
@@ -995,6 +1348,13 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         glUniform1i(m_ShaderProgramParams[NV12_PARAM_PLANE1], 0);
         glUniform1i(m_ShaderProgramParams[NV12_PARAM_PLANE2], 1);
     }
+    else if (m_EGLImagePixelFormat == AV_PIX_FMT_YUV420P) {
+        glUniformMatrix3fv(m_ShaderProgramParams[NV12_PARAM_YUVMAT], 1, GL_FALSE, getColorMatrix(frame));
+        glUniform3fv(m_ShaderProgramParams[NV12_PARAM_OFFSET], 1, getColorOffsets(frame));
+        glUniform1i(m_ShaderProgramParams[NV12_PARAM_PLANE1], 0);
+        glUniform1i(m_ShaderProgramParams[NV12_PARAM_PLANE2], 1);
+        glUniform1i(m_ShaderProgramParams[YUV420P_PARAM_PLANE3], 2);
+    }
     else if (m_EGLImagePixelFormat == AV_PIX_FMT_DRM_PRIME) {
         glUniform1i(m_ShaderProgramParams[OPAQUE_PARAM_TEXTURE], 0);
     }
@@ -1002,6 +1362,13 @@ void EGLRenderer::renderFrame(AVFrame* frame)
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     m_glBindVertexArrayOES(0);
 
+    if (m_EGLImagePixelFormat == AV_PIX_FMT_YUV420P) {
+        // This fence covers both the PBO copies and the draw sampling from
+        // the textures, so the slot can't be reused until both are done.
+        m_UploadRing[m_UploadRingIndex].fence = m_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_UploadRingIndex = (m_UploadRingIndex + 1) % EGL_UPLOAD_RING_SIZE;
+    }
+
     if(m_ImguiInited){
         //ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         mygui::InvokeUpdate();
@@ -1013,7 +1380,10 @@ void EGLRenderer::renderFrame(AVFrame* frame)
 
     SDL_GL_SwapWindow(m_Window);
 
-    if (m_BlockingSwapBuffers) {
+    if (m_AsyncFrameSync) {
+        insertFrameSync();
+    }
+    else if (m_BlockingSwapBuffers) {
         // This glClear() requires the new back buffer to complete. This ensures
         // our eglClientWaitSync() or glFinish() call in waitToRender() will not
         // return before the new buffer is actually ready for rendering.
@@ -1039,7 +1409,9 @@ void EGLRenderer::renderFrame(AVFrame* frame)
         }
     }
 
-    m_Backend->freeEGLImages(m_EGLDisplay, imgs);
+    if (m_EGLImagePixelFormat != AV_PIX_FMT_YUV420P) {
+        m_Backend->freeEGLImages(m_EGLDisplay, imgs);
+    }
 
     // Free the DMA-BUF backing the last frame now that it is definitely
     // no longer being used anymore. While the PRIME FD stays around until
@@ -1065,6 +1437,11 @@ bool EGLRenderer::testRenderFrame(AVFrame* frame)
     }
 #endif
 
+    // Software frames don't use EGLImages, so there's nothing to test
+    if (m_Backend->getEGLImagePixelFormat() == AV_PIX_FMT_YUV420P) {
+        return true;
+    }
+
     // Make sure we can get working EGLImages from the backend renderer.
     // Some devices (Raspberry Pi) will happily decode into DRM formats that
     // its own GL implementation won't accept in eglCreateImage().
@@ -30,6 +30,11 @@ private:
     const float *getColorMatrix(const AVFrame* frame);
     static int loadAndBuildShader(int shaderType, const char *filename);
     bool openDisplay(unsigned int platform, void* nativeDisplay);
+    bool initializeUploadRing(const AVFrame* frame);
+    void destroyUploadRing();
+    bool uploadSoftwareFrame(const AVFrame* frame);
+    void insertFrameSync();
+    void waitForFrameSync(int index);
 
     int m_ViewportWidth;
     int m_ViewportHeight;
@@ -50,6 +55,15 @@ private:
     unsigned int m_VAO;
     bool m_BlockingSwapBuffers;
     EGLSync m_LastRenderSync;
+
+    // With EGL_ASYNC_FENCES=1, each frame gets a fence after the buffer swap
+    // and we only wait for it when that frame's buffer is about to be reused,
+    // rather than waiting for the GPU to go idle after every frame.
+#define EGL_MAX_FRAMES_IN_FLIGHT 2
+    bool m_AsyncFrameSync;
+    EGLSync m_FrameEGLSyncs[EGL_MAX_FRAMES_IN_FLIGHT];
+    GLsync m_FrameGLSyncs[EGL_MAX_FRAMES_IN_FLIGHT];
+    int m_FrameSyncIndex;
     AVFrame* m_LastFrame;
     PFNGLEGLIMAGETARGETTEXTURE2DOESPROC m_glEGLImageTargetTexture2DOES;
     PFNGLGENVERTEXARRAYSOESPROC m_glGenVertexArraysOES;
@@ -59,6 +73,13 @@ private:
     PFNEGLCREATESYNCKHRPROC m_eglCreateSyncKHR;
     PFNEGLDESTROYSYNCPROC m_eglDestroySync;
     PFNEGLCLIENTWAITSYNCPROC m_eglClientWaitSync;
+    PFNGLMAPBUFFERRANGEEXTPROC m_glMapBufferRange;
+    PFNGLUNMAPBUFFEROESPROC m_glUnmapBuffer;
+    PFNGLBUFFERSTORAGEEXTPROC m_glBufferStorageEXT;
+    PFNGLTEXSTORAGE2DEXTPROC m_glTexStorage2D;
+    PFNGLFENCESYNCAPPLEPROC m_glFenceSync;
+    PFNGLCLIENTWAITSYNCAPPLEPROC m_glClientWaitSync;
+    PFNGLDELETESYNCAPPLEPROC m_glDeleteSync;
     int m_GlesMajorVersion;
     int m_GlesMinorVersion;
     bool m_HasExtUnpackSubimage;
@@ -67,8 +88,30 @@ private:
 #define NV12_PARAM_OFFSET 1
 #define NV12_PARAM_PLANE1 2
 #define NV12_PARAM_PLANE2 3
+#define YUV420P_PARAM_PLANE3 4
 #define OPAQUE_PARAM_TEXTURE 0
-    int m_ShaderProgramParams[4];
+    int m_ShaderProgramParams[5];
+
+    // Software frames are copied into a ring of pixel buffer objects, so
+    // the CPU can fill the next buffer while the GPU is still uploading
+    // and drawing from the previous ones. Each slot has its own textures
+    // and a fence that is signalled once the draw using them completes.
+#define EGL_UPLOAD_RING_SIZE 3
+    struct {
+        unsigned pbo;
+        void* mapping;
+        GLsync fence;
+        unsigned textures[3];
+    } m_UploadRing[EGL_UPLOAD_RING_SIZE];
+    int m_UploadRingIndex;
+    int m_UploadWidth;
+    int m_UploadHeight;
+    int m_UploadLinesize[3];
+    size_t m_UploadOffsets[3];
+    size_t m_UploadSize;
+    uint64_t m_TotalUploadCopyTimeUs;
+    uint64_t m_TotalUploadFenceWaitTimeUs;
+    uint32_t m_UploadedFrames;
 
 #define OVERLAY_PARAM_TEXTURE 0
     int m_OverlayShaderProgramParams[1];
@@ -0,0 +1,93 @@
+#include "nullvid.h"
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+NullRenderer::NullRenderer(const AVCodecHWConfig* hwDecodeCfg)
+    : m_HwDecodeCfg(hwDecodeCfg),
+      m_HwContext(nullptr)
+{
+
+}
+
+NullRenderer::~NullRenderer()
+{
+    if (m_HwContext != nullptr) {
+        av_buffer_unref(&m_HwContext);
+    }
+}
+
+bool NullRenderer::isEnabled()
+{
+    return qgetenv("NULL_RENDERER") == "1";
+}
+
+bool NullRenderer::initialize(PDECODER_PARAMETERS)
+{
+    if (m_HwDecodeCfg == nullptr) {
+        // Nothing to do for software decoding
+        return true;
+    }
+
+    // We only support hwaccels that can create their own device
+    if (!(m_HwDecodeCfg->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)) {
+        return false;
+    }
+
+    int err = av_hwdevice_ctx_create(&m_HwContext, m_HwDecodeCfg->device_type, nullptr, nullptr, 0);
+    if (err < 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to create %s device for null renderer: %d",
+                    av_hwdevice_get_type_name(m_HwDecodeCfg->device_type),
+                    err);
+        return false;
+    }
+
+    return true;
+}
+
+bool NullRenderer::prepareDecoderContext(AVCodecContext* context, AVDictionary**)
+{
+    if (m_HwContext != nullptr) {
+        context->hw_device_ctx = av_buffer_ref(m_HwContext);
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using null renderer (%s decoding)",
+                m_HwContext != nullptr ? av_hwdevice_get_type_name(m_HwDecodeCfg->device_type) : "software");
+
+    return true;
+}
+
+void NullRenderer::renderFrame(AVFrame*)
+{
+    // Nothing to do. Hardware frames may still be decoding at this point
+    // since nobody reads them, so throughput is measured at submission.
+}
+
+void NullRenderer::waitToRender()
+{
+    // There is no swap chain to wait on. Pacing only comes from
+    // the V-sync source, which may be simulated for benchmarking.
+}
+
+enum AVPixelFormat NullRenderer::getPreferredPixelFormat(int videoFormat)
+{
+    if (m_HwDecodeCfg != nullptr) {
+        return m_HwDecodeCfg->pix_fmt;
+    }
+
+    return IFFmpegRenderer::getPreferredPixelFormat(videoFormat);
+}
+
+bool NullRenderer::isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat)
+{
+    if (m_HwDecodeCfg != nullptr) {
+        return pixelFormat == getPreferredPixelFormat(videoFormat);
+    }
+
+    // We never look at the pixels, so any software format will do
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pixelFormat);
+    return desc != nullptr && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "renderer.h"
+
+// Discards decoded frames instead of displaying them, so the decoder and
+// Pacer can be benchmarked on machines without a display. Hardware decoders
+// that only need a device context (like VAAPI on a render node) still work.
+// Set NULL_RENDERER=1 to use it in place of all other renderers.
+class NullRenderer : public IFFmpegRenderer {
+public:
+    NullRenderer(const AVCodecHWConfig* hwDecodeCfg);
+    virtual ~NullRenderer() override;
+
+    static bool isEnabled();
+
+    virtual bool initialize(PDECODER_PARAMETERS params) override;
+    virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
+    virtual void renderFrame(AVFrame* frame) override;
+    virtual void waitToRender() override;
+    virtual enum AVPixelFormat getPreferredPixelFormat(int videoFormat) override;
+    virtual bool isPixelFormatSupported(int videoFormat, enum AVPixelFormat pixelFormat) override;
+
+private:
+    const AVCodecHWConfig* m_HwDecodeCfg;
+    AVBufferRef* m_HwContext;
+};
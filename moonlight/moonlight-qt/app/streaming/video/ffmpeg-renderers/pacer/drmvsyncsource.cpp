@@ -0,0 +1,201 @@
+#include "drmvsyncsource.h"
+
+#include <xf86drmMode.h>
+
+#include <SDL_syswm.h>
+
+#if !SDL_VERSION_ATLEAST(2, 0, 15) || !defined(SDL_VIDEO_DRIVER_KMSDRM)
+#warning Unable to use DrmVsyncSource without SDL KMSDRM support
+#else
+
+DrmVsyncSource::DrmVsyncSource(Pacer* pacer, uint32_t crtcId)
+    : m_Pacer(pacer),
+      m_CrtcId(crtcId),
+      m_DrmFd(-1),
+      m_DisplayFps(0),
+      m_CrtcSelection(DRM_VBLANK_RELATIVE)
+{
+
+}
+
+DrmVsyncSource::~DrmVsyncSource()
+{
+    // The DRM FD is owned by SDL
+}
+
+uint32_t DrmVsyncSource::findSdlCrtcId(SDL_Window* window)
+{
+    int displayIndex = SDL_GetWindowDisplayIndex(window);
+    if (displayIndex < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_GetWindowDisplayIndex() failed: %s",
+                     SDL_GetError());
+        return 0;
+    }
+
+    drmModeRes* resources = drmModeGetResources(m_DrmFd);
+    if (resources == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeGetResources() failed: %d",
+                     errno);
+        return 0;
+    }
+
+    // SDL's KMSDRM backend creates a display for each connected connector
+    // in the order that DRM lists them, and scans each one out of the CRTC
+    // that its encoder is currently bound to.
+    uint32_t crtcId = 0;
+    int connectedDisplays = 0;
+    for (int i = 0; i < resources->count_connectors && crtcId == 0; i++) {
+        drmModeConnector* connector = drmModeGetConnector(m_DrmFd, resources->connectors[i]);
+        if (connector == nullptr) {
+            continue;
+        }
+
+        if (connector->connection == DRM_MODE_CONNECTED && connector->count_modes > 0) {
+            if (connectedDisplays++ == displayIndex) {
+                drmModeEncoder* encoder = drmModeGetEncoder(m_DrmFd, connector->encoder_id);
+                if (encoder != nullptr) {
+                    crtcId = encoder->crtc_id;
+                    drmModeFreeEncoder(encoder);
+                }
+
+                if (crtcId == 0) {
+                    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                                "Connector %u for display %d has no CRTC",
+                                connector->connector_id,
+                                displayIndex);
+                }
+                else {
+                    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                                "Window is on display %d (connector %u, CRTC %u)",
+                                displayIndex,
+                                connector->connector_id,
+                                crtcId);
+                }
+            }
+        }
+
+        drmModeFreeConnector(connector);
+    }
+
+    drmModeFreeResources(resources);
+    return crtcId;
+}
+
+bool DrmVsyncSource::initialize(SDL_Window* window, int displayFps)
+{
+    SDL_SysWMinfo info;
+
+    SDL_VERSION(&info.version);
+
+    if (!SDL_GetWindowWMInfo(window, &info)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "SDL_GetWindowWMInfo() failed: %s",
+                     SDL_GetError());
+        return false;
+    }
+
+    // Pacer should not create us for non-KMSDRM windows
+    SDL_assert(info.subsystem == SDL_SYSWM_KMSDRM);
+
+    m_DrmFd = info.info.kmsdrm.drm_fd;
+    m_DisplayFps = displayFps;
+
+    const char* crtcSource = "renderer";
+    if (m_CrtcId == 0) {
+        // SDL is presenting, so we need to match the CRTC it's using
+        m_CrtcId = findSdlCrtcId(window);
+        crtcSource = "SDL window";
+    }
+
+    drmModeRes* resources = drmModeGetResources(m_DrmFd);
+    if (resources == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmModeGetResources() failed: %d",
+                     errno);
+        return false;
+    }
+
+    // V-blank events are selected by the index of the CRTC rather than its ID
+    int crtcIndex = -1;
+    for (int i = 0; i < resources->count_crtcs && m_CrtcId != 0; i++) {
+        if (resources->crtcs[i] == m_CrtcId) {
+            crtcIndex = i;
+            break;
+        }
+    }
+
+    // If we couldn't tell which CRTC is in use, fall back to the first active one.
+    // This is only right if there's a single display.
+    for (int i = 0; i < resources->count_crtcs && crtcIndex < 0; i++) {
+        drmModeCrtc* crtc = drmModeGetCrtc(m_DrmFd, resources->crtcs[i]);
+        if (crtc != nullptr) {
+            if (crtc->mode_valid && crtc->buffer_id != 0) {
+                crtcIndex = i;
+                m_CrtcId = crtc->crtc_id;
+                crtcSource = "first active CRTC";
+            }
+
+            drmModeFreeCrtc(crtc);
+        }
+    }
+
+    drmModeFreeResources(resources);
+
+    if (crtcIndex < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "Unable to find an active CRTC for V-sync");
+        return false;
+    }
+    else if (crtcIndex == 1) {
+        m_CrtcSelection = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE | DRM_VBLANK_SECONDARY);
+    }
+    else if (crtcIndex > 1) {
+        m_CrtcSelection = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
+                                             ((crtcIndex << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK));
+    }
+
+    // Make sure we can actually wait on this CRTC
+    drmVBlank vbl = {};
+    vbl.request.type = m_CrtcSelection;
+    vbl.request.sequence = 0;
+    if (drmWaitVBlank(m_DrmFd, &vbl) < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmWaitVBlank() failed: %d",
+                     errno);
+        return false;
+    }
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using V-blank events from CRTC %u (index %d, from %s)",
+                m_CrtcId,
+                crtcIndex,
+                crtcSource);
+
+    return true;
+}
+
+bool DrmVsyncSource::isAsync()
+{
+    // We wait in the context of the Pacer thread
+    return false;
+}
+
+void DrmVsyncSource::waitForVsync()
+{
+    drmVBlank vbl = {};
+    vbl.request.type = m_CrtcSelection;
+    vbl.request.sequence = 1;
+
+    if (drmWaitVBlank(m_DrmFd, &vbl) < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                     "drmWaitVBlank() failed: %d",
+                     errno);
+
+        // Don't spin if the CRTC went away (DPMS off, VT switch, etc.)
+        SDL_Delay(1000 / m_DisplayFps);
+    }
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "pacer.h"
+
+#include <xf86drm.h>
+
+class DrmVsyncSource : public IVsyncSource
+{
+public:
+    // If crtcId is 0, we use the CRTC of the display SDL put the window on
+    DrmVsyncSource(Pacer* pacer, uint32_t crtcId);
+
+    virtual ~DrmVsyncSource();
+
+    virtual bool initialize(SDL_Window* window, int displayFps) override;
+
+    virtual bool isAsync() override;
+
+    virtual void waitForVsync() override;
+
+private:
+    uint32_t findSdlCrtcId(SDL_Window* window);
+
+    Pacer* m_Pacer;
+    uint32_t m_CrtcId;
+    int m_DrmFd;
+    int m_DisplayFps;
+    drmVBlankSeqType m_CrtcSelection;
+};
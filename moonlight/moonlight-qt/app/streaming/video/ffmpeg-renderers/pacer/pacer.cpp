@@ -1,4 +1,5 @@
 #include "pacer.h"
+#include "simulatedvsyncsource.h"
 #include "streaming/streamutils.h"
 
 #ifdef Q_OS_WIN32
@@ -12,6 +13,10 @@
 #include "waylandvsyncsource.h"
 #endif
 
+#ifdef HAVE_DRM
+#include "drmvsyncsource.h"
+#endif
+
 #include <SDL_syswm.h>
 
 // Limit the number of queued frames to prevent excessive memory consumption
@@ -28,6 +33,13 @@
 // V-sync happens.
 #define TIMER_SLACK_MS 3
 
+// In latency-targeting mode, frames are handed to the renderer a render
+// budget ahead of the predicted V-sync. The budget grows quickly when a
+// frame misses its V-sync and shrinks slowly while frames make it.
+#define MIN_RENDER_BUDGET_US 1000
+#define RENDER_BUDGET_MISS_STEP_US 500
+#define RENDER_BUDGET_HIT_STEP_US 20
+
 Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats) :
     m_RenderThread(nullptr),
     m_VsyncThread(nullptr),
@@ -36,7 +48,14 @@ Pacer::Pacer(IFFmpegRenderer* renderer, PVIDEO_STATS videoStats) :
     m_VsyncRenderer(renderer),
     m_MaxVideoFps(0),
     m_DisplayFps(0),
-    m_VideoStats(videoStats)
+    m_VideoStats(videoStats),
+    m_LatencyTargetMs(0),
+    m_VsyncPeriodUs(0),
+    m_LastVsyncUs(0),
+    m_NextVsyncUs(0),
+    m_RenderBudgetUs(TIMER_SLACK_MS * 1000),
+    m_PendingDeadlineVsyncUs(0),
+    m_PresentDeadlineMissed(false)
 {
 
 }
@@ -125,7 +144,12 @@ int Pacer::vsyncThread(void *context)
             break;
         }
 
-        me->handleVsync(1000 / me->m_DisplayFps);
+        if (me->m_LatencyTargetMs > 0) {
+            me->handleVsyncWithLatencyTarget();
+        }
+        else {
+            me->handleVsync(1000 / me->m_DisplayFps);
+        }
     }
 
     return 0;
@@ -143,7 +167,9 @@ int Pacer::renderThread(void* context)
 
     while (!me->m_Stopping) {
         // Wait for the renderer to be ready for the next frame
+        uint64_t beforeWaitUs = LiGetMicroseconds();
         me->m_VsyncRenderer->waitToRender();
+        me->m_VideoStats->totalRenderBlockedTimeUs += LiGetMicroseconds() - beforeWaitUs;
 
         // Acquire the frame queue lock to protect the queue and
         // the not empty condition
@@ -256,47 +282,151 @@ void Pacer::handleVsync(int timeUntilNextVsyncMillis)
     enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
 }
 
-bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
+// Called by the V-sync thread instead of handleVsync() when a latency target is set.
+// Rather than presenting frames as soon as possible after V-sync and keeping a few
+// queued to absorb jitter, this waits until just before the next V-sync deadline
+// and presents the oldest frame that is still within the latency target.
+void Pacer::handleVsyncWithLatencyTarget()
 {
+    uint64_t vsyncTimeUs = LiGetMicroseconds();
+
+    m_FrameQueueLock.lock();
+
+    updateVsyncEstimate(vsyncTimeUs);
+
+    uint64_t deadlineUs = vsyncTimeUs;
+    if (m_NextVsyncUs > vsyncTimeUs + m_RenderBudgetUs) {
+        deadlineUs = m_NextVsyncUs - m_RenderBudgetUs;
+    }
+
+    m_PresentDeadlineMissed = false;
+
+    // Wait for the deadline, letting newer frames arrive in the meantime. The wait
+    // only has millisecond granularity, so we may stop up to 1 ms early.
+    while (!m_Stopping) {
+        uint64_t nowUs = LiGetMicroseconds();
+        if (nowUs + 1000 > deadlineUs) {
+            break;
+        }
+
+        m_PacingQueueNotEmpty.wait(&m_FrameQueueLock, (unsigned long)((deadlineUs - nowUs) / 1000));
+    }
+
+    if (m_Stopping) {
+        m_FrameQueueLock.unlock();
+        return;
+    }
+
+    if (m_PacingQueue.isEmpty()) {
+        // No frame made this V-sync, so submitFrame() will present the next one
+        // immediately rather than holding it until the next deadline.
+        m_PresentDeadlineMissed = true;
+        m_FrameQueueLock.unlock();
+        return;
+    }
+
+    // Drop frames that have been queued longer than the latency target as long
+    // as there's a newer frame to show instead
+    Uint32 now = SDL_GetTicks();
+    while (m_PacingQueue.count() > 1 && (int)(now - (Uint32)m_PacingQueue.head()->pkt_dts) > m_LatencyTargetMs) {
+        AVFrame* frame = m_PacingQueue.dequeue();
+
+        // Drop the lock while we call av_frame_free()
+        m_FrameQueueLock.unlock();
+        m_VideoStats->pacerDroppedFrames++;
+        av_frame_free(&frame);
+        m_FrameQueueLock.lock();
+    }
+
+    // Remember which V-sync this frame is meant for so renderFrame() can tell if it missed
+    m_PendingDeadlineVsyncUs = m_NextVsyncUs;
+    enqueueFrameForRenderingAndUnlock(m_PacingQueue.dequeue());
+}
+
+// Tracks the V-sync period and phase from the times the V-sync thread is woken up
+void Pacer::updateVsyncEstimate(uint64_t vsyncTimeUs)
+{
+    if (m_LastVsyncUs != 0) {
+        uint64_t intervalUs = vsyncTimeUs - m_LastVsyncUs;
+
+        // Ignore intervals that span a missed V-sync or come from a spurious wakeup
+        if (intervalUs > m_VsyncPeriodUs / 2 && intervalUs < m_VsyncPeriodUs * 3 / 2) {
+            m_VsyncPeriodUs = (m_VsyncPeriodUs * 15 + intervalUs) / 16;
+        }
+    }
+    m_LastVsyncUs = vsyncTimeUs;
+
+    // Our wakeups jitter around the actual V-sync, so only nudge the predicted
+    // phase toward the observed one unless we've lost track of it entirely.
+    if (m_NextVsyncUs != 0 &&
+            vsyncTimeUs + m_VsyncPeriodUs / 2 > m_NextVsyncUs &&
+            vsyncTimeUs < m_NextVsyncUs + m_VsyncPeriodUs / 2) {
+        int64_t errorUs = (int64_t)(vsyncTimeUs - m_NextVsyncUs);
+        m_NextVsyncUs += errorUs / 8 + m_VsyncPeriodUs;
+    }
+    else {
+        m_NextVsyncUs = vsyncTimeUs + m_VsyncPeriodUs;
+    }
+}
+
+bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing, int latencyTargetMs)
+{
+    int simulatedVsyncRate = SimulatedVsyncSource::getRateFromEnvironment();
+
     m_MaxVideoFps = maxVideoFps;
-    m_DisplayFps = StreamUtils::getDisplayRefreshRate(window);
+    m_DisplayFps = simulatedVsyncRate > 0 ?
+                simulatedVsyncRate : StreamUtils::getDisplayRefreshRate(window);
     m_RendererAttributes = m_VsyncRenderer->getRendererAttributes();
+    m_VsyncPeriodUs = 1000000 / m_DisplayFps;
 
     if (enablePacing) {
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                     "Frame pacing: target %d Hz with %d FPS stream",
                     m_DisplayFps, m_MaxVideoFps);
 
-        SDL_SysWMinfo info;
-        SDL_VERSION(&info.version);
-        if (!SDL_GetWindowWMInfo(window, &info)) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
-                         "SDL_GetWindowWMInfo() failed: %s",
-                         SDL_GetError());
-            return false;
+        if (simulatedVsyncRate > 0) {
+            // This doesn't depend on the window system, so it also works
+            // with SDL's dummy video driver.
+            m_VsyncSource = new SimulatedVsyncSource(this);
         }
-
-        switch (info.subsystem) {
-    #ifdef Q_OS_WIN32
-        case SDL_SYSWM_WINDOWS:
-            // Don't use D3DKMTWaitForVerticalBlankEvent() on Windows 7, because
-            // it blocks during other concurrent DX operations (like actually rendering).
-            if (IsWindows8OrGreater()) {
-                m_VsyncSource = new DxVsyncSource(this);
+        else {
+            SDL_SysWMinfo info;
+            SDL_VERSION(&info.version);
+            if (!SDL_GetWindowWMInfo(window, &info)) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                             "SDL_GetWindowWMInfo() failed: %s",
+                             SDL_GetError());
+                return false;
             }
-            break;
-    #endif
 
-    #if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
-        case SDL_SYSWM_WAYLAND:
-            m_VsyncSource = new WaylandVsyncSource(this);
-            break;
-    #endif
+            switch (info.subsystem) {
+        #ifdef Q_OS_WIN32
+            case SDL_SYSWM_WINDOWS:
+                // Don't use D3DKMTWaitForVerticalBlankEvent() on Windows 7, because
+                // it blocks during other concurrent DX operations (like actually rendering).
+                if (IsWindows8OrGreater()) {
+                    m_VsyncSource = new DxVsyncSource(this);
+                }
+                break;
+        #endif
 
-        default:
-            // Platforms without a VsyncSource will just render frames
-            // immediately like they used to.
-            break;
+        #if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
+            case SDL_SYSWM_WAYLAND:
+                m_VsyncSource = new WaylandVsyncSource(this);
+                break;
+        #endif
+
+        #if SDL_VERSION_ATLEAST(2, 0, 15) && defined(SDL_VIDEO_DRIVER_KMSDRM) && defined(HAVE_DRM)
+            case SDL_SYSWM_KMSDRM:
+                m_VsyncSource = new DrmVsyncSource(this, m_VsyncRenderer->getDrmCrtcId());
+                break;
+        #endif
+
+            default:
+                // Platforms without a VsyncSource will just render frames
+                // immediately like they used to.
+                break;
+            }
         }
 
         SDL_assert(m_VsyncSource != nullptr || !(m_RendererAttributes & RENDERER_ATTRIBUTE_FORCE_PACING));
@@ -315,8 +445,19 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
     }
 
     if (m_VsyncSource != nullptr) {
+        if (latencyTargetMs > 0) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                        "Frame pacing latency target: %d ms",
+                        latencyTargetMs);
+            m_LatencyTargetMs = latencyTargetMs;
+        }
+
         m_VsyncThread = SDL_CreateThread(Pacer::vsyncThread, "PacerVsync", this);
     }
+    else if (enablePacing && latencyTargetMs > 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Frame pacing latency target requires a V-sync source");
+    }
 
     if (m_VsyncRenderer->isRenderThreadSupported()) {
         m_RenderThread = SDL_CreateThread(Pacer::renderThread, "PacerRender", this);
@@ -325,6 +466,11 @@ bool Pacer::initialize(SDL_Window* window, int maxVideoFps, bool enablePacing)
     return true;
 }
 
+int Pacer::getLatencyTarget()
+{
+    return m_LatencyTargetMs;
+}
+
 void Pacer::signalVsync()
 {
     m_VsyncSignalled.wakeOne();
@@ -339,6 +485,12 @@ void Pacer::renderFrame(AVFrame* frame)
     // Render it
     m_VsyncRenderer->renderFrame(frame);
     Uint32 afterRender = SDL_GetTicks();
+    uint64_t afterRenderUs = LiGetMicroseconds();
+
+    // FFmpegVideoDecoder stores the frame number in the opaque field
+    if (frame->opaque != nullptr) {
+        LiRecordVideoFrameTraceStage((int)(intptr_t)frame->opaque, FRAME_TRACE_STAGE_PRESENTED);
+    }
 
     m_VideoStats->totalRenderTime += afterRender - beforeRender;
     m_VideoStats->renderedFrames++;
@@ -347,6 +499,19 @@ void Pacer::renderFrame(AVFrame* frame)
     // Drop frames if we have too many queued up for a while
     m_FrameQueueLock.lock();
 
+    if (m_PendingDeadlineVsyncUs != 0) {
+        // Renderers that wait for V-sync return right after the V-sync they made,
+        // so finishing well past the V-sync this frame was meant for is a miss.
+        if (afterRenderUs > m_PendingDeadlineVsyncUs + m_VsyncPeriodUs / 2) {
+            m_RenderBudgetUs = SDL_min(m_RenderBudgetUs + RENDER_BUDGET_MISS_STEP_US, m_VsyncPeriodUs / 2);
+        }
+        else if (m_RenderBudgetUs > MIN_RENDER_BUDGET_US + RENDER_BUDGET_HIT_STEP_US) {
+            m_RenderBudgetUs -= RENDER_BUDGET_HIT_STEP_US;
+        }
+
+        m_PendingDeadlineVsyncUs = 0;
+    }
+
     int frameDropTarget;
 
     if (m_RendererAttributes & RENDERER_ATTRIBUTE_NO_BUFFERING) {
@@ -401,9 +566,19 @@ void Pacer::submitFrame(AVFrame* frame)
     // Make sure initialize() has been called
     SDL_assert(m_MaxVideoFps != 0);
 
+    if (frame->opaque != nullptr) {
+        LiRecordVideoFrameTraceStage((int)(intptr_t)frame->opaque, FRAME_TRACE_STAGE_PACER_QUEUED);
+    }
+
     // Queue the frame and possibly wake up the render thread
     m_FrameQueueLock.lock();
-    if (m_VsyncSource != nullptr) {
+    if (m_PresentDeadlineMissed && m_PacingQueue.isEmpty()) {
+        // The V-sync thread gave up waiting for this frame, so present it now
+        // instead of adding a V-sync worth of latency by holding it.
+        m_PresentDeadlineMissed = false;
+        enqueueFrameForRenderingAndUnlock(frame);
+    }
+    else if (m_VsyncSource != nullptr) {
         dropFrameForEnqueue(m_PacingQueue);
         m_PacingQueue.enqueue(frame);
         m_FrameQueueLock.unlock();
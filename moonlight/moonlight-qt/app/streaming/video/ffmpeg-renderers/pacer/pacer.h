@@ -31,12 +31,15 @@ public:
 
     void submitFrame(AVFrame* frame);
 
-    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing);
+    bool initialize(SDL_Window* window, int maxVideoFps, bool enablePacing, int latencyTargetMs);
 
     void signalVsync();
 
     void renderOnMainThread();
 
+    // Returns the queue latency target in milliseconds or 0 if not pacing to a target
+    int getLatencyTarget();
+
 private:
     static int vsyncThread(void* context);
 
@@ -44,6 +47,10 @@ private:
 
     void handleVsync(int timeUntilNextVsyncMillis);
 
+    void handleVsyncWithLatencyTarget();
+
+    void updateVsyncEstimate(uint64_t vsyncTimeUs);
+
     void enqueueFrameForRenderingAndUnlock(AVFrame* frame);
 
     void renderFrame(AVFrame* frame);
@@ -68,4 +75,13 @@ private:
     int m_DisplayFps;
     PVIDEO_STATS m_VideoStats;
     int m_RendererAttributes;
+
+    // Latency-targeting mode state (protected by m_FrameQueueLock)
+    int m_LatencyTargetMs;
+    uint64_t m_VsyncPeriodUs;
+    uint64_t m_LastVsyncUs;
+    uint64_t m_NextVsyncUs;
+    uint64_t m_RenderBudgetUs;
+    uint64_t m_PendingDeadlineVsyncUs;
+    bool m_PresentDeadlineMissed;
 };
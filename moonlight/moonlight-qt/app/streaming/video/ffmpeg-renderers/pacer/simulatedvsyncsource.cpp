@@ -0,0 +1,58 @@
+#include "simulatedvsyncsource.h"
+
+#include <Limelight.h>
+
+SimulatedVsyncSource::SimulatedVsyncSource(Pacer* pacer)
+    : m_Pacer(pacer),
+      m_PeriodUs(0),
+      m_NextVsyncUs(0)
+{
+
+}
+
+SimulatedVsyncSource::~SimulatedVsyncSource()
+{
+
+}
+
+int SimulatedVsyncSource::getRateFromEnvironment()
+{
+    bool ok;
+    int rate = qEnvironmentVariableIntValue("SIMULATED_VSYNC_HZ", &ok);
+    return ok ? qBound(0, rate, 1000) : 0;
+}
+
+bool SimulatedVsyncSource::initialize(SDL_Window*, int displayFps)
+{
+    // Pacer passes our own rate as the display refresh rate
+    m_PeriodUs = 1000000 / displayFps;
+    m_NextVsyncUs = LiGetMicroseconds() + m_PeriodUs;
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using simulated V-sync at %d Hz",
+                displayFps);
+
+    return true;
+}
+
+bool SimulatedVsyncSource::isAsync()
+{
+    // We wait in the context of the Pacer thread
+    return false;
+}
+
+void SimulatedVsyncSource::waitForVsync()
+{
+    uint64_t nowUs = LiGetMicroseconds();
+
+    if (nowUs < m_NextVsyncUs) {
+        // Like a real V-sync wait, this may wake up a little late
+        SDL_Delay((Uint32)((m_NextVsyncUs - nowUs + 999) / 1000));
+        m_NextVsyncUs += m_PeriodUs;
+    }
+    else {
+        // We were held up past one or more V-syncs, so skip ahead to the next
+        // one on the original schedule, as a display would.
+        m_NextVsyncUs += ((nowUs - m_NextVsyncUs) / m_PeriodUs + 1) * m_PeriodUs;
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "pacer.h"
+
+// Produces V-sync at a fixed rate instead of following a display, so the
+// Pacer can be exercised on machines without one. This is enabled by
+// setting SIMULATED_VSYNC_HZ to the desired refresh rate.
+class SimulatedVsyncSource : public IVsyncSource
+{
+public:
+    SimulatedVsyncSource(Pacer* pacer);
+
+    virtual ~SimulatedVsyncSource();
+
+    // Returns 0 if the simulated V-sync source is disabled
+    static int getRateFromEnvironment();
+
+    virtual bool initialize(SDL_Window* window, int displayFps) override;
+
+    virtual bool isAsync() override;
+
+    virtual void waitForVsync() override;
+
+private:
+    Pacer* m_Pacer;
+    uint64_t m_PeriodUs;
+    uint64_t m_NextVsyncUs;
+};
@@ -264,5 +264,10 @@ public:
     }
 
     virtual void unmapDrmPrimeFrame(AVDRMFrameDescriptor*) {}
+
+    // The CRTC this renderer presents on, or 0 if SDL does the presenting
+    virtual uint32_t getDrmCrtcId() {
+        return 0;
+    }
 #endif
 };
@@ -0,0 +1,75 @@
+#include "swframe.h"
+
+#include <Limelight.h>
+
+#include <QByteArray>
+
+SwFrameRenderer::SwFrameRenderer()
+{
+
+}
+
+SwFrameRenderer::~SwFrameRenderer()
+{
+
+}
+
+bool SwFrameRenderer::initialize(PDECODER_PARAMETERS params)
+{
+    if (qgetenv("EGL_SOFTWARE_FRAMES") != "1") {
+        return false;
+    }
+
+    // The EGLRenderer only has an upload path for 8-bit planar YUV
+    if (params->videoFormat & VIDEO_FORMAT_MASK_10BIT) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "EGL software frame upload does not support 10-bit video");
+        return false;
+    }
+
+    return true;
+}
+
+bool SwFrameRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
+{
+    /* Nothing to do */
+
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Using EGL software frame upload");
+
+    return true;
+}
+
+void SwFrameRenderer::renderFrame(AVFrame*)
+{
+    // Frames are always rendered by the EGLRenderer
+    SDL_assert(false);
+}
+
+bool SwFrameRenderer::isDirectRenderingSupported()
+{
+    return false;
+}
+
+bool SwFrameRenderer::isPixelFormatSupported(int videoFormat, AVPixelFormat pixelFormat)
+{
+    return pixelFormat == AV_PIX_FMT_YUVJ420P ||
+            IFFmpegRenderer::isPixelFormatSupported(videoFormat, pixelFormat);
+}
+
+bool SwFrameRenderer::canExportEGL()
+{
+    return true;
+}
+
+AVPixelFormat SwFrameRenderer::getEGLImagePixelFormat()
+{
+    // This tells the EGLRenderer to upload the planes itself
+    return AV_PIX_FMT_YUV420P;
+}
+
+bool SwFrameRenderer::initializeEGL(EGLDisplay, const EGLExtensions&)
+{
+    // We don't create any EGLImages
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "renderer.h"
+
+// Passes software-decoded YUV 4:2:0 frames to the EGLRenderer, which
+// streams them into textures itself rather than importing EGLImages.
+// This is opt-in via EGL_SOFTWARE_FRAMES=1 since the SdlRenderer is
+// still the default for software decoding.
+class SwFrameRenderer : public IFFmpegRenderer {
+public:
+    SwFrameRenderer();
+    virtual ~SwFrameRenderer() override;
+    virtual bool initialize(PDECODER_PARAMETERS params) override;
+    virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
+    virtual void renderFrame(AVFrame* frame) override;
+    virtual bool isDirectRenderingSupported() override;
+    virtual bool isPixelFormatSupported(int videoFormat, AVPixelFormat pixelFormat) override;
+    virtual bool canExportEGL() override;
+    virtual AVPixelFormat getEGLImagePixelFormat() override;
+    virtual bool initializeEGL(EGLDisplay dpy, const EGLExtensions &ext) override;
+};
@@ -0,0 +1,1879 @@
+#include "vulkanvid.h"
+#include "streaming/session.h"
+#include "streaming/streamutils.h"
+
+#include <libdrm/drm_fourcc.h>
+
+#include <QStringList>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <SDL_syswm.h>
+
+#if defined(SDL_VIDEO_DRIVER_X11) && defined(HAS_X11)
+#include <vulkan/vulkan_xlib.h>
+#endif
+
+#if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
+#include <vulkan/vulkan_wayland.h>
+#endif
+
+// Not present in some old libdrm headers
+#ifndef DRM_FORMAT_P010
+#define DRM_FORMAT_P010	fourcc_code('P', '0', '1', '0')
+#endif
+
+#ifndef DRM_FORMAT_R16
+#define DRM_FORMAT_R16 fourcc_code('R', '1', '6', ' ')
+#endif
+
+#ifndef DRM_FORMAT_GR1616
+#define DRM_FORMAT_GR1616 fourcc_code('G', 'R', '3', '2')
+#endif
+
+#define VULKAN_LOG(Category, ...) SDL_Log ## Category(\
+        SDL_LOG_CATEGORY_APPLICATION, \
+        "VulkanRenderer: " __VA_ARGS__)
+
+// Compiled from shaders/vk_yuv.comp at build time
+static const uint32_t k_YuvShader[] = {
+#include "vk_yuv.spv.h"
+};
+
+// Must match the push constant block in vk_yuv.comp. Each column
+// of a mat3 is padded out to the size of a vec4.
+typedef struct _VULKAN_CSC_PARAMS {
+    float yuvmat[12];
+    float offset[3];
+    int32_t chromaPlanes;
+    int32_t overlayRects[Overlay::OverlayMax][4];
+} VULKAN_CSC_PARAMS, *PVULKAN_CSC_PARAMS;
+
+static const VkImageSubresourceRange k_ColorSubresourceRange = {
+    VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1
+};
+
+static QStringList getDeviceExtensions(VkPhysicalDevice device)
+{
+    QStringList extensions;
+    uint32_t count = 0;
+
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr);
+
+    QVector<VkExtensionProperties> properties(count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &count, properties.data());
+
+    for (const VkExtensionProperties& property : properties) {
+        extensions.append(property.extensionName);
+    }
+
+    return extensions;
+}
+
+// Returns the Vulkan format of each plane in a DRM PRIME layer
+static int getDrmLayerPlaneFormats(uint32_t drmFormat, VkFormat formats[3])
+{
+    switch (drmFormat) {
+    case DRM_FORMAT_NV12:
+        formats[0] = VK_FORMAT_R8_UNORM;
+        formats[1] = VK_FORMAT_R8G8_UNORM;
+        return 2;
+    case DRM_FORMAT_P010:
+        formats[0] = VK_FORMAT_R16_UNORM;
+        formats[1] = VK_FORMAT_R16G16_UNORM;
+        return 2;
+    case DRM_FORMAT_YUV420:
+        formats[0] = formats[1] = formats[2] = VK_FORMAT_R8_UNORM;
+        return 3;
+
+    // Separate layers for each plane
+    case DRM_FORMAT_R8:
+        formats[0] = VK_FORMAT_R8_UNORM;
+        return 1;
+    case DRM_FORMAT_GR88:
+        formats[0] = VK_FORMAT_R8G8_UNORM;
+        return 1;
+    case DRM_FORMAT_R16:
+        formats[0] = VK_FORMAT_R16_UNORM;
+        return 1;
+    case DRM_FORMAT_GR1616:
+        formats[0] = VK_FORMAT_R16G16_UNORM;
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+VulkanRenderer::VulkanRenderer(IFFmpegRenderer* backendRenderer)
+    : m_Backend(backendRenderer),
+      m_Window(nullptr),
+      m_EnableVsync(false),
+      m_Instance(VK_NULL_HANDLE),
+      m_Surface(VK_NULL_HANDLE),
+      m_PhysicalDevice(VK_NULL_HANDLE),
+      m_MemoryProperties{},
+      m_QueueFamily(0),
+      m_Device(VK_NULL_HANDLE),
+      m_Queue(VK_NULL_HANDLE),
+      m_HasPresentWait(false),
+      m_vkGetMemoryFdPropertiesKHR(nullptr),
+#ifdef VK_KHR_present_wait
+      m_vkWaitForPresentKHR(nullptr),
+#endif
+      m_Swapchain(VK_NULL_HANDLE),
+      m_SwapchainFormat(VK_FORMAT_UNDEFINED),
+      m_SwapchainExtent{},
+      m_ExtentFromWindow(false),
+      m_SwapchainOutOfDate(false),
+      m_PresentId(0),
+      m_Sampler(VK_NULL_HANDLE),
+      m_DescriptorSetLayout(VK_NULL_HANDLE),
+      m_DescriptorPool(VK_NULL_HANDLE),
+      m_PipelineLayout(VK_NULL_HANDLE),
+      m_Pipeline(VK_NULL_HANDLE),
+      m_CommandPool(VK_NULL_HANDLE),
+      m_OutputImage{},
+      m_OutputWidth(0),
+      m_OutputHeight(0),
+      m_Timeline(VK_NULL_HANDLE),
+      m_TimelineValue(0),
+      m_Slots{},
+      m_SlotIndex(0),
+      m_Overlays{},
+      m_OverlayHasValidData{}
+{
+    SDL_assert(backendRenderer == nullptr || backendRenderer->canExportDrmPrime());
+}
+
+VulkanRenderer::~VulkanRenderer()
+{
+    if (m_Device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(m_Device);
+
+        for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+            releaseFrameSlot(i);
+
+            // Software frames keep their plane images between frames
+            for (int j = 0; j < m_Slots[i].planeCount; j++) {
+                destroyPlane(m_Slots[i].planes[j]);
+            }
+            if (m_Slots[i].stagingMapping != nullptr) {
+                vkUnmapMemory(m_Device, m_Slots[i].stagingMemory);
+            }
+            vkDestroyBuffer(m_Device, m_Slots[i].stagingBuffer, nullptr);
+            vkFreeMemory(m_Device, m_Slots[i].stagingMemory, nullptr);
+            vkDestroySemaphore(m_Device, m_Slots[i].acquireSemaphore, nullptr);
+        }
+
+        for (int i = 0; i < Overlay::OverlayMax; i++) {
+            destroyOverlay((Overlay::OverlayType)i);
+        }
+
+        destroyOutputImage();
+        destroySwapchain();
+
+        vkDestroySemaphore(m_Device, m_Timeline, nullptr);
+        vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
+        vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
+        vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
+        vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(m_Device, m_DescriptorSetLayout, nullptr);
+        vkDestroySampler(m_Device, m_Sampler, nullptr);
+        vkDestroyDevice(m_Device, nullptr);
+    }
+
+    if (m_Surface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
+    }
+
+    if (m_Instance != VK_NULL_HANDLE) {
+        vkDestroyInstance(m_Instance, nullptr);
+    }
+}
+
+bool VulkanRenderer::isEnabled()
+{
+    return qgetenv("VULKAN_RENDERER") == "1";
+}
+
+bool VulkanRenderer::createInstance(const char* surfaceExtension)
+{
+    const char* extensions[] = { VK_KHR_SURFACE_EXTENSION_NAME, surfaceExtension };
+
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Moonlight";
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+
+    VkInstanceCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+    createInfo.enabledExtensionCount = SDL_arraysize(extensions);
+    createInfo.ppEnabledExtensionNames = extensions;
+
+    VkResult res = vkCreateInstance(&createInfo, nullptr, &m_Instance);
+    if (res != VK_SUCCESS) {
+        m_Instance = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkCreateInstance() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::selectPhysicalDevice()
+{
+    QStringList requiredExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    if (m_Backend != nullptr) {
+        requiredExtensions << VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME
+                           << VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME
+                           << VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME
+                           << VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME;
+    }
+
+    uint32_t count = 0;
+    vkEnumeratePhysicalDevices(m_Instance, &count, nullptr);
+
+    QVector<VkPhysicalDevice> devices(count);
+    vkEnumeratePhysicalDevices(m_Instance, &count, devices.data());
+
+    int bestScore = 0;
+    for (VkPhysicalDevice device : devices) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            VULKAN_LOG(Info, "Skipping %s: Vulkan 1.2 is required", properties.deviceName);
+            continue;
+        }
+
+        QStringList extensions = getDeviceExtensions(device);
+        bool missingExtension = false;
+        for (const QString& extension : requiredExtensions) {
+            if (!extensions.contains(extension)) {
+                VULKAN_LOG(Info, "Skipping %s: %s is not supported",
+                           properties.deviceName, qPrintable(extension));
+                missingExtension = true;
+                break;
+            }
+        }
+        if (missingExtension) {
+            continue;
+        }
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+        if (!timelineFeatures.timelineSemaphore) {
+            VULKAN_LOG(Info, "Skipping %s: timeline semaphores are not supported", properties.deviceName);
+            continue;
+        }
+
+        // We need a queue that can run our compute shader, blit, and present
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+        QVector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+        int queueFamily = -1;
+        for (uint32_t i = 0; i < queueFamilyCount; i++) {
+            VkBool32 presentSupported = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_Surface, &presentSupported);
+
+            if (presentSupported &&
+                    (queueFamilies[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
+                queueFamily = i;
+                break;
+            }
+        }
+        if (queueFamily < 0) {
+            VULKAN_LOG(Info, "Skipping %s: no suitable queue", properties.deviceName);
+            continue;
+        }
+
+        // Only use a software implementation like lavapipe if there's nothing else
+        int score = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU ? 1 : 2;
+        if (score > bestScore) {
+            bestScore = score;
+            m_PhysicalDevice = device;
+            m_QueueFamily = queueFamily;
+        }
+    }
+
+    if (m_PhysicalDevice == VK_NULL_HANDLE) {
+        VULKAN_LOG(Error, "No suitable Vulkan device found");
+        return false;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+    VULKAN_LOG(Info, "Using %s (Vulkan %u.%u.%u)",
+               properties.deviceName,
+               VK_VERSION_MAJOR(properties.apiVersion),
+               VK_VERSION_MINOR(properties.apiVersion),
+               VK_VERSION_PATCH(properties.apiVersion));
+
+    vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &m_MemoryProperties);
+    return true;
+}
+
+bool VulkanRenderer::createDevice()
+{
+    QVector<const char*> extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    if (m_Backend != nullptr) {
+        extensions.append(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME);
+        extensions.append(VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME);
+        extensions.append(VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME);
+        extensions.append(VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME);
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
+
+#ifdef VK_KHR_present_wait
+    // Present wait lets us block until a given frame has actually been displayed,
+    // which is what we want for frame pacing. It requires present IDs.
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWaitFeatures.pNext = &presentIdFeatures;
+
+    QStringList deviceExtensions = getDeviceExtensions(m_PhysicalDevice);
+    if (deviceExtensions.contains(VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+            deviceExtensions.contains(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &presentWaitFeatures;
+        vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features);
+
+        if (presentIdFeatures.presentId && presentWaitFeatures.presentWait) {
+            extensions.append(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            extensions.append(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            presentIdFeatures.pNext = nullptr;
+            presentWaitFeatures.pNext = &presentIdFeatures;
+            timelineFeatures.pNext = &presentWaitFeatures;
+            m_HasPresentWait = true;
+        }
+    }
+#endif
+
+    float queuePriority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo = {};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = m_QueueFamily;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &queuePriority;
+
+    VkDeviceCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &timelineFeatures;
+    createInfo.queueCreateInfoCount = 1;
+    createInfo.pQueueCreateInfos = &queueInfo;
+    createInfo.enabledExtensionCount = extensions.size();
+    createInfo.ppEnabledExtensionNames = extensions.data();
+
+    VkResult res = vkCreateDevice(m_PhysicalDevice, &createInfo, nullptr, &m_Device);
+    if (res != VK_SUCCESS) {
+        m_Device = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkCreateDevice() failed: %d", res);
+        return false;
+    }
+
+    vkGetDeviceQueue(m_Device, m_QueueFamily, 0, &m_Queue);
+
+    if (m_Backend != nullptr) {
+        m_vkGetMemoryFdPropertiesKHR = (PFN_vkGetMemoryFdPropertiesKHR)vkGetDeviceProcAddr(m_Device, "vkGetMemoryFdPropertiesKHR");
+        if (m_vkGetMemoryFdPropertiesKHR == nullptr) {
+            VULKAN_LOG(Error, "vkGetMemoryFdPropertiesKHR() is missing");
+            return false;
+        }
+    }
+
+#ifdef VK_KHR_present_wait
+    if (m_HasPresentWait) {
+        m_vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(m_Device, "vkWaitForPresentKHR");
+        m_HasPresentWait = m_vkWaitForPresentKHR != nullptr;
+    }
+#endif
+
+    VULKAN_LOG(Info, "Present wait: %s", m_HasPresentWait ? "yes" : "no");
+    return true;
+}
+
+void VulkanRenderer::getWindowPixelSize(int* width, int* height)
+{
+#if SDL_VERSION_ATLEAST(2, 26, 0)
+    SDL_GetWindowSizeInPixels(m_Window, width, height);
+#else
+    SDL_GetWindowSize(m_Window, width, height);
+#endif
+}
+
+bool VulkanRenderer::createSwapchain()
+{
+    VkSurfaceCapabilitiesKHR caps;
+    VkResult res = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_PhysicalDevice, m_Surface, &caps);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR() failed: %d", res);
+        return false;
+    }
+
+    // We blit into the swapchain images rather than rendering to them
+    if (!(caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        VULKAN_LOG(Error, "Swapchain images can't be a transfer destination");
+        return false;
+    }
+
+    VkExtent2D extent = caps.currentExtent;
+    m_ExtentFromWindow = extent.width == UINT32_MAX;
+    if (m_ExtentFromWindow) {
+        // The surface size is determined by the swapchain (Wayland)
+        int width, height;
+        getWindowPixelSize(&width, &height);
+        extent.width = qBound(caps.minImageExtent.width, (uint32_t)width, caps.maxImageExtent.width);
+        extent.height = qBound(caps.minImageExtent.height, (uint32_t)height, caps.maxImageExtent.height);
+    }
+
+    if (extent.width == 0 || extent.height == 0) {
+        // The window is minimized
+        return false;
+    }
+
+    if (m_SwapchainFormat == VK_FORMAT_UNDEFINED) {
+        uint32_t formatCount = 0;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(m_PhysicalDevice, m_Surface, &formatCount, nullptr);
+
+        QVector<VkSurfaceFormatKHR> formats(formatCount);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(m_PhysicalDevice, m_Surface, &formatCount, formats.data());
+
+        // The compute shader output is already gamma encoded, so we
+        // need a UNORM format rather than an SRGB one.
+        for (const VkSurfaceFormatKHR& format : formats) {
+            if ((format.format == VK_FORMAT_B8G8R8A8_UNORM || format.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+                    format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                VkFormatProperties formatProperties;
+                vkGetPhysicalDeviceFormatProperties(m_PhysicalDevice, format.format, &formatProperties);
+                if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) {
+                    m_SwapchainFormat = format.format;
+                    break;
+                }
+            }
+        }
+
+        if (m_SwapchainFormat == VK_FORMAT_UNDEFINED) {
+            VULKAN_LOG(Error, "No suitable swapchain format");
+            return false;
+        }
+    }
+
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(m_PhysicalDevice, m_Surface, &presentModeCount, nullptr);
+
+    QVector<VkPresentModeKHR> presentModes(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(m_PhysicalDevice, m_Surface, &presentModeCount, presentModes.data());
+
+    // FIFO is always supported
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (!m_EnableVsync) {
+        if (presentModes.contains(VK_PRESENT_MODE_MAILBOX_KHR)) {
+            presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        else if (presentModes.contains(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+            presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+    }
+
+    uint32_t imageCount = caps.minImageCount + 1;
+    if (caps.maxImageCount != 0 && imageCount > caps.maxImageCount) {
+        imageCount = caps.maxImageCount;
+    }
+
+    VkSwapchainCreateInfoKHR createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = m_Surface;
+    createInfo.minImageCount = imageCount;
+    createInfo.imageFormat = m_SwapchainFormat;
+    createInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    createInfo.imageExtent = extent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.preTransform = caps.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = m_Swapchain;
+
+    if (!(caps.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR)) {
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+    }
+
+    VkSwapchainKHR swapchain;
+    res = vkCreateSwapchainKHR(m_Device, &createInfo, nullptr, &swapchain);
+
+    // The old swapchain is retired whether or not this succeeded
+    destroySwapchain();
+
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateSwapchainKHR() failed: %d", res);
+        return false;
+    }
+
+    m_Swapchain = swapchain;
+    m_SwapchainExtent = extent;
+    m_SwapchainOutOfDate = false;
+    m_PresentId = 0;
+
+    vkGetSwapchainImagesKHR(m_Device, m_Swapchain, &imageCount, nullptr);
+    m_SwapchainImages.resize(imageCount);
+    vkGetSwapchainImagesKHR(m_Device, m_Swapchain, &imageCount, m_SwapchainImages.data());
+
+    // Each image needs its own semaphore, since we don't know when
+    // the presentation engine is done waiting on the previous one.
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    m_RenderCompleteSemaphores.fill(VK_NULL_HANDLE, imageCount);
+    for (uint32_t i = 0; i < imageCount; i++) {
+        res = vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_RenderCompleteSemaphores[i]);
+        if (res != VK_SUCCESS) {
+            VULKAN_LOG(Error, "vkCreateSemaphore() failed: %d", res);
+            destroySwapchain();
+            return false;
+        }
+    }
+
+    VULKAN_LOG(Info, "Created %ux%u swapchain with %u images (present mode %d)",
+               extent.width, extent.height, imageCount, presentMode);
+    return true;
+}
+
+void VulkanRenderer::destroySwapchain()
+{
+    for (VkSemaphore semaphore : m_RenderCompleteSemaphores) {
+        vkDestroySemaphore(m_Device, semaphore, nullptr);
+    }
+    m_RenderCompleteSemaphores.clear();
+    m_SwapchainImages.clear();
+
+    if (m_Swapchain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(m_Device, m_Swapchain, nullptr);
+        m_Swapchain = VK_NULL_HANDLE;
+    }
+}
+
+bool VulkanRenderer::createPipeline()
+{
+    VkResult res;
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    res = vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_Sampler);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateSampler() failed: %d", res);
+        return false;
+    }
+
+    VkSampler overlaySamplers[Overlay::OverlayMax];
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        overlaySamplers[i] = m_Sampler;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[5] = {};
+    for (int i = 0; i < 3; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = &m_Sampler;
+    }
+    bindings[3].binding = 3;
+    bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[3].descriptorCount = 1;
+    bindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[4].binding = 4;
+    bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[4].descriptorCount = Overlay::OverlayMax;
+    bindings[4].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[4].pImmutableSamplers = overlaySamplers;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = SDL_arraysize(bindings);
+    layoutInfo.pBindings = bindings;
+    res = vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_DescriptorSetLayout);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateDescriptorSetLayout() failed: %d", res);
+        return false;
+    }
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(VULKAN_CSC_PARAMS);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_DescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    res = vkCreatePipelineLayout(m_Device, &pipelineLayoutInfo, nullptr, &m_PipelineLayout);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreatePipelineLayout() failed: %d", res);
+        return false;
+    }
+
+    VkShaderModuleCreateInfo shaderInfo = {};
+    shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderInfo.codeSize = sizeof(k_YuvShader);
+    shaderInfo.pCode = k_YuvShader;
+
+    VkShaderModule shaderModule;
+    res = vkCreateShaderModule(m_Device, &shaderInfo, nullptr, &shaderModule);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateShaderModule() failed: %d", res);
+        return false;
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_PipelineLayout;
+    res = vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipeline);
+    vkDestroyShaderModule(m_Device, shaderModule, nullptr);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateComputePipelines() failed: %d", res);
+        return false;
+    }
+
+    VkDescriptorPoolSize poolSizes[2] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = (3 + Overlay::OverlayMax) * VULKAN_FRAMES_IN_FLIGHT;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = VULKAN_FRAMES_IN_FLIGHT;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = VULKAN_FRAMES_IN_FLIGHT;
+    poolInfo.poolSizeCount = SDL_arraysize(poolSizes);
+    poolInfo.pPoolSizes = poolSizes;
+    res = vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_DescriptorPool);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateDescriptorPool() failed: %d", res);
+        return false;
+    }
+
+    VkCommandPoolCreateInfo commandPoolInfo = {};
+    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolInfo.queueFamilyIndex = m_QueueFamily;
+    res = vkCreateCommandPool(m_Device, &commandPoolInfo, nullptr, &m_CommandPool);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateCommandPool() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::createFrameSlots()
+{
+    VkResult res;
+
+    VkSemaphoreTypeCreateInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &timelineInfo;
+    res = vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_Timeline);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkCreateSemaphore() failed: %d", res);
+        return false;
+    }
+
+    VkCommandBuffer commandBuffers[VULKAN_FRAMES_IN_FLIGHT];
+    VkCommandBufferAllocateInfo commandBufferInfo = {};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.commandPool = m_CommandPool;
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandBufferCount = VULKAN_FRAMES_IN_FLIGHT;
+    res = vkAllocateCommandBuffers(m_Device, &commandBufferInfo, commandBuffers);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkAllocateCommandBuffers() failed: %d", res);
+        return false;
+    }
+
+    VkDescriptorSet descriptorSets[VULKAN_FRAMES_IN_FLIGHT];
+    VkDescriptorSetLayout setLayouts[VULKAN_FRAMES_IN_FLIGHT];
+    for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+        setLayouts[i] = m_DescriptorSetLayout;
+    }
+    VkDescriptorSetAllocateInfo descriptorSetInfo = {};
+    descriptorSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetInfo.descriptorPool = m_DescriptorPool;
+    descriptorSetInfo.descriptorSetCount = VULKAN_FRAMES_IN_FLIGHT;
+    descriptorSetInfo.pSetLayouts = setLayouts;
+    res = vkAllocateDescriptorSets(m_Device, &descriptorSetInfo, descriptorSets);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkAllocateDescriptorSets() failed: %d", res);
+        return false;
+    }
+
+    // The swapchain image acquire must be a binary semaphore
+    semaphoreInfo.pNext = nullptr;
+    for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+        m_Slots[i].commandBuffer = commandBuffers[i];
+        m_Slots[i].descriptorSet = descriptorSets[i];
+        m_Slots[i].uploadFormat = AV_PIX_FMT_NONE;
+
+        res = vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &m_Slots[i].acquireSemaphore);
+        if (res != VK_SUCCESS) {
+            VULKAN_LOG(Error, "vkCreateSemaphore() failed: %d", res);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::initialize(PDECODER_PARAMETERS params)
+{
+    m_Window = params->window;
+    m_EnableVsync = params->enableVsync;
+
+    // We only have an SDR swapchain and no PQ handling yet, so let
+    // the session fall back to a renderer that can display HDR.
+    if (params->videoFormat & VIDEO_FORMAT_MASK_10BIT) {
+        VULKAN_LOG(Info, "HDR is not supported");
+        return false;
+    }
+
+    SDL_SysWMinfo info;
+    SDL_VERSION(&info.version);
+    if (!SDL_GetWindowWMInfo(m_Window, &info)) {
+        VULKAN_LOG(Error, "SDL_GetWindowWMInfo() failed: %s", SDL_GetError());
+        return false;
+    }
+
+    // We create the surface ourselves, since SDL can only do it
+    // for windows created with SDL_WINDOW_VULKAN.
+    VkResult res;
+    switch (info.subsystem) {
+#if defined(SDL_VIDEO_DRIVER_X11) && defined(HAS_X11)
+    case SDL_SYSWM_X11:
+    {
+        if (!createInstance(VK_KHR_XLIB_SURFACE_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkXlibSurfaceCreateInfoKHR surfaceInfo = {};
+        surfaceInfo.sType = VK_STRUCTURE_TYPE_XLIB_SURFACE_CREATE_INFO_KHR;
+        surfaceInfo.dpy = info.info.x11.display;
+        surfaceInfo.window = info.info.x11.window;
+        res = vkCreateXlibSurfaceKHR(m_Instance, &surfaceInfo, nullptr, &m_Surface);
+        break;
+    }
+#endif
+#if defined(SDL_VIDEO_DRIVER_WAYLAND) && defined(HAS_WAYLAND)
+    case SDL_SYSWM_WAYLAND:
+    {
+        if (!createInstance(VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME)) {
+            return false;
+        }
+
+        VkWaylandSurfaceCreateInfoKHR surfaceInfo = {};
+        surfaceInfo.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
+        surfaceInfo.display = info.info.wl.display;
+        surfaceInfo.surface = info.info.wl.surface;
+        res = vkCreateWaylandSurfaceKHR(m_Instance, &surfaceInfo, nullptr, &m_Surface);
+        break;
+    }
+#endif
+    default:
+        VULKAN_LOG(Info, "Unsupported window system: %d", info.subsystem);
+        return false;
+    }
+
+    if (res != VK_SUCCESS) {
+        m_Surface = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "Failed to create Vulkan surface: %d", res);
+        return false;
+    }
+
+    return selectPhysicalDevice() &&
+            createDevice() &&
+            createSwapchain() &&
+            createPipeline() &&
+            createFrameSlots();
+}
+
+bool VulkanRenderer::prepareDecoderContext(AVCodecContext*, AVDictionary**)
+{
+    VULKAN_LOG(Info, "Using Vulkan renderer (%s frames)",
+               m_Backend != nullptr ? "DRM PRIME" : "software");
+
+    return true;
+}
+
+bool VulkanRenderer::isPixelFormatSupported(int videoFormat, AVPixelFormat pixelFormat)
+{
+    if (m_Backend != nullptr) {
+        // Pixel format support should be determined by the backend renderer
+        return m_Backend->isPixelFormatSupported(videoFormat, pixelFormat);
+    }
+
+    return !(videoFormat & VIDEO_FORMAT_MASK_10BIT) &&
+            (pixelFormat == AV_PIX_FMT_YUV420P || pixelFormat == AV_PIX_FMT_NV12);
+}
+
+AVPixelFormat VulkanRenderer::getPreferredPixelFormat(int videoFormat)
+{
+    if (m_Backend != nullptr) {
+        // Pixel format preference should be determined by the backend renderer
+        return m_Backend->getPreferredPixelFormat(videoFormat);
+    }
+
+    return AV_PIX_FMT_YUV420P;
+}
+
+uint32_t VulkanRenderer::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties)
+{
+    for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1 << i)) &&
+                (m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+bool VulkanRenderer::createPlaneImage(VulkanPlane& plane, VkFormat format, int width, int height,
+                                      VkImageTiling tiling, VkImageUsageFlags usage, const void* next)
+{
+    VkImageCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    createInfo.pNext = next;
+    createInfo.imageType = VK_IMAGE_TYPE_2D;
+    createInfo.format = format;
+    createInfo.extent.width = width;
+    createInfo.extent.height = height;
+    createInfo.extent.depth = 1;
+    createInfo.mipLevels = 1;
+    createInfo.arrayLayers = 1;
+    createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    createInfo.tiling = tiling;
+    createInfo.usage = usage;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkResult res = vkCreateImage(m_Device, &createInfo, nullptr, &plane.image);
+    if (res != VK_SUCCESS) {
+        plane.image = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkCreateImage() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::allocatePlaneMemory(VulkanPlane& plane, VkMemoryPropertyFlags properties)
+{
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(m_Device, plane.image, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+    if (allocateInfo.memoryTypeIndex == UINT32_MAX) {
+        allocateInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, 0);
+        if (allocateInfo.memoryTypeIndex == UINT32_MAX) {
+            VULKAN_LOG(Error, "No usable memory type for image (type bits: 0x%x)",
+                       requirements.memoryTypeBits);
+            return false;
+        }
+    }
+
+    VkResult res = vkAllocateMemory(m_Device, &allocateInfo, nullptr, &plane.memory);
+    if (res != VK_SUCCESS) {
+        plane.memory = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkAllocateMemory() failed: %d", res);
+        return false;
+    }
+
+    res = vkBindImageMemory(m_Device, plane.image, plane.memory, 0);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkBindImageMemory() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::createPlaneView(VulkanPlane& plane, VkFormat format)
+{
+    VkImageViewCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    createInfo.image = plane.image;
+    createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    createInfo.format = format;
+    createInfo.subresourceRange = k_ColorSubresourceRange;
+
+    VkResult res = vkCreateImageView(m_Device, &createInfo, nullptr, &plane.view);
+    if (res != VK_SUCCESS) {
+        plane.view = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkCreateImageView() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+void VulkanRenderer::destroyPlane(VulkanPlane& plane)
+{
+    vkDestroyImageView(m_Device, plane.view, nullptr);
+    vkDestroyImage(m_Device, plane.image, nullptr);
+    vkFreeMemory(m_Device, plane.memory, nullptr);
+    plane = {};
+}
+
+bool VulkanRenderer::createStagingBuffer(VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory)
+{
+    VkResult res;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    res = vkCreateBuffer(m_Device, &bufferInfo, nullptr, buffer);
+    if (res != VK_SUCCESS) {
+        *buffer = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkCreateBuffer() failed: %d", res);
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(m_Device, *buffer, &requirements);
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = requirements.size;
+    allocateInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (allocateInfo.memoryTypeIndex == UINT32_MAX) {
+        VULKAN_LOG(Error, "No host-visible coherent memory type for staging buffer");
+        return false;
+    }
+
+    res = vkAllocateMemory(m_Device, &allocateInfo, nullptr, memory);
+    if (res != VK_SUCCESS) {
+        *memory = VK_NULL_HANDLE;
+        VULKAN_LOG(Error, "vkAllocateMemory() failed: %d", res);
+        return false;
+    }
+
+    res = vkBindBufferMemory(m_Device, *buffer, *memory, 0);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkBindBufferMemory() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+void VulkanRenderer::notifyOverlayUpdated(Overlay::OverlayType type)
+{
+    // We upload the updated overlay in updateOverlay() on the render
+    // thread, since this is called on an arbitrary thread.
+    if (!Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        // If the overlay has been disabled, mark the data as invalid/stale.
+        SDL_AtomicSet(&m_OverlayHasValidData[type], 0);
+    }
+}
+
+void VulkanRenderer::updateOverlay(Overlay::OverlayType type)
+{
+    auto& overlay = m_Overlays[type];
+
+    // Do nothing if this overlay is disabled
+    if (!Session::get()->getOverlayManager().isOverlayEnabled(type)) {
+        return;
+    }
+
+    SDL_Surface* newSurface = Session::get()->getOverlayManager().getUpdatedOverlaySurface(type);
+    if (newSurface == nullptr) {
+        return;
+    }
+
+    SDL_assert(!SDL_MUSTLOCK(newSurface));
+    SDL_assert(newSurface->format->format == SDL_PIXELFORMAT_ARGB8888);
+    SDL_assert(newSurface->pitch % newSurface->format->BytesPerPixel == 0);
+
+    // A frame in flight may still be reading the old overlay image.
+    // Overlays change rarely enough that just waiting here is fine.
+    vkDeviceWaitIdle(m_Device);
+    SDL_AtomicSet(&m_OverlayHasValidData[type], 0);
+    destroyOverlay(type);
+
+    // ARGB8888 is stored as BGRA in memory on little-endian hosts
+    VkDeviceSize size = (VkDeviceSize)newSurface->pitch * newSurface->h;
+    void* mapping;
+    if (!createStagingBuffer(size, &overlay.stagingBuffer, &overlay.stagingMemory) ||
+            vkMapMemory(m_Device, overlay.stagingMemory, 0, VK_WHOLE_SIZE, 0, &mapping) != VK_SUCCESS) {
+        destroyOverlay(type);
+        SDL_FreeSurface(newSurface);
+        return;
+    }
+    memcpy(mapping, newSurface->pixels, size);
+    vkUnmapMemory(m_Device, overlay.stagingMemory);
+
+    if (!createPlaneImage(overlay.image, VK_FORMAT_B8G8R8A8_UNORM, newSurface->w, newSurface->h,
+                          VK_IMAGE_TILING_OPTIMAL,
+                          VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                          nullptr) ||
+            !allocatePlaneMemory(overlay.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ||
+            !createPlaneView(overlay.image, VK_FORMAT_B8G8R8A8_UNORM)) {
+        destroyOverlay(type);
+        SDL_FreeSurface(newSurface);
+        return;
+    }
+
+    // The copy into the image is recorded with the next frame
+    overlay.width = newSurface->w;
+    overlay.height = newSurface->h;
+    overlay.rowLength = newSurface->pitch / newSurface->format->BytesPerPixel;
+    overlay.uploadPending = true;
+
+    SDL_FreeSurface(newSurface);
+
+    SDL_AtomicSet(&m_OverlayHasValidData[type], 1);
+}
+
+void VulkanRenderer::destroyOverlay(Overlay::OverlayType type)
+{
+    auto& overlay = m_Overlays[type];
+
+    destroyPlane(overlay.image);
+    vkDestroyBuffer(m_Device, overlay.stagingBuffer, nullptr);
+    vkFreeMemory(m_Device, overlay.stagingMemory, nullptr);
+    overlay = {};
+}
+
+bool VulkanRenderer::createOutputImage(int width, int height)
+{
+    if (!createPlaneImage(m_OutputImage, VK_FORMAT_R8G8B8A8_UNORM, width, height,
+                          VK_IMAGE_TILING_OPTIMAL,
+                          VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                          nullptr) ||
+            !allocatePlaneMemory(m_OutputImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ||
+            !createPlaneView(m_OutputImage, VK_FORMAT_R8G8B8A8_UNORM)) {
+        destroyPlane(m_OutputImage);
+        return false;
+    }
+
+    m_OutputWidth = width;
+    m_OutputHeight = height;
+    return true;
+}
+
+void VulkanRenderer::destroyOutputImage()
+{
+    destroyPlane(m_OutputImage);
+    m_OutputWidth = m_OutputHeight = 0;
+}
+
+bool VulkanRenderer::importDrmPrimeFrame(const AVDRMFrameDescriptor* drmFrame, int width, int height, int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+
+    SDL_assert(slot.planeCount == 0);
+
+    // Each plane is imported as a separate image, so we don't need
+    // to care whether the planes were exported as separate layers.
+    for (int i = 0; i < drmFrame->nb_layers; i++) {
+        const AVDRMLayerDescriptor& layer = drmFrame->layers[i];
+        VkFormat formats[3];
+
+        if (getDrmLayerPlaneFormats(layer.format, formats) != layer.nb_planes) {
+            VULKAN_LOG(Error, "Unsupported DRM format: %x (%d planes)",
+                       layer.format, layer.nb_planes);
+            return false;
+        }
+
+        for (int j = 0; j < layer.nb_planes; j++) {
+            const AVDRMPlaneDescriptor& planeDesc = layer.planes[j];
+            const AVDRMObjectDescriptor& object = drmFrame->objects[planeDesc.object_index];
+            VkResult res;
+
+            if (slot.planeCount == 3) {
+                VULKAN_LOG(Error, "Too many planes in DRM PRIME frame");
+                return false;
+            }
+
+            // We can't guess the layout of a buffer without an explicit modifier
+            if (object.format_modifier == DRM_FORMAT_MOD_INVALID) {
+                VULKAN_LOG(Error, "DRM PRIME frame has no format modifier");
+                return false;
+            }
+
+            VkSubresourceLayout planeLayout = {};
+            planeLayout.offset = planeDesc.offset;
+            planeLayout.rowPitch = planeDesc.pitch;
+
+            VkImageDrmFormatModifierExplicitCreateInfoEXT modifierInfo = {};
+            modifierInfo.sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT;
+            modifierInfo.drmFormatModifier = object.format_modifier;
+            modifierInfo.drmFormatModifierPlaneCount = 1;
+            modifierInfo.pPlaneLayouts = &planeLayout;
+
+            VkExternalMemoryImageCreateInfo externalInfo = {};
+            externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+            externalInfo.pNext = &modifierInfo;
+            externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+
+            // The first plane is luma and the rest are 4:2:0 chroma
+            VulkanPlane& plane = slot.planes[slot.planeCount++];
+            int planeWidth = slot.planeCount == 1 ? width : (width + 1) / 2;
+            int planeHeight = slot.planeCount == 1 ? height : (height + 1) / 2;
+            if (!createPlaneImage(plane, formats[j], planeWidth, planeHeight,
+                                  VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+                                  VK_IMAGE_USAGE_SAMPLED_BIT,
+                                  &externalInfo)) {
+                return false;
+            }
+
+            VkMemoryFdPropertiesKHR fdProperties = {};
+            fdProperties.sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR;
+            res = m_vkGetMemoryFdPropertiesKHR(m_Device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+                                               object.fd, &fdProperties);
+            if (res != VK_SUCCESS) {
+                VULKAN_LOG(Error, "vkGetMemoryFdPropertiesKHR() failed: %d", res);
+                return false;
+            }
+
+            VkMemoryRequirements requirements;
+            vkGetImageMemoryRequirements(m_Device, plane.image, &requirements);
+
+            // Vulkan takes ownership of the FD when the import succeeds
+            int fd = fcntl(object.fd, F_DUPFD_CLOEXEC, 0);
+            if (fd < 0) {
+                VULKAN_LOG(Error, "Failed to duplicate DMA-BUF FD: %d", errno);
+                return false;
+            }
+
+            VkImportMemoryFdInfoKHR importInfo = {};
+            importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR;
+            importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+            importInfo.fd = fd;
+
+            VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+            dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+            dedicatedInfo.pNext = &importInfo;
+            dedicatedInfo.image = plane.image;
+
+            VkMemoryAllocateInfo allocateInfo = {};
+            allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocateInfo.pNext = &dedicatedInfo;
+            allocateInfo.allocationSize = requirements.size;
+            allocateInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits & fdProperties.memoryTypeBits, 0);
+            if (allocateInfo.memoryTypeIndex == UINT32_MAX) {
+                close(fd);
+                VULKAN_LOG(Error, "No memory type can import this DMA-BUF (image: 0x%x, FD: 0x%x)",
+                           requirements.memoryTypeBits,
+                           fdProperties.memoryTypeBits);
+                return false;
+            }
+
+            res = vkAllocateMemory(m_Device, &allocateInfo, nullptr, &plane.memory);
+            if (res != VK_SUCCESS) {
+                plane.memory = VK_NULL_HANDLE;
+                close(fd);
+                VULKAN_LOG(Error, "Failed to import DMA-BUF: %d", res);
+                return false;
+            }
+
+            res = vkBindImageMemory(m_Device, plane.image, plane.memory, 0);
+            if (res != VK_SUCCESS) {
+                VULKAN_LOG(Error, "vkBindImageMemory() failed: %d", res);
+                return false;
+            }
+
+            if (!createPlaneView(plane, formats[j])) {
+                return false;
+            }
+        }
+    }
+
+    if (slot.planeCount < 2) {
+        VULKAN_LOG(Error, "DRM PRIME frame has no chroma planes");
+        return false;
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::uploadSoftwareFrame(const AVFrame* frame, int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+    VkResult res;
+
+    if (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_NV12) {
+        VULKAN_LOG(Error, "Unsupported software frame format: %d", frame->format);
+        return false;
+    }
+
+    int planeCount = frame->format == AV_PIX_FMT_YUV420P ? 3 : 2;
+    int chromaHeight = (frame->height + 1) / 2;
+    VkDeviceSize frameSize = (VkDeviceSize)frame->linesize[0] * frame->height;
+    for (int i = 1; i < planeCount; i++) {
+        frameSize += (VkDeviceSize)frame->linesize[i] * chromaHeight;
+    }
+
+    // Recreate our plane images if the frame format or size changed
+    if (slot.uploadFormat != frame->format ||
+            slot.uploadWidth != frame->width ||
+            slot.uploadHeight != frame->height) {
+        for (int i = 0; i < slot.planeCount; i++) {
+            destroyPlane(slot.planes[i]);
+        }
+        slot.planeCount = 0;
+        slot.uploadFormat = AV_PIX_FMT_NONE;
+
+        for (int i = 0; i < planeCount; i++) {
+            VkFormat format = (frame->format == AV_PIX_FMT_NV12 && i == 1) ?
+                        VK_FORMAT_R8G8_UNORM : VK_FORMAT_R8_UNORM;
+            VulkanPlane& plane = slot.planes[slot.planeCount++];
+
+            if (!createPlaneImage(plane, format,
+                                  i == 0 ? frame->width : (frame->width + 1) / 2,
+                                  i == 0 ? frame->height : chromaHeight,
+                                  VK_IMAGE_TILING_OPTIMAL,
+                                  VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                  nullptr) ||
+                    !allocatePlaneMemory(plane, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ||
+                    !createPlaneView(plane, format)) {
+                return false;
+            }
+        }
+
+        slot.uploadFormat = frame->format;
+        slot.uploadWidth = frame->width;
+        slot.uploadHeight = frame->height;
+    }
+
+    // The staging buffer only grows, since the linesize may vary between frames
+    if (slot.stagingSize < frameSize) {
+        if (slot.stagingMapping != nullptr) {
+            vkUnmapMemory(m_Device, slot.stagingMemory);
+            slot.stagingMapping = nullptr;
+        }
+        vkDestroyBuffer(m_Device, slot.stagingBuffer, nullptr);
+        vkFreeMemory(m_Device, slot.stagingMemory, nullptr);
+        slot.stagingBuffer = VK_NULL_HANDLE;
+        slot.stagingMemory = VK_NULL_HANDLE;
+        slot.stagingSize = 0;
+
+        if (!createStagingBuffer(frameSize, &slot.stagingBuffer, &slot.stagingMemory)) {
+            return false;
+        }
+
+        res = vkMapMemory(m_Device, slot.stagingMemory, 0, VK_WHOLE_SIZE, 0, &slot.stagingMapping);
+        if (res != VK_SUCCESS) {
+            slot.stagingMapping = nullptr;
+            VULKAN_LOG(Error, "vkMapMemory() failed: %d", res);
+            return false;
+        }
+
+        slot.stagingSize = frameSize;
+    }
+
+    uint8_t* staging = (uint8_t*)slot.stagingMapping;
+    for (int i = 0; i < planeCount; i++) {
+        size_t planeSize = (size_t)frame->linesize[i] * (i == 0 ? frame->height : chromaHeight);
+        memcpy(staging, frame->data[i], planeSize);
+        staging += planeSize;
+    }
+
+    return true;
+}
+
+bool VulkanRenderer::waitForFrameSlot(int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+
+    if (slot.timelineValue == 0) {
+        // Never submitted
+        return true;
+    }
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_Timeline;
+    waitInfo.pValues = &slot.timelineValue;
+
+    VkResult res = vkWaitSemaphores(m_Device, &waitInfo, 1000 * 1000 * 1000);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkWaitSemaphores() failed: %d", res);
+        return false;
+    }
+
+    return true;
+}
+
+void VulkanRenderer::releaseFrameSlot(int slotIndex)
+{
+    auto& slot = m_Slots[slotIndex];
+
+    // Imported planes are only valid for the frame they came from
+    if (m_Backend != nullptr) {
+        for (int i = 0; i < slot.planeCount; i++) {
+            destroyPlane(slot.planes[i]);
+        }
+        slot.planeCount = 0;
+    }
+
+    av_frame_free(&slot.frame);
+}
+
+const float* VulkanRenderer::getColorOffsets(const AVFrame* frame)
+{
+    static const float limitedOffsets[] = { 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f };
+    static const float fullOffsets[] = { 0.0f, 128.0f / 255.0f, 128.0f / 255.0f };
+
+    return isFrameFullRange(frame) ? fullOffsets : limitedOffsets;
+}
+
+const float* VulkanRenderer::getColorMatrix(const AVFrame* frame)
+{
+    // These are the same column-major matrices that EGLRenderer uses
+    static const float bt601Lim[] = {
+        1.1644f, 1.1644f, 1.1644f,
+        0.0f, -0.3917f, 2.0172f,
+        1.5960f, -0.8129f, 0.0f
+    };
+    static const float bt601Full[] = {
+        1.0f, 1.0f, 1.0f,
+        0.0f, -0.3441f, 1.7720f,
+        1.4020f, -0.7141f, 0.0f
+    };
+    static const float bt709Lim[] = {
+        1.1644f, 1.1644f, 1.1644f,
+        0.0f, -0.2132f, 2.1124f,
+        1.7927f, -0.5329f, 0.0f
+    };
+    static const float bt709Full[] = {
+        1.0f, 1.0f, 1.0f,
+        0.0f, -0.1873f, 1.8556f,
+        1.5748f, -0.4681f, 0.0f
+    };
+    static const float bt2020Lim[] = {
+        1.1644f, 1.1644f, 1.1644f,
+        0.0f, -0.1874f, 2.1418f,
+        1.6781f, -0.6505f, 0.0f
+    };
+    static const float bt2020Full[] = {
+        1.0f, 1.0f, 1.0f,
+        0.0f, -0.1646f, 1.8814f,
+        1.4746f, -0.5714f, 0.0f
+    };
+
+    bool fullRange = isFrameFullRange(frame);
+    switch (getFrameColorspace(frame)) {
+        case COLORSPACE_REC_601:
+            return fullRange ? bt601Full : bt601Lim;
+        case COLORSPACE_REC_709:
+            return fullRange ? bt709Full : bt709Lim;
+        case COLORSPACE_REC_2020:
+            return fullRange ? bt2020Full : bt2020Lim;
+        default:
+            SDL_assert(false);
+    }
+
+    return bt601Lim;
+}
+
+void VulkanRenderer::recordCommands(int slotIndex, uint32_t imageIndex, const AVFrame* frame)
+{
+    auto& slot = m_Slots[slotIndex];
+    VkCommandBuffer cmd = slot.commandBuffer;
+    VkImage swapchainImage = m_SwapchainImages[imageIndex];
+
+    vkResetCommandBuffer(cmd, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmd, &beginInfo);
+
+    VkImageMemoryBarrier barriers[3] = {};
+    for (int i = 0; i < slot.planeCount; i++) {
+        barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[i].image = slot.planes[i].image;
+        barriers[i].subresourceRange = k_ColorSubresourceRange;
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+
+    if (m_Backend != nullptr) {
+        // Acquire the imported planes from the decoder, which is outside of Vulkan
+        for (int i = 0; i < slot.planeCount; i++) {
+            barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT;
+            barriers[i].dstQueueFamilyIndex = m_QueueFamily;
+            barriers[i].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, slot.planeCount, barriers);
+    }
+    else {
+        // Copy the software frame from the staging buffer into the plane images
+        for (int i = 0; i < slot.planeCount; i++) {
+            barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barriers[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        }
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, slot.planeCount, barriers);
+
+        VkDeviceSize offset = 0;
+        for (int i = 0; i < slot.planeCount; i++) {
+            int texelSize = (frame->format == AV_PIX_FMT_NV12 && i == 1) ? 2 : 1;
+            uint32_t planeHeight = i == 0 ? frame->height : (frame->height + 1) / 2;
+
+            VkBufferImageCopy region = {};
+            region.bufferOffset = offset;
+            region.bufferRowLength = frame->linesize[i] / texelSize;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent.width = i == 0 ? frame->width : (frame->width + 1) / 2;
+            region.imageExtent.height = planeHeight;
+            region.imageExtent.depth = 1;
+            vkCmdCopyBufferToImage(cmd, slot.stagingBuffer, slot.planes[i].image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+            offset += (VkDeviceSize)frame->linesize[i] * planeHeight;
+        }
+
+        for (int i = 0; i < slot.planeCount; i++) {
+            barriers[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, slot.planeCount, barriers);
+    }
+
+    // Copy any new overlay surfaces into their images
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        auto& overlay = m_Overlays[i];
+        if (!overlay.uploadPending) {
+            continue;
+        }
+
+        VkImageMemoryBarrier overlayBarrier = {};
+        overlayBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        overlayBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        overlayBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        overlayBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        overlayBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        overlayBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        overlayBarrier.image = overlay.image.image;
+        overlayBarrier.subresourceRange = k_ColorSubresourceRange;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &overlayBarrier);
+
+        VkBufferImageCopy region = {};
+        region.bufferRowLength = overlay.rowLength;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width = overlay.width;
+        region.imageExtent.height = overlay.height;
+        region.imageExtent.depth = 1;
+        vkCmdCopyBufferToImage(cmd, overlay.stagingBuffer, overlay.image.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        overlayBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        overlayBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        overlayBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        overlayBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 0, nullptr, 1, &overlayBarrier);
+
+        overlay.uploadPending = false;
+    }
+
+    // The previous frame's blit must be done reading the output image before we overwrite it
+    VkImageMemoryBarrier outputBarrier = {};
+    outputBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    outputBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    outputBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    outputBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    outputBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    outputBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    outputBarrier.image = m_OutputImage.image;
+    outputBarrier.subresourceRange = k_ColorSubresourceRange;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &outputBarrier);
+
+    VULKAN_CSC_PARAMS params = {};
+    const float* colorMatrix = getColorMatrix(frame);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            params.yuvmat[column * 4 + row] = colorMatrix[column * 3 + row];
+        }
+    }
+    memcpy(params.offset, getColorOffsets(frame), sizeof(params.offset));
+    params.chromaPlanes = slot.planeCount - 1;
+
+    SDL_Rect src, dst;
+    src.x = src.y = 0;
+    src.w = m_OutputWidth;
+    src.h = m_OutputHeight;
+    dst.x = dst.y = 0;
+    dst.w = m_SwapchainExtent.width;
+    dst.h = m_SwapchainExtent.height;
+    StreamUtils::scaleSourceToDestinationSurface(&src, &dst);
+
+    // The overlays are blended into the output image before it is scaled, so
+    // size them to come out 1:1 in the window. They sit in the corners of the
+    // video rather than the window, which only differs when letterboxed.
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        const auto& overlay = m_Overlays[i];
+        if (!Session::get()->getOverlayManager().isOverlayEnabled((Overlay::OverlayType)i) ||
+                !SDL_AtomicGet(&m_OverlayHasValidData[i]) ||
+                overlay.image.view == VK_NULL_HANDLE) {
+            // An empty rect isn't drawn
+            continue;
+        }
+
+        int32_t* rect = params.overlayRects[i];
+        rect[2] = qMin(overlay.width * src.w / dst.w, m_OutputWidth);
+        rect[3] = qMin(overlay.height * src.h / dst.h, m_OutputHeight);
+        rect[0] = 0;
+        if (i == Overlay::OverlayStatusUpdate) {
+            // Bottom left
+            rect[1] = m_OutputHeight - rect[3];
+        }
+        else if (i == Overlay::OverlayDebug) {
+            // Top left
+            rect[1] = 0;
+        }
+        else {
+            SDL_assert(false);
+        }
+    }
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout,
+                            0, 1, &slot.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(cmd, m_PipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(params), &params);
+    vkCmdDispatch(cmd, (m_OutputWidth + 7) / 8, (m_OutputHeight + 7) / 8, 1);
+
+    VkImageMemoryBarrier blitBarriers[2] = {};
+    blitBarriers[0] = outputBarrier;
+    blitBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    blitBarriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    blitBarriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    blitBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    blitBarriers[1] = outputBarrier;
+    blitBarriers[1].image = swapchainImage;
+    blitBarriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    blitBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    blitBarriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 2, blitBarriers);
+
+    // Clear the letterbox area and scale the frame into the rest
+    VkClearColorValue black = {};
+    black.float32[3] = 1.0f;
+    vkCmdClearColorImage(cmd, swapchainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         &black, 1, &k_ColorSubresourceRange);
+
+    VkImageMemoryBarrier clearBarrier = blitBarriers[1];
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &clearBarrier);
+
+    VkImageBlit blit = {};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1] = { src.w, src.h, 1 };
+    blit.dstSubresource = blit.srcSubresource;
+    blit.dstOffsets[0] = { dst.x, dst.y, 0 };
+    blit.dstOffsets[1] = { dst.x + dst.w, dst.y + dst.h, 1 };
+    vkCmdBlitImage(cmd,
+                   m_OutputImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   swapchainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   1, &blit, VK_FILTER_LINEAR);
+
+    VkImageMemoryBarrier presentBarrier = clearBarrier;
+    presentBarrier.dstAccessMask = 0;
+    presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &presentBarrier);
+
+    vkEndCommandBuffer(cmd);
+}
+
+void VulkanRenderer::waitToRender()
+{
+#ifdef VK_KHR_present_wait
+    // Wait for our last frame to actually reach the display before the Pacer
+    // picks the next one, so we always present the newest frame available
+    // without building up a queue of frames in the swapchain.
+    if (m_HasPresentWait && m_PresentId != 0 && !m_SwapchainOutOfDate) {
+        // Don't wait forever if the window is hidden and nothing is presented
+        VkResult res = m_vkWaitForPresentKHR(m_Device, m_Swapchain, m_PresentId, 100 * 1000 * 1000);
+        if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+            m_SwapchainOutOfDate = true;
+        }
+    }
+#endif
+}
+
+void VulkanRenderer::renderFrame(AVFrame* frame)
+{
+    int slotIndex = m_SlotIndex;
+    auto& slot = m_Slots[slotIndex];
+    VkResult res;
+
+    // Wait for the GPU to finish with the last frame that used this slot.
+    // There's nothing to wait for unless we're more than a frame ahead.
+    if (!waitForFrameSlot(slotIndex)) {
+        return;
+    }
+    releaseFrameSlot(slotIndex);
+
+    // The swapchain isn't invalidated by window resizes on Wayland
+    if (m_ExtentFromWindow && m_Swapchain != VK_NULL_HANDLE) {
+        int width, height;
+        getWindowPixelSize(&width, &height);
+        if ((uint32_t)width != m_SwapchainExtent.width || (uint32_t)height != m_SwapchainExtent.height) {
+            m_SwapchainOutOfDate = true;
+        }
+    }
+
+    if (m_SwapchainOutOfDate || m_Swapchain == VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(m_Device);
+        if (!createSwapchain()) {
+            return;
+        }
+    }
+
+    if (frame->width != m_OutputWidth || frame->height != m_OutputHeight) {
+        vkDeviceWaitIdle(m_Device);
+        destroyOutputImage();
+        if (!createOutputImage(frame->width, frame->height)) {
+            return;
+        }
+    }
+
+    if (m_Backend != nullptr) {
+        AVDRMFrameDescriptor mappedFrame;
+
+        if (!m_Backend->mapDrmPrimeFrame(frame, &mappedFrame)) {
+            return;
+        }
+
+        // Our imported memory holds its own references to the DMA-BUFs
+        bool imported = importDrmPrimeFrame(&mappedFrame, frame->width, frame->height, slotIndex);
+        m_Backend->unmapDrmPrimeFrame(&mappedFrame);
+        if (!imported) {
+            return;
+        }
+
+        slot.frame = av_frame_clone(frame);
+    }
+    else if (!uploadSoftwareFrame(frame, slotIndex)) {
+        return;
+    }
+
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        updateOverlay((Overlay::OverlayType)i);
+    }
+
+    VkDescriptorImageInfo imageInfos[4 + Overlay::OverlayMax] = {};
+    for (int i = 0; i < 3; i++) {
+        // Planar chroma uses all three planes, while interleaved chroma
+        // just needs something valid bound to the third one.
+        imageInfos[i].imageView = slot.planes[qMin(i, slot.planeCount - 1)].view;
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    imageInfos[3].imageView = m_OutputImage.view;
+    imageInfos[3].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    for (int i = 0; i < Overlay::OverlayMax; i++) {
+        // Overlays that aren't drawn still need something valid bound
+        imageInfos[4 + i].imageView = m_Overlays[i].image.view != VK_NULL_HANDLE ?
+                    m_Overlays[i].image.view : slot.planes[0].view;
+        imageInfos[4 + i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    VkWriteDescriptorSet writes[5] = {};
+    for (int i = 0; i < 5; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = slot.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = i < 4 ? 1 : Overlay::OverlayMax;
+        writes[i].descriptorType = i == 3 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[i].pImageInfo = &imageInfos[i];
+    }
+    vkUpdateDescriptorSets(m_Device, SDL_arraysize(writes), writes, 0, nullptr);
+
+    // Lost if we failed to replace it after a failed submission
+    if (slot.acquireSemaphore == VK_NULL_HANDLE) {
+        return;
+    }
+
+    uint32_t imageIndex;
+    res = vkAcquireNextImageKHR(m_Device, m_Swapchain, UINT64_MAX, slot.acquireSemaphore, VK_NULL_HANDLE, &imageIndex);
+    if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+        m_SwapchainOutOfDate = true;
+        return;
+    }
+    else if (res == VK_SUBOPTIMAL_KHR) {
+        // We can still present this frame
+        m_SwapchainOutOfDate = true;
+    }
+    else if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkAcquireNextImageKHR() failed: %d", res);
+        return;
+    }
+
+    recordCommands(slotIndex, imageIndex, frame);
+
+    // Signal the timeline with the submission so we know when this slot
+    // is free again, along with the binary semaphore for presentation.
+    VkSemaphore signalSemaphores[2] = { m_RenderCompleteSemaphores[imageIndex], m_Timeline };
+    uint64_t waitValue = 0;
+    uint64_t signalValues[2] = { 0, m_TimelineValue + 1 };
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = SDL_arraysize(signalValues);
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
+    // Nothing touches the swapchain image until the clear
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &slot.acquireSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &slot.commandBuffer;
+    submitInfo.signalSemaphoreCount = SDL_arraysize(signalSemaphores);
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    res = vkQueueSubmit(m_Queue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (res != VK_SUCCESS) {
+        VULKAN_LOG(Error, "vkQueueSubmit() failed: %d", res);
+
+        // Nothing will wait on the acquire semaphore now, so it would still be
+        // signaled the next time we acquire with this slot. Replace it, and
+        // recreate the swapchain to get back the image we never presented.
+        vkDeviceWaitIdle(m_Device);
+        vkDestroySemaphore(m_Device, slot.acquireSemaphore, nullptr);
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        res = vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &slot.acquireSemaphore);
+        if (res != VK_SUCCESS) {
+            slot.acquireSemaphore = VK_NULL_HANDLE;
+            VULKAN_LOG(Error, "vkCreateSemaphore() failed: %d", res);
+        }
+
+        m_SwapchainOutOfDate = true;
+        return;
+    }
+
+    slot.timelineValue = ++m_TimelineValue;
+    m_SlotIndex = (m_SlotIndex + 1) % VULKAN_FRAMES_IN_FLIGHT;
+
+    VkPresentInfoKHR presentInfo = {};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &m_RenderCompleteSemaphores[imageIndex];
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &m_Swapchain;
+    presentInfo.pImageIndices = &imageIndex;
+
+#ifdef VK_KHR_present_id
+    uint64_t presentId = m_PresentId + 1;
+    VkPresentIdKHR presentIdInfo = {};
+    presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    presentIdInfo.swapchainCount = 1;
+    presentIdInfo.pPresentIds = &presentId;
+    if (m_HasPresentWait) {
+        presentInfo.pNext = &presentIdInfo;
+    }
+#endif
+
+    res = vkQueuePresentKHR(m_Queue, &presentInfo);
+    if (res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR) {
+#ifdef VK_KHR_present_id
+        if (m_HasPresentWait) {
+            m_PresentId = presentId;
+        }
+#endif
+        if (res == VK_SUBOPTIMAL_KHR) {
+            m_SwapchainOutOfDate = true;
+        }
+    }
+    else if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+        m_SwapchainOutOfDate = true;
+    }
+    else {
+        VULKAN_LOG(Error, "vkQueuePresentKHR() failed: %d", res);
+    }
+}
+
+bool VulkanRenderer::testRenderFrame(AVFrame* frame)
+{
+    if (m_Backend == nullptr) {
+        return frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_NV12;
+    }
+
+    // Make sure we can actually import what the backend exports
+    AVDRMFrameDescriptor drmDescriptor;
+    if (!m_Backend->mapDrmPrimeFrame(frame, &drmDescriptor)) {
+        return false;
+    }
+
+    bool imported = importDrmPrimeFrame(&drmDescriptor, frame->width, frame->height, m_SlotIndex);
+    releaseFrameSlot(m_SlotIndex);
+    m_Backend->unmapDrmPrimeFrame(&drmDescriptor);
+
+    return imported;
+}
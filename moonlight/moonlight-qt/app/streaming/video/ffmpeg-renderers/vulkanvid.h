@@ -0,0 +1,146 @@
+#pragma once
+
+#include "renderer.h"
+
+#include <vulkan/vulkan.h>
+
+#include <QVector>
+
+// Presents frames with Vulkan, converting from YUV to RGB in a compute
+// shader and blitting the result to the swapchain. As a frontend renderer,
+// it imports DRM PRIME frames from the backend without copying them. On its
+// own, it uploads software frames instead, which allows it to run on
+// lavapipe without a GPU. Overlays are blended in by the same compute
+// shader. HDR isn't supported yet. This is opt-in by setting VULKAN_RENDERER=1.
+class VulkanRenderer : public IFFmpegRenderer {
+public:
+    VulkanRenderer(IFFmpegRenderer* backendRenderer);
+    virtual ~VulkanRenderer() override;
+
+    static bool isEnabled();
+
+    virtual bool initialize(PDECODER_PARAMETERS params) override;
+    virtual bool prepareDecoderContext(AVCodecContext* context, AVDictionary** options) override;
+    virtual void waitToRender() override;
+    virtual void renderFrame(AVFrame* frame) override;
+    virtual bool testRenderFrame(AVFrame* frame) override;
+    virtual void notifyOverlayUpdated(Overlay::OverlayType type) override;
+    virtual bool isPixelFormatSupported(int videoFormat, AVPixelFormat pixelFormat) override;
+    virtual AVPixelFormat getPreferredPixelFormat(int videoFormat) override;
+
+private:
+    struct VulkanPlane {
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+    };
+
+    bool createInstance(const char* surfaceExtension);
+    bool selectPhysicalDevice();
+    bool createDevice();
+    bool createSwapchain();
+    void destroySwapchain();
+    bool createPipeline();
+    bool createFrameSlots();
+    bool createOutputImage(int width, int height);
+    void destroyOutputImage();
+    bool createPlaneImage(VulkanPlane& plane, VkFormat format, int width, int height,
+                          VkImageTiling tiling, VkImageUsageFlags usage, const void* next);
+    bool allocatePlaneMemory(VulkanPlane& plane, VkMemoryPropertyFlags properties);
+    bool createPlaneView(VulkanPlane& plane, VkFormat format);
+    void destroyPlane(VulkanPlane& plane);
+    bool createStagingBuffer(VkDeviceSize size, VkBuffer* buffer, VkDeviceMemory* memory);
+    void updateOverlay(Overlay::OverlayType type);
+    void destroyOverlay(Overlay::OverlayType type);
+    bool importDrmPrimeFrame(const AVDRMFrameDescriptor* drmFrame, int width, int height, int slotIndex);
+    bool uploadSoftwareFrame(const AVFrame* frame, int slotIndex);
+    bool waitForFrameSlot(int slotIndex);
+    void releaseFrameSlot(int slotIndex);
+    void recordCommands(int slotIndex, uint32_t imageIndex, const AVFrame* frame);
+    void getWindowPixelSize(int* width, int* height);
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties);
+    const float* getColorOffsets(const AVFrame* frame);
+    const float* getColorMatrix(const AVFrame* frame);
+
+    IFFmpegRenderer* m_Backend;
+    SDL_Window* m_Window;
+    bool m_EnableVsync;
+
+    VkInstance m_Instance;
+    VkSurfaceKHR m_Surface;
+    VkPhysicalDevice m_PhysicalDevice;
+    VkPhysicalDeviceMemoryProperties m_MemoryProperties;
+    uint32_t m_QueueFamily;
+    VkDevice m_Device;
+    VkQueue m_Queue;
+    bool m_HasPresentWait;
+    PFN_vkGetMemoryFdPropertiesKHR m_vkGetMemoryFdPropertiesKHR;
+#ifdef VK_KHR_present_wait
+    PFN_vkWaitForPresentKHR m_vkWaitForPresentKHR;
+#endif
+
+    VkSwapchainKHR m_Swapchain;
+    VkFormat m_SwapchainFormat;
+    VkExtent2D m_SwapchainExtent;
+    bool m_ExtentFromWindow;
+    bool m_SwapchainOutOfDate;
+    QVector<VkImage> m_SwapchainImages;
+    QVector<VkSemaphore> m_RenderCompleteSemaphores;
+    uint64_t m_PresentId;
+
+    VkSampler m_Sampler;
+    VkDescriptorSetLayout m_DescriptorSetLayout;
+    VkDescriptorPool m_DescriptorPool;
+    VkPipelineLayout m_PipelineLayout;
+    VkPipeline m_Pipeline;
+    VkCommandPool m_CommandPool;
+
+    // The compute shader converts each frame into this image,
+    // which is then scaled into the swapchain image by a blit.
+    VulkanPlane m_OutputImage;
+    int m_OutputWidth;
+    int m_OutputHeight;
+
+    // Every submission signals the next value of this timeline semaphore,
+    // so we can tell when the GPU is done with each frame slot without
+    // a fence per frame.
+    VkSemaphore m_Timeline;
+    uint64_t m_TimelineValue;
+
+#define VULKAN_FRAMES_IN_FLIGHT 2
+    struct {
+        VkCommandBuffer commandBuffer;
+        VkSemaphore acquireSemaphore;
+        VkDescriptorSet descriptorSet;
+        uint64_t timelineValue;
+
+        // The decoder surface must stay alive while the GPU reads from it
+        AVFrame* frame;
+
+        int planeCount;
+        VulkanPlane planes[3];
+
+        // Software frames are copied through here into the plane images
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        void* stagingMapping;
+        VkDeviceSize stagingSize;
+        int uploadFormat;
+        int uploadWidth;
+        int uploadHeight;
+    } m_Slots[VULKAN_FRAMES_IN_FLIGHT];
+    int m_SlotIndex;
+
+    // Overlay surfaces are uploaded on the render thread, since
+    // notifyOverlayUpdated() may be called from any thread.
+    struct {
+        VulkanPlane image;
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        int width;
+        int height;
+        int rowLength;
+        bool uploadPending;
+    } m_Overlays[Overlay::OverlayMax];
+    SDL_atomic_t m_OverlayHasValidData[Overlay::OverlayMax];
+};
@@ -6,6 +6,7 @@
 #include <h264_stream.h>
 
 #include "ffmpeg-renderers/sdlvid.h"
+#include "ffmpeg-renderers/nullvid.h"
 
 #ifdef Q_OS_WIN32
 #include "ffmpeg-renderers/dxva2.h"
@@ -34,6 +35,11 @@
 
 #ifdef HAVE_EGL
 #include "ffmpeg-renderers/eglvid.h"
+#include "ffmpeg-renderers/swframe.h"
+#endif
+
+#ifdef HAVE_VULKAN
+#include "ffmpeg-renderers/vulkanvid.h"
 #endif
 
 #ifdef HAVE_CUDA
@@ -47,6 +53,9 @@
 
 #define FAILED_DECODES_RESET_THRESHOLD 20
 
+static_assert(VIDEO_FRAME_BUFFER_PADDING >= AV_INPUT_BUFFER_PADDING_SIZE,
+              "Frame buffers must be padded enough for FFmpeg's bitstream readers");
+
 static const struct {
     const char* codec;
     int capabilities;
@@ -69,6 +78,29 @@ bool FFmpegVideoDecoder::isHardwareAccelerated()
             (m_VideoDecoderCtx->codec->capabilities & AV_CODEC_CAP_HARDWARE) != 0;
 }
 
+int FFmpegVideoDecoder::getSoftwareDecodeThreadCount()
+{
+    bool ok;
+    int threads = qEnvironmentVariableIntValue("SOFTWARE_DECODE_THREADS", &ok);
+    if (ok) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                    "Using software decode thread count override: %d",
+                    threads);
+        return qBound(1, threads, MAX_SLICES);
+    }
+
+    threads = SDL_GetCPUCount();
+
+    // Leave a core free for the receive, audio, and render threads
+    // if we have enough of them. If a slice thread gets preempted by
+    // one of those, the whole frame has to wait for it to finish.
+    if (threads >= 4) {
+        threads--;
+    }
+
+    return qBound(1, threads, MAX_SLICES);
+}
+
 bool FFmpegVideoDecoder::isAlwaysFullScreen()
 {
     return m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FULLSCREEN_ONLY;
@@ -99,8 +131,8 @@ int FFmpegVideoDecoder::getDecoderCapabilities()
         capabilities = m_BackendRenderer->getDecoderCapabilities();
 
         if (!isHardwareAccelerated()) {
-            // Slice up to 4 times for parallel CPU decoding, once slice per core
-            int slices = qMin(MAX_SLICES, SDL_GetCPUCount());
+            // Ask for one slice per decoder thread so FFmpeg can decode them in parallel
+            int slices = getSoftwareDecodeThreadCount();
             SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
                         "Encoder configured for %d slices per frame",
                         slices);
@@ -131,6 +163,10 @@ int FFmpegVideoDecoder::getDecoderCapabilities()
     // our operation.
     capabilities |= CAPABILITY_PULL_RENDERER;
 
+    // Have frames assembled into a single buffer that we can pass to
+    // FFmpeg without copying it again in submitDecodeUnit().
+    capabilities |= CAPABILITY_CONTIGUOUS_FRAME_BUFFER;
+
     return capabilities;
 }
 
@@ -281,20 +317,30 @@ void FFmpegVideoDecoder::reset()
 bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params, bool useAlternateFrontend)
 {
     if (useAlternateFrontend) {
-//#ifdef HAVE_DRM
-//        // If we're trying to stream HDR, we need to use the DRM renderer in direct
-//        // rendering mode so it can set the HDR metadata on the display. EGL does
-//        // not currently support this (and even if it did, Mesa and Wayland don't
-//        // currently have protocols to actually get that metadata to the display).
-//        if ((params->videoFormat & VIDEO_FORMAT_MASK_10BIT) && m_BackendRenderer->canExportDrmPrime()) {
-//            m_FrontendRenderer = new DrmRenderer(m_BackendRenderer);
-//            if (m_FrontendRenderer->initialize(params)) {
-//                return true;
-//            }
-//            delete m_FrontendRenderer;
-//            m_FrontendRenderer = nullptr;
-//        }
-//#endif
+#ifdef HAVE_DRM
+        // In KMS scanout mode, the DRM renderer puts the backend's frames directly
+        // on a display plane without a GL composition pass. This is also the only
+        // way to get HDR metadata to the display, since EGL does not support it.
+        if (DrmRenderer::isKmsScanoutEnabled() && m_BackendRenderer->canExportDrmPrime()) {
+            m_FrontendRenderer = new DrmRenderer(m_BackendRenderer);
+            if (m_FrontendRenderer->initialize(params)) {
+                return true;
+            }
+            delete m_FrontendRenderer;
+            m_FrontendRenderer = nullptr;
+        }
+#endif
+
+#ifdef HAVE_VULKAN
+        if (VulkanRenderer::isEnabled() && m_BackendRenderer->canExportDrmPrime()) {
+            m_FrontendRenderer = new VulkanRenderer(m_BackendRenderer);
+            if (m_FrontendRenderer->initialize(params)) {
+                return true;
+            }
+            delete m_FrontendRenderer;
+            m_FrontendRenderer = nullptr;
+        }
+#endif
 
 #ifdef HAVE_EGL
         if (m_BackendRenderer->canExportEGL()) {
@@ -326,6 +372,26 @@ bool FFmpegVideoDecoder::createFrontendRenderer(PDECODER_PARAMETERS params, bool
     return true;
 }
 
+bool FFmpegVideoDecoder::getTestFrame(int videoFormat, const uint8_t** data, int* size)
+{
+    switch (videoFormat) {
+    case VIDEO_FORMAT_H264:
+        *data = k_H264TestFrame;
+        *size = sizeof(k_H264TestFrame);
+        return true;
+    case VIDEO_FORMAT_H265:
+        *data = k_HEVCMainTestFrame;
+        *size = sizeof(k_HEVCMainTestFrame);
+        return true;
+    case VIDEO_FORMAT_H265_MAIN10:
+        *data = k_HEVCMain10TestFrame;
+        *size = sizeof(k_HEVCMain10TestFrame);
+        return true;
+    default:
+        return false;
+    }
+}
+
 bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, PDECODER_PARAMETERS params, bool testFrame, bool useAlternateFrontend)
 {
     // In test-only mode, we should only see test frames
@@ -343,7 +409,8 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, PDECODER
     if (!testFrame) {
         m_Pacer = new Pacer(m_FrontendRenderer, &m_ActiveWndVideoStats);
         if (!m_Pacer->initialize(params->window, params->frameRate,
-                                 params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)))) {
+                                 params->enableFramePacing || (params->enableVsync && (m_FrontendRenderer->getRendererAttributes() & RENDERER_ATTRIBUTE_FORCE_PACING)),
+                                 params->enableFramePacing ? params->framePacingLatency : 0)) {
             return false;
         }
     }
@@ -374,7 +441,7 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, PDECODER
     // Enable slice multi-threading for software decoding
     if (!isHardwareAccelerated()) {
         m_VideoDecoderCtx->thread_type = FF_THREAD_SLICE;
-        m_VideoDecoderCtx->thread_count = qMin(MAX_SLICES, SDL_GetCPUCount());
+        m_VideoDecoderCtx->thread_count = getSoftwareDecodeThreadCount();
     }
     else {
         // No threading for HW decode
@@ -416,26 +483,18 @@ bool FFmpegVideoDecoder::completeInitialization(const AVCodec* decoder, PDECODER
     // now to see if things will actually work when the video stream
     // comes in.
     if (testFrame) {
-        switch (params->videoFormat) {
-        case VIDEO_FORMAT_H264:
-            m_Pkt->data = (uint8_t*)k_H264TestFrame;
-            m_Pkt->size = sizeof(k_H264TestFrame);
-            break;
-        case VIDEO_FORMAT_H265:
-            m_Pkt->data = (uint8_t*)k_HEVCMainTestFrame;
-            m_Pkt->size = sizeof(k_HEVCMainTestFrame);
-            break;
-        case VIDEO_FORMAT_H265_MAIN10:
-            m_Pkt->data = (uint8_t*)k_HEVCMain10TestFrame;
-            m_Pkt->size = sizeof(k_HEVCMain10TestFrame);
-            break;
-        default:
+        const uint8_t* testFrameData;
+        int testFrameSize;
+        if (!getTestFrame(params->videoFormat, &testFrameData, &testFrameSize)) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
                          "No test frame for format: %x",
                          params->videoFormat);
             return false;
         }
 
+        m_Pkt->data = (uint8_t*)testFrameData;
+        m_Pkt->size = testFrameSize;
+
         AVFrame* frame = av_frame_alloc();
         if (!frame) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -527,8 +586,10 @@ void FFmpegVideoDecoder::addVideoStats(VIDEO_STATS& src, VIDEO_STATS& dst)
     dst.pacerDroppedFrames += src.pacerDroppedFrames;
     dst.totalReassemblyTime += src.totalReassemblyTime;
     dst.totalDecodeTime += src.totalDecodeTime;
+    dst.totalDecoderTimeUs += src.totalDecoderTimeUs;
     dst.totalPacerTime += src.totalPacerTime;
     dst.totalRenderTime += src.totalRenderTime;
+    dst.totalRenderBlockedTimeUs += src.totalRenderBlockedTimeUs;
 
     if (!LiGetEstimatedRttInfo(&dst.lastRtt, &dst.lastRttVariance)) {
         dst.lastRtt = 0;
@@ -597,6 +658,20 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output)
                               m_VideoDecoderCtx->height,
                               stats.totalFps,
                               codecString);
+
+            if (!isHardwareAccelerated()) {
+                offset += sprintf(&output[offset],
+                                  "Video decoder: %s (%d slice threads)\n",
+                                  m_VideoDecoderCtx->codec->name,
+                                  m_VideoDecoderCtx->thread_count);
+            }
+            else {
+                offset += sprintf(&output[offset],
+                                  "Video decoder: %s\n",
+                                  m_HwDecodeCfg != nullptr ?
+                                      av_hwdevice_get_type_name(m_HwDecodeCfg->device_type) :
+                                      m_VideoDecoderCtx->codec->name);
+            }
         }
 
         offset += sprintf(&output[offset],
@@ -610,6 +685,7 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output)
 
     if (stats.renderedFrames != 0) {
         char rttString[32];
+        char pacerTargetString[32];
 
         if (stats.lastRtt != 0) {
             sprintf(rttString, "%u ms (variance: %u ms)", stats.lastRtt, stats.lastRttVariance);
@@ -618,26 +694,57 @@ void FFmpegVideoDecoder::stringifyVideoStats(VIDEO_STATS& stats, char* output)
             sprintf(rttString, "N/A");
         }
 
+        if (m_Pacer != nullptr && m_Pacer->getLatencyTarget() > 0) {
+            sprintf(pacerTargetString, " (target: %d ms)", m_Pacer->getLatencyTarget());
+        }
+        else {
+            pacerTargetString[0] = 0;
+        }
+
         offset += sprintf(&output[offset],
                           "Frames dropped by your network connection: %.2f%%\n"
                           "Frames dropped due to network jitter: %.2f%%\n"
                           "Average network latency: %s\n"
-                          "Average decoding time: %.2f ms\n"
-                          "Average frame queue delay: %.2f ms\n"
-                          "Average rendering time (including monitor V-sync latency): %.2f ms\n",
+                          "Average decoding time: %.2f ms (in decoder: %.2f ms)\n"
+                          "Average frame queue delay: %.2f ms%s\n"
+                          "Average rendering time (including monitor V-sync latency): %.2f ms\n"
+                          "Average render thread blocked time: %.2f ms\n",
                           (float)stats.networkDroppedFrames / stats.totalFrames * 100,
                           (float)stats.pacerDroppedFrames / stats.decodedFrames * 100,
                           rttString,
                           (float)stats.totalDecodeTime / stats.decodedFrames,
+                          (float)stats.totalDecoderTimeUs / 1000 / stats.decodedFrames,
                           (float)stats.totalPacerTime / stats.renderedFrames,
-                          (float)stats.totalRenderTime / stats.renderedFrames);
+                          pacerTargetString,
+                          (float)stats.totalRenderTime / stats.renderedFrames,
+                          (float)stats.totalRenderBlockedTimeUs / 1000 / stats.renderedFrames);
+
+        if (Session::get() != nullptr) {
+            int concealedFrames, fecRecoveredFrames;
+
+            Session::get()->getAudioConcealmentStats(concealedFrames, fecRecoveredFrames);
+            offset += sprintf(&output[offset],
+                              "Lost audio frames concealed: %d (%d using FEC data)\n",
+                              concealedFrames,
+                              fecRecoveredFrames);
+
+            int currentLatencyMs, targetLatencyMs;
+
+            Session::get()->getAudioLatencyStats(currentLatencyMs, targetLatencyMs);
+            if (targetLatencyMs >= 0) {
+                offset += sprintf(&output[offset],
+                                  "Audio jitter buffer latency: %d ms (target %d ms)\n",
+                                  currentLatencyMs,
+                                  targetLatencyMs);
+            }
+        }
     }
 }
 
 void FFmpegVideoDecoder::logVideoStats(VIDEO_STATS& stats, const char* title)
 {
     if (stats.renderedFps > 0 || stats.renderedFrames != 0) {
-        char videoStatsStr[512];
+        char videoStatsStr[1024];
         stringifyVideoStats(stats, videoStatsStr);
 
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
@@ -729,9 +836,9 @@ bool FFmpegVideoDecoder::tryInitializeRenderer(const AVCodec* decoder,
 {
     m_HwDecodeCfg = hwConfig;
 
-    // i == 0 - Indirect via EGL or DRM frontend with zero-copy DMA-BUF passing
+    // i == 0 - Indirect via EGL, DRM, or Vulkan frontend with zero-copy DMA-BUF passing
     // i == 1 - Direct rendering or indirect via SDL read-back
-#ifdef HAVE_EGL
+#if defined(HAVE_EGL) || defined(HAVE_VULKAN)
     for (int i = 0; i < 2; i++) {
 #else
     for (int i = 1; i < 2; i++) {
@@ -739,7 +846,7 @@ bool FFmpegVideoDecoder::tryInitializeRenderer(const AVCodec* decoder,
         SDL_assert(m_BackendRenderer == nullptr);
         if ((m_BackendRenderer = createRendererFunc()) != nullptr &&
                 m_BackendRenderer->initialize(params) &&
-                completeInitialization(decoder, params, m_TestOnly || m_BackendRenderer->needsTestFrame(), i == 0 /* EGL/DRM */)) {
+                completeInitialization(decoder, params, m_TestOnly || m_BackendRenderer->needsTestFrame(), i == 0 /* EGL/DRM/Vulkan */)) {
             if (m_TestOnly) {
                 // This decoder is only for testing capabilities, so don't bother
                 // creating a usable renderer
@@ -751,7 +858,7 @@ bool FFmpegVideoDecoder::tryInitializeRenderer(const AVCodec* decoder,
                 reset();
                 if ((m_BackendRenderer = createRendererFunc()) != nullptr &&
                         m_BackendRenderer->initialize(params) &&
-                        completeInitialization(decoder, params, false, i == 0 /* EGL/DRM */)) {
+                        completeInitialization(decoder, params, false, i == 0 /* EGL/DRM/Vulkan */)) {
                     return true;
                 }
                 else {
@@ -940,6 +1047,34 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
         return false;
     }
 
+    if (NullRenderer::isEnabled()) {
+        // Decode without presenting anything to measure decoder throughput.
+        // This uses the standard hwaccels without any special renderer, so
+        // it will also work on headless machines.
+        if (params->vds != StreamingPreferences::VDS_FORCE_SOFTWARE) {
+            for (int i = 0;; i++) {
+                const AVCodecHWConfig *config = avcodec_get_hw_config(decoder, i);
+                if (!config) {
+                    break;
+                }
+
+                if (tryInitializeRenderer(decoder, params, config,
+                                          [config]() -> IFFmpegRenderer* { return new NullRenderer(config); })) {
+                    return true;
+                }
+            }
+        }
+
+        if (params->vds != StreamingPreferences::VDS_FORCE_HARDWARE) {
+            if (tryInitializeRenderer(decoder, params, nullptr,
+                                      []() -> IFFmpegRenderer* { return new NullRenderer(nullptr); })) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     // Look for a hardware decoder first unless software-only
     if (params->vds != StreamingPreferences::VDS_FORCE_SOFTWARE) {
         // Look for the first matching hwaccel hardware decoder (pass 0)
@@ -1010,6 +1145,23 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     // Fallback to software if no matching hardware decoder was found
     // and if software fallback is allowed
     if (params->vds != StreamingPreferences::VDS_FORCE_HARDWARE) {
+#ifdef HAVE_EGL
+        // This is only enabled by EGL_SOFTWARE_FRAMES=1 for now
+        if (tryInitializeRenderer(decoder, params, nullptr,
+                                  []() -> IFFmpegRenderer* { return new SwFrameRenderer(); })) {
+            return true;
+        }
+#endif
+
+#ifdef HAVE_VULKAN
+        // This is only enabled by VULKAN_RENDERER=1 for now
+        if (VulkanRenderer::isEnabled() &&
+                tryInitializeRenderer(decoder, params, nullptr,
+                                      []() -> IFFmpegRenderer* { return new VulkanRenderer(nullptr); })) {
+            return true;
+        }
+#endif
+
         if (tryInitializeRenderer(decoder, params, nullptr,
                                   []() -> IFFmpegRenderer* { return new SdlRenderer(); })) {
             return true;
@@ -1020,6 +1172,11 @@ bool FFmpegVideoDecoder::initialize(PDECODER_PARAMETERS params)
     return false;
 }
 
+void FFmpegVideoDecoder::freeFrameBuffer(void*, uint8_t* data)
+{
+    LiFreeVideoFrameBuffer((char*)data);
+}
+
 void FFmpegVideoDecoder::writeBuffer(PLENTRY entry, int& offset)
 {
     if (m_NeedsSpsFixup && entry->bufferType == BUFFER_TYPE_SPS) {
@@ -1115,16 +1272,26 @@ void FFmpegVideoDecoder::decoderThreadProc()
                     frame->pkt_dts = SDL_GetTicks();
 
                     if (!m_FrameInfoQueue.isEmpty()) {
+                        FRAME_INFO frameInfo = m_FrameInfoQueue.dequeue();
+
                         // Data buffers in the DU are not valid here!
-                        DECODE_UNIT du = m_FrameInfoQueue.dequeue();
+                        DECODE_UNIT& du = frameInfo.du;
 
                         // Count time in avcodec_send_packet() and avcodec_receive_frame()
                         // as time spent decoding. Also count time spent in the decode unit
                         // queue because that's directly caused by decoder latency.
                         m_ActiveWndVideoStats.totalDecodeTime += LiGetMillis() - du.enqueueTimeMs;
 
+                        // Track time in the decoder itself separately, since that's what
+                        // we want to compare between software and hardware decoders.
+                        m_ActiveWndVideoStats.totalDecoderTimeUs += LiGetMicroseconds() - frameInfo.submitTimeUs;
+
                         // Store the presentation time
                         frame->pts = du.presentationTimeMs;
+
+                        // Remember the frame number so the Pacer can trace this frame
+                        LiRecordVideoFrameTraceStage(du.frameNumber, FRAME_TRACE_STAGE_DECODED);
+                        frame->opaque = (void*)(intptr_t)du.frameNumber;
                     }
 
                     m_ActiveWndVideoStats.decodedFrames++;
@@ -1156,7 +1323,7 @@ void FFmpegVideoDecoder::decoderThreadProc()
                     SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
                                 "avcodec_receive_frame() failed: %s (frame %d)",
                                 errorstring,
-                                !m_FrameInfoQueue.isEmpty() ? m_FrameInfoQueue.head().frameNumber : -1);
+                                !m_FrameInfoQueue.isEmpty() ? m_FrameInfoQueue.head().du.frameNumber : -1);
 
                     if (++m_ConsecutiveFailedDecodes == FAILED_DECODES_RESET_THRESHOLD) {
                         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
@@ -1231,23 +1398,46 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
     m_ActiveWndVideoStats.receivedFrames++;
     m_ActiveWndVideoStats.totalFrames++;
 
-    int requiredBufferSize = du->fullLength;
-    if (du->frameType == FRAME_TYPE_IDR) {
-        // Add some extra space in case we need to do an SPS fixup
-        requiredBufferSize += MAX_SPS_EXTRA_SIZE;
+    // If the frame was assembled into a single buffer, we can give it to FFmpeg
+    // as-is rather than copying it into m_DecodeBuffer. That's not possible if
+    // we need to rewrite the SPS.
+    bool zeroCopy = false;
+    if (du->frameBuffer != nullptr && !(m_NeedsSpsFixup && du->frameType == FRAME_TYPE_IDR)) {
+        char* frameBuffer = LiTakeVideoFrameBuffer(du);
+
+        m_Pkt->buf = av_buffer_create(reinterpret_cast<uint8_t*>(frameBuffer),
+                                      du->fullLength + VIDEO_FRAME_BUFFER_PADDING,
+                                      freeFrameBuffer, nullptr, 0);
+        if (m_Pkt->buf != nullptr) {
+            m_Pkt->data = m_Pkt->buf->data;
+            m_Pkt->size = du->fullLength;
+            zeroCopy = true;
+        }
+        else {
+            // Return the buffer to the DU so it is freed by LiCompleteVideoFrame()
+            du->frameBuffer = frameBuffer;
+        }
     }
 
-    // Ensure the decoder buffer is large enough
-    m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!zeroCopy) {
+        int requiredBufferSize = du->fullLength;
+        if (du->frameType == FRAME_TYPE_IDR) {
+            // Add some extra space in case we need to do an SPS fixup
+            requiredBufferSize += MAX_SPS_EXTRA_SIZE;
+        }
 
-    int offset = 0;
-    while (entry != nullptr) {
-        writeBuffer(entry, offset);
-        entry = entry->next;
-    }
+        // Ensure the decoder buffer is large enough
+        m_DecodeBuffer.reserve(requiredBufferSize + AV_INPUT_BUFFER_PADDING_SIZE);
 
-    m_Pkt->data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
-    m_Pkt->size = offset;
+        int offset = 0;
+        while (entry != nullptr) {
+            writeBuffer(entry, offset);
+            entry = entry->next;
+        }
+
+        m_Pkt->data = reinterpret_cast<uint8_t*>(m_DecodeBuffer.data());
+        m_Pkt->size = offset;
+    }
 
     if (du->frameType == FRAME_TYPE_IDR) {
         m_Pkt->flags = AV_PKT_FLAG_KEY;
@@ -1258,7 +1448,15 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
 
     m_ActiveWndVideoStats.totalReassemblyTime += du->enqueueTimeMs - du->receiveTimeMs;
 
+    LiRecordVideoFrameTraceStage(du->frameNumber, FRAME_TRACE_STAGE_SUBMITTED);
+    uint64_t submitTimeUs = LiGetMicroseconds();
     err = avcodec_send_packet(m_VideoDecoderCtx, m_Pkt);
+
+    // The decoder holds its own reference to the frame buffer now
+    if (zeroCopy) {
+        av_packet_unref(m_Pkt);
+    }
+
     if (err < 0) {
         char errorstring[512];
         av_strerror(err, errorstring, sizeof(errorstring));
@@ -1285,7 +1483,7 @@ int FFmpegVideoDecoder::submitDecodeUnit(PDECODE_UNIT du)
         return DR_NEED_IDR;
     }
 
-    m_FrameInfoQueue.enqueue(*du);
+    m_FrameInfoQueue.enqueue({ *du, submitTimeUs });
 
     m_FramesIn++;
     return DR_OK;
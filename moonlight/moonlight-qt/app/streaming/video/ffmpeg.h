@@ -9,6 +9,7 @@
 
 extern "C" {
 #include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
 }
 
 class FFmpegVideoDecoder : public IVideoDecoder {
@@ -29,6 +30,9 @@ public:
 
     virtual IFFmpegRenderer* getBackendRenderer();
 
+    // Returns a complete 720p access unit that decodes to a single frame
+    static bool getTestFrame(int videoFormat, const uint8_t** data, int* size);
+
 private:
     bool completeInitialization(const AVCodec* decoder, PDECODER_PARAMETERS params, bool testFrame, bool useAlternateFrontend);
 
@@ -54,6 +58,8 @@ private:
 
     void writeBuffer(PLENTRY entry, int& offset);
 
+    static void freeFrameBuffer(void* opaque, uint8_t* data);
+
     static
     enum AVPixelFormat ffGetFormat(AVCodecContext* context,
                                    const enum AVPixelFormat* pixFmts);
@@ -62,6 +68,8 @@ private:
 
     static int decoderThreadProcThunk(void* context);
 
+    static int getSoftwareDecodeThreadCount();
+
     AVPacket* m_Pkt;
     AVCodecContext* m_VideoDecoderCtx;
     QByteArray m_DecodeBuffer;
@@ -85,8 +93,12 @@ private:
     SDL_Thread* m_DecoderThread;
     SDL_atomic_t m_DecoderThreadShouldQuit;
 
-    // Data buffers in the queued DU are not valid
-    QQueue<DECODE_UNIT> m_FrameInfoQueue;
+    typedef struct _FRAME_INFO {
+        // Data buffers in the queued DU are not valid
+        DECODE_UNIT du;
+        uint64_t submitTimeUs;
+    } FRAME_INFO;
+    QQueue<FRAME_INFO> m_FrameInfoQueue;
 
     static const uint8_t k_H264TestFrame[];
     static const uint8_t k_HEVCMainTestFrame[];
@@ -55,17 +55,21 @@ SOURCES += \
     $$ENET_DIR/unix.c \
     $$ENET_DIR/win32.c \
     $$COMMON_C_DIR/src/AudioStream.c \
+    $$COMMON_C_DIR/src/BufferPool.c \
     $$COMMON_C_DIR/src/ByteBuffer.c \
     $$COMMON_C_DIR/src/Connection.c \
     $$COMMON_C_DIR/src/ConnectionTester.c \
     $$COMMON_C_DIR/src/ControlStream.c \
     $$COMMON_C_DIR/src/FakeCallbacks.c \
+    $$COMMON_C_DIR/src/FrameTrace.c \
     $$COMMON_C_DIR/src/InputStream.c \
     $$COMMON_C_DIR/src/LinkedBlockingQueue.c \
     $$COMMON_C_DIR/src/Misc.c \
+    $$COMMON_C_DIR/src/PacketImpairment.c \
     $$COMMON_C_DIR/src/Platform.c \
     $$COMMON_C_DIR/src/PlatformCrypto.c \
     $$COMMON_C_DIR/src/PlatformSockets.c \
+    $$COMMON_C_DIR/src/RingBlockingQueue.c \
     $$COMMON_C_DIR/src/RtpAudioQueue.c \
     $$COMMON_C_DIR/src/RtpVideoQueue.c \
     $$COMMON_C_DIR/src/RtspConnection.c \
@@ -73,6 +77,7 @@ SOURCES += \
     $$COMMON_C_DIR/src/SdpGenerator.c \
     $$COMMON_C_DIR/src/SimpleStun.c \
     $$COMMON_C_DIR/src/VideoDepacketizer.c \
+    $$COMMON_C_DIR/src/VideoReplay.c \
     $$COMMON_C_DIR/src/VideoStream.c
 HEADERS += \
     $$COMMON_C_DIR/src/Limelight.h
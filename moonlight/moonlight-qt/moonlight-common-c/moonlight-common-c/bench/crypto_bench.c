@@ -0,0 +1,167 @@
+// Compares PltDecryptMessageBatch() against decrypting the same messages one
+// at a time with PltDecryptMessage(), and checks that both return the original
+// plaintext, including after the key changes on the same batch context.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Limelight.h>
+#include "PlatformCrypto.h"
+
+#define BATCH_SIZE 8
+#define ITERATIONS 20000
+#define MAX_MESSAGE_SIZE 1024
+#define GCM_IV_LENGTH 12
+#define GCM_TAG_LENGTH 16
+
+#define CHECK(x) \
+    if (!(x)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+        exit(EXIT_FAILURE); \
+    }
+
+static unsigned char key[16];
+static unsigned char plaintext[BATCH_SIZE][MAX_MESSAGE_SIZE];
+static unsigned char ciphertext[BATCH_SIZE][ROUND_TO_PKCS7_PADDED_LEN(MAX_MESSAGE_SIZE + 1)];
+static unsigned char decrypted[BATCH_SIZE][ROUND_TO_PKCS7_PADDED_LEN(MAX_MESSAGE_SIZE + 1)];
+static unsigned char ivs[BATCH_SIZE][16];
+static unsigned char tags[BATCH_SIZE][GCM_TAG_LENGTH];
+
+static void checkDecrypted(PPLT_CRYPTO_MESSAGE messages, int messageSize) {
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        CHECK(messages[i].outputDataLength == messageSize);
+        CHECK(memcmp(decrypted[i], plaintext[i], messageSize) == 0);
+    }
+}
+
+// Builds a batch like the audio stream would receive
+static void buildBatch(PPLT_CRYPTO_CONTEXT encryptCtx, int algorithm,
+                       PPLT_CRYPTO_MESSAGE messages, int messageSize) {
+    int ivLength = algorithm == ALGORITHM_AES_GCM ? GCM_IV_LENGTH : 16;
+    int tagLength = algorithm == ALGORITHM_AES_GCM ? GCM_TAG_LENGTH : 0;
+    int flags = algorithm == ALGORITHM_AES_CBC ? (CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH) : 0;
+
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        int ciphertextLength = sizeof(ciphertext[i]);
+        unsigned char input[ROUND_TO_PKCS7_PADDED_LEN(MAX_MESSAGE_SIZE + 1)];
+
+        PltGenerateRandomData(plaintext[i], messageSize);
+        PltGenerateRandomData(ivs[i], ivLength);
+
+        // Encryption may pad the input in place
+        memcpy(input, plaintext[i], messageSize);
+        CHECK(PltEncryptMessage(encryptCtx, algorithm, flags,
+                                key, sizeof(key),
+                                ivs[i], ivLength,
+                                tagLength ? tags[i] : NULL, tagLength,
+                                input, messageSize,
+                                ciphertext[i], &ciphertextLength));
+
+        messages[i].iv = ivs[i];
+        messages[i].tag = tagLength ? tags[i] : NULL;
+        messages[i].inputData = ciphertext[i];
+        messages[i].inputDataLength = ciphertextLength;
+        messages[i].outputData = decrypted[i];
+        messages[i].outputDataLength = sizeof(decrypted[i]);
+    }
+}
+
+// A batch context must pick up a new key rather than keep decrypting with the old one
+static void checkKeyChange(void) {
+    PLT_CRYPTO_MESSAGE messages[BATCH_SIZE];
+    PPLT_CRYPTO_CONTEXT batchCtx = PltCreateCryptoContext();
+    CHECK(batchCtx != NULL);
+
+    for (int round = 0; round < 2; round++) {
+        // Encryption contexts don't support key changes either
+        PPLT_CRYPTO_CONTEXT encryptCtx = PltCreateCryptoContext();
+        CHECK(encryptCtx != NULL);
+
+        PltGenerateRandomData(key, sizeof(key));
+        buildBatch(encryptCtx, ALGORITHM_AES_CBC, messages, 64);
+        CHECK(PltDecryptMessageBatch(batchCtx, ALGORITHM_AES_CBC, CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH,
+                                     key, sizeof(key),
+                                     16, 0,
+                                     messages, BATCH_SIZE));
+        checkDecrypted(messages, 64);
+
+        PltDestroyCryptoContext(encryptCtx);
+    }
+
+    PltDestroyCryptoContext(batchCtx);
+}
+
+static void runBenchmark(int algorithm, int messageSize) {
+    PLT_CRYPTO_MESSAGE messages[BATCH_SIZE];
+    PPLT_CRYPTO_CONTEXT encryptCtx, singleCtx, batchCtx;
+    int ivLength = algorithm == ALGORITHM_AES_GCM ? GCM_IV_LENGTH : 16;
+    int tagLength = algorithm == ALGORITHM_AES_GCM ? GCM_TAG_LENGTH : 0;
+    int flags = algorithm == ALGORITHM_AES_CBC ? (CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH) : 0;
+    uint64_t startUs, singleUs, batchUs;
+
+    encryptCtx = PltCreateCryptoContext();
+    singleCtx = PltCreateCryptoContext();
+    batchCtx = PltCreateCryptoContext();
+    CHECK(encryptCtx != NULL && singleCtx != NULL && batchCtx != NULL);
+
+    buildBatch(encryptCtx, algorithm, messages, messageSize);
+
+    startUs = LiGetMicroseconds();
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            messages[i].outputDataLength = sizeof(decrypted[i]);
+            CHECK(PltDecryptMessage(singleCtx, algorithm, flags,
+                                    key, sizeof(key),
+                                    messages[i].iv, ivLength,
+                                    messages[i].tag, tagLength,
+                                    messages[i].inputData, messages[i].inputDataLength,
+                                    messages[i].outputData, &messages[i].outputDataLength));
+        }
+    }
+    singleUs = LiGetMicroseconds() - startUs;
+    checkDecrypted(messages, messageSize);
+
+    memset(decrypted, 0, sizeof(decrypted));
+
+    startUs = LiGetMicroseconds();
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            messages[i].outputDataLength = sizeof(decrypted[i]);
+        }
+        CHECK(PltDecryptMessageBatch(batchCtx, algorithm, flags,
+                                     key, sizeof(key),
+                                     ivLength, tagLength,
+                                     messages, BATCH_SIZE));
+    }
+    batchUs = LiGetMicroseconds() - startUs;
+    checkDecrypted(messages, messageSize);
+
+    printf("%s %4d bytes: per-packet %7.1f ns/msg, batched %7.1f ns/msg, %5.2fx\n",
+           algorithm == ALGORITHM_AES_CBC ? "AES-CBC" : "AES-GCM",
+           messageSize,
+           singleUs * 1000.0 / (ITERATIONS * BATCH_SIZE),
+           batchUs * 1000.0 / (ITERATIONS * BATCH_SIZE),
+           batchUs > 0 ? (double)singleUs / batchUs : 0);
+
+    PltDestroyCryptoContext(encryptCtx);
+    PltDestroyCryptoContext(singleCtx);
+    PltDestroyCryptoContext(batchCtx);
+}
+
+int main(void) {
+    static const int messageSizes[] = { 64, 250, 500, MAX_MESSAGE_SIZE };
+
+    PltGenerateRandomData(key, sizeof(key));
+
+    for (size_t i = 0; i < sizeof(messageSizes) / sizeof(messageSizes[0]); i++) {
+        runBenchmark(ALGORITHM_AES_CBC, messageSizes[i]);
+    }
+    for (size_t i = 0; i < sizeof(messageSizes) / sizeof(messageSizes[0]); i++) {
+        runBenchmark(ALGORITHM_AES_GCM, messageSizes[i]);
+    }
+
+    checkKeyChange();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,306 @@
+// Stress tests the ring blocking queue with concurrent producers, consumers,
+// and pollers, checks its drain, shutdown, and user wake semantics, then
+// compares its throughput against the linked blocking queue.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RingBlockingQueue.h"
+
+#define STRESS_ITEMS 1000000
+#define STRESS_BOUND 32
+#define BENCH_ITEMS 2000000
+#define BENCH_BOUND 1024
+
+#define CHECK(x) \
+    if (!(x)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+        exit(EXIT_FAILURE); \
+    }
+
+static PLINKED_BLOCKING_QUEUE_ENTRY entries;
+static unsigned char* received;
+
+typedef struct _STRESS_CONSUMER {
+    PRING_BLOCKING_QUEUE queue;
+    bool poll;
+    int count;
+} STRESS_CONSUMER;
+
+static void produce(PRING_BLOCKING_QUEUE queue, int items) {
+    for (int i = 0; i < items; i++) {
+        int err;
+
+        // Real producers flush on overflow, but we want every item delivered.
+        // Yield rather than spin, since the consumers may share our CPU.
+        while ((err = RbqOfferQueueItem(queue, (void*)(uintptr_t)(i + 1), &entries[i])) == LBQ_BOUND_EXCEEDED) {
+            PltSleepMs(0);
+        }
+        CHECK(err == LBQ_SUCCESS);
+    }
+}
+
+static void stressConsumerThread(void* context) {
+    STRESS_CONSUMER* consumer = context;
+    uintptr_t last = 0;
+
+    for (;;) {
+        void* data;
+        int err;
+
+        if (consumer->poll) {
+            err = RbqPollQueueElement(consumer->queue, &data);
+            if (err == LBQ_NO_ELEMENT) {
+                PltSleepMs(0);
+                continue;
+            }
+        }
+        else {
+            err = RbqWaitForQueueElement(consumer->queue, &data);
+        }
+
+        if (err == LBQ_INTERRUPTED) {
+            break;
+        }
+        CHECK(err == LBQ_SUCCESS);
+
+        // Each consumer must see items in the order they were offered
+        CHECK((uintptr_t)data > last);
+        last = (uintptr_t)data;
+
+        // And no item may be returned twice
+        CHECK(!received[last - 1]);
+        received[last - 1] = 1;
+        consumer->count++;
+    }
+}
+
+static void testStress(void) {
+    RING_BLOCKING_QUEUE queue;
+    STRESS_CONSUMER waiter = { &queue, false, 0 };
+    STRESS_CONSUMER poller = { &queue, true, 0 };
+    PLT_THREAD waiterThread, pollerThread;
+
+    CHECK(RbqInitializeRingBlockingQueue(&queue, STRESS_BOUND) == 0);
+    memset(received, 0, STRESS_ITEMS);
+
+    CHECK(PltCreateThread("Waiter", stressConsumerThread, &waiter, &waiterThread) == 0);
+    CHECK(PltCreateThread("Poller", stressConsumerThread, &poller, &pollerThread) == 0);
+
+    produce(&queue, STRESS_ITEMS);
+
+    // Draining lets the consumers finish off what's left before exiting
+    RbqSignalQueueDrain(&queue);
+
+    PltJoinThread(&waiterThread);
+    PltCloseThread(&waiterThread);
+    PltJoinThread(&pollerThread);
+    PltCloseThread(&pollerThread);
+
+    CHECK(waiter.count + poller.count == STRESS_ITEMS);
+    CHECK(RbqDestroyRingBlockingQueue(&queue) == NULL);
+
+    printf("Stress: %d items (%d waited, %d polled)\n", STRESS_ITEMS, waiter.count, poller.count);
+}
+
+static void testDrain(void) {
+    RING_BLOCKING_QUEUE queue;
+    void* data;
+
+    CHECK(RbqInitializeRingBlockingQueue(&queue, 16) == 0);
+
+    produce(&queue, 10);
+    RbqSignalQueueDrain(&queue);
+
+    // Nothing new is accepted, but everything already queued is returned
+    CHECK(RbqOfferQueueItem(&queue, NULL, &entries[10]) == LBQ_INTERRUPTED);
+    for (int i = 0; i < 10; i++) {
+        CHECK(RbqWaitForQueueElement(&queue, &data) == LBQ_SUCCESS);
+        CHECK((uintptr_t)data == (uintptr_t)(i + 1));
+    }
+    CHECK(RbqWaitForQueueElement(&queue, &data) == LBQ_INTERRUPTED);
+    CHECK(RbqPollQueueElement(&queue, &data) == LBQ_INTERRUPTED);
+
+    CHECK(RbqDestroyRingBlockingQueue(&queue) == NULL);
+    printf("Drain: OK\n");
+}
+
+typedef struct _BLOCKED_WAITER {
+    PRING_BLOCKING_QUEUE queue;
+    int results[2];
+    uint64_t wakeTimeUs;
+} BLOCKED_WAITER;
+
+static void blockedWaiterThread(void* context) {
+    BLOCKED_WAITER* waiter = context;
+    void* data;
+
+    for (int i = 0; i < 2; i++) {
+        waiter->results[i] = RbqWaitForQueueElement(waiter->queue, &data);
+        if (i == 0) {
+            waiter->wakeTimeUs = LiGetMicroseconds();
+        }
+    }
+}
+
+// Blocks a waiter on an empty queue, wakes it with the given signal, and
+// returns how long it took the waiter to wake up
+static uint64_t wakeBlockedWaiter(void (*signal)(PRING_BLOCKING_QUEUE), int* results) {
+    RING_BLOCKING_QUEUE queue;
+    BLOCKED_WAITER waiter = { &queue, { -1, -1 }, 0 };
+    PLT_THREAD thread;
+    uint64_t signalTimeUs;
+    PLINKED_BLOCKING_QUEUE_ENTRY remaining;
+
+    CHECK(RbqInitializeRingBlockingQueue(&queue, 16) == 0);
+    CHECK(PltCreateThread("Blocked waiter", blockedWaiterThread, &waiter, &thread) == 0);
+
+    // Give the waiter time to spin out and go to sleep
+    PltSleepMs(100);
+
+    signalTimeUs = LiGetMicroseconds();
+    signal(&queue);
+
+    // The second wait either returns right away or needs an item
+    PltSleepMs(10);
+    RbqOfferQueueItem(&queue, (void*)1, &entries[0]);
+    RbqSignalQueueShutdown(&queue);
+
+    PltJoinThread(&thread);
+    PltCloseThread(&thread);
+
+    remaining = RbqDestroyRingBlockingQueue(&queue);
+    CHECK(remaining == NULL || remaining == &entries[0]);
+
+    results[0] = waiter.results[0];
+    results[1] = waiter.results[1];
+    return waiter.wakeTimeUs - signalTimeUs;
+}
+
+static void testShutdown(void) {
+    RING_BLOCKING_QUEUE queue;
+    int results[2];
+    uint64_t wakeUs;
+    void* data;
+
+    wakeUs = wakeBlockedWaiter(RbqSignalQueueShutdown, results);
+    CHECK(results[0] == LBQ_INTERRUPTED);
+    CHECK(results[1] == LBQ_INTERRUPTED);
+
+    // Shutdown takes effect even if there's data available
+    CHECK(RbqInitializeRingBlockingQueue(&queue, 16) == 0);
+    produce(&queue, 5);
+    RbqSignalQueueShutdown(&queue);
+    CHECK(RbqWaitForQueueElement(&queue, &data) == LBQ_INTERRUPTED);
+    CHECK(RbqPollQueueElement(&queue, &data) == LBQ_INTERRUPTED);
+    CHECK(RbqOfferQueueItem(&queue, NULL, &entries[5]) == LBQ_INTERRUPTED);
+    CHECK(RbqDestroyRingBlockingQueue(&queue) == &entries[0]);
+
+    printf("Shutdown: OK (woke in %llu us)\n", (unsigned long long)wakeUs);
+}
+
+static void testUserWake(void) {
+    int results[2];
+    uint64_t wakeUs;
+
+    // A user wake is returned once, then the waiter goes back to waiting
+    wakeUs = wakeBlockedWaiter(RbqSignalQueueUserWake, results);
+    CHECK(results[0] == LBQ_USER_WAKE);
+    CHECK(results[1] == LBQ_SUCCESS || results[1] == LBQ_INTERRUPTED);
+
+    printf("User wake: OK (woke in %llu us)\n", (unsigned long long)wakeUs);
+}
+
+typedef struct _BENCH_CONTEXT {
+    void* queue;
+    bool ring;
+} BENCH_CONTEXT;
+
+static void benchConsumerThread(void* context) {
+    BENCH_CONTEXT* bench = context;
+    void* data;
+
+    for (int i = 0; i < BENCH_ITEMS; i++) {
+        int err = bench->ring ?
+                    RbqWaitForQueueElement(bench->queue, &data) :
+                    LbqWaitForQueueElement(bench->queue, &data);
+        CHECK(err == LBQ_SUCCESS);
+    }
+}
+
+static void benchmark(bool ring) {
+    RING_BLOCKING_QUEUE rbq;
+    LINKED_BLOCKING_QUEUE lbq;
+    BENCH_CONTEXT bench;
+    PLT_THREAD thread;
+    uint64_t startUs, elapsedUs;
+    int overflows = 0;
+
+    if (ring) {
+        CHECK(RbqInitializeRingBlockingQueue(&rbq, BENCH_BOUND) == 0);
+        bench.queue = &rbq;
+    }
+    else {
+        CHECK(LbqInitializeLinkedBlockingQueue(&lbq, BENCH_BOUND) == 0);
+        bench.queue = &lbq;
+    }
+    bench.ring = ring;
+
+    CHECK(PltCreateThread("Bench consumer", benchConsumerThread, &bench, &thread) == 0);
+
+    startUs = LiGetMicroseconds();
+    for (int i = 0; i < BENCH_ITEMS; i++) {
+        int err;
+
+        for (;;) {
+            err = ring ?
+                    RbqOfferQueueItem(&rbq, NULL, &entries[i]) :
+                    LbqOfferQueueItem(&lbq, NULL, &entries[i]);
+            if (err != LBQ_BOUND_EXCEEDED) {
+                break;
+            }
+
+            overflows++;
+            PltSleepMs(0);
+        }
+        CHECK(err == LBQ_SUCCESS);
+    }
+
+    PltJoinThread(&thread);
+    PltCloseThread(&thread);
+    elapsedUs = LiGetMicroseconds() - startUs;
+
+    if (ring) {
+        RbqSignalQueueShutdown(&rbq);
+        RbqDestroyRingBlockingQueue(&rbq);
+    }
+    else {
+        LbqSignalQueueShutdown(&lbq);
+        LbqDestroyLinkedBlockingQueue(&lbq);
+    }
+
+    printf("%s: %.1f ns/item, %.2f M items/s (%d full queue retries)\n",
+           ring ? "Ring blocking queue  " : "Linked blocking queue",
+           elapsedUs * 1000.0 / BENCH_ITEMS,
+           BENCH_ITEMS / (double)elapsedUs,
+           overflows);
+}
+
+int main(void) {
+    entries = calloc(STRESS_ITEMS > BENCH_ITEMS ? STRESS_ITEMS : BENCH_ITEMS, sizeof(*entries));
+    received = malloc(STRESS_ITEMS);
+    CHECK(entries != NULL && received != NULL);
+
+    testStress();
+    testDrain();
+    testShutdown();
+    testUserWake();
+
+    benchmark(false);
+    benchmark(true);
+
+    free(entries);
+    free(received);
+    return EXIT_SUCCESS;
+}
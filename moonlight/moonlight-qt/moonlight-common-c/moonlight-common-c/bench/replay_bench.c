@@ -0,0 +1,344 @@
+// Replays a recorded H.264 or HEVC elementary stream through the RTP queue,
+// FEC and depacketizer with LiStartVideoReplay(), optionally with simulated
+// packet loss, reordering and duplication. No decoder is involved, so this
+// measures the library's share of the video pipeline. Every frame that comes
+// out of the depacketizer is checked byte for byte against the recording.
+//
+// The stream must be laid out like a host's (parameter sets followed by the
+// IDR slice), so streams using extensions like SVC trip assertions in debug
+// builds. JM_cqm_cabac.264 from the h264bitstream samples works well.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Limelight.h>
+#include "PlatformThreads.h"
+
+#define CHECK(x) \
+    if (!(x)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+        exit(EXIT_FAILURE); \
+    }
+
+static unsigned char* streamData;
+static size_t streamLength;
+static size_t streamCursor;
+
+static unsigned char* frameBuffer;
+static size_t frameBufferSize;
+
+static uint32_t framesInOrder;
+static uint32_t framesAfterGap;
+static uint32_t framesRepeated;
+static uint32_t framesCorrupted;
+static uint32_t idrFrames;
+static uint64_t bytesDelivered;
+
+static void logMessage(const char* format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static bool isHevc;
+
+// Returns the offset of the next Annex B start sequence or length if there are none
+static size_t findStartSequence(const unsigned char* data, size_t length, size_t offset) {
+    while (offset + 3 <= length) {
+        if (data[offset] == 0 && data[offset + 1] == 0 && data[offset + 2] == 1) {
+            return offset;
+        }
+        offset++;
+    }
+
+    return length;
+}
+
+// The depacketizer drops AUD and SEI NALUs and the padding around them, and
+// either start sequence length may come out. To compare the output with the
+// recording, we rewrite both with a 3 byte start sequence before each NALU,
+// no trailing zero bytes, and no AUD or SEI NALUs. Returns the new length.
+static size_t canonicalizeNalus(const unsigned char* data, size_t length, unsigned char* output) {
+    size_t outputLength = 0;
+    size_t offset = findStartSequence(data, length, 0);
+
+    while (offset < length) {
+        size_t nal = offset + 3;
+        size_t end = findStartSequence(data, length, nal);
+        size_t nextOffset = end;
+        bool skip;
+
+        while (end > nal && data[end - 1] == 0) {
+            end--;
+        }
+
+        if (nal < length) {
+            if (isHevc) {
+                int type = (data[nal] >> 1) & 0x3F;
+                skip = type == 35 || type == 39;
+            }
+            else {
+                int type = data[nal] & 0x1F;
+                skip = type == 6 || type == 9;
+            }
+
+            if (!skip) {
+                memcpy(&output[outputLength], &data[offset], end - offset);
+                outputLength += end - offset;
+            }
+        }
+
+        offset = nextOffset;
+    }
+
+    return outputLength;
+}
+
+// Returns the offset of data in the stream at or after start, or -1 if it isn't there
+static long findInStream(const unsigned char* data, size_t length, size_t start) {
+    for (size_t offset = start; offset + length <= streamLength; offset++) {
+        if (streamData[offset] == data[0] && memcmp(&streamData[offset], data, length) == 0) {
+            return (long)offset;
+        }
+    }
+
+    return -1;
+}
+
+static int submitDecodeUnit(PDECODE_UNIT decodeUnit) {
+    size_t length = 0;
+    long offset;
+
+    if ((size_t)decodeUnit->fullLength > frameBufferSize) {
+        frameBufferSize = decodeUnit->fullLength;
+        frameBuffer = realloc(frameBuffer, frameBufferSize);
+        CHECK(frameBuffer != NULL);
+    }
+
+    for (PLENTRY entry = decodeUnit->bufferList; entry != NULL; entry = entry->next) {
+        CHECK(length + entry->length <= (size_t)decodeUnit->fullLength);
+        memcpy(&frameBuffer[length], entry->data, entry->length);
+        length += entry->length;
+    }
+    CHECK(length == (size_t)decodeUnit->fullLength);
+
+    bytesDelivered += length;
+    length = canonicalizeNalus(frameBuffer, length, frameBuffer);
+    CHECK(length != 0);
+    if (decodeUnit->frameType == FRAME_TYPE_IDR) {
+        idrFrames++;
+    }
+
+    // Frames come out in stream order, except that frames can be skipped after
+    // unrecoverable loss and the last IDR frame is resent when we ask for one.
+    if (streamCursor + length <= streamLength && memcmp(&streamData[streamCursor], frameBuffer, length) == 0) {
+        framesInOrder++;
+        streamCursor += length;
+    }
+    else if ((offset = findInStream(frameBuffer, length, streamCursor)) >= 0) {
+        framesAfterGap++;
+        streamCursor = offset + length;
+    }
+    else if (findInStream(frameBuffer, length, 0) >= 0) {
+        framesRepeated++;
+    }
+    else {
+        fprintf(stderr, "Frame %d (%zu bytes) doesn't match the recording\n",
+                decodeUnit->frameNumber, length);
+        framesCorrupted++;
+    }
+
+    return DR_OK;
+}
+
+static int parseIntArg(int argc, char* argv[], int* i) {
+    CHECK(*i + 1 < argc);
+    return atoi(argv[++(*i)]);
+}
+
+static void printUsage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options] <H.264 or HEVC stream>\n"
+            "  --hevc                 the stream is HEVC rather than H.264\n"
+            "  --timing <file>        recorder timing file (otherwise frames are split on access units)\n"
+            "  --fps <rate>           frame rate without a timing file (default 60)\n"
+            "  --speed <percent>      pace as a percentage of the recorded pace (default 0, unpaced)\n"
+            "  --loops <count>        replay the stream this many times (default 1)\n"
+            "  --packet-size <bytes>  video packet size (default 1392)\n"
+            "  --fec <percent>        FEC parity percentage (default 20)\n"
+            "  --loss <percent>       packet loss\n"
+            "  --burst <packets>      mean loss burst length\n"
+            "  --reorder <percent>    packets held back for reordering\n"
+            "  --reorder-depth <n>    maximum reorder distance\n"
+            "  --duplicate <percent>  duplicated packets\n"
+            "  --audio <ms>           also send a paced synthetic audio stream (use with --speed)\n"
+            "  --seed <n>             impairment seed (default 1)\n",
+            program);
+}
+
+int main(int argc, char* argv[]) {
+    VIDEO_REPLAY_CONFIGURATION config;
+    VIDEO_REPLAY_STATS stats, totals;
+    CONNECTION_LISTENER_CALLBACKS clCallbacks;
+    DECODER_RENDERER_CALLBACKS drCallbacks;
+    uint64_t startUs, elapsedUs;
+    int loops = 1;
+    FILE* file;
+
+    LiInitializeVideoReplayConfiguration(&config);
+    config.videoFormat = VIDEO_FORMAT_H264;
+    config.width = 1280;
+    config.height = 720;
+    config.fps = 60;
+    config.speedPercent = 0;
+    config.impairment.seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hevc") == 0) {
+            config.videoFormat = VIDEO_FORMAT_H265;
+            isHevc = true;
+        }
+        else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            config.timingFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fps") == 0) {
+            config.fps = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--speed") == 0) {
+            config.speedPercent = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--loops") == 0) {
+            loops = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--packet-size") == 0) {
+            config.packetSize = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--fec") == 0) {
+            config.fecPercentage = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--loss") == 0) {
+            config.impairment.lossPercent = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--burst") == 0) {
+            config.impairment.burstLength = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--reorder") == 0) {
+            config.impairment.reorderPercent = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--reorder-depth") == 0) {
+            config.impairment.reorderDepth = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--duplicate") == 0) {
+            config.impairment.duplicatePercent = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--audio") == 0) {
+            config.audioPacketDuration = parseIntArg(argc, argv, &i);
+        }
+        else if (strcmp(argv[i], "--seed") == 0) {
+            config.impairment.seed = (unsigned int)parseIntArg(argc, argv, &i);
+        }
+        else if (argv[i][0] != '-' && config.streamFile == NULL) {
+            config.streamFile = argv[i];
+        }
+        else {
+            printUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (config.streamFile == NULL || loops <= 0) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Keep our own copy of the recording to check the frames against
+    file = fopen(config.streamFile, "rb");
+    CHECK(file != NULL);
+    CHECK(fseek(file, 0, SEEK_END) == 0);
+    streamLength = (size_t)ftell(file);
+    CHECK(fseek(file, 0, SEEK_SET) == 0);
+    streamData = malloc(streamLength);
+    CHECK(streamData != NULL && fread(streamData, 1, streamLength, file) == streamLength);
+    fclose(file);
+    streamLength = canonicalizeNalus(streamData, streamLength, streamData);
+
+    memset(&clCallbacks, 0, sizeof(clCallbacks));
+    clCallbacks.logMessage = logMessage;
+
+    LiInitializeVideoCallbacks(&drCallbacks);
+    drCallbacks.submitDecodeUnit = submitDecodeUnit;
+    drCallbacks.capabilities = CAPABILITY_DIRECT_SUBMIT;
+
+    memset(&totals, 0, sizeof(totals));
+    elapsedUs = 0;
+    for (int loop = 0; loop < loops; loop++) {
+        streamCursor = 0;
+        startUs = LiGetMicroseconds();
+
+        CHECK(LiStartVideoReplay(&config, &clCallbacks, &drCallbacks, NULL, 0) == 0);
+        while (!LiIsVideoReplayFinished()) {
+            PltSleepMs(1);
+        }
+        LiGetVideoReplayStats(&stats);
+        LiStopVideoReplay();
+
+        elapsedUs += LiGetMicroseconds() - startUs;
+
+        totals.framesSent += stats.framesSent;
+        totals.framesDelivered += stats.framesDelivered;
+        totals.framesRecovered += stats.framesRecovered;
+        totals.packetsSent += stats.packetsSent;
+        totals.packetsDropped += stats.packetsDropped;
+        totals.packetsReordered += stats.packetsReordered;
+        totals.packetsDuplicated += stats.packetsDuplicated;
+        totals.idrFramesResent += stats.idrFramesResent;
+        totals.totalAddedLatencyUs += stats.totalAddedLatencyUs;
+        if (stats.maxAddedLatencyUs > totals.maxAddedLatencyUs) {
+            totals.maxAddedLatencyUs = stats.maxAddedLatencyUs;
+        }
+        totals.totalQueueTimeUs += stats.totalQueueTimeUs;
+        totals.audioPacketsSent += stats.audioPacketsSent;
+        totals.audioPacketsDelivered += stats.audioPacketsDelivered;
+        totals.audioPacketsRecovered += stats.audioPacketsRecovered;
+        totals.audioPacketsLost += stats.audioPacketsLost;
+        totals.audioPacketsCorrupted += stats.audioPacketsCorrupted;
+    }
+
+    printf("Frames: %u sent, %u delivered (%u in order, %u after a gap, %u repeated IDR, %u corrupted), %u IDR, %u recovered from FEC\n",
+           totals.framesSent, totals.framesDelivered, framesInOrder, framesAfterGap, framesRepeated,
+           framesCorrupted, idrFrames, totals.framesRecovered);
+    printf("Packets: %u sent, %u dropped, %u reordered, %u duplicated\n",
+           totals.packetsSent, totals.packetsDropped, totals.packetsReordered, totals.packetsDuplicated);
+    printf("Throughput: %.0f frames/s, %.1f MB/s over %.3f s\n",
+           totals.framesDelivered * 1000000.0 / elapsedUs,
+           bytesDelivered / (double)elapsedUs,
+           elapsedUs / 1000000.0);
+    printf("Queue time: %.2f us per packet\n",
+           totals.packetsSent != 0 ? (double)totals.totalQueueTimeUs / totals.packetsSent : 0.0);
+    printf("Added latency: %.2f ms average, %.2f ms max\n",
+           totals.framesDelivered != 0 ? totals.totalAddedLatencyUs / 1000.0 / totals.framesDelivered : 0.0,
+           totals.maxAddedLatencyUs / 1000.0);
+    if (config.audioPacketDuration > 0) {
+        printf("Audio: %u packets sent, %u delivered (%u recovered), %u lost, %u corrupted\n",
+               totals.audioPacketsSent, totals.audioPacketsDelivered, totals.audioPacketsRecovered,
+               totals.audioPacketsLost, totals.audioPacketsCorrupted);
+    }
+
+    CHECK(framesCorrupted == 0);
+    CHECK(totals.audioPacketsCorrupted == 0);
+    CHECK(framesInOrder + framesAfterGap + framesRepeated == totals.framesDelivered);
+
+    // Without impairments, every frame must arrive intact and in order
+    if (config.impairment.lossPercent == 0 && config.impairment.reorderPercent == 0 &&
+            config.impairment.duplicatePercent == 0) {
+        CHECK(framesInOrder == totals.framesSent);
+    }
+
+    free(frameBuffer);
+    free(streamData);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+// Times reed_solomon_reconstruct() with each GF(2^8) kernel the CPU supports
+// and checks that every kernel recovers exactly the data that was erased.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Limelight.h>
+#include "rs.h"
+
+#define ITERATIONS 2000
+
+// Video FEC blocks are sent as up to 255 shards of one packet each
+static const struct {
+    int dataShards;
+    int parityShards;
+    int blockSize;
+} configs[] = {
+    { 4, 1, 1392 },
+    { 20, 4, 1392 },
+    { 64, 16, 1392 },
+    { 200, 50, 1392 },
+};
+
+static const struct {
+    int kernel;
+    const char* name;
+} kernels[] = {
+    { RS_KERNEL_SCALAR, "scalar" },
+    { RS_KERNEL_SSSE3, "SSSE3 (PSHUFB)" },
+    { RS_KERNEL_AVX2, "AVX2 (PSHUFB)" },
+    { RS_KERNEL_GFNI, "AVX-512 GFNI" },
+};
+
+static int runConfig(int dataShards, int parityShards, int blockSize) {
+    int totalShards = dataShards + parityShards;
+    reed_solomon* rs;
+    unsigned char** shards;
+    unsigned char** original;
+    unsigned char* marks;
+    double scalarUs = 0;
+    int failed = 0;
+
+    rs = reed_solomon_new(dataShards, parityShards);
+    shards = malloc(sizeof(*shards) * totalShards);
+    original = malloc(sizeof(*original) * totalShards);
+    marks = calloc(totalShards, 1);
+    if (rs == NULL || shards == NULL || original == NULL || marks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < totalShards; i++) {
+        shards[i] = malloc(blockSize);
+        original[i] = malloc(blockSize);
+        if (shards[i] == NULL || original[i] == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (i < dataShards) {
+            for (int j = 0; j < blockSize; j++) {
+                shards[i][j] = (unsigned char)rand();
+            }
+        }
+    }
+
+    // Generate the parity with the scalar kernel as the reference
+    reed_solomon_set_kernel(RS_KERNEL_SCALAR);
+    reed_solomon_encode(rs, shards, totalShards, blockSize);
+    for (int i = 0; i < totalShards; i++) {
+        memcpy(original[i], shards[i], blockSize);
+    }
+
+    // Lose as many data shards as we have parity, which is the worst case
+    for (int i = 0; i < parityShards; i++) {
+        int shard;
+
+        do {
+            shard = rand() % dataShards;
+        } while (marks[shard]);
+
+        marks[shard] = 1;
+    }
+
+    printf("%d data + %d parity shards of %d bytes:\n", dataShards, parityShards, blockSize);
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        uint64_t totalUs = 0;
+        double usPerBlock;
+
+        if (!reed_solomon_set_kernel(kernels[k].kernel)) {
+            printf("  %-16s unsupported\n", kernels[k].name);
+            continue;
+        }
+
+        for (int iter = 0; iter < ITERATIONS; iter++) {
+            uint64_t startUs;
+
+            for (int i = 0; i < dataShards; i++) {
+                if (marks[i]) {
+                    memset(shards[i], 0, blockSize);
+                }
+            }
+
+            startUs = LiGetMicroseconds();
+            if (reed_solomon_reconstruct(rs, shards, marks, totalShards, blockSize) != 0) {
+                printf("  %-16s reconstruction failed\n", kernels[k].name);
+                failed = 1;
+                break;
+            }
+            totalUs += LiGetMicroseconds() - startUs;
+        }
+
+        for (int i = 0; i < dataShards; i++) {
+            if (memcmp(shards[i], original[i], blockSize) != 0) {
+                printf("  %-16s shard %d doesn't match the scalar result\n", kernels[k].name, i);
+                failed = 1;
+                break;
+            }
+        }
+
+        usPerBlock = (double)totalUs / ITERATIONS;
+        if (kernels[k].kernel == RS_KERNEL_SCALAR) {
+            scalarUs = usPerBlock;
+        }
+
+        printf("  %-16s %8.2f us/block %8.1f MB/s %6.2fx\n",
+               kernels[k].name,
+               usPerBlock,
+               usPerBlock > 0 ? (double)parityShards * blockSize / usPerBlock : 0,
+               usPerBlock > 0 ? scalarUs / usPerBlock : 0);
+    }
+
+    for (int i = 0; i < totalShards; i++) {
+        free(shards[i]);
+        free(original[i]);
+    }
+    free(shards);
+    free(original);
+    free(marks);
+    reed_solomon_release(rs);
+
+    return failed;
+}
+
+int main(void) {
+    int failed = 0;
+
+    srand(1234);
+    reed_solomon_init();
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        failed |= runConfig(configs[i].dataShards, configs[i].parityShards, configs[i].blockSize);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -46,6 +46,30 @@
 #define alloca(x) _alloca(x)
 #endif
 
+/*
+ * SIMD kernels for x86. They are compiled with per-function target attributes
+ * (GCC/Clang) so the rest of the library doesn't require these instruction sets,
+ * and they are selected at runtime by reed_solomon_init() based on CPUID.
+ */
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RS_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RS_TARGET(x)
+#else
+#include <cpuid.h>
+#define RS_TARGET(x) __attribute__((target(x)))
+#endif
+
+/* GFNI intrinsics require a reasonably recent compiler */
+#if (defined(__clang__) && __clang_major__ >= 7) || \
+    (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8) || \
+    (defined(_MSC_VER) && _MSC_VER >= 1920)
+#define RS_X86_GFNI
+#endif
+#endif
+
 typedef unsigned char gf;
 
 #define GF_BITS  8
@@ -81,6 +105,26 @@ static gf __declspec(align (256)) gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)];
 static gf gf_mul_table[(GF_SIZE + 1)*(GF_SIZE + 1)] __attribute__((aligned (256)));
 #endif
 
+/*
+ * Split-nibble multiplication tables used by the PSHUFB kernels:
+ * c*x == gf_mul_lo[c][x & 0xF] ^ gf_mul_hi[c][x >> 4]
+ */
+#ifdef _MSC_VER
+static gf __declspec(align (32)) gf_mul_lo[GF_SIZE + 1][16];
+static gf __declspec(align (32)) gf_mul_hi[GF_SIZE + 1][16];
+#else
+static gf gf_mul_lo[GF_SIZE + 1][16] __attribute__((aligned (32)));
+static gf gf_mul_hi[GF_SIZE + 1][16] __attribute__((aligned (32)));
+#endif
+
+/*
+ * Multiplication by a constant is linear over GF(2), so it can also be
+ * expressed as an 8x8 bit matrix for the GFNI affine transform instruction.
+ * This works for our field polynomial, unlike GF2P8MULB which is hardwired
+ * to the AES polynomial.
+ */
+static unsigned long long gf_affine[GF_SIZE + 1];
+
 /*
  * modnn(x) computes x % GF_SIZE, where GF_SIZE is 2**GF_BITS - 1,
  * without a slow divide.
@@ -93,7 +137,7 @@ static inline gf modnn(int x) {
     return x;
 }
 
-static void addmul(gf *dst1, gf *src1, gf c, int sz) {
+static void addmul_scalar(gf *dst1, gf *src1, gf c, int sz) {
     USE_GF_MULC;
     if (c != 0) {
         register gf *dst = dst1, *src = src1;
@@ -105,7 +149,7 @@ static void addmul(gf *dst1, gf *src1, gf c, int sz) {
     }
 }
 
-static void mul(gf *dst1, gf *src1, gf c, int sz) {
+static void mul_scalar(gf *dst1, gf *src1, gf c, int sz) {
     USE_GF_MULC;
     if (c != 0) {
         register gf *dst = dst1, *src = src1;
@@ -114,7 +158,262 @@ static void mul(gf *dst1, gf *src1, gf c, int sz) {
         for (; dst < lim; dst++, src++)
             GF_MULC(*dst , *src);
     } else
-        memset(dst1, 0, c);
+        memset(dst1, 0, sz);
+}
+
+#ifdef RS_X86_SIMD
+RS_TARGET("ssse3")
+static void addmul_ssse3(gf *dst, gf *src, gf c, int sz) {
+    __m128i lo, hi, mask;
+    int i = 0;
+
+    if (c == 0)
+        return;
+
+    lo = _mm_load_si128((const __m128i*)gf_mul_lo[c]);
+    hi = _mm_load_si128((const __m128i*)gf_mul_hi[c]);
+    mask = _mm_set1_epi8(0x0F);
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)&src[i]);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),
+                                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(_mm_loadu_si128((const __m128i*)&dst[i]), p));
+    }
+
+    addmul_scalar(&dst[i], &src[i], c, sz - i);
+}
+
+RS_TARGET("ssse3")
+static void mul_ssse3(gf *dst, gf *src, gf c, int sz) {
+    __m128i lo, hi, mask;
+    int i = 0;
+
+    if (c == 0) {
+        memset(dst, 0, sz);
+        return;
+    }
+
+    lo = _mm_load_si128((const __m128i*)gf_mul_lo[c]);
+    hi = _mm_load_si128((const __m128i*)gf_mul_hi[c]);
+    mask = _mm_set1_epi8(0x0F);
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)&src[i]);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),
+                                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+        _mm_storeu_si128((__m128i*)&dst[i], p);
+    }
+
+    mul_scalar(&dst[i], &src[i], c, sz - i);
+}
+
+RS_TARGET("avx2")
+static void addmul_avx2(gf *dst, gf *src, gf c, int sz) {
+    __m256i lo, hi, mask;
+    int i = 0;
+
+    if (c == 0)
+        return;
+
+    lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_lo[c]));
+    hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_hi[c]));
+    mask = _mm256_set1_epi8(0x0F);
+
+    for (; i + 32 <= sz; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)&src[i]);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)),
+                                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)&dst[i]), p));
+    }
+
+    addmul_scalar(&dst[i], &src[i], c, sz - i);
+}
+
+RS_TARGET("avx2")
+static void mul_avx2(gf *dst, gf *src, gf c, int sz) {
+    __m256i lo, hi, mask;
+    int i = 0;
+
+    if (c == 0) {
+        memset(dst, 0, sz);
+        return;
+    }
+
+    lo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_lo[c]));
+    hi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)gf_mul_hi[c]));
+    mask = _mm256_set1_epi8(0x0F);
+
+    for (; i + 32 <= sz; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)&src[i]);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)),
+                                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        _mm256_storeu_si256((__m256i*)&dst[i], p);
+    }
+
+    mul_scalar(&dst[i], &src[i], c, sz - i);
+}
+
+#ifdef RS_X86_GFNI
+RS_TARGET("avx512f,avx512bw,gfni")
+static void addmul_gfni(gf *dst, gf *src, gf c, int sz) {
+    __m512i a;
+    int i = 0;
+
+    if (c == 0)
+        return;
+
+    a = _mm512_set1_epi64((long long)gf_affine[c]);
+
+    for (; i + 64 <= sz; i += 64) {
+        __m512i p = _mm512_gf2p8affine_epi64_epi8(_mm512_loadu_si512((const void*)&src[i]), a, 0);
+        _mm512_storeu_si512((void*)&dst[i], _mm512_xor_si512(_mm512_loadu_si512((const void*)&dst[i]), p));
+    }
+
+    addmul_scalar(&dst[i], &src[i], c, sz - i);
+}
+
+RS_TARGET("avx512f,avx512bw,gfni")
+static void mul_gfni(gf *dst, gf *src, gf c, int sz) {
+    __m512i a;
+    int i = 0;
+
+    if (c == 0) {
+        memset(dst, 0, sz);
+        return;
+    }
+
+    a = _mm512_set1_epi64((long long)gf_affine[c]);
+
+    for (; i + 64 <= sz; i += 64) {
+        __m512i p = _mm512_gf2p8affine_epi64_epi8(_mm512_loadu_si512((const void*)&src[i]), a, 0);
+        _mm512_storeu_si512((void*)&dst[i], p);
+    }
+
+    mul_scalar(&dst[i], &src[i], c, sz - i);
+}
+#endif
+
+#define RS_CPU_SSSE3   0x1
+#define RS_CPU_AVX2    0x2
+#define RS_CPU_AVX512  0x4
+#define RS_CPU_GFNI    0x8
+
+static void cpuid_count(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+    if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3]))
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+static unsigned long long read_xcr0(void) {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static int detect_cpu_features(void) {
+    unsigned int regs[4];
+    unsigned long long xcr0 = 0;
+    int features = 0;
+
+    cpuid_count(0, 0, regs);
+    if (regs[0] < 1)
+        return 0;
+
+    cpuid_count(1, 0, regs);
+    if (regs[2] & (1 << 9))
+        features |= RS_CPU_SSSE3;
+
+    /* Wider registers also require the OS to save their state (OSXSAVE + XCR0) */
+    if (regs[2] & (1 << 27))
+        xcr0 = read_xcr0();
+
+    cpuid_count(0, 0, regs);
+    if (regs[0] < 7)
+        return features;
+
+    cpuid_count(7, 0, regs);
+    if ((regs[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+        features |= RS_CPU_AVX2;
+    if ((regs[1] & (1 << 16)) && (regs[1] & (1u << 30)) && (xcr0 & 0xE6) == 0xE6)
+        features |= RS_CPU_AVX512;
+    if (regs[2] & (1 << 8))
+        features |= RS_CPU_GFNI;
+
+    return features;
+}
+#endif
+
+/* Selected by reed_solomon_init() */
+static void (*addmul_impl)(gf *dst, gf *src, gf c, int sz) = addmul_scalar;
+static void (*mul_impl)(gf *dst, gf *src, gf c, int sz) = mul_scalar;
+static const char* kernel_name = "scalar";
+
+static void addmul(gf *dst, gf *src, gf c, int sz) {
+    addmul_impl(dst, src, c, sz);
+}
+
+static void mul(gf *dst, gf *src, gf c, int sz) {
+    mul_impl(dst, src, c, sz);
+}
+
+int reed_solomon_set_kernel(int kernel) {
+#ifdef RS_X86_SIMD
+    int features = detect_cpu_features();
+#endif
+
+    switch (kernel) {
+    case RS_KERNEL_SCALAR:
+        addmul_impl = addmul_scalar;
+        mul_impl = mul_scalar;
+        kernel_name = "scalar";
+        return 1;
+#ifdef RS_X86_SIMD
+    case RS_KERNEL_SSSE3:
+        if (!(features & RS_CPU_SSSE3))
+            return 0;
+        addmul_impl = addmul_ssse3;
+        mul_impl = mul_ssse3;
+        kernel_name = "SSSE3";
+        return 1;
+    case RS_KERNEL_AVX2:
+        if (!(features & RS_CPU_AVX2))
+            return 0;
+        addmul_impl = addmul_avx2;
+        mul_impl = mul_avx2;
+        kernel_name = "AVX2";
+        return 1;
+#ifdef RS_X86_GFNI
+    case RS_KERNEL_GFNI:
+        if ((features & (RS_CPU_AVX512 | RS_CPU_GFNI)) != (RS_CPU_AVX512 | RS_CPU_GFNI))
+            return 0;
+        addmul_impl = addmul_gfni;
+        mul_impl = mul_gfni;
+        kernel_name = "AVX-512 GFNI";
+        return 1;
+#endif
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void select_kernels(void) {
+    /* Use the fastest kernel this CPU supports */
+    if (reed_solomon_set_kernel(RS_KERNEL_GFNI) ||
+            reed_solomon_set_kernel(RS_KERNEL_AVX2) ||
+            reed_solomon_set_kernel(RS_KERNEL_SSSE3)) {
+        return;
+    }
+
+    reed_solomon_set_kernel(RS_KERNEL_SCALAR);
 }
 
 /* y = a.dot(b) */
@@ -149,6 +448,30 @@ static void init_mul_table(void) {
 
     for (j=0; j< GF_SIZE+1; j++)
         gf_mul_table[j] = gf_mul_table[j<<8] = 0;
+
+    for (i=0; i< GF_SIZE+1; i++) {
+        unsigned long long a = 0;
+
+        for (j=0; j< 16; j++) {
+            int hi = j << 4;
+
+            gf_mul_lo[i][j] = gf_mul(i, j);
+            gf_mul_hi[i][j] = gf_mul(i, hi);
+        }
+
+        /* Row r (stored in byte 7-r) selects the input bits that produce output bit r */
+        for (j=0; j< GF_BITS; j++) {
+            int bit = 1 << j;
+            gf col = gf_mul(i, bit);
+            int r;
+
+            for (r=0; r< GF_BITS; r++) {
+                if (col & (1 << r))
+                    a |= 1ULL << (8*(7-r) + j);
+            }
+        }
+        gf_affine[i] = a;
+    }
 }
 
 /*
@@ -380,6 +703,11 @@ static inline int code_some_shards(gf* matrixRows, gf** inputs, gf** outputs, in
 void reed_solomon_init(void) {
     generate_gf();
     init_mul_table();
+    select_kernels();
+}
+
+const char* reed_solomon_kernel_name(void) {
+    return kernel_name;
 }
 
 reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
@@ -389,7 +717,7 @@ reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
     reed_solomon* rs = NULL;
 
     do {
-        rs = malloc(sizeof(reed_solomon));
+        rs = calloc(1, sizeof(reed_solomon));
         if (NULL == rs)
             return NULL;
 
@@ -473,6 +801,11 @@ reed_solomon* reed_solomon_new(int data_shards, int parity_shards) {
 
 void reed_solomon_release(reed_solomon* rs) {
     if (NULL != rs) {
+        for (int i = 0; i < DECODE_CACHE_SIZE; i++) {
+            if (NULL != rs->decode_cache[i].matrix)
+                free(rs->decode_cache[i].matrix);
+        }
+
         if (NULL != rs->m)
             free(rs->m);
 
@@ -483,6 +816,61 @@ void reed_solomon_release(reed_solomon* rs) {
     }
 }
 
+/**
+ * find the cached inverse for an erasure pattern
+ * return NULL on miss
+ * */
+static gf* decode_cache_lookup(reed_solomon* rs, const unsigned int* key) {
+    decode_cache_entry* entry;
+    int i;
+
+    for (i = 0; i < DECODE_CACHE_SIZE; i++) {
+        entry = &rs->decode_cache[i];
+        if (NULL != entry->matrix && 0 == memcmp(entry->key, key, sizeof(entry->key))) {
+            entry->last_used = ++rs->decode_cache_clock;
+            rs->decode_cache_hits++;
+            return entry->matrix;
+        }
+    }
+
+    rs->decode_cache_misses++;
+    return NULL;
+}
+
+/**
+ * store the inverse for an erasure pattern, evicting the least recently used entry
+ * failure to allocate just leaves the pattern uncached
+ * */
+static void decode_cache_insert(reed_solomon* rs, const unsigned int* key, gf* matrix, int nr_rows) {
+    decode_cache_entry* victim = &rs->decode_cache[0];
+    int i;
+
+    for (i = 0; i < DECODE_CACHE_SIZE; i++) {
+        decode_cache_entry* entry = &rs->decode_cache[i];
+        if (NULL == entry->matrix) {
+            victim = entry;
+            break;
+        }
+        if (entry->last_used < victim->last_used)
+            victim = entry;
+    }
+
+    if (NULL == victim->matrix || victim->nr_rows < nr_rows) {
+        gf* new_m = (gf*) malloc(nr_rows * rs->data_shards);
+        if (NULL == new_m)
+            return;
+
+        if (NULL != victim->matrix)
+            free(victim->matrix);
+        victim->matrix = new_m;
+    }
+
+    memcpy(victim->key, key, sizeof(victim->key));
+    memcpy(victim->matrix, matrix, nr_rows * rs->data_shards);
+    victim->nr_rows = nr_rows;
+    victim->last_used = ++rs->decode_cache_clock;
+}
+
 /**
  * decode one shard
  * input:
@@ -498,7 +886,9 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
     gf dataDecodeMatrix[DATA_SHARDS_MAX*DATA_SHARDS_MAX];
     unsigned char* subShards[DATA_SHARDS_MAX];
     unsigned char* outputs[DATA_SHARDS_MAX];
+    unsigned int key[(DATA_SHARDS_MAX + 31) / 32];
     gf* m = rs->m;
+    gf* cached;
     int i, j, c, swap, subMatrixRow, dataShards;
 
     /* the erased_blocks should always sorted
@@ -521,16 +911,29 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
             break;
     }
 
+    dataShards = rs->data_shards;
+
+    /* the inverse only depends on which data shards are erased and which parity rows replace them */
+    memset(key, 0, sizeof(key));
+    for (i = 0; i < nr_fec_blocks; i++) {
+        j = erased_blocks[i];
+        key[j / 32] |= 1u << (j % 32);
+        j = dataShards + fec_block_nos[i];
+        key[j / 32] |= 1u << (j % 32);
+    }
+    cached = decode_cache_lookup(rs, key);
+
     j = 0;
     subMatrixRow = 0;
-    dataShards = rs->data_shards;
     for (i = 0; i < dataShards; i++) {
         if (j < nr_fec_blocks && i == (int)erased_blocks[j])
             j++;
         else {
             /* this row is ok */
-            for (c = 0; c < dataShards; c++)
-                dataDecodeMatrix[subMatrixRow*dataShards + c] = m[i*dataShards + c];
+            if (NULL == cached) {
+                for (c = 0; c < dataShards; c++)
+                    dataDecodeMatrix[subMatrixRow*dataShards + c] = m[i*dataShards + c];
+            }
 
             subShards[subMatrixRow] = data_blocks[i];
             subMatrixRow++;
@@ -539,9 +942,11 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
 
     for (i = 0; i < nr_fec_blocks && subMatrixRow < dataShards; i++) {
         subShards[subMatrixRow] = dec_fec_blocks[i];
-        j = dataShards + fec_block_nos[i];
-        for (c = 0; c < dataShards; c++)
-            dataDecodeMatrix[subMatrixRow*dataShards + c] = m[j*dataShards + c];
+        if (NULL == cached) {
+            j = dataShards + fec_block_nos[i];
+            for (c = 0; c < dataShards; c++)
+                dataDecodeMatrix[subMatrixRow*dataShards + c] = m[j*dataShards + c];
+        }
 
         subMatrixRow++;
     }
@@ -549,15 +954,23 @@ static int reed_solomon_decode(reed_solomon* rs, unsigned char **data_blocks, in
     if (subMatrixRow < dataShards)
         return -1;
 
-    invert_mat(dataDecodeMatrix, dataShards);
+    for (i = 0; i < nr_fec_blocks; i++)
+        outputs[i] = data_blocks[erased_blocks[i]];
 
-    for (i = 0; i < nr_fec_blocks; i++) {
-        j = erased_blocks[i];
-        outputs[i] = data_blocks[j];
-        memmove(dataDecodeMatrix+i*dataShards, dataDecodeMatrix+j*dataShards, dataShards);
+    if (NULL == cached) {
+        if (0 != invert_mat(dataDecodeMatrix, dataShards))
+            return -1;
+
+        for (i = 0; i < nr_fec_blocks; i++) {
+            j = erased_blocks[i];
+            memmove(dataDecodeMatrix+i*dataShards, dataDecodeMatrix+j*dataShards, dataShards);
+        }
+
+        decode_cache_insert(rs, key, dataDecodeMatrix, nr_fec_blocks);
+        cached = dataDecodeMatrix;
     }
 
-    return code_some_shards(dataDecodeMatrix, subShards, outputs, dataShards, nr_fec_blocks, block_size);
+    return code_some_shards(cached, subShards, outputs, dataShards, nr_fec_blocks, block_size);
 }
 
 /**
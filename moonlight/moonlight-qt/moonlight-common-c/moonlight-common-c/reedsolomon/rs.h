@@ -4,12 +4,32 @@
 /* use small value to save memory */
 #define DATA_SHARDS_MAX 255
 
+/* number of inverted decode matrices kept per reed_solomon object */
+#define DECODE_CACHE_SIZE 8
+
+/**
+ * inverted decode matrix for one erasure pattern
+ * key: bitmap of the erased data shards and the parity shards used to recover them
+ * matrix[nr_rows][data_shards]: rows of the inverse that produce the erased shards
+ * */
+typedef struct _decode_cache_entry {
+    unsigned int key[(DATA_SHARDS_MAX + 31) / 32];
+    unsigned int last_used;
+    int nr_rows;
+    unsigned char* matrix;
+} decode_cache_entry;
+
 typedef struct _reed_solomon {
     int data_shards;
     int parity_shards;
     int shards;
     unsigned char* m;
     unsigned char* parity;
+
+    decode_cache_entry decode_cache[DECODE_CACHE_SIZE];
+    unsigned int decode_cache_clock;
+    unsigned int decode_cache_hits;
+    unsigned int decode_cache_misses;
 } reed_solomon;
 
 /**
@@ -17,6 +37,25 @@ typedef struct _reed_solomon {
  * */
 void reed_solomon_init(void);
 
+/**
+ * name of the GF(2^8) kernels selected by reed_solomon_init()
+ * */
+const char* reed_solomon_kernel_name(void);
+
+/**
+ * GF(2^8) kernels, in increasing order of speed
+ * */
+#define RS_KERNEL_SCALAR 0
+#define RS_KERNEL_SSSE3  1 /* PSHUFB */
+#define RS_KERNEL_AVX2   2 /* PSHUFB */
+#define RS_KERNEL_GFNI   3 /* AVX-512 GFNI */
+
+/**
+ * force a specific kernel (after reed_solomon_init) for benchmarking
+ * returns 0 if the compiler or CPU doesn't support it
+ * */
+int reed_solomon_set_kernel(int kernel);
+
 reed_solomon* reed_solomon_new(int data_shards, int parity_shards);
 void reed_solomon_release(reed_solomon* rs);
 
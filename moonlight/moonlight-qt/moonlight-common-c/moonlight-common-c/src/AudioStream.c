@@ -2,7 +2,7 @@
 
 static SOCKET rtpSocket = INVALID_SOCKET;
 
-static LINKED_BLOCKING_QUEUE packetQueue;
+static RING_BLOCKING_QUEUE packetQueue;
 static RTP_AUDIO_QUEUE rtpAudioQueue;
 
 static PLT_THREAD udpPingThread;
@@ -25,6 +25,9 @@ static uint8_t opusHeaderByte;
 
 #define MAX_PACKET_SIZE 1400
 
+// Maximum number of queued packets that we decrypt together
+#define AUDIO_DECRYPT_BATCH_SIZE 8
+
 // This is much larger than we should typically have buffered, but
 // it needs to be. We need a cushion in case our thread gets blocked
 // for longer than normal.
@@ -71,7 +74,7 @@ static void AudioPingThreadProc(void* context) {
 
 // Initialize the audio stream and start
 int initializeAudioStream(void) {
-    LbqInitializeLinkedBlockingQueue(&packetQueue, 30);
+    RbqInitializeRingBlockingQueue(&packetQueue, 30);
     RtpaInitializeQueue(&rtpAudioQueue);
     lastSeq = 0;
     receivedDataFromPeer = false;
@@ -141,30 +144,93 @@ void destroyAudioStream(void) {
     }
 
     PltDestroyCryptoContext(audioDecryptionCtx);
-    freePacketList(LbqDestroyLinkedBlockingQueue(&packetQueue));
+    freePacketList(RbqDestroyRingBlockingQueue(&packetQueue));
     RtpaCleanupQueue(&rtpAudioQueue);
 }
 
-static bool queuePacketToLbq(PQUEUED_AUDIO_PACKET* packet) {
+static bool queuePacketToRbq(PQUEUED_AUDIO_PACKET* packet) {
     int err;
 
     do {
-        err = LbqOfferQueueItem(&packetQueue, *packet, &(*packet)->header.lentry);
+        err = RbqOfferQueueItem(&packetQueue, *packet, &(*packet)->header.lentry);
         if (err == LBQ_SUCCESS) {
-            // The LBQ owns the buffer now
+            // The queue owns the buffer now
             *packet = NULL;
         }
         else if (err == LBQ_BOUND_EXCEEDED) {
             Limelog("Audio packet queue overflow\n");
 
             // The audio queue is full, so free all existing items and try again
-            freePacketList(LbqFlushQueueItems(&packetQueue));
+            freePacketList(RbqFlushQueueItems(&packetQueue));
         }
     } while (err == LBQ_BOUND_EXCEEDED);
 
     return err == LBQ_SUCCESS;
 }
 
+// Decrypts the audio data of each packet in place. Packets that
+// fail to decrypt are marked with a negative size.
+static void decryptInputData(PQUEUED_AUDIO_PACKET* packets, int packetCount) {
+    // We must have room for the AES padding which may be written to the buffer
+    unsigned char decryptedOpusData[AUDIO_DECRYPT_BATCH_SIZE][ROUND_TO_PKCS7_PADDED_LEN(MAX_PACKET_SIZE)];
+    unsigned char ivs[AUDIO_DECRYPT_BATCH_SIZE][16];
+    PLT_CRYPTO_MESSAGE messages[AUDIO_DECRYPT_BATCH_SIZE];
+    PQUEUED_AUDIO_PACKET messagePackets[AUDIO_DECRYPT_BATCH_SIZE];
+    int messageCount = 0;
+
+    LC_ASSERT(packetCount <= AUDIO_DECRYPT_BATCH_SIZE);
+
+    for (int i = 0; i < packetCount; i++) {
+        PRTP_PACKET rtp = (PRTP_PACKET)&packets[i]->data[0];
+
+        // Skip lost packet placeholders
+        if (packets[i]->header.size == 0) {
+            continue;
+        }
+
+        // The IV is the avkeyid (equivalent to the rikeyid) +
+        // the RTP sequence number, in big endian.
+        uint32_t ivSeq = BE32(avRiKeyId + rtp->sequenceNumber);
+
+        memset(ivs[messageCount], 0, sizeof(ivs[messageCount]));
+        memcpy(ivs[messageCount], &ivSeq, sizeof(ivSeq));
+
+        messages[messageCount].iv = ivs[messageCount];
+        messages[messageCount].tag = NULL;
+        messages[messageCount].inputData = (unsigned char*)(rtp + 1);
+        messages[messageCount].inputDataLength = packets[i]->header.size - sizeof(*rtp);
+        messages[messageCount].outputData = decryptedOpusData[messageCount];
+        messages[messageCount].outputDataLength = sizeof(decryptedOpusData[messageCount]);
+
+        LC_ASSERT(messages[messageCount].inputDataLength <= MAX_PACKET_SIZE);
+
+        messagePackets[messageCount++] = packets[i];
+    }
+
+    if (messageCount == 0) {
+        return;
+    }
+
+    PltDecryptMessageBatch(audioDecryptionCtx, ALGORITHM_AES_CBC, CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH,
+                           (unsigned char*)StreamConfig.remoteInputAesKey, sizeof(StreamConfig.remoteInputAesKey),
+                           16, 0, messages, messageCount);
+
+    for (int i = 0; i < messageCount; i++) {
+        PRTP_PACKET rtp = (PRTP_PACKET)&messagePackets[i]->data[0];
+
+        if (messages[i].outputDataLength < 0) {
+            Limelog("Failed to decrypt audio packet (sequence number: %u)\n", rtp->sequenceNumber);
+            LC_ASSERT(false);
+            messagePackets[i]->header.size = -1;
+            continue;
+        }
+
+        // The plaintext is always smaller than the ciphertext, so it fits in the packet
+        memcpy(rtp + 1, decryptedOpusData[i], messages[i].outputDataLength);
+        messagePackets[i]->header.size = sizeof(*rtp) + messages[i].outputDataLength;
+    }
+}
+
 static void decodeInputData(PQUEUED_AUDIO_PACKET packet) {
     // If the packet size is zero, this is a placeholder for a missing
     // packet. Trigger packet loss concealment logic in libopus by
@@ -173,6 +239,10 @@ static void decodeInputData(PQUEUED_AUDIO_PACKET packet) {
         AudioCallbacks.decodeAndPlaySample(NULL, 0);
         return;
     }
+    else if (packet->header.size < 0) {
+        // This packet failed to decrypt
+        return;
+    }
 
     PRTP_PACKET rtp = (PRTP_PACKET)&packet->data[0];
     if (lastSeq != 0 && (unsigned short)(lastSeq + 1) != rtp->sequenceNumber) {
@@ -181,63 +251,31 @@ static void decodeInputData(PQUEUED_AUDIO_PACKET packet) {
 
     lastSeq = rtp->sequenceNumber;
 
-    if (AudioEncryptionEnabled) {
-        // We must have room for the AES padding which may be written to the buffer
-        unsigned char decryptedOpusData[ROUND_TO_PKCS7_PADDED_LEN(MAX_PACKET_SIZE)];
-        unsigned char iv[16] = { 0 };
-        int dataLength = packet->header.size - sizeof(*rtp);
-
-        LC_ASSERT(dataLength <= MAX_PACKET_SIZE);
-
-        // The IV is the avkeyid (equivalent to the rikeyid) +
-        // the RTP sequence number, in big endian.
-        uint32_t ivSeq = BE32(avRiKeyId + rtp->sequenceNumber);
-
-        memcpy(iv, &ivSeq, sizeof(ivSeq));
-
-        if (!PltDecryptMessage(audioDecryptionCtx, ALGORITHM_AES_CBC, CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH,
-                               (unsigned char*)StreamConfig.remoteInputAesKey, sizeof(StreamConfig.remoteInputAesKey),
-                               iv, sizeof(iv),
-                               NULL, 0,
-                               (unsigned char*)(rtp + 1), dataLength,
-                               decryptedOpusData, &dataLength)) {
-            Limelog("Failed to decrypt audio packet (sequence number: %u)\n", rtp->sequenceNumber);
-            LC_ASSERT(false);
-            return;
-        }
-
 #ifdef LC_DEBUG
-        if (opusHeaderByte == INVALID_OPUS_HEADER) {
-            opusHeaderByte = decryptedOpusData[0];
-            LC_ASSERT(opusHeaderByte != INVALID_OPUS_HEADER);
-        }
-        else {
-            // Opus header should stay constant for the entire stream.
-            // If it doesn't, it may indicate that the RtpAudioQueue
-            // incorrectly recovered a data shard or the decryption
-            // of the audio packet failed. Sunshine violates this for
-            // surround sound in some cases, so just ignore it.
-            LC_ASSERT(decryptedOpusData[0] == opusHeaderByte || IS_SUNSHINE());
-        }
-#endif
-
-        AudioCallbacks.decodeAndPlaySample((char*)decryptedOpusData, dataLength);
+    if (opusHeaderByte == INVALID_OPUS_HEADER) {
+        opusHeaderByte = ((uint8_t*)(rtp + 1))[0];
+        LC_ASSERT(opusHeaderByte != INVALID_OPUS_HEADER);
     }
     else {
-#ifdef LC_DEBUG
-        if (opusHeaderByte == INVALID_OPUS_HEADER) {
-            opusHeaderByte = ((uint8_t*)(rtp + 1))[0];
-            LC_ASSERT(opusHeaderByte != INVALID_OPUS_HEADER);
-        }
-        else {
-            // Opus header should stay constant for the entire stream.
-            // If it doesn't, it may indicate that the RtpAudioQueue
-            // incorrectly recovered a data shard.
-            LC_ASSERT(((uint8_t*)(rtp + 1))[0] == opusHeaderByte);
-        }
+        // Opus header should stay constant for the entire stream.
+        // If it doesn't, it may indicate that the RtpAudioQueue
+        // incorrectly recovered a data shard or the decryption
+        // of the audio packet failed. Sunshine violates this for
+        // surround sound in some cases, so just ignore it.
+        LC_ASSERT(((uint8_t*)(rtp + 1))[0] == opusHeaderByte || (AudioEncryptionEnabled && IS_SUNSHINE()));
+    }
 #endif
 
-        AudioCallbacks.decodeAndPlaySample((char*)(rtp + 1), packet->header.size - sizeof(*rtp));
+    AudioCallbacks.decodeAndPlaySample((char*)(rtp + 1), packet->header.size - sizeof(*rtp));
+}
+
+static void decodeInputPackets(PQUEUED_AUDIO_PACKET* packets, int packetCount) {
+    if (AudioEncryptionEnabled) {
+        decryptInputData(packets, packetCount);
+    }
+
+    for (int i = 0; i < packetCount; i++) {
+        decodeInputData(packets[i]);
     }
 }
 
@@ -328,17 +366,17 @@ static void AudioReceiveThreadProc(void* context) {
         queueStatus = RtpaAddPacket(&rtpAudioQueue, (PRTP_PACKET)&packet->data[0], (uint16_t)packet->header.size);
         if (RTPQ_HANDLE_NOW(queueStatus)) {
             if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
-                if (!queuePacketToLbq(&packet)) {
+                if (!queuePacketToRbq(&packet)) {
                     // An exit signal was received
                     break;
                 }
                 else {
-                    // Ownership should have been taken by the LBQ
+                    // Ownership should have been taken by the queue
                     LC_ASSERT(packet == NULL);
                 }
             }
             else {
-                decodeInputData(packet);
+                decodeInputPackets(&packet, 1);
             }
         }
         else {
@@ -356,18 +394,18 @@ static void AudioReceiveThreadProc(void* context) {
                     queuedPacket->header.size = length;
 
                     if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
-                        if (!queuePacketToLbq(&queuedPacket)) {
+                        if (!queuePacketToRbq(&queuedPacket)) {
                             // An exit signal was received
                             free(queuedPacket);
                             break;
                         }
                         else {
-                            // Ownership should have been taken by the LBQ
+                            // Ownership should have been taken by the queue
                             LC_ASSERT(queuedPacket == NULL);
                         }
                     }
                     else {
-                        decodeInputData(queuedPacket);
+                        decodeInputPackets(&queuedPacket, 1);
                         free(queuedPacket);
                     }
                 }
@@ -387,18 +425,29 @@ static void AudioReceiveThreadProc(void* context) {
 
 static void AudioDecoderThreadProc(void* context) {
     int err;
-    PQUEUED_AUDIO_PACKET packet;
+    PQUEUED_AUDIO_PACKET packets[AUDIO_DECRYPT_BATCH_SIZE];
+    int packetCount;
 
     while (!PltIsThreadInterrupted(&decoderThread)) {
-        err = LbqWaitForQueueElement(&packetQueue, (void**)&packet);
+        err = RbqWaitForQueueElement(&packetQueue, (void**)&packets[0]);
         if (err != LBQ_SUCCESS) {
             // An exit signal was received
             return;
         }
 
-        decodeInputData(packet);
+        // If more packets built up while we were busy, grab them too
+        // so they can be decrypted in a single batch.
+        packetCount = 1;
+        while (packetCount < AUDIO_DECRYPT_BATCH_SIZE &&
+               RbqPollQueueElement(&packetQueue, (void**)&packets[packetCount]) == LBQ_SUCCESS) {
+            packetCount++;
+        }
+
+        decodeInputPackets(packets, packetCount);
 
-        free(packet);
+        for (int i = 0; i < packetCount; i++) {
+            free(packets[i]);
+        }
     }
 }
 
@@ -411,8 +460,8 @@ void stopAudioStream(void) {
 
     PltInterruptThread(&receiveThread);
     if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {        
-        // Signal threads waiting on the LBQ
-        LbqSignalQueueShutdown(&packetQueue);
+        // Signal threads waiting on the queue
+        RbqSignalQueueShutdown(&packetQueue);
         PltInterruptThread(&decoderThread);
     }
     
@@ -429,8 +478,9 @@ void stopAudioStream(void) {
     AudioCallbacks.cleanup();
 }
 
-int startAudioStream(void* audioContext, int arFlags) {
-    int err;
+// Set up the audio renderer. Like setupVideoDecoder(), this is separate from
+// startAudioStream() so it can overlap with the control stream connection.
+int setupAudioRenderer(void* audioContext, int arFlags) {
     OPUS_MULTISTREAM_CONFIGURATION chosenConfig;
 
     if (HighQualitySurroundEnabled) {
@@ -447,10 +497,12 @@ int startAudioStream(void* audioContext, int arFlags) {
 
     chosenConfig.samplesPerFrame = 48 * AudioPacketDuration;
 
-    err = AudioCallbacks.init(StreamConfig.audioConfiguration, &chosenConfig, audioContext, arFlags);
-    if (err != 0) {
-        return err;
-    }
+    return AudioCallbacks.init(StreamConfig.audioConfiguration, &chosenConfig, audioContext, arFlags);
+}
+
+// Start the audio stream after setupAudioRenderer()
+int startAudioStream(void) {
+    int err;
 
     AudioCallbacks.start();
 
@@ -479,7 +531,7 @@ int startAudioStream(void* audioContext, int arFlags) {
 }
 
 int LiGetPendingAudioFrames(void) {
-    return LbqGetItemCount(&packetQueue);
+    return RbqGetItemCount(&packetQueue);
 }
 
 int LiGetPendingAudioDuration(void) {
@@ -0,0 +1,174 @@
+#include "BufferPool.h"
+
+// This is a fixed-capacity pool of equally sized buffers carved out of a single
+// slab allocation. Free buffers are tracked in a bounded MPMC ring (Vyukov-style)
+// so buffers may be allocated and freed from any thread without taking a lock.
+//
+// If the pool is exhausted, BpAllocateBuffer() falls back to malloc() and counts
+// a miss. BpFreeBuffer() detects buffers that did not come from the slab and
+// releases them with free(), so callers can use it for any buffer they own.
+// Pointers into the middle of a slab buffer are rejected rather than returned to
+// the pool.
+
+static bool isBufferFromSlab(PBUFFER_POOL pool, void* buffer) {
+    return (char*)buffer >= pool->slab &&
+           (char*)buffer < pool->slab + ((size_t)pool->bufferSize * pool->bufferCount);
+}
+
+static bool pushFreeBuffer(PBUFFER_POOL pool, void* buffer) {
+    PBUFFER_POOL_CELL cell;
+    uint32_t position;
+
+    position = PltAtomicLoad32(&pool->enqueuePosition);
+    for (;;) {
+        int32_t diff;
+
+        cell = &pool->cells[position & pool->mask];
+        diff = (int32_t)(PltAtomicLoad32(&cell->sequence) - position);
+        if (diff == 0) {
+            if (PltAtomicCompareExchange32(&pool->enqueuePosition, position, position + 1)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // The ring is full
+            return false;
+        }
+
+        position = PltAtomicLoad32(&pool->enqueuePosition);
+    }
+
+    cell->buffer = buffer;
+    PltAtomicStore32(&cell->sequence, position + 1);
+    return true;
+}
+
+static void* popFreeBuffer(PBUFFER_POOL pool) {
+    PBUFFER_POOL_CELL cell;
+    uint32_t position;
+    void* buffer;
+
+    position = PltAtomicLoad32(&pool->dequeuePosition);
+    for (;;) {
+        int32_t diff;
+
+        cell = &pool->cells[position & pool->mask];
+        diff = (int32_t)(PltAtomicLoad32(&cell->sequence) - (position + 1));
+        if (diff == 0) {
+            if (PltAtomicCompareExchange32(&pool->dequeuePosition, position, position + 1)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            // The ring is empty
+            return NULL;
+        }
+
+        position = PltAtomicLoad32(&pool->dequeuePosition);
+    }
+
+    buffer = cell->buffer;
+    PltAtomicStore32(&cell->sequence, position + pool->mask + 1);
+    return buffer;
+}
+
+// The buffer count is rounded up to the next power of 2
+int BpInitializeBufferPool(PBUFFER_POOL pool, int bufferSize, uint32_t bufferCount) {
+    uint32_t capacity;
+    uint32_t i;
+
+    memset(pool, 0, sizeof(*pool));
+
+    LC_ASSERT(bufferSize > 0);
+    LC_ASSERT(bufferCount > 0);
+
+    // Set this first so heap fallback allocations work if we fail below
+    pool->bufferSize = bufferSize;
+
+    capacity = 1;
+    while (capacity < bufferCount) {
+        capacity <<= 1;
+    }
+
+    pool->cells = (PBUFFER_POOL_CELL)malloc(sizeof(*pool->cells) * capacity);
+    if (pool->cells == NULL) {
+        return -1;
+    }
+
+    pool->slab = (char*)malloc((size_t)bufferSize * capacity);
+    if (pool->slab == NULL) {
+        free(pool->cells);
+        pool->cells = NULL;
+        return -1;
+    }
+
+    pool->bufferCount = capacity;
+    pool->mask = capacity - 1;
+
+    for (i = 0; i < capacity; i++) {
+        pool->cells[i].sequence = i;
+        pool->cells[i].buffer = NULL;
+    }
+
+    for (i = 0; i < capacity; i++) {
+        pushFreeBuffer(pool, &pool->slab[(size_t)bufferSize * i]);
+    }
+
+    return 0;
+}
+
+// All slab buffers must have been returned to the pool before calling this
+void BpCleanupBufferPool(PBUFFER_POOL pool) {
+    LC_ASSERT(pool->slab == NULL ||
+              PltAtomicLoad32(&pool->enqueuePosition) - PltAtomicLoad32(&pool->dequeuePosition) == pool->bufferCount);
+
+    free(pool->slab);
+    free(pool->cells);
+    pool->slab = NULL;
+    pool->cells = NULL;
+}
+
+void* BpAllocateBuffer(PBUFFER_POOL pool) {
+    void* buffer;
+
+    if (pool->slab != NULL) {
+        buffer = popFreeBuffer(pool);
+        if (buffer != NULL) {
+            PltAtomicFetchAdd32(&pool->hits, 1);
+            return buffer;
+        }
+    }
+
+    // The pool is exhausted (or was never initialized), so fall back to the heap
+    PltAtomicFetchAdd32(&pool->misses, 1);
+    return malloc(pool->bufferSize);
+}
+
+void BpFreeBuffer(PBUFFER_POOL pool, void* buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+
+    if (pool->slab != NULL && isBufferFromSlab(pool, buffer)) {
+        // A pointer into the middle of a slab buffer is a caller bug. Putting it
+        // in the ring would hand out overlapping buffers and free() would corrupt
+        // the heap, so we leak it instead.
+        if (((char*)buffer - pool->slab) % pool->bufferSize != 0) {
+            LC_ASSERT(false);
+            return;
+        }
+
+        // There is a cell for every slab buffer, so this can never fail
+        if (!pushFreeBuffer(pool, buffer)) {
+            LC_ASSERT(false);
+        }
+    }
+    else {
+        free(buffer);
+    }
+}
+
+void BpGetStats(PBUFFER_POOL pool, uint32_t* hits, uint32_t* misses) {
+    *hits = PltAtomicLoad32(&pool->hits);
+    *misses = PltAtomicLoad32(&pool->misses);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Platform.h"
+#include "PlatformThreads.h"
+
+typedef struct _BUFFER_POOL_CELL {
+    volatile uint32_t sequence;
+    void* buffer;
+} BUFFER_POOL_CELL, *PBUFFER_POOL_CELL;
+
+typedef struct _BUFFER_POOL {
+    PBUFFER_POOL_CELL cells;
+    char* slab;
+    int bufferSize;
+    uint32_t bufferCount;
+    uint32_t mask;
+    volatile uint32_t enqueuePosition;
+    volatile uint32_t dequeuePosition;
+    volatile uint32_t hits;
+    volatile uint32_t misses;
+} BUFFER_POOL, *PBUFFER_POOL;
+
+int BpInitializeBufferPool(PBUFFER_POOL pool, int bufferSize, uint32_t bufferCount);
+void BpCleanupBufferPool(PBUFFER_POOL pool);
+void* BpAllocateBuffer(PBUFFER_POOL pool);
+void BpFreeBuffer(PBUFFER_POOL pool, void* buffer);
+void BpGetStats(PBUFFER_POOL pool, uint32_t* hits, uint32_t* misses);
@@ -5,6 +5,10 @@ static ConnListenerConnectionTerminated originalTerminationCallback;
 static bool alreadyTerminated;
 static PLT_THREAD terminationCallbackThread;
 static int terminationCallbackErrorCode;
+static PLT_THREAD controlStreamStartThread;
+static int controlStreamStartError;
+static uint64_t stageStartTimeUs[STAGE_MAX];
+static uint64_t stageCompleteTimeUs[STAGE_MAX];
 
 // Common globals
 char* RemoteAddrString;
@@ -51,6 +55,25 @@ const char* LiGetStageName(int stage) {
     return stageNames[stage];
 }
 
+void LiGetStageTimes(int stage, uint64_t* startTimeUs, uint64_t* completeTimeUs) {
+    LC_ASSERT(stage >= 0 && stage < STAGE_MAX);
+    *startTimeUs = stageStartTimeUs[stage];
+    *completeTimeUs = stageCompleteTimeUs[stage];
+}
+
+static void notifyStageStarting(int stage) {
+    stageStartTimeUs[stage] = LiGetMicroseconds();
+    ListenerCallbacks.stageStarting(stage);
+}
+
+static void notifyStageComplete(int stage) {
+    // Stages that run on another thread record their own completion time
+    if (stageCompleteTimeUs[stage] == 0) {
+        stageCompleteTimeUs[stage] = LiGetMicroseconds();
+    }
+    ListenerCallbacks.stageComplete(stage);
+}
+
 // Interrupt a pending connection attempt. This interruption happens asynchronously
 // so it is not safe to start another connection before LiStartConnection() returns.
 void LiInterruptConnection(void) {
@@ -172,6 +195,14 @@ static void ClInternalConnectionTerminated(int errorCode)
     PltCloseThread(&terminationCallbackThread);
 }
 
+static void controlStreamStartThreadFunc(void* context)
+{
+    controlStreamStartError = startControlStream();
+    if (controlStreamStartError == 0) {
+        stageCompleteTimeUs[STAGE_CONTROL_STREAM_START] = LiGetMicroseconds();
+    }
+}
+
 static bool parseRtspPortNumberFromUrl(const char* rtspSessionUrl, uint16_t* port)
 {
     // If the session URL is not present, we will just use the well known port
@@ -203,6 +234,10 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     PDECODER_RENDERER_CALLBACKS drCallbacks, PAUDIO_RENDERER_CALLBACKS arCallbacks, void* renderContext, int drFlags,
     void* audioContext, int arFlags) {
     int err;
+    int videoSetupErr, audioSetupErr;
+
+    memset(stageStartTimeUs, 0, sizeof(stageStartTimeUs));
+    memset(stageCompleteTimeUs, 0, sizeof(stageCompleteTimeUs));
 
     if (drCallbacks != NULL && (drCallbacks->capabilities & CAPABILITY_PULL_RENDERER) && drCallbacks->submitDecodeUnit) {
         Limelog("CAPABILITY_PULL_RENDERER cannot be set with a submitDecodeUnit callback\n");
@@ -313,7 +348,7 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
 
     Limelog("Initializing platform...");
-    ListenerCallbacks.stageStarting(STAGE_PLATFORM_INIT);
+    notifyStageStarting(STAGE_PLATFORM_INIT);
     err = initializePlatform();
     if (err != 0) {
         Limelog("failed: %d\n", err);
@@ -322,11 +357,11 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_PLATFORM_INIT);
-    ListenerCallbacks.stageComplete(STAGE_PLATFORM_INIT);
+    notifyStageComplete(STAGE_PLATFORM_INIT);
     Limelog("done\n");
 
     Limelog("Resolving host name...");
-    ListenerCallbacks.stageStarting(STAGE_NAME_RESOLUTION);
+    notifyStageStarting(STAGE_NAME_RESOLUTION);
     LC_ASSERT(RtspPortNumber != 0);
     if (RtspPortNumber != 48010) {
         // If we have an alternate RTSP port, use that as our test port. The host probably
@@ -362,7 +397,7 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_NAME_RESOLUTION);
-    ListenerCallbacks.stageComplete(STAGE_NAME_RESOLUTION);
+    notifyStageComplete(STAGE_NAME_RESOLUTION);
     Limelog("done\n");
 
     // If STREAM_CFG_AUTO was requested, determine the streamingRemotely value
@@ -385,7 +420,7 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
 
     Limelog("Initializing audio stream...");
-    ListenerCallbacks.stageStarting(STAGE_AUDIO_STREAM_INIT);
+    notifyStageStarting(STAGE_AUDIO_STREAM_INIT);
     err = initializeAudioStream();
     if (err != 0) {
         Limelog("failed: %d\n", err);
@@ -394,11 +429,11 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_AUDIO_STREAM_INIT);
-    ListenerCallbacks.stageComplete(STAGE_AUDIO_STREAM_INIT);
+    notifyStageComplete(STAGE_AUDIO_STREAM_INIT);
     Limelog("done\n");
 
     Limelog("Starting RTSP handshake...");
-    ListenerCallbacks.stageStarting(STAGE_RTSP_HANDSHAKE);
+    notifyStageStarting(STAGE_RTSP_HANDSHAKE);
     err = performRtspHandshake(serverInfo);
     if (err != 0) {
         Limelog("failed: %d\n", err);
@@ -407,11 +442,11 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_RTSP_HANDSHAKE);
-    ListenerCallbacks.stageComplete(STAGE_RTSP_HANDSHAKE);
+    notifyStageComplete(STAGE_RTSP_HANDSHAKE);
     Limelog("done\n");
 
     Limelog("Initializing control stream...");
-    ListenerCallbacks.stageStarting(STAGE_CONTROL_STREAM_INIT);
+    notifyStageStarting(STAGE_CONTROL_STREAM_INIT);
     err = initializeControlStream();
     if (err != 0) {
         Limelog("failed: %d\n", err);
@@ -420,54 +455,107 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_CONTROL_STREAM_INIT);
-    ListenerCallbacks.stageComplete(STAGE_CONTROL_STREAM_INIT);
+    notifyStageComplete(STAGE_CONTROL_STREAM_INIT);
     Limelog("done\n");
 
     Limelog("Initializing video stream...");
-    ListenerCallbacks.stageStarting(STAGE_VIDEO_STREAM_INIT);
+    notifyStageStarting(STAGE_VIDEO_STREAM_INIT);
     initializeVideoStream();
     stage++;
     LC_ASSERT(stage == STAGE_VIDEO_STREAM_INIT);
-    ListenerCallbacks.stageComplete(STAGE_VIDEO_STREAM_INIT);
+    notifyStageComplete(STAGE_VIDEO_STREAM_INIT);
     Limelog("done\n");
 
     Limelog("Initializing input stream...");
-    ListenerCallbacks.stageStarting(STAGE_INPUT_STREAM_INIT);
+    notifyStageStarting(STAGE_INPUT_STREAM_INIT);
     initializeInputStream();
     stage++;
     LC_ASSERT(stage == STAGE_INPUT_STREAM_INIT);
-    ListenerCallbacks.stageComplete(STAGE_INPUT_STREAM_INIT);
+    notifyStageComplete(STAGE_INPUT_STREAM_INIT);
     Limelog("done\n");
 
-    Limelog("Starting control stream...");
-    ListenerCallbacks.stageStarting(STAGE_CONTROL_STREAM_START);
-    err = startControlStream();
+    // The remaining stages depend on these earlier steps:
+    //
+    //   control stream start:        control stream init
+    //   decoder setup and RTP bind:  video stream init
+    //   audio renderer setup:        audio stream init
+    //   video stream start:          control stream start, decoder setup and RTP bind
+    //   audio stream start:          control stream start, audio renderer setup
+    //   input stream start:          control stream start, input stream init
+    //
+    // Connecting the control stream takes at least one round trip to the host, while
+    // setting up the decoder and audio renderer is local work that can take just as long.
+    // Neither depends on the other, so we connect the control stream on another thread
+    // while we set up the renderers here. The video and audio streams need the control
+    // stream to request IDR frames and report loss, so they start after we join it.
+    //
+    // The renderer callbacks and all listener callbacks other than logMessage() stay
+    // on our thread. startControlStream() logs, so logMessage() can be called from
+    // the other thread during the overlap, as it already is from the stream threads.
+    Limelog("Starting control stream...\n");
+    notifyStageStarting(STAGE_CONTROL_STREAM_START);
+    err = PltCreateThread("ControlStart", controlStreamStartThreadFunc, NULL, &controlStreamStartThread);
     if (err != 0) {
-        Limelog("failed: %d\n", err);
+        Limelog("Control stream start failed: %d\n", err);
         ListenerCallbacks.stageFailed(STAGE_CONTROL_STREAM_START, err);
         goto Cleanup;
     }
+
+    Limelog("Setting up video decoder...\n");
+    notifyStageStarting(STAGE_VIDEO_STREAM_START);
+    videoSetupErr = setupVideoDecoder(renderContext, drFlags);
+    audioSetupErr = -1;
+    if (videoSetupErr == 0) {
+        Limelog("Setting up audio renderer...\n");
+        notifyStageStarting(STAGE_AUDIO_STREAM_START);
+        audioSetupErr = setupAudioRenderer(audioContext, arFlags);
+    }
+
+    PltJoinThread(&controlStreamStartThread);
+    PltCloseThread(&controlStreamStartThread);
+
+    if (controlStreamStartError != 0) {
+        err = controlStreamStartError;
+        Limelog("Control stream start failed: %d\n", err);
+        ListenerCallbacks.stageFailed(STAGE_CONTROL_STREAM_START, err);
+
+        // Tear down the renderers we set up in the meantime
+        if (audioSetupErr == 0) {
+            AudioCallbacks.cleanup();
+        }
+        if (videoSetupErr == 0) {
+            cleanupVideoDecoder();
+        }
+        goto Cleanup;
+    }
     stage++;
     LC_ASSERT(stage == STAGE_CONTROL_STREAM_START);
-    ListenerCallbacks.stageComplete(STAGE_CONTROL_STREAM_START);
-    Limelog("done\n");
+    notifyStageComplete(STAGE_CONTROL_STREAM_START);
+    Limelog("Control stream started\n");
 
     Limelog("Starting video stream...");
-    ListenerCallbacks.stageStarting(STAGE_VIDEO_STREAM_START);
-    err = startVideoStream(renderContext, drFlags);
+    err = videoSetupErr;
+    if (err == 0) {
+        err = startVideoStream();
+    }
     if (err != 0) {
         Limelog("Video stream start failed: %d\n", err);
         ListenerCallbacks.stageFailed(STAGE_VIDEO_STREAM_START, err);
+        if (audioSetupErr == 0) {
+            AudioCallbacks.cleanup();
+        }
         goto Cleanup;
     }
     stage++;
     LC_ASSERT(stage == STAGE_VIDEO_STREAM_START);
-    ListenerCallbacks.stageComplete(STAGE_VIDEO_STREAM_START);
+    notifyStageComplete(STAGE_VIDEO_STREAM_START);
     Limelog("done\n");
 
     Limelog("Starting audio stream...");
-    ListenerCallbacks.stageStarting(STAGE_AUDIO_STREAM_START);
-    err = startAudioStream(audioContext, arFlags);
+    err = audioSetupErr;
+    if (err == 0) {
+        err = startAudioStream();
+    }
     if (err != 0) {
         Limelog("Audio stream start failed: %d\n", err);
         ListenerCallbacks.stageFailed(STAGE_AUDIO_STREAM_START, err);
@@ -475,11 +563,11 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_AUDIO_STREAM_START);
-    ListenerCallbacks.stageComplete(STAGE_AUDIO_STREAM_START);
+    notifyStageComplete(STAGE_AUDIO_STREAM_START);
     Limelog("done\n");
 
     Limelog("Starting input stream...");
-    ListenerCallbacks.stageStarting(STAGE_INPUT_STREAM_START);
+    notifyStageStarting(STAGE_INPUT_STREAM_START);
     err = startInputStream();
     if (err != 0) {
         Limelog("Input stream start failed: %d\n", err);
@@ -488,7 +576,7 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     }
     stage++;
     LC_ASSERT(stage == STAGE_INPUT_STREAM_START);
-    ListenerCallbacks.stageComplete(STAGE_INPUT_STREAM_START);
+    notifyStageComplete(STAGE_INPUT_STREAM_START);
     Limelog("done\n");
     
     // Wiggle the mouse a bit to wake the display up
@@ -497,6 +585,9 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     LiSendMouseMoveEvent(-1, -1);
     PltSleepMs(10);
 
+    Limelog("Connection established in %u ms\n",
+            (unsigned int)((stageCompleteTimeUs[STAGE_INPUT_STREAM_START] - stageStartTimeUs[STAGE_PLATFORM_INIT]) / 1000));
+
     ListenerCallbacks.connectionStarted();
 
 Cleanup:
@@ -3,6 +3,16 @@
 // This is a private header, but it just contains some time macros
 #include <enet/time.h>
 
+// On platforms where we can poll the ENet socket alongside a wakeup FD, the
+// control thread owns the ENet host and senders hand it their messages through
+// a lock-free queue instead of contending on enetMutex.
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#define CONTROL_STREAM_EVENT_LOOP
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#define CONTROL_STREAM_EVENT_LOOP
+#endif
+
 // NV control stream packet header for TCP
 typedef struct _NVCTL_TCP_PACKET_HEADER {
     unsigned short type;
@@ -27,6 +37,13 @@ typedef struct _NVCTL_ENCRYPTED_PACKET_HEADER {
     // encrypted NVCTL_ENET_PACKET_HEADER_V2 and payload data follow
 } NVCTL_ENCRYPTED_PACKET_HEADER, *PNVCTL_ENCRYPTED_PACKET_HEADER;
 
+// An outbound message waiting for the control thread to send it. The payload follows.
+typedef struct _QUEUED_CONTROL_MESSAGE {
+    struct _QUEUED_CONTROL_MESSAGE* next;
+    short type;
+    short payloadLength;
+} QUEUED_CONTROL_MESSAGE, *PQUEUED_CONTROL_MESSAGE;
+
 typedef struct _QUEUED_FRAME_INVALIDATION_TUPLE {
     int startFrame;
     int endFrame;
@@ -38,6 +55,11 @@ static ENetHost* client;
 static ENetPeer* peer;
 static PLT_MUTEX enetMutex;
 static bool usePeriodicPing;
+static bool useEventLoop;
+static PQUEUED_CONTROL_MESSAGE queuedMessages;
+static uint32_t wakePending;
+static int wakeReadFd = -1;
+static int wakeWriteFd = -1;
 
 static PLT_THREAD lossStatsThread;
 static PLT_THREAD invalidateRefFramesThread;
@@ -220,6 +242,76 @@ static bool supportsIdrFrameRequest;
 #define LOSS_REPORT_INTERVAL_MS 50
 #define PERIODIC_PING_INTERVAL_MS 250
 
+static bool createWakeFd(void) {
+#if defined(__linux__)
+    wakeReadFd = wakeWriteFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    return wakeReadFd >= 0;
+#elif defined(CONTROL_STREAM_EVENT_LOOP)
+    int fds[2];
+
+    if (pipe(fds) < 0) {
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    wakeReadFd = fds[0];
+    wakeWriteFd = fds[1];
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void closeWakeFd(void) {
+#ifdef CONTROL_STREAM_EVENT_LOOP
+    if (wakeWriteFd >= 0 && wakeWriteFd != wakeReadFd) {
+        close(wakeWriteFd);
+    }
+    if (wakeReadFd >= 0) {
+        close(wakeReadFd);
+    }
+#endif
+    wakeReadFd = wakeWriteFd = -1;
+}
+
+// Wakes the control thread if it's waiting for network events
+static void wakeControlThread(void) {
+#ifdef CONTROL_STREAM_EVENT_LOOP
+    // Only the first sender after the control thread drains the queue needs to signal it
+    if (PltAtomicCompareExchange32(&wakePending, 0, 1)) {
+        uint64_t value = 1;
+
+        // The FD is non-blocking, so this fails harmlessly if it's already signalled
+        if (write(wakeWriteFd, &value, sizeof(value)) < 0) {
+            LC_ASSERT(errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+#endif
+}
+
+static void clearWakeFd(void) {
+#ifdef CONTROL_STREAM_EVENT_LOOP
+    uint64_t value;
+
+    while (read(wakeReadFd, &value, sizeof(value)) > 0);
+#endif
+}
+
+// Interrupts the control receive thread and wakes it so it notices right away
+// rather than after the next RTO or ping
+static void interruptControlReceiveThread(void) {
+    PltInterruptThread(&controlReceiveThread);
+
+    if (useEventLoop) {
+        PltAtomicStore32(&wakePending, 0);
+        wakeControlThread();
+    }
+}
+
 // Initializes the control stream
 int initializeControlStream(void) {
     stopping = false;
@@ -229,6 +321,11 @@ int initializeControlStream(void) {
 
     encryptedControlStream = APP_VERSION_AT_LEAST(7, 1, 431);
 
+    // The event loop is only used for ENet. TCP sockets can be used from multiple threads at once.
+    queuedMessages = NULL;
+    wakePending = 0;
+    useEventLoop = AppVersionQuad[0] >= 5 && createWakeFd();
+
     if (AppVersionQuad[0] == 3) {
         packetTypes = (short*)packetTypesGen3;
         payloadLengths = (short*)payloadLengthsGen3;
@@ -262,15 +359,8 @@ int initializeControlStream(void) {
         }
     }
 
-    lastGoodFrame = 0;
-    lastSeenFrame = 0;
-    lossCountSinceLastReport = 0;
+    resetConnectionFrameStats();
     disconnectPending = false;
-    intervalGoodFrameCount = 0;
-    intervalTotalFrameCount = 0;
-    intervalStartTimeMs = 0;
-    lastIntervalLossPercentage = 0;
-    lastConnectionStatusUpdate = CONN_STATUS_OKAY;
     currentEnetSequenceNumber = 0;
     usePeriodicPing = APP_VERSION_AT_LEAST(7, 1, 415);
     encryptionCtx = PltCreateCryptoContext();
@@ -293,7 +383,20 @@ void freeFrameInvalidationList(PLINKED_BLOCKING_QUEUE_ENTRY entry) {
 
 // Cleans up control stream
 void destroyControlStream(void) {
+    PQUEUED_CONTROL_MESSAGE message;
+
     LC_ASSERT(stopping);
+
+    // Free messages that were never sent if the control stream failed to start
+    message = queuedMessages;
+    while (message != NULL) {
+        PQUEUED_CONTROL_MESSAGE next = message->next;
+        free(message);
+        message = next;
+    }
+    queuedMessages = NULL;
+    closeWakeFd();
+
     PltDestroyCryptoContext(encryptionCtx);
     PltDestroyCryptoContext(decryptionCtx);
     PltCloseEvent(&idrFrameRequiredEvent);
@@ -326,8 +429,26 @@ void queueFrameInvalidationTuple(int startFrame, int endFrame) {
     }
 }
 
+// Resets the frame loss statistics used for connection status updates
+void resetConnectionFrameStats(void) {
+    lastGoodFrame = 0;
+    lastSeenFrame = 0;
+    lossCountSinceLastReport = 0;
+    intervalGoodFrameCount = 0;
+    intervalTotalFrameCount = 0;
+    intervalStartTimeMs = 0;
+    lastIntervalLossPercentage = 0;
+    lastConnectionStatusUpdate = CONN_STATUS_OKAY;
+}
+
 // Request an IDR frame on demand by the decoder
 void LiRequestIdrFrame(void) {
+    // There's no control stream during a replay, so the replay supplies the IDR frame
+    if (isVideoReplayActive()) {
+        requestVideoReplayIdrFrame();
+        return;
+    }
+
     // Any reference frame invalidation requests should be dropped now.
     // We require a full IDR frame to recover.
     freeFrameInvalidationList(LbqFlushQueueItems(&invalidReferenceFrameTuples));
@@ -345,6 +466,10 @@ void connectionDetectedFrameLoss(int startFrame, int endFrame) {
 void connectionReceivedCompleteFrame(int frameIndex) {
     lastGoodFrame = frameIndex;
     intervalGoodFrameCount++;
+
+    if (isVideoReplayActive()) {
+        notifyVideoReplayFrameDelivered(frameIndex);
+    }
 }
 
 void connectionSawFrame(int frameIndex) {
@@ -489,7 +614,10 @@ static bool decryptControlMessageToV1(PNVCTL_ENCRYPTED_PACKET_HEADER encPacket,
     return true;
 }
 
-static bool sendMessageEnet(short ptype, short paylen, const void* payload) {
+// Builds the packet for a message and queues it on the ENet peer. The caller must
+// hold enetMutex or be the control thread in event loop mode, since this also
+// uses currentEnetSequenceNumber and the cipher context.
+static bool queueEnetPacket(short ptype, short paylen, const void* payload) {
     ENetPacket* enetPacket;
     int err;
 
@@ -507,10 +635,6 @@ static bool sendMessageEnet(short ptype, short paylen, const void* payload) {
             return false;
         }
 
-        // We (ab)use the enetMutex to protect currentEnetSequenceNumber and the cipherContext
-        // used inside encryptControlMessage().
-        PltLockMutex(&enetMutex);
-
         encPacket = (PNVCTL_ENCRYPTED_PACKET_HEADER)enetPacket->data;
         encPacket->encryptedHeaderType = 0x0001;
         encPacket->length = sizeof(encPacket->seq) + AES_GCM_TAG_LENGTH + sizeof(*packet) + paylen;
@@ -527,11 +651,8 @@ static bool sendMessageEnet(short ptype, short paylen, const void* payload) {
         if (!encryptControlMessage(encPacket, packet)) {
             Limelog("Failed to encrypt control stream message\n");
             enet_packet_destroy(enetPacket);
-            PltUnlockMutex(&enetMutex);
             return false;
         }
-
-        // enetMutex still locked here
     }
     else {
         PNVCTL_ENET_PACKET_HEADER_V1 packet;
@@ -543,18 +664,10 @@ static bool sendMessageEnet(short ptype, short paylen, const void* payload) {
         packet = (PNVCTL_ENET_PACKET_HEADER_V1)enetPacket->data;
         packet->type = LE16(ptype);
         memcpy(&packet[1], payload, paylen);
-
-        PltLockMutex(&enetMutex);
     }
 
     // Queue the packet to be sent
     err = enet_peer_send(peer, 0, enetPacket);
-
-    // Actually send it
-    enet_host_service(client, NULL, 0);
-
-    PltUnlockMutex(&enetMutex);
-
     if (err < 0) {
         Limelog("Failed to send ENet control packet\n");
         enet_packet_destroy(enetPacket);
@@ -564,6 +677,77 @@ static bool sendMessageEnet(short ptype, short paylen, const void* payload) {
     return true;
 }
 
+// Hands a message to the control thread to send
+static bool postMessageToControlThread(short ptype, short paylen, const void* payload) {
+    PQUEUED_CONTROL_MESSAGE message;
+
+    message = malloc(sizeof(*message) + paylen);
+    if (message == NULL) {
+        return false;
+    }
+
+    message->type = ptype;
+    message->payloadLength = paylen;
+    memcpy(&message[1], payload, paylen);
+
+    // Push onto the head of the list. The control thread takes the whole list at once.
+    do {
+        message->next = PltAtomicLoadPtr(&queuedMessages);
+    } while (!PltAtomicCompareExchangePtr(&queuedMessages, message->next, message));
+
+    wakeControlThread();
+    return true;
+}
+
+// Queues all posted messages on the ENet peer in the order they were posted. The caller
+// must be the control thread or have stopped it.
+static void queuePostedMessages(void) {
+    PQUEUED_CONTROL_MESSAGE list;
+    PQUEUED_CONTROL_MESSAGE reversed;
+
+    // Clear this first so a message posted after we take the list wakes us again
+    PltAtomicStore32(&wakePending, 0);
+    list = PltAtomicExchangePtr(&queuedMessages, NULL);
+
+    // The list is newest first, so reverse it
+    reversed = NULL;
+    while (list != NULL) {
+        PQUEUED_CONTROL_MESSAGE next = list->next;
+        list->next = reversed;
+        reversed = list;
+        list = next;
+    }
+
+    while (reversed != NULL) {
+        PQUEUED_CONTROL_MESSAGE next = reversed->next;
+
+        // Failures are logged by queueEnetPacket(). There's no one to report them to now.
+        queueEnetPacket(reversed->type, reversed->payloadLength, &reversed[1]);
+        free(reversed);
+        reversed = next;
+    }
+}
+
+static bool sendMessageEnet(short ptype, short paylen, const void* payload) {
+    bool ret;
+
+    if (useEventLoop) {
+        return postMessageToControlThread(ptype, paylen, payload);
+    }
+
+    PltLockMutex(&enetMutex);
+
+    ret = queueEnetPacket(ptype, paylen, payload);
+    if (ret) {
+        // Actually send it
+        enet_host_service(client, NULL, 0);
+    }
+
+    PltUnlockMutex(&enetMutex);
+
+    return ret;
+}
+
 static bool sendMessageTcp(short ptype, short paylen, const void* payload) {
     PNVCTL_TCP_PACKET_HEADER packet;
     SOCK_RET err;
@@ -593,7 +777,8 @@ static bool sendMessageAndForget(short ptype, short paylen, const void* payload)
     bool ret;
 
     // Unlike regular sockets, ENet sockets aren't safe to invoke from multiple
-    // threads at once. We have to synchronize them with a lock.
+    // threads at once. sendMessageEnet() either takes a lock or hands the
+    // message to the control thread.
     if (AppVersionQuad[0] >= 5) {
         ret = sendMessageEnet(ptype, paylen, payload);
     }
@@ -664,6 +849,14 @@ static void controlReceiveThreadFunc(void* context) {
 
         PltLockMutex(&enetMutex);
 
+        if (useEventLoop) {
+            // Send messages from other threads right away. The service call below
+            // returns as soon as it has a received event to hand us, before it
+            // sends anything, so we can't count on it to flush them.
+            queuePostedMessages();
+            enet_host_flush(client);
+        }
+
         // Poll for new packets and process retransmissions
         err = serviceEnetHost(client, &event, 0);
 
@@ -671,8 +864,9 @@ static void controlReceiveThreadFunc(void* context) {
         // the RTO timer or a ping.
         if (err == 0) {
             if (ENET_TIME_LESS(peer->nextTimeout, client->serviceTime)) {
-                // This can happen when we have no unacked reliable messages
-                waitTimeMs = 10;
+                // This can happen when we have no unacked reliable messages. Without the
+                // event loop, this is also how long a new message can wait to be serviced.
+                waitTimeMs = useEventLoop ? peer->pingInterval : 10;
             }
             else {
                 // We add 1 ms just to ensure we're unlikely to undershoot the sleep() and have to
@@ -720,6 +914,22 @@ static void controlReceiveThreadFunc(void* context) {
                     PltUnlockMutex(&enetMutex);
                 }
             }
+            else if (useEventLoop) {
+#ifdef CONTROL_STREAM_EVENT_LOOP
+                // No events ready - wait for readability, a posted message, or a local RTO timer to expire
+                struct pollfd pfds[2];
+
+                pfds[0].fd = client->socket;
+                pfds[0].events = POLLIN;
+                pfds[1].fd = wakeReadFd;
+                pfds[1].events = POLLIN;
+
+                if (pollSockets(pfds, 2, (int)waitTimeMs) > 0 && (pfds[1].revents & POLLIN)) {
+                    clearWakeFd();
+                }
+#endif
+                continue;
+            }
             else {
                 // No events ready - wait for readability or a local RTO timer to expire
                 enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
@@ -1112,7 +1322,7 @@ int stopControlStream(void) {
     
     PltInterruptThread(&lossStatsThread);
     PltInterruptThread(&requestIdrFrameThread);
-    PltInterruptThread(&controlReceiveThread);
+    interruptControlReceiveThread();
 
     PltJoinThread(&lossStatsThread);
     PltJoinThread(&requestIdrFrameThread);
@@ -1129,6 +1339,11 @@ int stopControlStream(void) {
         PltCloseThread(&invalidateRefFramesThread);
     }
 
+    if (useEventLoop && peer != NULL) {
+        // The control thread is gone, so queue anything it didn't get to ourselves
+        queuePostedMessages();
+    }
+
     if (peer != NULL) {
         // Gracefully disconnect to ensure the remote host receives all of our final
         // outbound traffic, including any key up events that might be sent.
@@ -1163,6 +1378,11 @@ int sendInputPacketOnControlStream(unsigned char* data, int length) {
 bool isControlDataInTransit(void) {
     bool ret = false;
 
+    // Posted messages haven't even been handed to ENet yet
+    if (PltAtomicLoadPtr(&queuedMessages) != NULL) {
+        return true;
+    }
+
     PltLockMutex(&enetMutex);
     if (peer != NULL && peer->state == ENET_PEER_STATE_CONNECTED) {
         if (peer->reliableDataInTransit != 0) {
@@ -1307,7 +1527,7 @@ int startControlStream(void) {
             ConnectionInterrupted = true;
         }
 
-        PltInterruptThread(&controlReceiveThread);
+        interruptControlReceiveThread();
         PltJoinThread(&controlReceiveThread);
         PltCloseThread(&controlReceiveThread);
 
@@ -1339,7 +1559,7 @@ int startControlStream(void) {
             ConnectionInterrupted = true;
         }
 
-        PltInterruptThread(&controlReceiveThread);
+        interruptControlReceiveThread();
         PltJoinThread(&controlReceiveThread);
         PltCloseThread(&controlReceiveThread);
 
@@ -1367,7 +1587,7 @@ int startControlStream(void) {
             ConnectionInterrupted = true;
         }
 
-        PltInterruptThread(&controlReceiveThread);
+        interruptControlReceiveThread();
         PltJoinThread(&controlReceiveThread);
         PltCloseThread(&controlReceiveThread);
 
@@ -1399,7 +1619,7 @@ int startControlStream(void) {
         PltJoinThread(&lossStatsThread);
         PltCloseThread(&lossStatsThread);
 
-        PltInterruptThread(&controlReceiveThread);
+        interruptControlReceiveThread();
         PltJoinThread(&controlReceiveThread);
         PltCloseThread(&controlReceiveThread);
 
@@ -1435,7 +1655,7 @@ int startControlStream(void) {
             PltJoinThread(&lossStatsThread);
             PltCloseThread(&lossStatsThread);
 
-            PltInterruptThread(&controlReceiveThread);
+            interruptControlReceiveThread();
             PltJoinThread(&controlReceiveThread);
             PltCloseThread(&controlReceiveThread);
 
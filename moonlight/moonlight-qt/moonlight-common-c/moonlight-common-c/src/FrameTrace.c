@@ -0,0 +1,332 @@
+#include "Limelight-internal.h"
+
+// This is a ring of per-frame stage timestamps indexed by frame number. The
+// depacketizer claims a slot when it delivers a frame and the client fills in
+// the later stages from its own threads, so each stage of a slot has only one
+// writer and no locking is required.
+//
+// Stage times are stored as 32-bit offsets from the receive time so they can
+// be written atomically on all platforms. An offset of 0 means the stage has
+// not been reached yet.
+
+#define FRAME_TRACE_MASK (FRAME_TRACE_SIZE - 1)
+
+#define FRAME_TRACE_MAGIC "MLFT"
+#define FRAME_TRACE_VERSION 1
+
+typedef struct _FRAME_TRACE_ENTRY {
+    // Frame number + 1 once the slot is valid, or 0 while it is being claimed
+    volatile uint32_t tag;
+    uint32_t reserved;
+    uint64_t receiveTimeUs;
+    volatile uint32_t stageOffsetUs[FRAME_TRACE_STAGE_MAX - 1];
+} FRAME_TRACE_ENTRY, *PFRAME_TRACE_ENTRY;
+
+typedef struct _FRAME_TRACE_FILE_HEADER {
+    char magic[4];
+    uint16_t version;
+    uint16_t stageCount;
+    uint32_t frameCount;
+    uint32_t reserved;
+} FRAME_TRACE_FILE_HEADER, *PFRAME_TRACE_FILE_HEADER;
+
+// Each track in the Chrome trace is named for the interval ending at that stage
+static const char* stageIntervalNames[FRAME_TRACE_STAGE_MAX] = {
+    NULL,
+    "Receive",
+    "Depacketize",
+    "Decode queue",
+    "Decode",
+    "Pacer submit",
+    "Pacing and render",
+};
+
+static PFRAME_TRACE_ENTRY traceEntries;
+static volatile uint32_t newestFrameNumber;
+static volatile uint32_t tracedFrames;
+
+int initializeFrameTrace(void) {
+    LC_ASSERT((FRAME_TRACE_SIZE & FRAME_TRACE_MASK) == 0);
+
+    traceEntries = calloc(FRAME_TRACE_SIZE, sizeof(*traceEntries));
+    if (traceEntries == NULL) {
+        return -1;
+    }
+
+    newestFrameNumber = 0;
+    tracedFrames = 0;
+    return 0;
+}
+
+void destroyFrameTrace(void) {
+    free(traceEntries);
+    traceEntries = NULL;
+}
+
+static uint32_t getStageOffset(uint64_t receiveTimeUs, uint64_t timeUs) {
+    // Keep recorded stages distinguishable from unrecorded ones
+    if (timeUs <= receiveTimeUs) {
+        return 1;
+    }
+    else if (timeUs - receiveTimeUs >= UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    else {
+        return (uint32_t)(timeUs - receiveTimeUs);
+    }
+}
+
+// Called by the depacketizer when a frame is delivered for decoding
+void recordFrameTraceNetworkStages(int frameNumber, uint64_t receiveTimeUs, uint64_t fecCompleteTimeUs, uint64_t depacketizedTimeUs) {
+    PFRAME_TRACE_ENTRY entry;
+    int i;
+
+    if (traceEntries == NULL) {
+        return;
+    }
+
+    entry = &traceEntries[(uint32_t)frameNumber & FRAME_TRACE_MASK];
+
+    // Invalidate the slot while we overwrite it so readers skip it
+    PltAtomicStore32(&entry->tag, 0);
+    PltAtomicFence();
+
+    entry->receiveTimeUs = receiveTimeUs;
+    for (i = 0; i < FRAME_TRACE_STAGE_MAX - 1; i++) {
+        entry->stageOffsetUs[i] = 0;
+    }
+    entry->stageOffsetUs[FRAME_TRACE_STAGE_FEC_COMPLETE - 1] = getStageOffset(receiveTimeUs, fecCompleteTimeUs);
+    entry->stageOffsetUs[FRAME_TRACE_STAGE_DEPACKETIZED - 1] = getStageOffset(receiveTimeUs, depacketizedTimeUs);
+
+    PltAtomicStore32(&entry->tag, (uint32_t)frameNumber + 1);
+    PltAtomicStore32(&newestFrameNumber, (uint32_t)frameNumber);
+    if (tracedFrames < FRAME_TRACE_SIZE) {
+        PltAtomicStore32(&tracedFrames, tracedFrames + 1);
+    }
+}
+
+void LiRecordVideoFrameTraceStage(int frameNumber, int stage) {
+    PFRAME_TRACE_ENTRY entry;
+    uint64_t timeUs;
+
+    LC_ASSERT(stage > FRAME_TRACE_STAGE_RECEIVED && stage < FRAME_TRACE_STAGE_MAX);
+    if (traceEntries == NULL || stage <= FRAME_TRACE_STAGE_RECEIVED || stage >= FRAME_TRACE_STAGE_MAX) {
+        return;
+    }
+
+    timeUs = PltGetMicroseconds();
+
+    entry = &traceEntries[(uint32_t)frameNumber & FRAME_TRACE_MASK];
+    if (PltAtomicLoad32(&entry->tag) != (uint32_t)frameNumber + 1) {
+        // This frame has already been overwritten (or was never delivered)
+        return;
+    }
+
+    PltAtomicStore32(&entry->stageOffsetUs[stage - 1], getStageOffset(entry->receiveTimeUs, timeUs));
+}
+
+// Copies a consistent snapshot of the given frame's slot. Returns false
+// if the frame is not in the trace.
+static bool readTraceEntry(uint32_t frameNumber, PFRAME_TRACE_ENTRY snapshot) {
+    PFRAME_TRACE_ENTRY entry = &traceEntries[frameNumber & FRAME_TRACE_MASK];
+    int i;
+
+    if (PltAtomicLoad32(&entry->tag) != frameNumber + 1) {
+        return false;
+    }
+
+    snapshot->tag = frameNumber + 1;
+    snapshot->reserved = 0;
+    snapshot->receiveTimeUs = entry->receiveTimeUs;
+    for (i = 0; i < FRAME_TRACE_STAGE_MAX - 1; i++) {
+        snapshot->stageOffsetUs[i] = PltAtomicLoad32(&entry->stageOffsetUs[i]);
+    }
+
+    // If the slot was reclaimed while we were copying, discard the copy
+    PltAtomicFence();
+    return PltAtomicLoad32(&entry->tag) == frameNumber + 1;
+}
+
+// Returns the number of frame numbers that may still be in the trace, ending with the
+// newest one. Frames that were never delivered leave holes that readTraceEntry() skips.
+static uint32_t getTraceWindow(uint32_t* firstFrameNumber) {
+    uint32_t newest = PltAtomicLoad32(&newestFrameNumber);
+    uint32_t frameCount;
+
+    if (PltAtomicLoad32(&tracedFrames) == 0) {
+        frameCount = 0;
+    }
+    else if (newest < FRAME_TRACE_SIZE - 1) {
+        frameCount = newest + 1;
+    }
+    else {
+        frameCount = FRAME_TRACE_SIZE;
+    }
+
+    *firstFrameNumber = newest - frameCount + 1;
+    return frameCount;
+}
+
+static int writeBinaryTrace(FILE* file, uint32_t firstFrameNumber, uint32_t frameCount) {
+    FRAME_TRACE_FILE_HEADER header;
+    uint32_t writtenFrames = 0;
+    long headerOffset;
+    uint32_t i;
+
+    headerOffset = ftell(file);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FRAME_TRACE_MAGIC, sizeof(header.magic));
+    header.version = FRAME_TRACE_VERSION;
+    header.stageCount = FRAME_TRACE_STAGE_MAX;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        return -1;
+    }
+
+    for (i = 0; i < frameCount; i++) {
+        FRAME_TRACE_ENTRY entry;
+
+        if (!readTraceEntry(firstFrameNumber + i, &entry)) {
+            continue;
+        }
+
+        // The file stores the frame number rather than the tag
+        entry.tag = firstFrameNumber + i;
+        if (fwrite(&entry, sizeof(entry), 1, file) != 1) {
+            return -1;
+        }
+
+        writtenFrames++;
+    }
+
+    // Now that we know how many frames were valid, fix up the header
+    header.frameCount = writtenFrames;
+    if (fseek(file, headerOffset, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int writeChromeTrace(FILE* file, uint32_t firstFrameNumber, uint32_t frameCount) {
+    bool firstEvent = true;
+    uint32_t i;
+    int stage;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    // Name each track after its pipeline interval
+    for (stage = FRAME_TRACE_STAGE_RECEIVED + 1; stage < FRAME_TRACE_STAGE_MAX; stage++) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                firstEvent ? "" : ",\n", stage, stageIntervalNames[stage]);
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+                stage, stage);
+        firstEvent = false;
+    }
+
+    for (i = 0; i < frameCount; i++) {
+        FRAME_TRACE_ENTRY entry;
+        uint32_t previousOffsetUs = 0;
+
+        if (!readTraceEntry(firstFrameNumber + i, &entry)) {
+            continue;
+        }
+
+        for (stage = FRAME_TRACE_STAGE_RECEIVED + 1; stage < FRAME_TRACE_STAGE_MAX; stage++) {
+            uint32_t offsetUs = entry.stageOffsetUs[stage - 1];
+
+            // Skip stages the frame didn't reach (or that raced with our copy)
+            if (offsetUs == 0 || offsetUs < previousOffsetUs) {
+                continue;
+            }
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%u,\"args\":{\"frame\":%u}}",
+                    stageIntervalNames[stage], stage,
+                    (unsigned long long)(entry.receiveTimeUs + previousOffsetUs),
+                    offsetUs - previousOffsetUs,
+                    firstFrameNumber + i);
+
+            previousOffsetUs = offsetUs;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    return ferror(file) ? -1 : 0;
+}
+
+int LiWriteVideoFrameTrace(const char* fileName, int format) {
+    uint32_t frameCount;
+    uint32_t firstFrameNumber;
+    FILE* file;
+    int err;
+
+    if (traceEntries == NULL) {
+        return -1;
+    }
+
+    frameCount = getTraceWindow(&firstFrameNumber);
+
+    file = fopen(fileName, "wb");
+    if (file == NULL) {
+        Limelog("Failed to open frame trace file: %s\n", fileName);
+        return -1;
+    }
+
+    switch (format) {
+    case FRAME_TRACE_FORMAT_BINARY:
+        err = writeBinaryTrace(file, firstFrameNumber, frameCount);
+        break;
+    case FRAME_TRACE_FORMAT_CHROME_JSON:
+        err = writeChromeTrace(file, firstFrameNumber, frameCount);
+        break;
+    default:
+        LC_ASSERT(false);
+        err = -1;
+        break;
+    }
+
+    if (fclose(file) != 0) {
+        err = -1;
+    }
+
+    if (err != 0) {
+        Limelog("Failed to write frame trace file: %s\n", fileName);
+    }
+
+    return err;
+}
+
+int LiGetVideoFrameTrace(PFRAME_TRACE_RECORD records, int maxRecords) {
+    uint32_t frameCount;
+    uint32_t firstFrameNumber;
+    int recordCount = 0;
+    uint32_t i;
+
+    if (traceEntries == NULL || maxRecords <= 0) {
+        return 0;
+    }
+
+    frameCount = getTraceWindow(&firstFrameNumber);
+
+    for (i = 0; i < frameCount && recordCount < maxRecords; i++) {
+        FRAME_TRACE_ENTRY entry;
+        PFRAME_TRACE_RECORD record = &records[recordCount];
+        int stage;
+
+        if (!readTraceEntry(firstFrameNumber + i, &entry)) {
+            continue;
+        }
+
+        record->frameNumber = (int)(firstFrameNumber + i);
+        record->stageTimeUs[FRAME_TRACE_STAGE_RECEIVED] = entry.receiveTimeUs;
+        for (stage = FRAME_TRACE_STAGE_RECEIVED + 1; stage < FRAME_TRACE_STAGE_MAX; stage++) {
+            uint32_t offsetUs = entry.stageOffsetUs[stage - 1];
+            record->stageTimeUs[stage] = offsetUs != 0 ? entry.receiveTimeUs + offsetUs : 0;
+        }
+
+        recordCount++;
+    }
+
+    return recordCount;
+}
@@ -10,6 +10,10 @@
 #include "RtpAudioQueue.h"
 #include "RtpVideoQueue.h"
 #include "ByteBuffer.h"
+#include "BufferPool.h"
+#include "RingBlockingQueue.h"
+#include "PacketImpairment.h"
+#include "VideoRecording.h"
 
 #include <enet/enet.h>
 
@@ -79,6 +83,7 @@ void* extendBuffer(void* ptr, size_t newSize);
 void fixupMissingCallbacks(PDECODER_RENDERER_CALLBACKS* drCallbacks, PAUDIO_RENDERER_CALLBACKS* arCallbacks,
     PCONNECTION_LISTENER_CALLBACKS* clCallbacks);
 void setRecorderCallbacks(PDECODER_RENDERER_CALLBACKS drCallbacks, PAUDIO_RENDERER_CALLBACKS arCallbacks);
+void recordVideoFrame(PDECODE_UNIT decodeUnit);
 
 char* getSdpPayloadForStreamConfig(int rtspClientVersion, int* length);
 
@@ -90,6 +95,7 @@ void connectionDetectedFrameLoss(int startFrame, int endFrame);
 void connectionReceivedCompleteFrame(int frameIndex);
 void connectionSawFrame(int frameIndex);
 void connectionLostPackets(int lastReceivedPacket, int nextReceivedPacket);
+void resetConnectionFrameStats(void);
 int sendInputPacketOnControlStream(unsigned char* data, int length);
 bool isControlDataInTransit(void);
 
@@ -102,16 +108,29 @@ void stopVideoDepacketizer(void);
 void requestDecoderRefresh(void);
 void notifyFrameLost(unsigned int frameNumber, bool speculative);
 
+int initializeFrameTrace(void);
+void destroyFrameTrace(void);
+void recordFrameTraceNetworkStages(int frameNumber, uint64_t receiveTimeUs, uint64_t fecCompleteTimeUs, uint64_t depacketizedTimeUs);
+
+bool isVideoReplayActive(void);
+void requestVideoReplayIdrFrame(void);
+void notifyVideoReplayFrameDelivered(int frameNumber);
+
 void initializeVideoStream(void);
+void* allocateVideoPacketBuffer(void);
+void freeVideoPacketBuffer(void* buffer);
 void destroyVideoStream(void);
 void notifyKeyFrameReceived(void);
-int startVideoStream(void* rendererContext, int drFlags);
+int setupVideoDecoder(void* rendererContext, int drFlags);
+void cleanupVideoDecoder(void);
+int startVideoStream(void);
 void stopVideoStream(void);
 
 int initializeAudioStream(void);
 int notifyAudioPortNegotiationComplete(void);
 void destroyAudioStream(void);
-int startAudioStream(void* audioContext, int arFlags);
+int setupAudioRenderer(void* audioContext, int arFlags);
+int startAudioStream(void);
 void stopAudioStream(void);
 
 int initializeInputStream(void);
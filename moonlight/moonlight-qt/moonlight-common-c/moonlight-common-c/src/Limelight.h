@@ -102,6 +102,14 @@ typedef struct _STREAM_CONFIGURATION {
     // enabled.
     int encryptionFlags;
 
+    // Specifies that the RTSP handshake may send requests that don't depend on
+    // earlier responses back to back on a single connection, with responses
+    // matched by CSeq. This saves several round trips at stream start over
+    // high latency links. Hosts that answer only one request per connection are
+    // detected and fall back to one request at a time. This is ignored for older
+    // GFE versions.
+    bool pipelineRtspHandshake;
+
     // AES encryption data for the remote input stream. This must be
     // the same as what was passed as rikey and rikeyid
     // in /launch and /resume requests.
@@ -172,8 +180,17 @@ typedef struct _DECODE_UNIT {
 
     // Head of the buffer chain (never NULL)
     PLENTRY bufferList;
+
+    // If CAPABILITY_CONTIGUOUS_FRAME_BUFFER is set, this points to a single allocation
+    // holding the entire frame. The buffers in bufferList point into it back-to-back,
+    // and the data is followed by VIDEO_FRAME_BUFFER_PADDING zeroed bytes. This is NULL
+    // if the capability is not set or LiTakeVideoFrameBuffer() was already called.
+    char* frameBuffer;
 } DECODE_UNIT, *PDECODE_UNIT;
 
+// Number of zeroed bytes following the frame data in DECODE_UNIT.frameBuffer
+#define VIDEO_FRAME_BUFFER_PADDING 64
+
 // Specifies that the audio stream should be encoded in stereo (default)
 #define AUDIO_CONFIGURATION_STEREO MAKE_AUDIO_CONFIGURATION(2, 0x3)
 
@@ -255,6 +272,12 @@ typedef struct _DECODE_UNIT {
 // number of slices per frame. This capability is only valid on video renderers.
 #define CAPABILITY_SLICES_PER_FRAME(x) (((unsigned char)(x)) << 24)
 
+// If set in the video renderer capabilities field, this flag causes each frame to be
+// assembled into a single padded buffer (DECODE_UNIT.frameBuffer) as packets arrive.
+// The renderer may take ownership of that buffer to pass it to the decoder without
+// another copy. This capability is only valid on video renderers.
+#define CAPABILITY_CONTIGUOUS_FRAME_BUFFER 0x40
+
 // This callback is invoked to provide details about the video stream and allow configuration of the decoder.
 // Returns 0 on success, non-zero on failure.
 typedef int(*DecoderRendererSetup)(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags);
@@ -358,10 +381,14 @@ void LiInitializeAudioCallbacks(PAUDIO_RENDERER_CALLBACKS arCallbacks);
 #define STAGE_INPUT_STREAM_START 11
 #define STAGE_MAX 12
 
-// This callback is invoked to indicate that a stage of initialization is about to begin
+// This callback is invoked to indicate that a stage of initialization is about to begin.
+// Some stages run concurrently, so a stage may start before the previous one completes.
+// Stages always complete in order, and all stage callbacks are invoked on the thread that
+// called LiStartConnection().
 typedef void(*ConnListenerStageStarting)(int stage);
 
-// This callback is invoked to indicate that a stage of initialization has completed
+// This callback is invoked to indicate that a stage of initialization has completed.
+// LiGetStageTimes() can be called from this callback to find how long the stage took.
 typedef void(*ConnListenerStageComplete)(int stage);
 
 // This callback is invoked to indicate that a stage of initialization has failed.
@@ -491,6 +518,12 @@ void LiInterruptConnection(void);
 // from the integer passed to the ConnListenerStageXXX callbacks
 const char* LiGetStageName(int stage);
 
+// This function returns the LiGetMicroseconds() times at which the given stage of the
+// current or most recent LiStartConnection() call started and completed. Either time is
+// 0 if the stage has not reached that point. Because some stages overlap, the time to
+// complete a stage is not necessarily the time between it and the previous stage.
+void LiGetStageTimes(int stage, uint64_t* startTimeUs, uint64_t* completeTimeUs);
+
 // This function returns an estimate of the current RTT to the host PC obtained via ENet
 // protocol statistics. This function will fail if the current GFE version does not use
 // ENet for the control stream (very old versions), or if the ENet peer is not connected.
@@ -616,6 +649,10 @@ int LiSendHighResHScrollEvent(short scrollAmount);
 // This function returns a time in milliseconds with an implementation-defined epoch.
 uint64_t LiGetMillis(void);
 
+// This function returns a time in microseconds with an implementation-defined epoch.
+// The epoch is not necessarily the same as LiGetMillis().
+uint64_t LiGetMicroseconds(void);
+
 // This is a simplistic STUN function that can assist clients in getting the WAN address
 // for machines they find using mDNS over IPv4. This can be used to pre-populate the external
 // address for streaming after GFE stopped sending it a while back. wanAddr is returned in
@@ -626,6 +663,11 @@ int LiFindExternalAddressIP4(const char* stunServer, unsigned short stunPort, un
 // if CAPABILITY_DIRECT_SUBMIT is not set for the video renderer.
 int LiGetPendingVideoFrames(void);
 
+// Returns the number of video packet buffers that were served from the preallocated
+// packet pool (hits) and the number that required a heap allocation because the
+// pool was exhausted (misses) during the current connection.
+void LiGetVideoPacketPoolStats(unsigned int* hits, unsigned int* misses);
+
 // Returns the number of queued audio frames ready for delivery. Only relevant
 // if CAPABILITY_DIRECT_SUBMIT is not set for the audio renderer. For most uses,
 // LiGetPendingAudioDuration() is probably a better option than this function.
@@ -701,6 +743,186 @@ bool LiPeekNextVideoFrame(PDECODE_UNIT* decodeUnit);
 void LiWakeWaitForVideoFrame(void);
 void LiCompleteVideoFrame(VIDEO_FRAME_HANDLE handle, int drStatus);
 
+// These functions allow a renderer using CAPABILITY_CONTIGUOUS_FRAME_BUFFER to keep the
+// frame buffer alive beyond LiCompleteVideoFrame() or the return of drSubmitDecodeUnit().
+// LiTakeVideoFrameBuffer() transfers ownership of the decode unit's frameBuffer to the caller
+// (returning NULL if there is none), and the buffer must later be released with
+// LiFreeVideoFrameBuffer(). The buffer list entries remain valid only until the frame
+// is completed, but the data they point to lives as long as the taken buffer.
+char* LiTakeVideoFrameBuffer(PDECODE_UNIT decodeUnit);
+void LiFreeVideoFrameBuffer(char* buffer);
+
+// Stages of the per-frame latency trace. The first three are recorded by the library
+// as a frame is received and reassembled. The rest are recorded by the client with
+// LiRecordVideoFrameTraceStage() as the frame moves through its video pipeline.
+#define FRAME_TRACE_STAGE_RECEIVED     0 // First packet of the frame received
+#define FRAME_TRACE_STAGE_FEC_COMPLETE 1 // Last FEC block of the frame received or recovered
+#define FRAME_TRACE_STAGE_DEPACKETIZED 2 // Frame reassembled and queued for the decoder
+#define FRAME_TRACE_STAGE_SUBMITTED    3 // Frame submitted to the decoder
+#define FRAME_TRACE_STAGE_DECODED      4 // Decoded picture returned by the decoder
+#define FRAME_TRACE_STAGE_PACER_QUEUED 5 // Picture queued for frame pacing
+#define FRAME_TRACE_STAGE_PRESENTED    6 // Picture presented to the display
+#define FRAME_TRACE_STAGE_MAX          7
+
+// The trace keeps the timestamps of the last FRAME_TRACE_SIZE frames delivered
+// by the depacketizer. Older frames are overwritten.
+#define FRAME_TRACE_SIZE 8192
+
+// This function records the current LiGetMicroseconds() time for the given stage of the
+// given frame number. It is lock-free and safe to call from any thread while the connection
+// is running. Stages recorded for frames that are no longer in the trace are ignored.
+void LiRecordVideoFrameTraceStage(int frameNumber, int stage);
+
+#define FRAME_TRACE_FORMAT_BINARY      0
+#define FRAME_TRACE_FORMAT_CHROME_JSON 1
+
+// This function writes the frames in the trace to the given file. FRAME_TRACE_FORMAT_CHROME_JSON
+// produces a trace event file viewable in chrome://tracing or Perfetto with one track per
+// stage. FRAME_TRACE_FORMAT_BINARY produces a compact file in host byte order consisting of:
+//   char magic[4] = "MLFT", uint16_t version = 1, uint16_t stageCount,
+//   uint32_t frameCount, uint32_t reserved
+// followed by frameCount records of:
+//   uint32_t frameNumber, uint32_t reserved, uint64_t receiveTimeUs,
+//   uint32_t stageOffsetUs[stageCount - 1]
+// Stage offsets are relative to receiveTimeUs and are 0 if the frame never reached that stage.
+// This function must be called between LiStartConnection() and LiStopConnection().
+// It returns 0 on success or -1 on failure.
+int LiWriteVideoFrameTrace(const char* fileName, int format);
+
+typedef struct _FRAME_TRACE_RECORD {
+    int frameNumber;
+
+    // LiGetMicroseconds() time of each stage, or 0 if the frame never reached it
+    uint64_t stageTimeUs[FRAME_TRACE_STAGE_MAX];
+} FRAME_TRACE_RECORD, *PFRAME_TRACE_RECORD;
+
+// This function copies the most recent frames in the trace (up to maxRecords) into the
+// records array in frame order and returns the number of records copied. Like
+// LiWriteVideoFrameTrace(), it must be called while the connection or replay is running.
+int LiGetVideoFrameTrace(PFRAME_TRACE_RECORD records, int maxRecords);
+
+// Simulated network impairments applied to replayed packets. The same seed produces
+// the same impairments on each run.
+typedef struct _PACKET_IMPAIRMENT_CONFIGURATION {
+    // Average percentage of packets dropped
+    int lossPercent;
+
+    // Mean length of a run of dropped packets. If this is 0 or 1, each packet is dropped
+    // independently. Otherwise, drops come in bursts from a two-state Gilbert-Elliott
+    // model that drops every packet in the bad state and none in the good state.
+    int burstLength;
+
+    // Percentage of packets that are held back behind 1 to reorderDepth later packets
+    int reorderPercent;
+    int reorderDepth;
+
+    // Percentage of packets that are delivered twice
+    int duplicatePercent;
+
+    unsigned int seed;
+} PACKET_IMPAIRMENT_CONFIGURATION, *PPACKET_IMPAIRMENT_CONFIGURATION;
+
+// Offline replay of a recorded video stream for benchmarking the video pipeline. The replay
+// splits each recorded frame into video packets with FEC parity, optionally drops some of them,
+// and feeds them through the RTP queue and depacketizer to the decoder callbacks just like
+// packets received from a host. No host or network connection is involved.
+//
+// Streams are recorded by building with LC_DEBUG_RECORD_MODE and passing the output path as
+// the renderContext to LiStartConnection(). The recorder writes the Annex B data of each frame
+// to that path and a timing file with the frame boundaries and receive times to the same path
+// with ".timing" appended.
+typedef struct _VIDEO_REPLAY_CONFIGURATION {
+    // Recorded elementary stream to replay
+    const char* streamFile;
+
+    // Timing file written by the recorder alongside the stream. If this is NULL,
+    // frames are found by parsing the H.264 or HEVC bitstream and are paced at fps.
+    // AV1 streams must have a timing file.
+    const char* timingFile;
+
+    // Stream parameters. These are only used if there is no timing file.
+    int videoFormat;
+    int width;
+    int height;
+    int fps;
+
+    // Size of the synthesized video packets (as in STREAM_CONFIGURATION) and the
+    // percentage of FEC parity packets sent with each FEC block
+    int packetSize;
+    int fecPercentage;
+
+    // Replay pace as a percentage of the recorded pace. If this is 0, frames are
+    // fed as fast as the decoder consumes them.
+    int speedPercent;
+
+    // Impairments applied to packets before they reach the RTP queues
+    PACKET_IMPAIRMENT_CONFIGURATION impairment;
+
+    // If this is non-zero, a synthetic audio stream with packets of this duration (in
+    // milliseconds) and FEC parity is fed through the audio RTP queue alongside the video.
+    // The audio is not decoded, so no audio callbacks are needed.
+    int audioPacketDuration;
+} VIDEO_REPLAY_CONFIGURATION, *PVIDEO_REPLAY_CONFIGURATION;
+
+// Use this function to initialize the replay configuration with the default packet
+// size, FEC percentage, and pace. streamFile must still be provided by the caller.
+void LiInitializeVideoReplayConfiguration(PVIDEO_REPLAY_CONFIGURATION replayConfig);
+
+typedef struct _VIDEO_REPLAY_STATS {
+    uint32_t framesSent;
+    uint32_t packetsSent;
+    uint32_t packetsDropped;
+    uint32_t packetsReordered;
+    uint32_t packetsDuplicated;
+
+    // Frames that were replaced by the last IDR frame in response to an IDR frame request
+    uint32_t idrFramesResent;
+
+    // Frames delivered to the decoder, and those among them that lost packets along the way
+    uint32_t framesDelivered;
+    uint32_t framesRecovered;
+
+    // Time between sending the last data packet of a frame and the frame being delivered.
+    // This is the latency added by waiting for parity or reordered packets.
+    uint64_t totalAddedLatencyUs;
+    uint32_t maxAddedLatencyUs;
+
+    // Time spent in the video RTP queue and depacketizer (which includes decoding
+    // with CAPABILITY_DIRECT_SUBMIT) for all packets that were not dropped
+    uint64_t totalQueueTimeUs;
+
+    // Synthetic audio stream counterparts of the above. Each audio data packet ends up
+    // either delivered or lost (and concealed), whether or not it was dropped. Recovered
+    // packets are delivered packets that were rebuilt from FEC parity. Corrupted packets
+    // were delivered with the wrong data, which is always a bug.
+    uint32_t audioPacketsSent;
+    uint32_t audioPacketsDropped;
+    uint32_t audioPacketsDelivered;
+    uint32_t audioPacketsRecovered;
+    uint32_t audioPacketsLost;
+    uint32_t audioPacketsCorrupted;
+    uint64_t audioTotalAddedLatencyUs;
+    uint32_t audioMaxAddedLatencyUs;
+    uint64_t audioTotalQueueTimeUs;
+} VIDEO_REPLAY_STATS, *PVIDEO_REPLAY_STATS;
+
+// Starts replaying the given recording to the decoder callbacks. The callbacks are used
+// exactly as LiStartConnection() would use them, including CAPABILITY_DIRECT_SUBMIT and
+// CAPABILITY_PULL_RENDERER. Only the logMessage callback of clCallbacks is used, and
+// clCallbacks may be NULL. A replay cannot run at the same time as a connection.
+// Returns 0 on success or an error code on failure.
+int LiStartVideoReplay(PVIDEO_REPLAY_CONFIGURATION replayConfig, PCONNECTION_LISTENER_CALLBACKS clCallbacks,
+    PDECODER_RENDERER_CALLBACKS drCallbacks, void* renderContext, int drFlags);
+
+// Returns true once every frame has been fed and all queued frames have been consumed
+bool LiIsVideoReplayFinished(void);
+
+void LiGetVideoReplayStats(PVIDEO_REPLAY_STATS stats);
+
+// Stops the replay and cleans up the decoder callbacks. This must be called after a
+// successful LiStartVideoReplay() even if the replay has finished.
+void LiStopVideoReplay(void);
+
 // This function returns the last reported HDR mode from the host PC.
 // See ConnListenerSetHdrMode() for more details.
 bool LiGetCurrentHostDisplayHdrMode(void);
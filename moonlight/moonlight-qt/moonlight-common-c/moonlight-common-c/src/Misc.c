@@ -154,3 +154,7 @@ void LiInitializeServerInformation(PSERVER_INFORMATION serverInfo) {
 uint64_t LiGetMillis(void) {
     return PltGetMillis();
 }
+
+uint64_t LiGetMicroseconds(void) {
+    return PltGetMicroseconds();
+}
@@ -0,0 +1,114 @@
+#include "Limelight-internal.h"
+
+// Impairments must be reproducible from the seed, so we use our own
+// xorshift32 generator rather than rand()
+static uint32_t nextRandom(PPACKET_IMPAIRMENT pi) {
+    pi->randomState ^= pi->randomState << 13;
+    pi->randomState ^= pi->randomState >> 17;
+    pi->randomState ^= pi->randomState << 5;
+    return pi->randomState;
+}
+
+static bool randomPercent(PPACKET_IMPAIRMENT pi, int percent) {
+    return percent > 0 && nextRandom(pi) % 100 < (uint32_t)percent;
+}
+
+void PiInitialize(PPACKET_IMPAIRMENT pi, PPACKET_IMPAIRMENT_CONFIGURATION config, uint32_t streamId) {
+    memset(pi, 0, sizeof(*pi));
+    memcpy(&pi->config, config, sizeof(pi->config));
+
+    pi->randomState = config->seed ^ (streamId * 0x9E3779B9);
+    if (pi->randomState == 0) {
+        // xorshift gets stuck at 0
+        pi->randomState = 1;
+    }
+
+    if (pi->config.reorderDepth < 1) {
+        pi->config.reorderDepth = 1;
+    }
+    else if (pi->config.reorderDepth > PI_MAX_REORDER_DEPTH) {
+        pi->config.reorderDepth = PI_MAX_REORDER_DEPTH;
+    }
+
+    if (config->burstLength > 1 && config->lossPercent > 0 && config->lossPercent < 100) {
+        // Bursts end with probability 1/burstLength per packet, which makes their mean
+        // length burstLength. We choose the start probability so the model spends
+        // lossPercent of the time in the bad state.
+        double endProbability = 1.0 / config->burstLength;
+        double startProbability = endProbability * config->lossPercent / (100 - config->lossPercent);
+
+        pi->burstEndThreshold = (uint32_t)(endProbability * UINT32_MAX);
+        pi->burstStartThreshold = startProbability >= 1.0 ? UINT32_MAX : (uint32_t)(startProbability * UINT32_MAX);
+    }
+}
+
+static bool shouldDropPacket(PPACKET_IMPAIRMENT pi) {
+    if (pi->config.lossPercent <= 0) {
+        return false;
+    }
+    else if (pi->burstEndThreshold == 0) {
+        // Bernoulli loss
+        return randomPercent(pi, pi->config.lossPercent);
+    }
+
+    // Gilbert-Elliott loss
+    if (pi->inBurst) {
+        if (nextRandom(pi) < pi->burstEndThreshold) {
+            pi->inBurst = false;
+        }
+    }
+    else if (nextRandom(pi) < pi->burstStartThreshold) {
+        pi->inBurst = true;
+    }
+
+    return pi->inBurst;
+}
+
+// Decides the fate of the next packet in the stream. If PI_DELAY is returned, the
+// impairment owns the packet until PiGetDelayedPacket() returns it. The caller should
+// drain PiGetDelayedPacket() after each packet it processes.
+int PiProcessPacket(PPACKET_IMPAIRMENT pi, void* packet, int length) {
+    pi->packetIndex++;
+
+    if (shouldDropPacket(pi)) {
+        return PI_DROP;
+    }
+
+    if (randomPercent(pi, pi->config.reorderPercent) && pi->delayedCount < PI_MAX_REORDER_DEPTH) {
+        PPI_DELAYED_PACKET delayedPacket = &pi->delayedPackets[pi->delayedCount++];
+
+        delayedPacket->packet = packet;
+        delayedPacket->length = length;
+        delayedPacket->releaseIndex = pi->packetIndex + 1 + nextRandom(pi) % (uint32_t)pi->config.reorderDepth;
+        return PI_DELAY;
+    }
+
+    if (randomPercent(pi, pi->config.duplicatePercent)) {
+        return PI_DUPLICATE;
+    }
+
+    return PI_DELIVER;
+}
+
+// Returns the next delayed packet that is due for delivery (or any delayed packet
+// if flush is true), or NULL if there are none
+void* PiGetDelayedPacket(PPACKET_IMPAIRMENT pi, int* length, bool flush) {
+    int i;
+
+    for (i = 0; i < pi->delayedCount; i++) {
+        PPI_DELAYED_PACKET delayedPacket = &pi->delayedPackets[i];
+
+        if (flush || !isBefore32(pi->packetIndex, delayedPacket->releaseIndex)) {
+            void* packet = delayedPacket->packet;
+
+            *length = delayedPacket->length;
+
+            // Keep the remaining packets in the order they were delayed
+            pi->delayedCount--;
+            memmove(delayedPacket, delayedPacket + 1, (pi->delayedCount - i) * sizeof(*delayedPacket));
+            return packet;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Limelight.h"
+
+// Packets held back for reordering must be released within this many packets
+#define PI_MAX_REORDER_DEPTH 64
+
+// Fates of a packet passed to PiProcessPacket()
+#define PI_DELIVER   0
+#define PI_DROP      1
+#define PI_DUPLICATE 2
+#define PI_DELAY     3
+
+typedef struct _PI_DELAYED_PACKET {
+    void* packet;
+    int length;
+    uint32_t releaseIndex;
+} PI_DELAYED_PACKET, *PPI_DELAYED_PACKET;
+
+typedef struct _PACKET_IMPAIRMENT {
+    PACKET_IMPAIRMENT_CONFIGURATION config;
+    uint32_t randomState;
+
+    // Gilbert-Elliott state transition thresholds (out of 2^32)
+    uint32_t burstStartThreshold;
+    uint32_t burstEndThreshold;
+    bool inBurst;
+
+    uint32_t packetIndex;
+    PI_DELAYED_PACKET delayedPackets[PI_MAX_REORDER_DEPTH];
+    int delayedCount;
+} PACKET_IMPAIRMENT, *PPACKET_IMPAIRMENT;
+
+// Packet streams that should be impaired independently must use different stream IDs
+void PiInitialize(PPACKET_IMPAIRMENT pi, PPACKET_IMPAIRMENT_CONFIGURATION config, uint32_t streamId);
+int PiProcessPacket(PPACKET_IMPAIRMENT pi, void* packet, int length);
+void* PiGetDelayedPacket(PPACKET_IMPAIRMENT pi, int* length, bool flush);
@@ -360,6 +360,135 @@ bool PltDecryptMessage(PPLT_CRYPTO_CONTEXT ctx, int algorithm, int flags,
 #endif
 }
 
+#ifndef USE_MBEDTLS
+// AES-CBC decryption of a block only depends on the key and the preceding ciphertext
+// block, so we can decrypt the messages back to back on a context that we never
+// reinitialize, then correct the first block of each message for its own IV. This
+// skips the EVP IV setup and padding finalization that dominate the cost of
+// decrypting small packets. Returns false if the batch must be decrypted one
+// message at a time instead.
+static bool decryptCbcBatch(PPLT_CRYPTO_CONTEXT ctx,
+                            unsigned char* key, int keyLength, int ivLength,
+                            PPLT_CRYPTO_MESSAGE messages, int messageCount,
+                            bool* success) {
+    LC_ASSERT(keyLength == 16);
+
+    if (ivLength != 16) {
+        return false;
+    }
+
+    for (int i = 0; i < messageCount; i++) {
+        // PKCS7 padding means we must always have whole blocks
+        if (messages[i].inputDataLength <= 0 || messages[i].inputDataLength % 16 != 0) {
+            return false;
+        }
+    }
+
+    // The chaining state is only valid for the key we initialized with
+    if (ctx->batchCtx != NULL && memcmp(ctx->batchKey, key, sizeof(ctx->batchKey)) != 0) {
+        EVP_CIPHER_CTX_free(ctx->batchCtx);
+        ctx->batchCtx = NULL;
+    }
+
+    if (ctx->batchCtx == NULL) {
+        ctx->batchCtx = EVP_CIPHER_CTX_new();
+        if (ctx->batchCtx == NULL) {
+            return false;
+        }
+
+        // The IV is only used for the first block, which we fix up anyway
+        memset(ctx->batchChainBlock, 0, sizeof(ctx->batchChainBlock));
+        if (EVP_DecryptInit_ex(ctx->batchCtx, EVP_aes_128_cbc(), NULL, key, ctx->batchChainBlock) != 1) {
+            EVP_CIPHER_CTX_free(ctx->batchCtx);
+            ctx->batchCtx = NULL;
+            return false;
+        }
+
+        // We remove the padding from each message ourselves
+        EVP_CIPHER_CTX_set_padding(ctx->batchCtx, 0);
+
+        memcpy(ctx->batchKey, key, sizeof(ctx->batchKey));
+    }
+
+    *success = true;
+    for (int i = 0; i < messageCount; i++) {
+        unsigned char* input = messages[i].inputData;
+        unsigned char* output = messages[i].outputData;
+        int length = messages[i].inputDataLength;
+        unsigned char lastBlock[16];
+        int outLength;
+
+        // This will be the chaining block for the next message
+        memcpy(lastBlock, &input[length - 16], sizeof(lastBlock));
+
+        if (EVP_DecryptUpdate(ctx->batchCtx, output, &outLength, input, length) != 1) {
+            // We don't know the chaining state anymore, so start over next time
+            EVP_CIPHER_CTX_free(ctx->batchCtx);
+            ctx->batchCtx = NULL;
+            return false;
+        }
+        LC_ASSERT(outLength == length);
+
+        // The first block was XORed with the previous ciphertext block rather than our IV
+        for (int j = 0; j < 16; j++) {
+            output[j] ^= ctx->batchChainBlock[j] ^ messages[i].iv[j];
+        }
+
+        memcpy(ctx->batchChainBlock, lastBlock, sizeof(lastBlock));
+
+        unsigned char paddingByte = output[length - 1];
+        bool paddingValid = paddingByte >= 1 && paddingByte <= 16;
+        for (int j = 1; paddingValid && j < paddingByte; j++) {
+            paddingValid = output[length - 1 - j] == paddingByte;
+        }
+
+        if (paddingValid) {
+            messages[i].outputDataLength = length - paddingByte;
+        }
+        else {
+            messages[i].outputDataLength = -1;
+            *success = false;
+        }
+    }
+
+    return true;
+}
+#endif
+
+bool PltDecryptMessageBatch(PPLT_CRYPTO_CONTEXT ctx, int algorithm, int flags,
+                            unsigned char* key, int keyLength,
+                            int ivLength, int tagLength,
+                            PPLT_CRYPTO_MESSAGE messages, int messageCount) {
+    bool ret = true;
+
+#ifndef USE_MBEDTLS
+    if (algorithm == ALGORITHM_AES_CBC &&
+            flags == (CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH) &&
+            decryptCbcBatch(ctx, key, keyLength, ivLength, messages, messageCount, &ret)) {
+        return ret;
+    }
+#endif
+
+    for (int i = 0; i < messageCount; i++) {
+        // The key schedule stays in the context across messages. For GCM,
+        // only the first message needs a reset since the IV length is fixed.
+        if (!PltDecryptMessage(ctx, algorithm, flags, key, keyLength,
+                               messages[i].iv, ivLength,
+                               messages[i].tag, tagLength,
+                               messages[i].inputData, messages[i].inputDataLength,
+                               messages[i].outputData, &messages[i].outputDataLength)) {
+            messages[i].outputDataLength = -1;
+            ret = false;
+        }
+
+        if (algorithm == ALGORITHM_AES_GCM) {
+            flags &= ~CIPHER_FLAG_RESET_IV;
+        }
+    }
+
+    return ret;
+}
+
 PPLT_CRYPTO_CONTEXT PltCreateCryptoContext(void) {
     PPLT_CRYPTO_CONTEXT ctx = malloc(sizeof(*ctx));
     if (!ctx) {
@@ -371,6 +500,8 @@ PPLT_CRYPTO_CONTEXT PltCreateCryptoContext(void) {
 #ifdef USE_MBEDTLS
     mbedtls_cipher_init(&ctx->ctx);
 #else
+    ctx->batchCtx = NULL;
+
     ctx->ctx = EVP_CIPHER_CTX_new();
     if (!ctx->ctx) {
         free(ctx);
@@ -386,6 +517,9 @@ void PltDestroyCryptoContext(PPLT_CRYPTO_CONTEXT ctx) {
     mbedtls_cipher_free(&ctx->ctx);
 #else
     EVP_CIPHER_CTX_free(ctx->ctx);
+    if (ctx->batchCtx != NULL) {
+        EVP_CIPHER_CTX_free(ctx->batchCtx);
+    }
 #endif
     free(ctx);
 }
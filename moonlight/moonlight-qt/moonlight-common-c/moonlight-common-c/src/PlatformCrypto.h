@@ -16,6 +16,11 @@ typedef struct _PLT_CRYPTO_CONTEXT {
 #else
     EVP_CIPHER_CTX* ctx;
     bool initialized;
+
+    // Used by PltDecryptMessageBatch() for AES-CBC
+    EVP_CIPHER_CTX* batchCtx;
+    unsigned char batchChainBlock[16];
+    unsigned char batchKey[16];
 #endif
 } PLT_CRYPTO_CONTEXT, *PPLT_CRYPTO_CONTEXT;
 
@@ -45,4 +50,23 @@ bool PltDecryptMessage(PPLT_CRYPTO_CONTEXT ctx, int algorithm, int flags,
                        unsigned char* inputData, int inputDataLength,
                        unsigned char* outputData, int* outputDataLength);
 
+typedef struct _PLT_CRYPTO_MESSAGE {
+    unsigned char* iv;
+    unsigned char* tag;
+    unsigned char* inputData;
+    int inputDataLength;
+    unsigned char* outputData;
+
+    // Set to the length of the decrypted data or -1 if decryption failed
+    int outputDataLength;
+} PLT_CRYPTO_MESSAGE, *PPLT_CRYPTO_MESSAGE;
+
+// Decrypts several independent messages that share a key and IV length. Each
+// output buffer must be at least as large as its input and must not overlap it.
+// Returns false if any of the messages failed to decrypt.
+bool PltDecryptMessageBatch(PPLT_CRYPTO_CONTEXT ctx, int algorithm, int flags,
+                            unsigned char* key, int keyLength,
+                            int ivLength, int tagLength,
+                            PPLT_CRYPTO_MESSAGE messages, int messageCount);
+
 void PltGenerateRandomData(unsigned char* data, int length);
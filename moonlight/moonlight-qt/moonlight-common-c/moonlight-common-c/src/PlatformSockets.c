@@ -1,3 +1,8 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// Required for recvmmsg()
+#define _GNU_SOURCE
+#endif
+
 #include "Limelight-internal.h"
 
 #define TEST_PORT_TIMEOUT_SEC 3
@@ -206,6 +211,77 @@ int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect) {
     return err;
 }
 
+// Receives up to count datagrams into the provided buffers (each of the given size).
+// Returns the number of datagrams received, 0 on timeout, or a negative value on error.
+// The lengths array is populated with the size of each received datagram.
+int recvUdpSocketBatch(SOCKET s, char** buffers, int* lengths, int size, int count, bool useSelect) {
+#if defined(LC_HAS_RECVMMSG)
+    struct mmsghdr msgs[UDP_RECV_BATCH_MAX];
+    struct iovec iovs[UDP_RECV_BATCH_MAX];
+    int err;
+    int i;
+
+    LC_ASSERT(count > 0 && count <= UDP_RECV_BATCH_MAX);
+
+    if (useSelect) {
+        struct pollfd pfd;
+
+        // Wait up to 100 ms for the socket to be readable
+        pfd.fd = s;
+        pfd.events = POLLIN;
+        err = pollSockets(&pfd, 1, UDP_RECV_POLL_TIMEOUT_MS);
+        if (err <= 0) {
+            // Return if an error or timeout occurs
+            return err;
+        }
+    }
+
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (i = 0; i < count; i++) {
+        iovs[i].iov_base = buffers[i];
+        iovs[i].iov_len = size;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    do {
+        // MSG_WAITFORONE makes recvmmsg() block (subject to SO_RCVTIMEO) only
+        // until the first datagram arrives. After that, it returns whatever
+        // additional datagrams are already waiting in the socket buffer.
+        err = recvmmsg(s, msgs, count, MSG_WAITFORONE, NULL);
+        if (err < 0 &&
+                (LastSocketError() == EWOULDBLOCK ||
+                 LastSocketError() == EINTR ||
+                 LastSocketError() == EAGAIN ||
+                 LastSocketError() == ETIMEDOUT)) {
+            // Return 0 for timeout
+            return 0;
+        }
+
+    // See comment in recvUdpSocket() regarding ICMP Port Unreachable errors
+    } while (err < 0 && LastSocketError() == ECONNREFUSED);
+
+    for (i = 0; i < err; i++) {
+        lengths[i] = (int)msgs[i].msg_len;
+    }
+
+    return err;
+#else
+    int err;
+
+    LC_ASSERT(count > 0);
+
+    // Fall back to receiving a single datagram per call
+    err = recvUdpSocket(s, buffers[0], size, useSelect);
+    if (err > 0) {
+        lengths[0] = err;
+        return 1;
+    }
+
+    return err;
+#endif
+}
+
 void closeSocket(SOCKET s) {
 #if defined(LC_WINDOWS)
     closesocket(s);
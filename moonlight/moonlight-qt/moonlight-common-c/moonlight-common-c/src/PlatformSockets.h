@@ -76,6 +76,15 @@ typedef struct sockaddr_in LC_SOCKADDR;
 
 #define LastSocketFail() ((LastSocketError() != 0) ? LastSocketError() : -1)
 
+// recvmmsg() allows us to pull a burst of datagrams out of a UDP socket with a
+// single syscall. Other platforms receive one datagram per recvUdpSocketBatch().
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define LC_HAS_RECVMMSG
+#define UDP_RECV_BATCH_MAX 32
+#else
+#define UDP_RECV_BATCH_MAX 1
+#endif
+
 #ifdef AF_INET6
 // IPv6 addresses have 2 extra characters for URL escaping
 #define URLSAFESTRING_LEN (INET6_ADDRSTRLEN+2)
@@ -91,6 +100,7 @@ SOCKET bindUdpSocket(int addrfamily, int bufferSize);
 int enableNoDelay(SOCKET s);
 int setSocketNonBlocking(SOCKET s, bool enabled);
 int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect);
+int recvUdpSocketBatch(SOCKET s, char** buffers, int* lengths, int size, int count, bool useSelect);
 void shutdownTcpSocket(SOCKET s);
 int setNonFatalRecvTimeoutMs(SOCKET s, int timeoutMs);
 void closeSocket(SOCKET s);
@@ -71,5 +71,42 @@ void PltDeleteConditionVariable(PLT_COND* cond);
 void PltSignalConditionVariable(PLT_COND* cond);
 void PltWaitForConditionVariable(PLT_COND* cond, PLT_MUTEX* mutex);
 
+// Atomic operations on 32-bit values. Loads have acquire semantics, stores have
+// release semantics, and read-modify-write operations are full barriers.
+#if defined(_MSC_VER)
+#define PltAtomicLoad32(ptr) ((uint32_t)InterlockedOr((volatile LONG*)(ptr), 0))
+#define PltAtomicStore32(ptr, val) ((void)InterlockedExchange((volatile LONG*)(ptr), (LONG)(val)))
+#define PltAtomicFetchAdd32(ptr, val) ((uint32_t)InterlockedExchangeAdd((volatile LONG*)(ptr), (LONG)(val)))
+#define PltAtomicCompareExchange32(ptr, expected, desired) \
+    ((uint32_t)InterlockedCompareExchange((volatile LONG*)(ptr), (LONG)(desired), (LONG)(expected)) == (uint32_t)(expected))
+#define PltAtomicLoadPtr(ptr) InterlockedCompareExchangePointer((PVOID volatile*)(ptr), NULL, NULL)
+#define PltAtomicStorePtr(ptr, val) ((void)InterlockedExchangePointer((PVOID volatile*)(ptr), (PVOID)(val)))
+#define PltAtomicExchangePtr(ptr, val) InterlockedExchangePointer((PVOID volatile*)(ptr), (PVOID)(val))
+#define PltAtomicCompareExchangePtr(ptr, expected, desired) \
+    (InterlockedCompareExchangePointer((PVOID volatile*)(ptr), (PVOID)(desired), (PVOID)(expected)) == (PVOID)(expected))
+#define PltAtomicFence() MemoryBarrier()
+#else
+#define PltAtomicLoad32(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define PltAtomicStore32(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define PltAtomicFetchAdd32(ptr, val) __atomic_fetch_add((ptr), (val), __ATOMIC_SEQ_CST)
+#define PltAtomicCompareExchange32(ptr, expected, desired) __sync_bool_compare_and_swap((ptr), (expected), (desired))
+#define PltAtomicLoadPtr(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define PltAtomicStorePtr(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define PltAtomicExchangePtr(ptr, val) __atomic_exchange_n((ptr), (val), __ATOMIC_SEQ_CST)
+#define PltAtomicCompareExchangePtr(ptr, expected, desired) __sync_bool_compare_and_swap((ptr), (expected), (desired))
+#define PltAtomicFence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+// Hint to the CPU that we're in a spin-wait loop
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define PltCpuRelax() YieldProcessor()
+#elif defined(__i386__) || defined(__x86_64__)
+#define PltCpuRelax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+#define PltCpuRelax() __asm__ __volatile__("yield")
+#else
+#define PltCpuRelax() ((void)0)
+#endif
+
 void PltSleepMs(int ms);
 void PltSleepMsInterruptible(PLT_THREAD* thread, int ms);
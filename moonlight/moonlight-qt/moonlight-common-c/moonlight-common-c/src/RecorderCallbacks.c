@@ -1,11 +1,46 @@
 #include "Limelight-internal.h"
 
 static FILE* videoFile;
+static FILE* videoTimingFile;
 static FILE* audioFile;
 
 static DECODER_RENDERER_CALLBACKS realDrCallbacks;
 static AUDIO_RENDERER_CALLBACKS realArCallbacks;
 
+static FILE* openVideoTimingFile(const char* videoPath, int videoFormat, int width, int height, int redrawRate)
+{
+    VIDEO_TIMING_FILE_HEADER header;
+    char* path;
+    FILE* file;
+
+    path = malloc(strlen(videoPath) + sizeof(VIDEO_TIMING_FILE_SUFFIX));
+    if (path == NULL) {
+        return NULL;
+    }
+
+    strcpy(path, videoPath);
+    strcat(path, VIDEO_TIMING_FILE_SUFFIX);
+    file = fopen(path, "wb");
+    free(path);
+    if (file == NULL) {
+        return NULL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VIDEO_TIMING_MAGIC, sizeof(header.magic));
+    header.version = VIDEO_TIMING_VERSION;
+    header.videoFormat = videoFormat;
+    header.width = width;
+    header.height = height;
+    header.fps = redrawRate;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return NULL;
+    }
+
+    return file;
+}
+
 static int recDrSetup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags)
 {
     const char* path = context;
@@ -15,6 +50,12 @@ static int recDrSetup(int videoFormat, int width, int height, int redrawRate, vo
         if (videoFile == NULL) {
             return -1;
         }
+
+        // The stream is still usable without timing, so this isn't fatal
+        videoTimingFile = openVideoTimingFile(path, videoFormat, width, height, redrawRate);
+        if (videoTimingFile == NULL) {
+            Limelog("Video timing will not be recorded - failed to create timing file!\n");
+        }
     }
     else {
         Limelog("Video recording will not be enabled - file path not specified in drContext!\n");
@@ -29,11 +70,17 @@ static void recDrCleanup(void)
         fclose(videoFile);
         videoFile = NULL;
     }
+    if (videoTimingFile != NULL) {
+        fclose(videoTimingFile);
+        videoTimingFile = NULL;
+    }
 
     realDrCallbacks.cleanup();
 }
 
-static int recDrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
+// Called by the depacketizer as each frame is handed to the client. This catches
+// frames for pull renderers too, which never go through submitDecodeUnit().
+void recordVideoFrame(PDECODE_UNIT decodeUnit)
 {
     if (videoFile != NULL) {
         PLENTRY entry = decodeUnit->bufferList;
@@ -43,7 +90,17 @@ static int recDrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
         }
     }
 
-    return realDrCallbacks.submitDecodeUnit(decodeUnit);
+    if (videoTimingFile != NULL) {
+        VIDEO_TIMING_RECORD record;
+
+        record.frameNumber = decodeUnit->frameNumber;
+        record.frameType = decodeUnit->frameType;
+        record.length = decodeUnit->fullLength;
+        record.presentationTimeMs = decodeUnit->presentationTimeMs;
+        record.receiveTimeMs = decodeUnit->receiveTimeMs;
+        record.enqueueTimeMs = decodeUnit->enqueueTimeMs;
+        fwrite(&record, sizeof(record), 1, videoTimingFile);
+    }
 }
 
 static int recArInit(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* context, int arFlags)
@@ -89,7 +146,6 @@ void setRecorderCallbacks(PDECODER_RENDERER_CALLBACKS drCallbacks, PAUDIO_RENDER
 
     drCallbacks->setup = recDrSetup;
     drCallbacks->cleanup = recDrCleanup;
-    drCallbacks->submitDecodeUnit = recDrSubmitDecodeUnit;
 
     arCallbacks->init = recArInit;
     arCallbacks->cleanup = recArCleanup;
@@ -0,0 +1,305 @@
+#include "RingBlockingQueue.h"
+
+#ifdef __linux__
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+// Sleep until wakeWaiters() is called, unless it has already been called
+// since the wake sequence was sampled
+static void waitForWake(PRING_BLOCKING_QUEUE queueHead, uint32_t wakeSequence) {
+#ifdef __linux__
+    syscall(SYS_futex, &queueHead->wakeSequence, FUTEX_WAIT_PRIVATE, wakeSequence, NULL, NULL, 0);
+#else
+    PltLockMutex(&queueHead->mutex);
+    if (PltAtomicLoad32(&queueHead->wakeSequence) == wakeSequence) {
+        PltWaitForConditionVariable(&queueHead->cond, &queueHead->mutex);
+    }
+    PltUnlockMutex(&queueHead->mutex);
+#endif
+}
+
+static void wakeWaiters(PRING_BLOCKING_QUEUE queueHead) {
+    PltAtomicFetchAdd32(&queueHead->wakeSequence, 1);
+
+#ifdef __linux__
+    syscall(SYS_futex, &queueHead->wakeSequence, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    // Synchronize with a waiter that is between checking the sequence and sleeping
+    PltLockMutex(&queueHead->mutex);
+    PltUnlockMutex(&queueHead->mutex);
+    PltSignalConditionVariable(&queueHead->cond);
+#endif
+}
+
+static bool isMultiprocessor(void) {
+#if defined(LC_WINDOWS)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    return sysconf(_SC_NPROCESSORS_ONLN) > 1;
+#else
+    return true;
+#endif
+}
+
+// Claim the entry at the head of the queue. Returns NULL if the queue is empty.
+static PLINKED_BLOCKING_QUEUE_ENTRY dequeueEntry(PRING_BLOCKING_QUEUE queueHead) {
+    for (;;) {
+        uint32_t head = PltAtomicLoad32(&queueHead->head);
+        PLINKED_BLOCKING_QUEUE_ENTRY entry;
+
+        if (head == PltAtomicLoad32(&queueHead->tail)) {
+            return NULL;
+        }
+
+        // If another thread claims this slot first, the value we read may be stale
+        // but the CAS will fail and we'll try again with the new head.
+        entry = PltAtomicLoadPtr(&queueHead->slots[head & queueHead->mask]);
+        if (PltAtomicCompareExchange32(&queueHead->head, head, head + 1)) {
+            return entry;
+        }
+    }
+}
+
+// Ring blocking queue init
+int RbqInitializeRingBlockingQueue(PRING_BLOCKING_QUEUE queueHead, int sizeBound) {
+    uint32_t capacity;
+
+    memset(queueHead, 0, sizeof(*queueHead));
+
+    LC_ASSERT(sizeBound > 0);
+
+    capacity = 1;
+    while (capacity < (uint32_t)sizeBound) {
+        capacity <<= 1;
+    }
+
+    queueHead->slots = calloc(capacity, sizeof(*queueHead->slots));
+    if (queueHead->slots == NULL) {
+        return -1;
+    }
+
+#ifndef __linux__
+    if (PltCreateMutex(&queueHead->mutex) != 0) {
+        free(queueHead->slots);
+        queueHead->slots = NULL;
+        return -1;
+    }
+
+    if (PltCreateConditionVariable(&queueHead->cond, &queueHead->mutex) != 0) {
+        PltDeleteMutex(&queueHead->mutex);
+        free(queueHead->slots);
+        queueHead->slots = NULL;
+        return -1;
+    }
+#endif
+
+    queueHead->mask = capacity - 1;
+    queueHead->sizeBound = (uint32_t)sizeBound;
+    queueHead->spinCount = isMultiprocessor() ? RBQ_SPIN_COUNT : 0;
+
+    return 0;
+}
+
+// Destroy the ring blocking queue and return any remaining entries
+PLINKED_BLOCKING_QUEUE_ENTRY RbqDestroyRingBlockingQueue(PRING_BLOCKING_QUEUE queueHead) {
+    PLINKED_BLOCKING_QUEUE_ENTRY head;
+
+    LC_ASSERT(queueHead->shutdown || queueHead->draining || queueHead->lifetimeSize == 0);
+
+    head = RbqFlushQueueItems(queueHead);
+
+#ifndef __linux__
+    PltDeleteConditionVariable(&queueHead->cond);
+    PltDeleteMutex(&queueHead->mutex);
+#endif
+
+    free(queueHead->slots);
+    queueHead->slots = NULL;
+
+    return head;
+}
+
+// Flush the queue
+PLINKED_BLOCKING_QUEUE_ENTRY RbqFlushQueueItems(PRING_BLOCKING_QUEUE queueHead) {
+    PLINKED_BLOCKING_QUEUE_ENTRY head = NULL;
+    PLINKED_BLOCKING_QUEUE_ENTRY tail = NULL;
+    PLINKED_BLOCKING_QUEUE_ENTRY entry;
+
+    if (queueHead->slots == NULL) {
+        return NULL;
+    }
+
+    while ((entry = dequeueEntry(queueHead)) != NULL) {
+        entry->flink = NULL;
+        entry->blink = tail;
+
+        if (tail == NULL) {
+            head = entry;
+        }
+        else {
+            tail->flink = entry;
+        }
+        tail = entry;
+    }
+
+    return head;
+}
+
+void RbqSignalQueueShutdown(PRING_BLOCKING_QUEUE queueHead) {
+    PltAtomicStore32(&queueHead->shutdown, 1);
+    wakeWaiters(queueHead);
+}
+
+void RbqSignalQueueDrain(PRING_BLOCKING_QUEUE queueHead) {
+    PltAtomicStore32(&queueHead->draining, 1);
+    wakeWaiters(queueHead);
+}
+
+void RbqSignalQueueUserWake(PRING_BLOCKING_QUEUE queueHead) {
+    PltAtomicStore32(&queueHead->pendingUserWake, 1);
+    wakeWaiters(queueHead);
+}
+
+int RbqGetItemCount(PRING_BLOCKING_QUEUE queueHead) {
+    return (int)(PltAtomicLoad32(&queueHead->tail) - PltAtomicLoad32(&queueHead->head));
+}
+
+int RbqOfferQueueItem(PRING_BLOCKING_QUEUE queueHead, void* data, PLINKED_BLOCKING_QUEUE_ENTRY entry) {
+    uint32_t tail = queueHead->tail;
+
+    // Initialization may have failed
+    if (queueHead->slots == NULL) {
+        return LBQ_INTERRUPTED;
+    }
+
+    if (PltAtomicLoad32(&queueHead->shutdown) || PltAtomicLoad32(&queueHead->draining)) {
+        return LBQ_INTERRUPTED;
+    }
+
+    if (tail - PltAtomicLoad32(&queueHead->head) >= queueHead->sizeBound) {
+        return LBQ_BOUND_EXCEEDED;
+    }
+
+    entry->flink = NULL;
+    entry->blink = NULL;
+    entry->data = data;
+
+    PltAtomicStorePtr(&queueHead->slots[tail & queueHead->mask], entry);
+    PltAtomicStore32(&queueHead->tail, tail + 1);
+    queueHead->lifetimeSize++;
+
+    // Pairs with the fence in RbqWaitForQueueElement(). Either the waiter
+    // sees our new tail or we see that it's waiting (or both). Clearing the
+    // flag ensures we only make one wake syscall per sleep.
+    PltAtomicFence();
+    if (PltAtomicLoad32(&queueHead->waiting) && PltAtomicCompareExchange32(&queueHead->waiting, 1, 0)) {
+        wakeWaiters(queueHead);
+    }
+
+    return LBQ_SUCCESS;
+}
+
+// This must be synchronized with RbqFlushQueueItems by the caller
+int RbqPeekQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data) {
+    uint32_t head;
+
+    if (PltAtomicLoad32(&queueHead->shutdown)) {
+        return LBQ_INTERRUPTED;
+    }
+
+    head = PltAtomicLoad32(&queueHead->head);
+    if (head == PltAtomicLoad32(&queueHead->tail)) {
+        return PltAtomicLoad32(&queueHead->draining) ? LBQ_INTERRUPTED : LBQ_NO_ELEMENT;
+    }
+
+    *data = ((PLINKED_BLOCKING_QUEUE_ENTRY)PltAtomicLoadPtr(&queueHead->slots[head & queueHead->mask]))->data;
+    return LBQ_SUCCESS;
+}
+
+int RbqPollQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data) {
+    PLINKED_BLOCKING_QUEUE_ENTRY entry;
+
+    if (PltAtomicLoad32(&queueHead->shutdown)) {
+        return LBQ_INTERRUPTED;
+    }
+
+    entry = dequeueEntry(queueHead);
+    if (entry == NULL) {
+        return PltAtomicLoad32(&queueHead->draining) ? LBQ_INTERRUPTED : LBQ_NO_ELEMENT;
+    }
+
+    *data = entry->data;
+    return LBQ_SUCCESS;
+}
+
+// Checks the wake conditions in the same order as LbqWaitForQueueElement().
+// Returns LBQ_NO_ELEMENT if the caller should keep waiting.
+static int tryWaitForQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data) {
+    PLINKED_BLOCKING_QUEUE_ENTRY entry;
+
+    // If we're shutting down, abort immediately, even if there's data available
+    if (PltAtomicLoad32(&queueHead->shutdown)) {
+        return LBQ_INTERRUPTED;
+    }
+
+    // If this is a user requested wake, process it now
+    if (PltAtomicCompareExchange32(&queueHead->pendingUserWake, 1, 0)) {
+        return LBQ_USER_WAKE;
+    }
+
+    entry = dequeueEntry(queueHead);
+    if (entry != NULL) {
+        *data = entry->data;
+        return LBQ_SUCCESS;
+    }
+
+    // If we're draining, only abort if we have no data available
+    if (PltAtomicLoad32(&queueHead->draining)) {
+        return LBQ_INTERRUPTED;
+    }
+
+    return LBQ_NO_ELEMENT;
+}
+
+int RbqWaitForQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data) {
+    int spins = 0;
+    int err;
+
+    for (;;) {
+        // Sample the wake sequence before checking so we can't miss a wakeup
+        uint32_t wakeSequence = PltAtomicLoad32(&queueHead->wakeSequence);
+
+        err = tryWaitForQueueElement(queueHead, data);
+        if (err != LBQ_NO_ELEMENT) {
+            return err;
+        }
+
+        // Spin briefly in case the producer is about to give us something
+        if (spins < queueHead->spinCount) {
+            spins++;
+            PltCpuRelax();
+            continue;
+        }
+
+        PltAtomicStore32(&queueHead->waiting, 1);
+
+        // Pairs with the fence in RbqOfferQueueItem()
+        PltAtomicFence();
+
+        err = tryWaitForQueueElement(queueHead, data);
+        if (err == LBQ_NO_ELEMENT) {
+            waitForWake(queueHead, wakeSequence);
+        }
+
+        PltAtomicStore32(&queueHead->waiting, 0);
+
+        if (err != LBQ_NO_ELEMENT) {
+            return err;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Platform.h"
+#include "PlatformThreads.h"
+#include "LinkedBlockingQueue.h"
+
+// A bounded lock-free alternative to the LBQ for hot producer/consumer pairs.
+// It has the same semantics and return values as the LBQ, with these restrictions:
+// - Only one thread may call RbqOfferQueueItem()
+// - Only one thread may block in RbqWaitForQueueElement() at a time
+// Polling and flushing are safe from any thread, so the producer can still
+// flush the queue on overflow.
+//
+// Entries are returned from RbqFlushQueueItems() and RbqDestroyRingBlockingQueue()
+// as a flink-chained list just like the LBQ equivalents.
+
+// Number of times a waiter checks the queue before sleeping. We don't
+// spin on uniprocessor systems since the producer can't run meanwhile.
+#define RBQ_SPIN_COUNT 64
+
+typedef struct _RING_BLOCKING_QUEUE {
+    PLINKED_BLOCKING_QUEUE_ENTRY* slots;
+    uint32_t mask;
+    uint32_t sizeBound;
+    int spinCount;
+
+    // Written by consumers
+    volatile uint32_t head;
+    char headPadding[64];
+
+    // Written by the producer
+    volatile uint32_t tail;
+    uint32_t lifetimeSize;
+    char tailPadding[64];
+
+    volatile uint32_t shutdown;
+    volatile uint32_t draining;
+    volatile uint32_t pendingUserWake;
+
+    // Bumped for each wakeup of a sleeping waiter
+    volatile uint32_t wakeSequence;
+    volatile uint32_t waiting;
+
+#ifndef __linux__
+    // Used to sleep if we don't have futexes
+    PLT_MUTEX mutex;
+    PLT_COND cond;
+#endif
+} RING_BLOCKING_QUEUE, *PRING_BLOCKING_QUEUE;
+
+int RbqInitializeRingBlockingQueue(PRING_BLOCKING_QUEUE queueHead, int sizeBound);
+int RbqOfferQueueItem(PRING_BLOCKING_QUEUE queueHead, void* data, PLINKED_BLOCKING_QUEUE_ENTRY entry);
+int RbqWaitForQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data);
+int RbqPollQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data);
+int RbqPeekQueueElement(PRING_BLOCKING_QUEUE queueHead, void** data);
+PLINKED_BLOCKING_QUEUE_ENTRY RbqDestroyRingBlockingQueue(PRING_BLOCKING_QUEUE queueHead);
+PLINKED_BLOCKING_QUEUE_ENTRY RbqFlushQueueItems(PRING_BLOCKING_QUEUE queueHead);
+void RbqSignalQueueShutdown(PRING_BLOCKING_QUEUE queueHead);
+void RbqSignalQueueDrain(PRING_BLOCKING_QUEUE queueHead);
+void RbqSignalQueueUserWake(PRING_BLOCKING_QUEUE queueHead);
+int RbqGetItemCount(PRING_BLOCKING_QUEUE queueHead);
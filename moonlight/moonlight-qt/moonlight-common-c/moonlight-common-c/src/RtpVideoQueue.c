@@ -18,6 +18,7 @@
 
 void RtpvInitializeQueue(PRTP_VIDEO_QUEUE queue) {
     reed_solomon_init();
+    Limelog("Using %s Reed-Solomon kernels\n", reed_solomon_kernel_name());
     memset(queue, 0, sizeof(*queue));
 
     queue->currentFrameNumber = 1;
@@ -28,16 +29,67 @@ static void purgeListEntries(PRTPV_QUEUE_LIST list) {
     while (list->head != NULL) {
         PRTPV_QUEUE_ENTRY entry = list->head;
         list->head = entry->next;
-        free(entry->packet);
+        freeVideoPacketBuffer(entry->packet);
     }
 
     list->tail = NULL;
     list->count = 0;
 }
 
+static void releaseReedSolomon(PRTP_VIDEO_QUEUE queue, reed_solomon* rs) {
+    queue->fecMatrixCacheHits += rs->decode_cache_hits;
+    queue->fecMatrixCacheMisses += rs->decode_cache_misses;
+    reed_solomon_release(rs);
+}
+
 void RtpvCleanupQueue(PRTP_VIDEO_QUEUE queue) {
     purgeListEntries(&queue->pendingFecBlockList);
     purgeListEntries(&queue->completedFecBlockList);
+
+    for (int i = 0; i < RTPV_RS_CACHE_SIZE; i++) {
+        if (queue->rsCache[i] != NULL) {
+            releaseReedSolomon(queue, queue->rsCache[i]);
+            queue->rsCache[i] = NULL;
+        }
+    }
+
+    if (queue->fecMatrixCacheHits + queue->fecMatrixCacheMisses != 0) {
+        Limelog("FEC decode matrix cache: %u hits, %u misses\n",
+                queue->fecMatrixCacheHits, queue->fecMatrixCacheMisses);
+    }
+}
+
+// Returns a decoder for the given shard configuration, reusing a previous one
+// if possible. The returned decoder remains owned by the queue.
+static reed_solomon* getReedSolomon(PRTP_VIDEO_QUEUE queue, int dataShards, int parityShards) {
+    reed_solomon* rs;
+    int i;
+
+    for (i = 0; i < RTPV_RS_CACHE_SIZE - 1; i++) {
+        rs = queue->rsCache[i];
+        if (rs == NULL || (rs->data_shards == dataShards && rs->parity_shards == parityShards)) {
+            break;
+        }
+    }
+
+    rs = queue->rsCache[i];
+    if (rs == NULL || rs->data_shards != dataShards || rs->parity_shards != parityShards) {
+        reed_solomon* newRs = reed_solomon_new(dataShards, parityShards);
+        if (newRs == NULL) {
+            return NULL;
+        }
+
+        // Evict the least recently used decoder if we're full
+        if (rs != NULL) {
+            releaseReedSolomon(queue, rs);
+        }
+        rs = newRs;
+    }
+
+    // Move it to the front
+    memmove(&queue->rsCache[1], &queue->rsCache[0], i * sizeof(queue->rsCache[0]));
+    queue->rsCache[0] = rs;
+    return rs;
 }
 
 static void insertEntryIntoList(PRTPV_QUEUE_LIST list, PRTPV_QUEUE_ENTRY entry) {
@@ -161,7 +213,7 @@ static bool queuePacket(PRTP_VIDEO_QUEUE queue, PRTPV_QUEUE_ENTRY newEntry, PRTP
     Limelog("FEC recovery returned corrupt packet %d" \
             " (frame %d)", rtpPacket->sequenceNumber, \
             queue->currentFrameNumber);               \
-    free(packets[i]);                                 \
+    freeVideoPacketBuffer(packets[i]);                \
     continue
 
 // Returns 0 if the frame is completely constructed
@@ -240,7 +292,7 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
         goto cleanup;
     }
     
-    rs = reed_solomon_new(queue->bufferDataPackets, queue->bufferParityPackets);
+    rs = getReedSolomon(queue, queue->bufferDataPackets, queue->bufferParityPackets);
     
     // This could happen in an OOM condition, but it could also mean the FEC data
     // that we fed to reed_solomon_new() is bogus, so we'll assert to get a better look.
@@ -253,7 +305,6 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
     memset(marks, 1, sizeof(char) * (totalPackets));
     
     int receiveSize = StreamConfig.packetSize + MAX_RTP_HEADER_SIZE;
-    int packetBufferSize = receiveSize + sizeof(RTPV_QUEUE_ENTRY);
 
 #ifdef FEC_VALIDATION_MODE
     // Choose a packet to drop
@@ -291,7 +342,7 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
     unsigned int i;
     for (i = 0; i < totalPackets; i++) {
         if (marks[i]) {
-            packets[i] = malloc(packetBufferSize);
+            packets[i] = allocateVideoPacketBuffer();
             if (packets[i] == NULL) {
                 ret = -4;
                 goto cleanup_packets;
@@ -382,7 +433,7 @@ cleanup_packets:
 
                     // This drop was fake, so we don't want to actually submit it to the depacketizer.
                     // It will get confused because it's already seen this packet before.
-                    free(packets[i]);
+                    freeVideoPacketBuffer(packets[i]);
                     continue;
                 }
 #endif
@@ -413,14 +464,12 @@ cleanup_packets:
                 LC_ASSERT(isBefore16(rtpPacket->sequenceNumber, queue->bufferFirstParitySequenceNumber));
                 queuePacket(queue, queueEntry, rtpPacket, StreamConfig.packetSize + dataOffset, false, true);
             } else if (packets[i] != NULL) {
-                free(packets[i]);
+                freeVideoPacketBuffer(packets[i]);
             }
         }
     }
 
 cleanup:
-    reed_solomon_release(rs);
-
     if (packets != NULL)
         free(packets);
 
@@ -432,6 +481,7 @@ cleanup:
 
 static void stageCompleteFecBlock(PRTP_VIDEO_QUEUE queue) {
     unsigned int nextSeqNum = queue->bufferLowestSequenceNumber;
+    uint64_t fecCompleteTimeUs = PltGetMicroseconds();
 
     while (queue->pendingFecBlockList.count > 0) {
         PRTPV_QUEUE_ENTRY entry = queue->pendingFecBlockList.head;
@@ -453,7 +503,7 @@ static void stageCompleteFecBlock(PRTP_VIDEO_QUEUE queue) {
                 removeEntryFromList(&queue->pendingFecBlockList, parityEntry);
 
                 // Free the entry and packet
-                free(parityEntry->packet);
+                freeVideoPacketBuffer(parityEntry->packet);
 
                 continue;
             }
@@ -468,6 +518,8 @@ static void stageCompleteFecBlock(PRTP_VIDEO_QUEUE queue) {
                 // since it properly handles out of order packets.
                 LC_ASSERT(queue->bufferFirstRecvTimeMs != 0);
                 entry->receiveTimeMs = queue->bufferFirstRecvTimeMs;
+                entry->receiveTimeUs = queue->bufferFirstRecvTimeUs;
+                entry->fecCompleteTimeUs = fecCompleteTimeUs;
 
                 // Move this packet to the completed FEC block list
                 insertEntryIntoList(&queue->completedFecBlockList, entry);
@@ -643,6 +695,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
         connectionSawFrame(queue->currentFrameNumber);
         
         queue->bufferFirstRecvTimeMs = PltGetMillis();
+        queue->bufferFirstRecvTimeUs = PltGetMicroseconds();
         queue->bufferLowestSequenceNumber = U16(packet->sequenceNumber - fecIndex);
         queue->nextContiguousSequenceNumber = queue->bufferLowestSequenceNumber;
         queue->receivedDataPackets = 0;
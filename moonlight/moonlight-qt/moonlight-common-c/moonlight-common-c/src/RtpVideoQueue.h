@@ -1,12 +1,19 @@
 #pragma once
 
 #include "Video.h"
+#include "rs.h"
+
+// Number of Reed-Solomon decoders (one per shard configuration) kept alive
+// so their cached decode matrices can be reused across FEC blocks
+#define RTPV_RS_CACHE_SIZE 4
 
 typedef struct _RTPV_QUEUE_ENTRY {
     struct _RTPV_QUEUE_ENTRY* next;
     struct _RTPV_QUEUE_ENTRY* prev;
     PRTP_PACKET packet;
     uint64_t receiveTimeMs;
+    uint64_t receiveTimeUs;
+    uint64_t fecCompleteTimeUs;
     uint32_t presentationTimeMs;
     int length;
     bool isParity;
@@ -23,6 +30,7 @@ typedef struct _RTP_VIDEO_QUEUE {
     RTPV_QUEUE_LIST completedFecBlockList;
 
     uint64_t bufferFirstRecvTimeMs;
+    uint64_t bufferFirstRecvTimeUs;
     uint32_t bufferLowestSequenceNumber;
     uint32_t bufferHighestSequenceNumber;
     uint32_t bufferFirstParitySequenceNumber;
@@ -44,6 +52,11 @@ typedef struct _RTP_VIDEO_QUEUE {
 
     uint32_t lastOosFramePresentationTimestamp;
     bool receivedOosData;
+
+    // Most recently used first
+    reed_solomon* rsCache[RTPV_RS_CACHE_SIZE];
+    uint32_t fecMatrixCacheHits;
+    uint32_t fecMatrixCacheMisses;
 } RTP_VIDEO_QUEUE, *PRTP_VIDEO_QUEUE;
 
 #define RTPF_RET_QUEUED    0
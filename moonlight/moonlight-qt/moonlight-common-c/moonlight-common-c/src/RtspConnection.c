@@ -1,10 +1,31 @@
 #include "Limelight-internal.h"
 #include "Rtsp.h"
 
+#include <ctype.h>
+
 #define RTSP_CONNECT_TIMEOUT_SEC 10
 #define RTSP_RECEIVE_TIMEOUT_SEC 15
+
+// Hosts that don't support pipelining may never answer a pipelined batch,
+// so we wait less for the first response before falling back to serial requests.
+#define RTSP_PIPELINE_FIRST_RESPONSE_TIMEOUT_MS 3000
 #define RTSP_RETRY_DELAY_MS 500
 
+// The most requests that are sent together without depending on each other's responses
+#define RTSP_MAX_BATCH_SIZE 3
+
+typedef struct _RTSP_TRANSACTION {
+    // Used in log messages (e.g. "SETUP streamid=audio")
+    char* description;
+    int sequenceNumber;
+    bool expectingPayload;
+    bool completed;
+    RTSP_MESSAGE request;
+    RTSP_MESSAGE response;
+} RTSP_TRANSACTION, *PRTSP_TRANSACTION;
+
+typedef bool (*RtspRequestInitializer)(PRTSP_MESSAGE request, char* target);
+
 static int currentSeqNumber;
 static char rtspTargetUrl[256];
 static char* sessionIdString;
@@ -13,6 +34,9 @@ static int rtspClientVersion;
 static char urlAddr[URLSAFESTRING_LEN];
 static bool useEnet;
 static char* controlStreamId;
+static bool pipelineRequests;
+static RTSP_TRANSACTION batch[RTSP_MAX_BATCH_SIZE];
+static int batchSize;
 
 static SOCKET sock = INVALID_SOCKET;
 static ENetHost* client;
@@ -208,21 +232,9 @@ Exit:
     return ret;
 }
 
-// Send RTSP message and get response over TCP
-static bool transactRtspMessageTcp(PRTSP_MESSAGE request, PRTSP_MESSAGE response, int* error) {
-    SOCK_RET err;
-    bool ret;
-    int offset;
-    char* serializedMessage = NULL;
-    int messageLen;
-    char* responseBuffer;
-    int responseBufferSize;
-    int connectRetries;
-
-    *error = -1;
-    ret = false;
-    responseBuffer = NULL;
-    connectRetries = 0;
+// Connect the RTSP socket over TCP
+static bool connectRtspSocket(int* error) {
+    int connectRetries = 0;
 
     // Retry up to 10 seconds if we receive ECONNREFUSED errors from the host PC.
     // This can happen with GFE 3.22 when initially launching a session because it
@@ -246,7 +258,25 @@ static bool transactRtspMessageTcp(PRTSP_MESSAGE request, PRTSP_MESSAGE response
             break;
         }
     } while (connectRetries++ < (RTSP_CONNECT_TIMEOUT_SEC * 1000) / RTSP_RETRY_DELAY_MS && !ConnectionInterrupted);
-    if (sock == INVALID_SOCKET) {
+
+    return sock != INVALID_SOCKET;
+}
+
+// Send RTSP message and get response over TCP
+static bool transactRtspMessageTcp(PRTSP_MESSAGE request, PRTSP_MESSAGE response, int* error) {
+    SOCK_RET err;
+    bool ret;
+    int offset;
+    char* serializedMessage = NULL;
+    int messageLen;
+    char* responseBuffer;
+    int responseBufferSize;
+
+    *error = -1;
+    ret = false;
+    responseBuffer = NULL;
+
+    if (!connectRtspSocket(error)) {
         return ret;
     }
 
@@ -348,148 +378,394 @@ static bool transactRtspMessage(PRTSP_MESSAGE request, PRTSP_MESSAGE response, b
     }
 }
 
-// Send RTSP OPTIONS request
-static bool requestOptions(PRTSP_MESSAGE response, int* error) {
-    RTSP_MESSAGE request;
-    bool ret;
+// Find the value of a header in a raw RTSP message. Header names are case-insensitive.
+static char* findRtspHeaderValue(char* message, char* headersEnd, const char* name) {
+    size_t nameLength = strlen(name);
+    char* line = strstr(message, "\r\n");
 
-    *error = -1;
+    while (line != NULL && line < headersEnd) {
+        size_t i;
+
+        line += 2;
+        for (i = 0; i < nameLength; i++) {
+            if (tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) {
+                break;
+            }
+        }
+
+        if (i == nameLength && line[nameLength] == ':') {
+            return &line[nameLength + 1];
+        }
 
-    ret = initializeRtspRequest(&request, "OPTIONS", rtspTargetUrl);
-    if (ret) {
-        ret = transactRtspMessage(&request, response, false, error);
-        freeMessage(&request);
+        line = strstr(line, "\r\n");
     }
 
-    return ret;
+    return NULL;
 }
 
-// Send RTSP DESCRIBE request
-static bool requestDescribe(PRTSP_MESSAGE response, int* error) {
-    RTSP_MESSAGE request;
-    bool ret;
+// Get the length of the first complete RTSP response in a null-terminated buffer.
+// Returns 0 if more data is needed or -1 if the response is malformed.
+static int getRtspResponseLength(char* buffer, int length, bool connectionClosed) {
+    char* headersEnd;
+    char* contentLengthStr;
+    long contentLength;
+    int headersLength;
+
+    headersEnd = strstr(buffer, "\r\n\r\n");
+    if (headersEnd == NULL) {
+        return 0;
+    }
+    headersLength = (int)(headersEnd - buffer) + 4;
+
+    contentLengthStr = findRtspHeaderValue(buffer, headersEnd, "Content-Length");
+    if (contentLengthStr == NULL) {
+        // Hosts that close the connection after each response may not send a
+        // Content-Length, so the payload runs until the end of the connection.
+        // Otherwise, a response without one has no payload.
+        return connectionClosed ? length : headersLength;
+    }
 
-    *error = -1;
+    contentLength = strtol(contentLengthStr, NULL, 10);
+    if (contentLength < 0 || contentLength > INT32_MAX - headersLength) {
+        Limelog("RTSP response has invalid Content-Length\n");
+        return -1;
+    }
 
-    ret = initializeRtspRequest(&request, "DESCRIBE", rtspTargetUrl);
-    if (ret) {
-        if (addOption(&request, "Accept",
-            "application/sdp") &&
-            addOption(&request, "If-Modified-Since",
-                "Thu, 01 Jan 1970 00:00:00 GMT")) {
-            ret = transactRtspMessage(&request, response, true, error);
-        }
-        else {
-            ret = false;
+    return (headersLength + contentLength <= length) ? headersLength + (int)contentLength : 0;
+}
+
+// Parse a pipelined response and match it to its request in the batch by CSeq
+static bool completePipelinedTransaction(char* buffer, int length) {
+    RTSP_MESSAGE response;
+    int i;
+
+    if (parseRtspMessage(&response, buffer, length) != RTSP_ERROR_SUCCESS) {
+        Limelog("Failed to parse RTSP response\n");
+        return false;
+    }
+
+    for (i = 0; i < batchSize; i++) {
+        if (!batch[i].completed && batch[i].sequenceNumber == response.sequenceNumber) {
+            batch[i].response = response;
+            batch[i].completed = true;
+            return true;
         }
-        freeMessage(&request);
     }
 
-    return ret;
+    Limelog("RTSP response has unexpected CSeq: %d\n", response.sequenceNumber);
+    freeMessage(&response);
+    return false;
 }
 
-// Send RTSP SETUP request
-static bool setupStream(PRTSP_MESSAGE response, char* target, int* error) {
-    RTSP_MESSAGE request;
-    bool ret;
-    char* transportValue;
+// Send all requests in the batch back to back on one TCP connection and match the
+// responses to them by CSeq. Returns the number of requests that were answered before
+// the host closed the connection, or -1 if we couldn't connect. Hosts that only handle
+// one request per connection will answer the first request and close the connection,
+// so the caller must send any unanswered requests again on their own.
+static int transactRtspBatchPipelinedTcp(int* error) {
+    SOCK_RET err;
+    char* serializedBatch;
+    int batchLength;
+    char* responseBuffer;
+    int responseBufferSize;
+    int offset;
+    int completed;
+    bool connectionClosed;
+    int i;
 
     *error = -1;
+    serializedBatch = NULL;
+    responseBuffer = NULL;
+    completed = 0;
+
+    if (!connectRtspSocket(error)) {
+        return -1;
+    }
+
+    // Serialize the whole batch so it can be sent in one go
+    batchLength = 0;
+    for (i = 0; i < batchSize; i++) {
+        char* serializedMessage;
+        int messageLen;
+
+        serializedMessage = serializeRtspMessage(&batch[i].request, &messageLen);
+        if (serializedMessage == NULL) {
+            goto Exit;
+        }
+
+        serializedBatch = extendBuffer(serializedBatch, batchLength + messageLen);
+        if (serializedBatch == NULL) {
+            free(serializedMessage);
+            goto Exit;
+        }
+
+        memcpy(&serializedBatch[batchLength], serializedMessage, messageLen);
+        batchLength += messageLen;
+        free(serializedMessage);
+    }
+
+    // enableNoDelay() must have been called for sendMtuSafe() to work.
+    enableNoDelay(sock);
+    err = sendMtuSafe(sock, serializedBatch, batchLength);
+    if (err == SOCKET_ERROR) {
+        *error = LastSocketError();
+        Limelog("Failed to send pipelined RTSP messages: %d\n", *error);
+        goto Exit;
+    }
 
-    ret = initializeRtspRequest(&request, "SETUP", target);
-    if (ret) {
-        if (hasSessionId) {
-            if (!addOption(&request, "Session", sessionIdString)) {
-                ret = false;
-                goto FreeMessage;
+    // Read responses until all requests are answered or the server closes the connection
+    offset = 0;
+    responseBufferSize = 0;
+    connectionClosed = false;
+    while (completed < batchSize && !connectionClosed) {
+        struct pollfd pfd;
+        int responseLength;
+        bool firstResponse = completed == 0 && offset == 0;
+
+        // Leave room for the null terminator
+        if (offset + 1 >= responseBufferSize) {
+            responseBufferSize = offset + 16384;
+            responseBuffer = extendBuffer(responseBuffer, responseBufferSize);
+            if (responseBuffer == NULL) {
+                Limelog("Failed to allocate RTSP response buffer\n");
+                goto Exit;
             }
         }
 
-        if (AppVersionQuad[0] >= 6) {
-            // It looks like GFE doesn't care what we say our port is but
-            // we need to give it some port to successfully complete the
-            // handshake process.
-            transportValue = "unicast;X-GS-ClientPort=50000-50001";
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        err = pollSockets(&pfd, 1, firstResponse ? RTSP_PIPELINE_FIRST_RESPONSE_TIMEOUT_MS : RTSP_RECEIVE_TIMEOUT_SEC * 1000);
+        if (err == 0) {
+            // If nothing was answered, the caller sends the requests again one at a time
+            *error = ETIMEDOUT;
+            Limelog("Pipelined RTSP request timed out%s\n", firstResponse ? " waiting for the first response" : "");
+            goto Exit;
         }
-        else {
-            transportValue = " ";
+        else if (err < 0) {
+            *error = LastSocketError();
+            Limelog("Failed to wait for pipelined RTSP response: %d\n", *error);
+            goto Exit;
         }
-        
-        if (addOption(&request, "Transport", transportValue) &&
-            addOption(&request, "If-Modified-Since",
-                "Thu, 01 Jan 1970 00:00:00 GMT")) {
-            ret = transactRtspMessage(&request, response, false, error);
+
+        err = recv(sock, &responseBuffer[offset], responseBufferSize - offset - 1, 0);
+        if (err < 0) {
+            *error = LastSocketError();
+            Limelog("Failed to read pipelined RTSP response: %d\n", *error);
+            goto Exit;
+        }
+        else if (err == 0) {
+            connectionClosed = true;
         }
         else {
-            ret = false;
+            offset += err;
         }
+        responseBuffer[offset] = 0;
 
-    FreeMessage:
-        freeMessage(&request);
+        // Consume every complete response we have so far
+        while (completed < batchSize &&
+               (responseLength = getRtspResponseLength(responseBuffer, offset, connectionClosed)) != 0) {
+            if (responseLength < 0 || !completePipelinedTransaction(responseBuffer, responseLength)) {
+                goto Exit;
+            }
+
+            completed++;
+            offset -= responseLength;
+            memmove(responseBuffer, &responseBuffer[responseLength], offset);
+            responseBuffer[offset] = 0;
+        }
     }
 
-    return ret;
+Exit:
+    if (serializedBatch != NULL) {
+        free(serializedBatch);
+    }
+
+    if (responseBuffer != NULL) {
+        free(responseBuffer);
+    }
+
+    closeSocket(sock);
+    sock = INVALID_SOCKET;
+    return completed;
 }
 
-// Send RTSP PLAY request
-static bool playStream(PRTSP_MESSAGE response, char* target, int* error) {
-    RTSP_MESSAGE request;
-    bool ret;
+// Build an RTSP request and add it to the current batch
+static bool addRtspRequest(char* description, RtspRequestInitializer initializeRequest, char* target, bool expectingPayload) {
+    PRTSP_TRANSACTION transaction;
 
-    *error = -1;
+    LC_ASSERT(batchSize < RTSP_MAX_BATCH_SIZE);
+    transaction = &batch[batchSize];
 
-    ret = initializeRtspRequest(&request, "PLAY", target);
-    if (ret != 0) {
-        if (addOption(&request, "Session", sessionIdString)) {
-            ret = transactRtspMessage(&request, response, false, error);
-        }
-        else {
-            ret = false;
+    memset(transaction, 0, sizeof(*transaction));
+    transaction->description = description;
+    transaction->expectingPayload = expectingPayload;
+    transaction->sequenceNumber = currentSeqNumber;
+    if (!initializeRequest(&transaction->request, target)) {
+        Limelog("Failed to create RTSP %s request\n", description);
+        return false;
+    }
+
+    batchSize++;
+    return true;
+}
+
+// Free the requests and responses in the current batch
+static void freeRtspBatch(void) {
+    int i;
+
+    for (i = 0; i < batchSize; i++) {
+        freeMessage(&batch[i].request);
+        if (batch[i].completed) {
+            freeMessage(&batch[i].response);
         }
-        freeMessage(&request);
     }
 
-    return ret;
+    batchSize = 0;
 }
 
-// Send RTSP ANNOUNCE message
-static bool sendVideoAnnounce(PRTSP_MESSAGE response, int* error) {
-    RTSP_MESSAGE request;
-    bool ret;
-    int payloadLength;
-    char payloadLengthStr[16];
+// Send the requests in the current batch and wait for all of their responses.
+// Returns 0 if every request succeeded or the error to fail the handshake with.
+static int transactRtspBatch(void) {
+    int error = -1;
+    int i;
 
-    *error = -1;
+    if (pipelineRequests && batchSize > 1) {
+        int completed = transactRtspBatchPipelinedTcp(&error);
+        if (completed < 0) {
+            Limelog("RTSP %s request failed: %d\n", batch[0].description, error);
+            return error;
+        }
+        else if (completed < batchSize) {
+            // Don't try again for the rest of the handshake
+            Limelog("RTSP: Host answered %d of %d pipelined requests. Falling back to serial requests.\n",
+                    completed, batchSize);
+            pipelineRequests = false;
+        }
+    }
 
-    ret = initializeRtspRequest(&request, "ANNOUNCE",
-                                APP_VERSION_AT_LEAST(7, 1, 431) ? controlStreamId : "streamid=video");
-    if (ret) {
-        ret = false;
+    // Send any requests that weren't answered above, stopping at the first failure
+    for (i = 0; i < batchSize; i++) {
+        if (!batch[i].completed) {
+            if (!transactRtspMessage(&batch[i].request, &batch[i].response, batch[i].expectingPayload, &error)) {
+                Limelog("RTSP %s request failed: %d\n", batch[i].description, error);
+                return error;
+            }
 
-        if (!addOption(&request, "Session", sessionIdString) ||
-            !addOption(&request, "Content-type", "application/sdp")) {
-            goto FreeMessage;
+            batch[i].completed = true;
         }
 
-        request.payload = getSdpPayloadForStreamConfig(rtspClientVersion, &payloadLength);
-        if (request.payload == NULL) {
-            goto FreeMessage;
+        if (batch[i].response.message.response.statusCode != 200) {
+            Limelog("RTSP %s request failed: %d\n",
+                    batch[i].description, batch[i].response.message.response.statusCode);
+            return batch[i].response.message.response.statusCode;
         }
-        request.flags |= FLAG_ALLOCATED_PAYLOAD;
-        request.payloadLength = payloadLength;
+    }
 
-        sprintf(payloadLengthStr, "%d", payloadLength);
-        if (!addOption(&request, "Content-length", payloadLengthStr)) {
+    return 0;
+}
+
+// Create RTSP OPTIONS request
+static bool initializeOptionsRequest(PRTSP_MESSAGE request, char* target) {
+    return initializeRtspRequest(request, "OPTIONS", target);
+}
+
+// Create RTSP DESCRIBE request
+static bool initializeDescribeRequest(PRTSP_MESSAGE request, char* target) {
+    if (!initializeRtspRequest(request, "DESCRIBE", target)) {
+        return false;
+    }
+
+    if (!addOption(request, "Accept",
+            "application/sdp") ||
+        !addOption(request, "If-Modified-Since",
+            "Thu, 01 Jan 1970 00:00:00 GMT")) {
+        freeMessage(request);
+        return false;
+    }
+
+    return true;
+}
+
+// Create RTSP SETUP request
+static bool initializeSetupRequest(PRTSP_MESSAGE request, char* target) {
+    char* transportValue;
+
+    if (!initializeRtspRequest(request, "SETUP", target)) {
+        return false;
+    }
+
+    if (hasSessionId) {
+        if (!addOption(request, "Session", sessionIdString)) {
             goto FreeMessage;
         }
+    }
 
-        ret = transactRtspMessage(&request, response, false, error);
+    if (AppVersionQuad[0] >= 6) {
+        // It looks like GFE doesn't care what we say our port is but
+        // we need to give it some port to successfully complete the
+        // handshake process.
+        transportValue = "unicast;X-GS-ClientPort=50000-50001";
+    }
+    else {
+        transportValue = " ";
+    }
 
-    FreeMessage:
-        freeMessage(&request);
+    if (addOption(request, "Transport", transportValue) &&
+        addOption(request, "If-Modified-Since",
+            "Thu, 01 Jan 1970 00:00:00 GMT")) {
+        return true;
     }
 
-    return ret;
+FreeMessage:
+    freeMessage(request);
+    return false;
+}
+
+// Create RTSP PLAY request
+static bool initializePlayRequest(PRTSP_MESSAGE request, char* target) {
+    if (!initializeRtspRequest(request, "PLAY", target)) {
+        return false;
+    }
+
+    if (!addOption(request, "Session", sessionIdString)) {
+        freeMessage(request);
+        return false;
+    }
+
+    return true;
+}
+
+// Create RTSP ANNOUNCE request
+static bool initializeAnnounceRequest(PRTSP_MESSAGE request, char* target) {
+    int payloadLength;
+    char payloadLengthStr[16];
+
+    if (!initializeRtspRequest(request, "ANNOUNCE", target)) {
+        return false;
+    }
+
+    if (!addOption(request, "Session", sessionIdString) ||
+        !addOption(request, "Content-type", "application/sdp")) {
+        goto FreeMessage;
+    }
+
+    request->payload = getSdpPayloadForStreamConfig(rtspClientVersion, &payloadLength);
+    if (request->payload == NULL) {
+        goto FreeMessage;
+    }
+    request->flags |= FLAG_ALLOCATED_PAYLOAD;
+    request->payloadLength = payloadLength;
+
+    sprintf(payloadLengthStr, "%d", payloadLength);
+    if (!addOption(request, "Content-length", payloadLengthStr)) {
+        goto FreeMessage;
+    }
+
+    return true;
+
+FreeMessage:
+    freeMessage(request);
+    return false;
 }
 
 static int parseOpusConfigFromParamString(char* paramStr, int channelCount, POPUS_MULTISTREAM_CONFIGURATION opusConfig) {
@@ -717,7 +993,11 @@ int performRtspHandshake(PSERVER_INFORMATION serverInfo) {
     useEnet = (AppVersionQuad[0] >= 5) && (AppVersionQuad[0] <= 7) && (AppVersionQuad[2] < 404);
     currentSeqNumber = 1;
     hasSessionId = false;
+    batchSize = 0;
     controlStreamId = APP_VERSION_AT_LEAST(7, 1, 431) ? "streamid=control/13/0" : "streamid=control/1/0";
+
+    // Hosts old enough to use ENet for RTSP only ever get one request at a time
+    pipelineRequests = StreamConfig.pipelineRtspHandshake && !useEnet && AppVersionQuad[0] >= 7;
     AudioEncryptionEnabled = false;
 
     // HACK: In order to get GFE to respect our request for a lower audio bitrate, we must
@@ -809,50 +1089,37 @@ int performRtspHandshake(PSERVER_INFORMATION serverInfo) {
         enet_host_flush(client);
     }
 
-    {
-        RTSP_MESSAGE response;
-        int error = -1;
-
-        if (!requestOptions(&response, &error)) {
-            Limelog("RTSP OPTIONS request failed: %d\n", error);
-            ret = error;
-            goto Exit;
-        }
-
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP OPTIONS request failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
-            goto Exit;
-        }
+    // OPTIONS, DESCRIBE, and the first SETUP don't depend on each other's responses.
+    // The first SETUP gives us the session ID that the rest of the requests need.
+    if (!addRtspRequest("OPTIONS", initializeOptionsRequest, rtspTargetUrl, false) ||
+        !addRtspRequest("DESCRIBE", initializeDescribeRequest, rtspTargetUrl, true) ||
+        !addRtspRequest("SETUP streamid=audio", initializeSetupRequest,
+                        AppVersionQuad[0] >= 5 ? "streamid=audio/0/0" : "streamid=audio", false)) {
+        ret = -1;
+        goto Exit;
+    }
 
-        freeMessage(&response);
+    ret = transactRtspBatch();
+    if (ret != 0) {
+        goto Exit;
     }
 
     {
-        RTSP_MESSAGE response;
-        int error = -1;
+        PRTSP_MESSAGE response = &batch[1].response;
 
-        if (!requestDescribe(&response, &error)) {
-            Limelog("RTSP DESCRIBE request failed: %d\n", error);
-            ret = error;
+        if (response->payload == NULL) {
+            Limelog("RTSP DESCRIBE response is missing payload\n");
+            ret = -1;
             goto Exit;
         }
 
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP DESCRIBE request failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
-            goto Exit;
-        }
-        
         // The RTSP DESCRIBE reply will contain a collection of SDP media attributes that
         // describe the various supported video stream formats and include the SPS, PPS,
         // and VPS (if applicable). We will use this information to determine whether the
         // server can support HEVC. For some reason, they still set the MIME type of the HEVC
         // format to H264, so we can't just look for the HEVC MIME type. What we'll do instead is
         // look for the base 64 encoded VPS NALU prefix that is unique to the HEVC bitstream.
-        if (StreamConfig.supportsHevc && strstr(response.payload, "sprop-parameter-sets=AAAAAU")) {
+        if (StreamConfig.supportsHevc && strstr(response->payload, "sprop-parameter-sets=AAAAAU")) {
             if (StreamConfig.enableHdr) {
                 NegotiatedVideoFormat = VIDEO_FORMAT_H265_MAIN10;
             }
@@ -876,43 +1143,25 @@ int performRtspHandshake(PSERVER_INFORMATION serverInfo) {
         }
 
         // Look for the SDP attribute that indicates we're dealing with a server that supports RFI
-        ReferenceFrameInvalidationSupported = strstr(response.payload, "x-nv-video[0].refPicInvalidation") != NULL;
+        ReferenceFrameInvalidationSupported = strstr(response->payload, "x-nv-video[0].refPicInvalidation") != NULL;
         if (!ReferenceFrameInvalidationSupported) {
             Limelog("Reference frame invalidation is not supported by this host\n");
         }
 
         // Parse the Opus surround parameters out of the RTSP DESCRIBE response.
-        ret = parseOpusConfigurations(&response);
+        ret = parseOpusConfigurations(response);
         if (ret != 0) {
             goto Exit;
         }
-
-        freeMessage(&response);
     }
 
     {
-        RTSP_MESSAGE response;
+        PRTSP_MESSAGE response = &batch[2].response;
         char* sessionId;
-        int error = -1;
-
-        if (!setupStream(&response,
-                         AppVersionQuad[0] >= 5 ? "streamid=audio/0/0" : "streamid=audio",
-                         &error)) {
-            Limelog("RTSP SETUP streamid=audio request failed: %d\n", error);
-            ret = error;
-            goto Exit;
-        }
-
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP SETUP streamid=audio request failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
-            goto Exit;
-        }
 
         // Parse the audio port out of the RTSP SETUP response
         LC_ASSERT(AudioPortNumber == 0);
-        if (!parseServerPortFromTransport(&response, &AudioPortNumber)) {
+        if (!parseServerPortFromTransport(response, &AudioPortNumber)) {
             // Use the well known port if parsing fails
             AudioPortNumber = 48000;
 
@@ -927,7 +1176,7 @@ int performRtspHandshake(PSERVER_INFORMATION serverInfo) {
         // which is not the case for the video stream.
         notifyAudioPortNegotiationComplete();
 
-        sessionId = getOptionContent(response.options, "Session");
+        sessionId = getOptionContent(response->options, "Session");
 
         if (sessionId == NULL) {
             Limelog("RTSP SETUP streamid=audio is missing session attribute\n");
@@ -948,66 +1197,40 @@ int performRtspHandshake(PSERVER_INFORMATION serverInfo) {
         }
 
         hasSessionId = true;
-
-        freeMessage(&response);
     }
 
-    {
-        RTSP_MESSAGE response;
-        int error = -1;
-
-        if (!setupStream(&response,
-                         AppVersionQuad[0] >= 5 ? "streamid=video/0/0" : "streamid=video",
-                         &error)) {
-            Limelog("RTSP SETUP streamid=video request failed: %d\n", error);
-            ret = error;
-            goto Exit;
-        }
+    freeRtspBatch();
 
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP SETUP streamid=video request failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
-            goto Exit;
-        }
+    // The remaining SETUPs only need the session ID
+    if (!addRtspRequest("SETUP streamid=video", initializeSetupRequest,
+                        AppVersionQuad[0] >= 5 ? "streamid=video/0/0" : "streamid=video", false) ||
+        (AppVersionQuad[0] >= 5 &&
+         !addRtspRequest("SETUP streamid=control", initializeSetupRequest, controlStreamId, false))) {
+        ret = -1;
+        goto Exit;
+    }
 
-        // Parse the video port out of the RTSP SETUP response
-        LC_ASSERT(VideoPortNumber == 0);
-        if (!parseServerPortFromTransport(&response, &VideoPortNumber)) {
-            // Use the well known port if parsing fails
-            VideoPortNumber = 47998;
+    ret = transactRtspBatch();
+    if (ret != 0) {
+        goto Exit;
+    }
 
-            Limelog("Video port: %u (RTSP parsing failed)\n", VideoPortNumber);
-        }
-        else {
-            Limelog("Video port: %u\n", VideoPortNumber);
-        }
+    // Parse the video port out of the RTSP SETUP response
+    LC_ASSERT(VideoPortNumber == 0);
+    if (!parseServerPortFromTransport(&batch[0].response, &VideoPortNumber)) {
+        // Use the well known port if parsing fails
+        VideoPortNumber = 47998;
 
-        freeMessage(&response);
+        Limelog("Video port: %u (RTSP parsing failed)\n", VideoPortNumber);
+    }
+    else {
+        Limelog("Video port: %u\n", VideoPortNumber);
     }
-    
-    if (AppVersionQuad[0] >= 5) {
-        RTSP_MESSAGE response;
-        int error = -1;
-
-        if (!setupStream(&response,
-                         controlStreamId,
-                         &error)) {
-            Limelog("RTSP SETUP streamid=control request failed: %d\n", error);
-            ret = error;
-            goto Exit;
-        }
-
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP SETUP streamid=control request failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
-            goto Exit;
-        }
 
+    if (AppVersionQuad[0] >= 5) {
         // Parse the control port out of the RTSP SETUP response
         LC_ASSERT(ControlPortNumber == 0);
-        if (!parseServerPortFromTransport(&response, &ControlPortNumber)) {
+        if (!parseServerPortFromTransport(&batch[1].response, &ControlPortNumber)) {
             // Use the well known port if parsing fails
             ControlPortNumber = 47999;
 
@@ -1016,96 +1239,43 @@ int performRtspHandshake(PSERVER_INFORMATION serverInfo) {
         else {
             Limelog("Control port: %u\n", ControlPortNumber);
         }
-
-        freeMessage(&response);
     }
 
-    {
-        RTSP_MESSAGE response;
-        int error = -1;
-
-        if (!sendVideoAnnounce(&response, &error)) {
-            Limelog("RTSP ANNOUNCE request failed: %d\n", error);
-            ret = error;
-            goto Exit;
-        }
-
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP ANNOUNCE request failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
-            goto Exit;
-        }
+    freeRtspBatch();
 
-        freeMessage(&response);
+    // The ANNOUNCE payload includes the video port, so it must wait for the SETUPs.
+    // The host handles requests in order, so the PLAY can follow right behind it.
+    if (!addRtspRequest("ANNOUNCE", initializeAnnounceRequest,
+                        APP_VERSION_AT_LEAST(7, 1, 431) ? controlStreamId : "streamid=video", false)) {
+        ret = -1;
+        goto Exit;
     }
 
     // GFE 3.22 uses a single PLAY message
     if (APP_VERSION_AT_LEAST(7, 1, 431)) {
-        RTSP_MESSAGE response;
-        int error = -1;
-
-        if (!playStream(&response, "/", &error)) {
-            Limelog("RTSP PLAY request failed: %d\n", error);
-            ret = error;
-            goto Exit;
-        }
-
-        if (response.message.response.statusCode != 200) {
-            Limelog("RTSP PLAY failed: %d\n",
-                response.message.response.statusCode);
-            ret = response.message.response.statusCode;
+        if (!addRtspRequest("PLAY", initializePlayRequest, "/", false)) {
+            ret = -1;
             goto Exit;
         }
-
-        freeMessage(&response);
     }
     else {
-        {
-            RTSP_MESSAGE response;
-            int error = -1;
-
-            if (!playStream(&response, "streamid=video", &error)) {
-                Limelog("RTSP PLAY streamid=video request failed: %d\n", error);
-                ret = error;
-                goto Exit;
-            }
-
-            if (response.message.response.statusCode != 200) {
-                Limelog("RTSP PLAY streamid=video failed: %d\n",
-                    response.message.response.statusCode);
-                ret = response.message.response.statusCode;
-                goto Exit;
-            }
-
-            freeMessage(&response);
+        if (!addRtspRequest("PLAY streamid=video", initializePlayRequest, "streamid=video", false) ||
+            !addRtspRequest("PLAY streamid=audio", initializePlayRequest, "streamid=audio", false)) {
+            ret = -1;
+            goto Exit;
         }
+    }
 
-        {
-            RTSP_MESSAGE response;
-            int error = -1;
-
-            if (!playStream(&response, "streamid=audio", &error)) {
-                Limelog("RTSP PLAY streamid=audio request failed: %d\n", error);
-                ret = error;
-                goto Exit;
-            }
-
-            if (response.message.response.statusCode != 200) {
-                Limelog("RTSP PLAY streamid=audio failed: %d\n",
-                    response.message.response.statusCode);
-                ret = response.message.response.statusCode;
-                goto Exit;
-            }
-
-            freeMessage(&response);
-        }
+    ret = transactRtspBatch();
+    if (ret != 0) {
+        goto Exit;
     }
 
-    
     ret = 0;
     
 Exit:
+    freeRtspBatch();
+
     // Cleanup the ENet stuff
     if (useEnet) {
         if (peer != NULL) {
@@ -17,16 +17,23 @@ static bool decodingFrame;
 static bool strictIdrFrameWait;
 static uint64_t syntheticPtsBase;
 static uint64_t firstPacketReceiveTime;
+static uint64_t firstPacketReceiveTimeUs;
+static uint64_t lastFecCompleteTimeUs;
 static unsigned int firstPacketPresentationTime;
 static bool dropStatePending;
 static bool idrFrameProcessed;
 
+// Used for CAPABILITY_CONTIGUOUS_FRAME_BUFFER
+static bool contiguousFrameBuffers;
+static char* frameBuffer;
+static int frameBufferCapacity;
+
 #define DR_CLEANUP -1000
 
 #define CONSECUTIVE_DROP_LIMIT 120
 static unsigned int consecutiveFrameDrops;
 
-static LINKED_BLOCKING_QUEUE decodeUnitQueue;
+static RING_BLOCKING_QUEUE decodeUnitQueue;
 
 typedef struct _BUFFER_DESC {
     char* data;
@@ -54,7 +61,7 @@ typedef struct _LENTRY_INTERNAL {
 
 // Init
 void initializeVideoDepacketizer(int pktSize) {
-    LbqInitializeLinkedBlockingQueue(&decodeUnitQueue, 15);
+    RbqInitializeRingBlockingQueue(&decodeUnitQueue, 15);
 
     nextFrameNumber = 1;
     startFrameNumber = 0;
@@ -65,10 +72,15 @@ void initializeVideoDepacketizer(int pktSize) {
     decodingFrame = false;
     syntheticPtsBase = 0;
     firstPacketReceiveTime = 0;
+    firstPacketReceiveTimeUs = 0;
+    lastFecCompleteTimeUs = 0;
     firstPacketPresentationTime = 0;
     dropStatePending = false;
     idrFrameProcessed = false;
     strictIdrFrameWait = !isReferenceFrameInvalidationEnabled();
+    contiguousFrameBuffers = (VideoCallbacks.capabilities & CAPABILITY_CONTIGUOUS_FRAME_BUFFER) != 0;
+    frameBuffer = NULL;
+    frameBufferCapacity = 0;
 }
 
 // Free the NAL chain
@@ -78,11 +90,12 @@ static void cleanupFrameState(void) {
     while (nalChainHead != NULL) {
         lastEntry = (PLENTRY_INTERNAL)nalChainHead;
         nalChainHead = lastEntry->entry.next;
-        free(lastEntry->allocPtr);
+        freeVideoPacketBuffer(lastEntry->allocPtr);
     }
 
     nalChainTail = NULL;
 
+    // The contiguous frame buffer (if any) is kept for the next frame
     nalChainDataLength = 0;
 }
 
@@ -136,13 +149,17 @@ static void freeDecodeUnitList(PLINKED_BLOCKING_QUEUE_ENTRY entry) {
 }
 
 void stopVideoDepacketizer(void) {
-    LbqSignalQueueShutdown(&decodeUnitQueue);
+    RbqSignalQueueShutdown(&decodeUnitQueue);
 }
 
 // Cleanup video depacketizer and free malloced memory
 void destroyVideoDepacketizer(void) {
-    freeDecodeUnitList(LbqDestroyLinkedBlockingQueue(&decodeUnitQueue));
+    freeDecodeUnitList(RbqDestroyRingBlockingQueue(&decodeUnitQueue));
     cleanupFrameState();
+
+    free(frameBuffer);
+    frameBuffer = NULL;
+    frameBufferCapacity = 0;
 }
 
 static bool getAnnexBStartSequence(PBUFFER_DESC current, PBUFFER_DESC startSeq) {
@@ -223,12 +240,15 @@ void validateDecodeUnitForPlayback(PDECODE_UNIT decodeUnit) {
 bool LiWaitForNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* decodeUnit) {
     PQUEUED_DECODE_UNIT qdu;
 
-    int err = LbqWaitForQueueElement(&decodeUnitQueue, (void**)&qdu);
+    int err = RbqWaitForQueueElement(&decodeUnitQueue, (void**)&qdu);
     if (err != LBQ_SUCCESS) {
         return false;
     }
 
     validateDecodeUnitForPlayback(&qdu->decodeUnit);
+#ifdef LC_DEBUG_RECORD_MODE
+    recordVideoFrame(&qdu->decodeUnit);
+#endif
 
     *frameHandle = qdu;
     *decodeUnit = &qdu->decodeUnit;
@@ -238,12 +258,15 @@ bool LiWaitForNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* deco
 bool LiPollNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* decodeUnit) {
     PQUEUED_DECODE_UNIT qdu;
 
-    int err = LbqPollQueueElement(&decodeUnitQueue, (void**)&qdu);
+    int err = RbqPollQueueElement(&decodeUnitQueue, (void**)&qdu);
     if (err != LBQ_SUCCESS) {
         return false;
     }
 
     validateDecodeUnitForPlayback(&qdu->decodeUnit);
+#ifdef LC_DEBUG_RECORD_MODE
+    recordVideoFrame(&qdu->decodeUnit);
+#endif
 
     *frameHandle = qdu;
     *decodeUnit = &qdu->decodeUnit;
@@ -253,7 +276,7 @@ bool LiPollNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* decodeU
 bool LiPeekNextVideoFrame(PDECODE_UNIT* decodeUnit) {
     PQUEUED_DECODE_UNIT qdu;
 
-    int err = LbqPeekQueueElement(&decodeUnitQueue, (void**)&qdu);
+    int err = RbqPeekQueueElement(&decodeUnitQueue, (void**)&qdu);
     if (err != LBQ_SUCCESS) {
         return false;
     }
@@ -265,7 +288,17 @@ bool LiPeekNextVideoFrame(PDECODE_UNIT* decodeUnit) {
 }
 
 void LiWakeWaitForVideoFrame(void) {
-    LbqSignalQueueUserWake(&decodeUnitQueue);
+    RbqSignalQueueUserWake(&decodeUnitQueue);
+}
+
+char* LiTakeVideoFrameBuffer(PDECODE_UNIT decodeUnit) {
+    char* buffer = decodeUnit->frameBuffer;
+    decodeUnit->frameBuffer = NULL;
+    return buffer;
+}
+
+void LiFreeVideoFrameBuffer(char* buffer) {
+    free(buffer);
 }
 
 // Cleanup a decode unit by freeing the buffer chain and the holder
@@ -286,9 +319,12 @@ void LiCompleteVideoFrame(VIDEO_FRAME_HANDLE handle, int drStatus) {
     while (qdu->decodeUnit.bufferList != NULL) {
         lastEntry = (PLENTRY_INTERNAL)qdu->decodeUnit.bufferList;
         qdu->decodeUnit.bufferList = lastEntry->entry.next;
-        free(lastEntry->allocPtr);
+        freeVideoPacketBuffer(lastEntry->allocPtr);
     }
 
+    // Free the frame buffer unless the renderer took it
+    free(qdu->decodeUnit.frameBuffer);
+
     // We will have stack-allocated entries iff we have a direct-submit decoder
     if ((VideoCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
         free(qdu);
@@ -452,6 +488,20 @@ static void reassembleFrame(int frameNumber) {
             qdu->decodeUnit.receiveTimeMs = firstPacketReceiveTime;
             qdu->decodeUnit.presentationTimeMs = firstPacketPresentationTime;
             qdu->decodeUnit.enqueueTimeMs = LiGetMillis();
+            qdu->decodeUnit.frameBuffer = NULL;
+
+            recordFrameTraceNetworkStages(frameNumber, firstPacketReceiveTimeUs,
+                                          lastFecCompleteTimeUs, PltGetMicroseconds());
+
+            // Hand the frame buffer off with the decode unit. The depacketizer
+            // will allocate a new one for the next frame.
+            if (contiguousFrameBuffers) {
+                LC_ASSERT(frameBuffer != NULL);
+                memset(&frameBuffer[nalChainDataLength], 0, VIDEO_FRAME_BUFFER_PADDING);
+                qdu->decodeUnit.frameBuffer = frameBuffer;
+                frameBuffer = NULL;
+                frameBufferCapacity = 0;
+            }
 
             // IDR frames will have leading CSD buffers
             if (nalChainHead->bufferType != BUFFER_TYPE_PICDATA) {
@@ -466,7 +516,7 @@ static void reassembleFrame(int frameNumber) {
             nalChainDataLength = 0;
 
             if ((VideoCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
-                if (LbqOfferQueueItem(&decodeUnitQueue, qdu, &qdu->entry) == LBQ_BOUND_EXCEEDED) {
+                if (RbqOfferQueueItem(&decodeUnitQueue, qdu, &qdu->entry) == LBQ_BOUND_EXCEEDED) {
                     Limelog("Video decode unit queue overflow\n");
 
                     // RFI recovery is not supported here
@@ -478,10 +528,11 @@ static void reassembleFrame(int frameNumber) {
                     dropFrameState();
 
                     // Free the DU we were going to queue
+                    free(qdu->decodeUnit.frameBuffer);
                     free(qdu);
 
                     // Free all frames in the decode unit queue
-                    freeDecodeUnitList(LbqFlushQueueItems(&decodeUnitQueue));
+                    freeDecodeUnitList(RbqFlushQueueItems(&decodeUnitQueue));
 
                     // Request an IDR frame to recover
                     LiRequestIdrFrame();
@@ -491,6 +542,9 @@ static void reassembleFrame(int frameNumber) {
             else {
                 // Submit the frame to the decoder
                 validateDecodeUnitForPlayback(&qdu->decodeUnit);
+#ifdef LC_DEBUG_RECORD_MODE
+                recordVideoFrame(&qdu->decodeUnit);
+#endif
                 LiCompleteVideoFrame(qdu, VideoCallbacks.submitDecodeUnit(&qdu->decodeUnit));
             }
 
@@ -551,11 +605,95 @@ static int getBufferFlags(char* data, int length) {
     }
 }
 
+// Ensures the contiguous frame buffer can hold the specified number of bytes (plus padding).
+// Since the buffer may move, the entries already pointing into it are rebased.
+static bool reserveFrameBuffer(int size) {
+    char* newBuffer;
+    int newCapacity;
+    int offset;
+    PLENTRY entry;
+
+    if (size <= frameBufferCapacity) {
+        return true;
+    }
+
+    newCapacity = frameBufferCapacity * 2;
+    if (newCapacity < size) {
+        newCapacity = size;
+    }
+
+    newBuffer = realloc(frameBuffer, newCapacity + VIDEO_FRAME_BUFFER_PADDING);
+    if (newBuffer == NULL) {
+        return false;
+    }
+
+    frameBuffer = newBuffer;
+    frameBufferCapacity = newCapacity;
+
+    offset = 0;
+    for (entry = nalChainHead; entry != NULL; entry = entry->next) {
+        entry->data = &frameBuffer[offset];
+        offset += entry->length;
+    }
+
+    return true;
+}
+
+// Copies the fragment to the end of the contiguous frame buffer. Consecutive picture
+// data is coalesced into a single entry, so P-frames have only one buffer in the chain.
+static void queueFragmentContiguous(char* data, int offset, int length) {
+    PLENTRY_INTERNAL entry;
+    int bufferType;
+
+    if (!reserveFrameBuffer(nalChainDataLength + length)) {
+        return;
+    }
+
+    bufferType = getBufferFlags(&data[offset], length);
+    memcpy(&frameBuffer[nalChainDataLength], &data[offset], length);
+
+    if (nalChainTail != NULL &&
+            nalChainTail->bufferType == BUFFER_TYPE_PICDATA &&
+            bufferType == BUFFER_TYPE_PICDATA) {
+        nalChainTail->length += length;
+    }
+    else {
+        entry = (PLENTRY_INTERNAL)malloc(sizeof(*entry));
+        if (entry == NULL) {
+            return;
+        }
+
+        entry->allocPtr = entry;
+        entry->entry.next = NULL;
+        entry->entry.data = &frameBuffer[nalChainDataLength];
+        entry->entry.length = length;
+        entry->entry.bufferType = bufferType;
+
+        if (nalChainTail == NULL) {
+            LC_ASSERT(nalChainHead == NULL);
+            nalChainHead = nalChainTail = (PLENTRY)entry;
+        }
+        else {
+            LC_ASSERT(nalChainHead != NULL);
+            nalChainTail->next = (PLENTRY)entry;
+            nalChainTail = nalChainTail->next;
+        }
+    }
+
+    nalChainDataLength += length;
+}
+
 // As an optimization, we can cast the existing packet buffer to a PLENTRY and avoid
 // a malloc() and a memcpy() of the packet data.
 static void queueFragment(PLENTRY_INTERNAL* existingEntry, char* data, int offset, int length) {
     PLENTRY_INTERNAL entry;
 
+    // In contiguous mode, the data is copied and the caller retains the packet buffer
+    if (contiguousFrameBuffers) {
+        queueFragmentContiguous(data, offset, length);
+        return;
+    }
+
     if (existingEntry == NULL || *existingEntry == NULL) {
         entry = (PLENTRY_INTERNAL)malloc(sizeof(*entry) + length);
     }
@@ -669,7 +807,7 @@ void requestDecoderRefresh(void) {
     waitingForIdrFrame = true;
     
     // Flush the decode unit queue
-    freeDecodeUnitList(LbqFlushQueueItems(&decodeUnitQueue));
+    freeDecodeUnitList(RbqFlushQueueItems(&decodeUnitQueue));
     
     // Request the receive thread drop its state
     // on the next call. We can't do it here because
@@ -693,7 +831,8 @@ static int isFirstPacket(uint8_t flags, uint8_t fecBlockNumber) {
 // Process an RTP Payload
 // The caller will free *existingEntry unless we NULL it
 static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
-                       uint64_t receiveTimeMs, unsigned int presentationTimeMs,
+                       uint64_t receiveTimeMs, uint64_t receiveTimeUs,
+                       uint64_t fecCompleteTimeUs, unsigned int presentationTimeMs,
                        PLENTRY_INTERNAL* existingEntry) {
     BUFFER_DESC currentPos;
     uint32_t frameIndex;
@@ -775,6 +914,14 @@ static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
         // We're now decoding a frame
         decodingFrame = true;
         firstPacketReceiveTime = receiveTimeMs;
+        firstPacketReceiveTimeUs = receiveTimeUs;
+
+        // Size the frame buffer for the whole frame up front using the FEC block
+        // info, so we don't usually have to grow it while the frame arrives.
+        if (contiguousFrameBuffers) {
+            reserveFrameBuffer((int)((videoPacket->fecInfo & 0xFFC00000) >> 22) *
+                               (fecLastBlockNumber + 1) * currentPos.length);
+        }
         
         // Some versions of Sunshine don't send a valid PTS, so we will
         // synthesize one using the receive time as the time base.
@@ -792,6 +939,9 @@ static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
 
     lastPacketInStream = streamPacketIndex;
 
+    // The frame's FEC blocks complete in order, so the last packet's time is the frame's
+    lastFecCompleteTimeUs = fecCompleteTimeUs;
+
     // If this is the first packet, skip the frame header (if one exists)
     if (firstPacket) {
         // Parse the frame type from the header
@@ -1030,15 +1180,17 @@ void queueRtpPacket(PRTPV_QUEUE_ENTRY queueEntryPtr) {
     processRtpPayload((PNV_VIDEO_PACKET)(((char*)queueEntry.packet) + dataOffset),
                       queueEntry.length - dataOffset,
                       queueEntry.receiveTimeMs,
+                      queueEntry.receiveTimeUs,
+                      queueEntry.fecCompleteTimeUs,
                       queueEntry.presentationTimeMs,
                       &existingEntry);
 
     if (existingEntry != NULL) {
         // processRtpPayload didn't want this packet, so just free it
-        free(existingEntry->allocPtr);
+        freeVideoPacketBuffer(existingEntry->allocPtr);
     }
 }
 
 int LiGetPendingVideoFrames(void) {
-    return LbqGetItemCount(&decodeUnitQueue);
+    return RbqGetItemCount(&decodeUnitQueue);
 }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Platform.h"
+
+// The stream recorder (LC_DEBUG_RECORD_MODE) writes the Annex B data of each
+// decode unit back to back in one file, and a timing file next to it that
+// describes each decode unit. Both are in host byte order.
+
+#define VIDEO_TIMING_FILE_SUFFIX ".timing"
+#define VIDEO_TIMING_MAGIC "MLRT"
+#define VIDEO_TIMING_VERSION 1
+
+#pragma pack(push, 1)
+
+typedef struct _VIDEO_TIMING_FILE_HEADER {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t videoFormat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+} VIDEO_TIMING_FILE_HEADER, *PVIDEO_TIMING_FILE_HEADER;
+
+// One per decode unit in stream order
+typedef struct _VIDEO_TIMING_RECORD {
+    uint32_t frameNumber;
+    uint32_t frameType;
+    uint32_t length;
+    uint32_t presentationTimeMs;
+    uint64_t receiveTimeMs;
+    uint64_t enqueueTimeMs;
+} VIDEO_TIMING_RECORD, *PVIDEO_TIMING_RECORD;
+
+#pragma pack(pop)
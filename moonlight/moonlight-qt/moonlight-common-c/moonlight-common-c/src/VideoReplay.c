@@ -0,0 +1,1128 @@
+#include "Limelight-internal.h"
+#include "rs.h"
+
+#define REPLAY_DEFAULT_PACKET_SIZE 1392
+#define REPLAY_DEFAULT_FEC_PERCENTAGE 20
+
+// An unpaced replay waits for the decoder to drain the decode unit
+// queue down to this many frames before sending the next one
+#define REPLAY_MAX_PENDING_FRAMES 2
+
+// Hosts split large frames into at most 4 FEC blocks
+#define REPLAY_MAX_FEC_BLOCKS 4
+
+// Each frame starts with an 8 byte header that carries the frame type
+#define REPLAY_FRAME_HEADER_SIZE 8
+#define REPLAY_FRAME_TYPE_P 1
+#define REPLAY_FRAME_TYPE_IDR 2
+
+// RTP packets use a 90 KHz presentation timestamp clock
+#define PTS_DIVISOR 90
+
+// Number of recent frames and audio packets we keep delivery state for. This
+// must cover the frames and packets that can be in flight in the RTP queues.
+#define REPLAY_FRAME_STATE_COUNT 256
+#define REPLAY_AUDIO_STATE_COUNT 256
+
+// Size of the synthetic audio payloads, which is about what a 5 ms CBR Opus
+// packet is for stereo at the bitrate hosts use
+#define REPLAY_AUDIO_PAYLOAD_SIZE 80
+
+#define REPLAY_AUDIO_PAYLOAD_TYPE 97
+#define REPLAY_AUDIO_FEC_PAYLOAD_TYPE 127
+
+#ifndef MIN
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
+typedef struct _REPLAY_FRAME {
+    size_t offset;
+    uint32_t length;
+    uint32_t frameNumber;
+    uint32_t presentationTimeMs;
+    uint64_t receiveTimeMs;
+
+    // Recorded time between the first packet and the complete frame
+    uint32_t networkTimeMs;
+
+    bool idrFrame;
+} REPLAY_FRAME, *PREPLAY_FRAME;
+
+typedef struct _REPLAY_FRAME_STATE {
+    uint32_t frameNumber;
+    bool lostPackets;
+    uint64_t lastDataSendTimeUs;
+} REPLAY_FRAME_STATE, *PREPLAY_FRAME_STATE;
+
+typedef struct _REPLAY_AUDIO_STATE {
+    uint16_t sequenceNumber;
+    bool received;
+    uint64_t sendTimeUs;
+} REPLAY_AUDIO_STATE, *PREPLAY_AUDIO_STATE;
+
+static VIDEO_REPLAY_CONFIGURATION replayConfig;
+static char* streamData;
+static PREPLAY_FRAME frames;
+static int frameCount;
+
+static RTP_VIDEO_QUEUE replayQueue;
+static reed_solomon* replayRs;
+static uint32_t nextPacketIndex;
+static PACKET_IMPAIRMENT videoImpairment;
+static REPLAY_FRAME_STATE frameStates[REPLAY_FRAME_STATE_COUNT];
+
+static RTP_AUDIO_QUEUE replayAudioQueue;
+static PACKET_IMPAIRMENT audioImpairment;
+static REPLAY_AUDIO_STATE audioStates[REPLAY_AUDIO_STATE_COUNT];
+static uint16_t nextAudioDeliverySequenceNumber;
+static bool audioDeliveryStarted;
+
+static PLT_THREAD feederThread;
+static PLT_THREAD decoderThread;
+static PLT_THREAD audioThread;
+
+static volatile bool replayActive;
+static volatile uint32_t idrFrameRequested;
+static volatile uint32_t videoFeedFinished;
+static volatile uint32_t audioFeedFinished;
+static volatile uint32_t replayFinished;
+static VIDEO_REPLAY_STATS replayStats;
+
+void LiInitializeVideoReplayConfiguration(PVIDEO_REPLAY_CONFIGURATION config) {
+    memset(config, 0, sizeof(*config));
+    config->packetSize = REPLAY_DEFAULT_PACKET_SIZE;
+    config->fecPercentage = REPLAY_DEFAULT_FEC_PERCENTAGE;
+    config->speedPercent = 100;
+}
+
+bool isVideoReplayActive(void) {
+    return replayActive;
+}
+
+// Called from LiRequestIdrFrame() while a replay is running
+void requestVideoReplayIdrFrame(void) {
+    PltAtomicStore32(&idrFrameRequested, 1);
+}
+
+static bool addFrame(int* capacity, size_t offset, size_t length, bool idrFrame) {
+    PREPLAY_FRAME frame;
+
+    if (frameCount == *capacity) {
+        *capacity = *capacity != 0 ? *capacity * 2 : 256;
+        frames = extendBuffer(frames, *capacity * sizeof(*frames));
+        if (frames == NULL) {
+            return false;
+        }
+    }
+
+    frame = &frames[frameCount];
+    frame->offset = offset;
+    frame->length = (uint32_t)length;
+    frame->frameNumber = frameCount + 1;
+    frame->presentationTimeMs = 0;
+    frame->receiveTimeMs = 0;
+    frame->networkTimeMs = 0;
+    frame->idrFrame = idrFrame;
+    frameCount++;
+
+    return true;
+}
+
+// Returns the offset of the next Annex B start sequence or length if there are none
+static size_t findStartSequence(const unsigned char* data, size_t length, size_t offset) {
+    while (offset + 3 <= length) {
+        if (data[offset] == 0 && data[offset + 1] == 0 && data[offset + 2] == 1) {
+            return offset;
+        }
+        offset++;
+    }
+
+    return length;
+}
+
+// Splits the stream into frames at the NAL units that begin an access unit
+static int findUntimedFrames(size_t streamLength) {
+    const unsigned char* data = (const unsigned char*)streamData;
+    size_t frameStart;
+    size_t offset;
+    bool sawPicture = false;
+    bool idrFrame = false;
+    int capacity = 0;
+
+    if ((replayConfig.videoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265)) == 0) {
+        Limelog("Replaying this video format requires a timing file\n");
+        return -1;
+    }
+
+    if (replayConfig.fps <= 0) {
+        Limelog("Replaying without a timing file requires a frame rate\n");
+        return -1;
+    }
+
+    // Anything before the first start sequence belongs to the first frame
+    frameStart = 0;
+    offset = findStartSequence(data, streamLength, 0);
+    while (offset + 3 < streamLength) {
+        size_t nal = offset + 3;
+        size_t nextOffset = findStartSequence(data, streamLength, nal);
+        bool picture, firstSlice, prefix, idrNal;
+
+        if (replayConfig.videoFormat & VIDEO_FORMAT_MASK_H264) {
+            int type = data[nal] & 0x1F;
+
+            // A first_mb_in_slice of 0 is coded as a single 1 bit
+            picture = type >= 1 && type <= 5;
+            firstSlice = picture && nal + 1 < streamLength && (data[nal + 1] & 0x80);
+            prefix = type >= 6 && type <= 9;
+            idrNal = type == 5;
+        }
+        else {
+            int type = (data[nal] >> 1) & 0x3F;
+
+            picture = type < 32;
+            firstSlice = picture && nal + 2 < streamLength && (data[nal + 2] & 0x80);
+            prefix = (type >= 32 && type <= 35) || type == 39;
+            idrNal = type >= 16 && type <= 21;
+        }
+
+        if (sawPicture && (prefix || firstSlice)) {
+            size_t frameEnd = offset;
+
+            // Keep the leading zero of a 4 byte start sequence with its frame
+            if (frameEnd > frameStart && data[frameEnd - 1] == 0) {
+                frameEnd--;
+            }
+
+            if (!addFrame(&capacity, frameStart, frameEnd - frameStart, idrFrame)) {
+                return -1;
+            }
+
+            frameStart = frameEnd;
+            sawPicture = false;
+            idrFrame = false;
+        }
+
+        sawPicture |= picture;
+        idrFrame |= idrNal;
+        offset = nextOffset;
+    }
+
+    if (sawPicture && !addFrame(&capacity, frameStart, streamLength - frameStart, idrFrame)) {
+        return -1;
+    }
+
+    // Without timing, pretend each frame arrived exactly on time
+    for (int i = 0; i < frameCount; i++) {
+        frames[i].presentationTimeMs = (uint32_t)((uint64_t)i * 1000 / replayConfig.fps);
+        frames[i].receiveTimeMs = frames[i].presentationTimeMs;
+    }
+
+    return 0;
+}
+
+static int loadTimedFrames(FILE* timingFile, size_t streamLength) {
+    VIDEO_TIMING_FILE_HEADER header;
+    VIDEO_TIMING_RECORD record;
+    size_t offset = 0;
+    int capacity = 0;
+
+    if (fread(&header, sizeof(header), 1, timingFile) != 1 ||
+            memcmp(header.magic, VIDEO_TIMING_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != VIDEO_TIMING_VERSION) {
+        Limelog("Replay timing file is invalid\n");
+        return -1;
+    }
+
+    replayConfig.videoFormat = header.videoFormat;
+    replayConfig.width = header.width;
+    replayConfig.height = header.height;
+    replayConfig.fps = header.fps;
+
+    while (fread(&record, sizeof(record), 1, timingFile) == 1) {
+        PREPLAY_FRAME frame;
+
+        if (record.length > streamLength - offset) {
+            Limelog("Replay timing file doesn't match the stream\n");
+            return -1;
+        }
+
+        if (!addFrame(&capacity, offset, record.length, record.frameType == FRAME_TYPE_IDR)) {
+            return -1;
+        }
+
+        frame = &frames[frameCount - 1];
+        frame->frameNumber = record.frameNumber;
+        frame->presentationTimeMs = record.presentationTimeMs;
+        frame->receiveTimeMs = record.receiveTimeMs;
+        frame->networkTimeMs = (uint32_t)(record.enqueueTimeMs > record.receiveTimeMs ?
+                                          record.enqueueTimeMs - record.receiveTimeMs : 0);
+
+        offset += record.length;
+    }
+
+    return 0;
+}
+
+static void freeRecording(void) {
+    free(frames);
+    frames = NULL;
+    frameCount = 0;
+
+    free(streamData);
+    streamData = NULL;
+}
+
+static int loadRecording(void) {
+    FILE* file;
+    long streamLength;
+    int err;
+
+    file = fopen(replayConfig.streamFile, "rb");
+    if (file == NULL) {
+        Limelog("Failed to open replay stream: %s\n", replayConfig.streamFile);
+        return -1;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (streamLength = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+        Limelog("Replay stream is empty: %s\n", replayConfig.streamFile);
+        fclose(file);
+        return -1;
+    }
+
+    streamData = malloc(streamLength);
+    if (streamData == NULL || fread(streamData, 1, streamLength, file) != (size_t)streamLength) {
+        Limelog("Failed to read replay stream: %s\n", replayConfig.streamFile);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+
+    if (replayConfig.timingFile != NULL) {
+        file = fopen(replayConfig.timingFile, "rb");
+        if (file == NULL) {
+            Limelog("Failed to open replay timing file: %s\n", replayConfig.timingFile);
+            return -1;
+        }
+
+        err = loadTimedFrames(file, streamLength);
+        fclose(file);
+    }
+    else {
+        err = findUntimedFrames(streamLength);
+    }
+
+    if (err != 0) {
+        return err;
+    }
+
+    if (frameCount == 0) {
+        Limelog("Replay stream has no frames\n");
+        return -1;
+    }
+
+    Limelog("Loaded %d frames for replay\n", frameCount);
+    return 0;
+}
+
+static reed_solomon* getReplayReedSolomon(int dataShards, int parityShards) {
+    if (replayRs == NULL || replayRs->data_shards != dataShards || replayRs->parity_shards != parityShards) {
+        if (replayRs != NULL) {
+            reed_solomon_release(replayRs);
+        }
+        replayRs = reed_solomon_new(dataShards, parityShards);
+    }
+
+    return replayRs;
+}
+
+// Sleeps until the given time. Returns false if the replay is stopping.
+static bool waitUntil(PLT_THREAD* thread, uint64_t timeUs) {
+    for (;;) {
+        uint64_t nowUs = PltGetMicroseconds();
+
+        if (PltIsThreadInterrupted(thread)) {
+            return false;
+        }
+
+        // We can't sleep for less than a millisecond, so send a bit early instead
+        if (nowUs + 1000 > timeUs) {
+            return true;
+        }
+
+        PltSleepMsInterruptible(thread, (int)((timeUs - nowUs) / 1000));
+    }
+}
+
+// Called by the depacketizer when a frame is delivered during a replay. This happens
+// on the feeder thread because the RTP queue delivers frames from RtpvAddPacket().
+void notifyVideoReplayFrameDelivered(int frameNumber) {
+    PREPLAY_FRAME_STATE state = &frameStates[(uint32_t)frameNumber % REPLAY_FRAME_STATE_COUNT];
+
+    if (state->frameNumber != (uint32_t)frameNumber) {
+        return;
+    }
+
+    replayStats.framesDelivered++;
+    if (state->lostPackets) {
+        replayStats.framesRecovered++;
+    }
+
+    if (state->lastDataSendTimeUs != 0) {
+        uint64_t addedLatencyUs = PltGetMicroseconds() - state->lastDataSendTimeUs;
+
+        replayStats.totalAddedLatencyUs += addedLatencyUs;
+        if (addedLatencyUs > replayStats.maxAddedLatencyUs) {
+            replayStats.maxAddedLatencyUs = (uint32_t)addedLatencyUs;
+        }
+    }
+}
+
+static void queueVideoPacket(char* packet, int length) {
+    int receiveSize = StreamConfig.packetSize + MAX_RTP_HEADER_SIZE;
+    uint64_t startTimeUs = PltGetMicroseconds();
+
+    replayStats.packetsSent++;
+    if (RtpvAddPacket(&replayQueue, (PRTP_PACKET)packet, length,
+                      (PRTPV_QUEUE_ENTRY)&packet[receiveSize]) != RTPF_RET_QUEUED) {
+        freeVideoPacketBuffer(packet);
+    }
+
+    replayStats.totalQueueTimeUs += PltGetMicroseconds() - startTimeUs;
+}
+
+// Sends a video packet through the simulated network to the RTP queue
+static void impairVideoPacket(PREPLAY_FRAME_STATE frameState, char* packet, int length) {
+    char* duplicatePacket;
+
+    switch (PiProcessPacket(&videoImpairment, packet, length)) {
+    case PI_DROP:
+        replayStats.packetsDropped++;
+        frameState->lostPackets = true;
+        freeVideoPacketBuffer(packet);
+        break;
+
+    case PI_DELAY:
+        replayStats.packetsReordered++;
+        break;
+
+    case PI_DUPLICATE:
+        // The RTP queue takes ownership of the packet, so copy it first
+        duplicatePacket = allocateVideoPacketBuffer();
+        if (duplicatePacket != NULL) {
+            memcpy(duplicatePacket, packet, StreamConfig.packetSize + MAX_RTP_HEADER_SIZE);
+        }
+
+        queueVideoPacket(packet, length);
+        if (duplicatePacket != NULL) {
+            replayStats.packetsDuplicated++;
+            queueVideoPacket(duplicatePacket, length);
+        }
+        break;
+
+    default:
+        queueVideoPacket(packet, length);
+        break;
+    }
+
+    while ((packet = PiGetDelayedPacket(&videoImpairment, &length, false)) != NULL) {
+        queueVideoPacket(packet, length);
+    }
+}
+
+// Fills the RTP and NV headers that are present in both data and parity packets
+static void initializePacketHeaders(char* packet, uint32_t packetIndex, uint32_t frameNumber,
+                                    uint32_t presentationTimeMs, uint32_t fecInfo, uint8_t multiFecBlocks) {
+    PRTP_PACKET rtpPacket = (PRTP_PACKET)packet;
+    PNV_VIDEO_PACKET nvPacket = (PNV_VIDEO_PACKET)&packet[MAX_RTP_HEADER_SIZE];
+
+    // The receive thread has already converted these to host byte order
+    rtpPacket->header = 0x80 | FLAG_EXTENSION;
+    rtpPacket->packetType = 0;
+    rtpPacket->sequenceNumber = U16(packetIndex);
+    rtpPacket->timestamp = presentationTimeMs * PTS_DIVISOR;
+    rtpPacket->ssrc = 0;
+
+    nvPacket->frameIndex = LE32(frameNumber);
+    nvPacket->fecInfo = LE32(fecInfo);
+    nvPacket->multiFecFlags = 0x10;
+    nvPacket->multiFecBlocks = multiFecBlocks;
+}
+
+// Picks the number of FEC blocks for a frame like the host does. Frames too large for
+// the maximum number of blocks at the configured FEC percentage get less parity.
+static bool chooseFecBlocks(int totalDataShards, int* blockCount, int* blockDataShards, int* fecPercentage) {
+    for (*blockCount = 1; *blockCount <= REPLAY_MAX_FEC_BLOCKS; (*blockCount)++) {
+        *blockDataShards = (totalDataShards + *blockCount - 1) / *blockCount;
+        *fecPercentage = replayConfig.fecPercentage;
+
+        if (*blockCount == REPLAY_MAX_FEC_BLOCKS) {
+            while (*fecPercentage > 0 &&
+                   *blockDataShards + (*blockDataShards * *fecPercentage + 99) / 100 > DATA_SHARDS_MAX) {
+                (*fecPercentage)--;
+            }
+        }
+
+        if (*blockDataShards + (*blockDataShards * *fecPercentage + 99) / 100 <= DATA_SHARDS_MAX) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Splits a frame into data and parity packets and feeds them to the RTP queue, spreading them
+// out over spreadUs. Returns false if the replay is stopping.
+static bool sendFrame(PREPLAY_FRAME frame, uint32_t frameNumber, uint64_t sendTimeUs, uint64_t spreadUs) {
+    char frameHeader[REPLAY_FRAME_HEADER_SIZE] = { 0x01 };
+    int payloadSize = StreamConfig.packetSize - sizeof(NV_VIDEO_PACKET);
+    int receiveSize = StreamConfig.packetSize + MAX_RTP_HEADER_SIZE;
+    int frameLength = REPLAY_FRAME_HEADER_SIZE + frame->length;
+    int totalDataShards = (frameLength + payloadSize - 1) / payloadSize;
+    int blockCount, blockDataShards, fecPercentage;
+    int totalPackets, sentPackets;
+    int frameOffset = 0;
+    int block;
+    PREPLAY_FRAME_STATE frameState = &frameStates[frameNumber % REPLAY_FRAME_STATE_COUNT];
+
+    frameHeader[3] = frame->idrFrame ? REPLAY_FRAME_TYPE_IDR : REPLAY_FRAME_TYPE_P;
+
+    frameState->frameNumber = frameNumber;
+    frameState->lostPackets = false;
+    frameState->lastDataSendTimeUs = 0;
+
+    if (!chooseFecBlocks(totalDataShards, &blockCount, &blockDataShards, &fecPercentage)) {
+        Limelog("Replay frame %u is too large to send (%u bytes)\n", frame->frameNumber, frame->length);
+        return true;
+    }
+
+    totalPackets = 0;
+    for (block = 0; block < blockCount; block++) {
+        int dataShards = MIN(blockDataShards, totalDataShards - block * blockDataShards);
+        totalPackets += dataShards + (dataShards * fecPercentage + 99) / 100;
+    }
+
+    sentPackets = 0;
+    for (block = 0; block < blockCount; block++) {
+        unsigned char* shards[DATA_SHARDS_MAX];
+        int dataShards = MIN(blockDataShards, totalDataShards - block * blockDataShards);
+        int parityShards = (dataShards * fecPercentage + 99) / 100;
+        uint8_t multiFecBlocks = (uint8_t)((((blockCount - 1) << 2) | block) << 4);
+        int i;
+
+        for (i = 0; i < dataShards + parityShards; i++) {
+            shards[i] = allocateVideoPacketBuffer();
+            if (shards[i] == NULL) {
+                Limelog("Replay: allocateVideoPacketBuffer() failed\n");
+                while (i-- > 0) {
+                    freeVideoPacketBuffer(shards[i]);
+                }
+                return false;
+            }
+
+            memset(shards[i], 0, receiveSize);
+            initializePacketHeaders((char*)shards[i], nextPacketIndex + i, frameNumber, frame->presentationTimeMs,
+                                    (dataShards << 22) | (i << 12) | (fecPercentage << 4), multiFecBlocks);
+        }
+
+        // Copy the frame data after the frame header
+        for (i = 0; i < dataShards; i++) {
+            PNV_VIDEO_PACKET nvPacket = (PNV_VIDEO_PACKET)&shards[i][MAX_RTP_HEADER_SIZE];
+            char* payload = (char*)(nvPacket + 1);
+            int length = MIN(payloadSize, frameLength - frameOffset);
+            int headerLength = 0;
+
+            if (frameOffset < REPLAY_FRAME_HEADER_SIZE) {
+                headerLength = MIN(length, REPLAY_FRAME_HEADER_SIZE - frameOffset);
+                memcpy(payload, &frameHeader[frameOffset], headerLength);
+            }
+            memcpy(&payload[headerLength],
+                   &streamData[frame->offset + frameOffset + headerLength - REPLAY_FRAME_HEADER_SIZE],
+                   length - headerLength);
+            frameOffset += length;
+
+            nvPacket->streamPacketIndex = LE32(U24(nextPacketIndex + i) << 8);
+            nvPacket->flags = FLAG_CONTAINS_PIC_DATA;
+            if (i == 0) {
+                nvPacket->flags |= FLAG_SOF;
+            }
+            if (i == dataShards - 1) {
+                nvPacket->flags |= FLAG_EOF;
+            }
+        }
+
+        // Like the host, we compute parity over the whole packets and then
+        // overwrite the headers in the parity packets
+        if (parityShards != 0) {
+            reed_solomon* rs = getReplayReedSolomon(dataShards, parityShards);
+            if (rs == NULL || reed_solomon_encode(rs, shards, dataShards + parityShards, receiveSize) != 0) {
+                Limelog("Replay: Reed-Solomon encoding failed\n");
+                for (i = 0; i < dataShards + parityShards; i++) {
+                    freeVideoPacketBuffer(shards[i]);
+                }
+                return false;
+            }
+
+            for (i = dataShards; i < dataShards + parityShards; i++) {
+                initializePacketHeaders((char*)shards[i], nextPacketIndex + i, frameNumber, frame->presentationTimeMs,
+                                        (dataShards << 22) | (i << 12) | (fecPercentage << 4), multiFecBlocks);
+            }
+        }
+
+        for (i = 0; i < dataShards + parityShards; i++) {
+            int length = receiveSize;
+
+            if (spreadUs != 0 && !waitUntil(&feederThread, sendTimeUs + spreadUs * sentPackets / totalPackets)) {
+                while (i < dataShards + parityShards) {
+                    freeVideoPacketBuffer(shards[i++]);
+                }
+                return false;
+            }
+
+            // The last data packet of the frame is only as long as its data. Without
+            // impairments, the frame would be complete as soon as it arrives.
+            if (i == dataShards - 1 && block == blockCount - 1) {
+                length = MAX_RTP_HEADER_SIZE + sizeof(NV_VIDEO_PACKET) + (frameLength - (totalDataShards - 1) * payloadSize);
+                frameState->lastDataSendTimeUs = PltGetMicroseconds();
+            }
+
+            sentPackets++;
+            impairVideoPacket(frameState, (char*)shards[i], length);
+        }
+
+        nextPacketIndex += dataShards + parityShards;
+    }
+
+    return true;
+}
+
+// Feeds the recorded frames to the RTP queue at the recorded pace (scaled by
+// the replay speed) as if they were arriving from a host
+static void VideoReplayThreadProc(void* context) {
+    uint32_t frameNumberOffset = 1 - frames[0].frameNumber;
+    uint64_t frameTimeUs = PltGetMicroseconds();
+    int lastIdrFrame = -1;
+    int i;
+
+    for (i = 0; i < frameCount; i++) {
+        PREPLAY_FRAME frame = &frames[i];
+        uint64_t spreadUs = 0;
+
+        if (replayConfig.speedPercent > 0) {
+            uint64_t maxSpreadUs = 1000000ULL * 100 / ((uint64_t)replayConfig.fps * replayConfig.speedPercent);
+
+            if (i > 0 && frame->receiveTimeMs > frames[i - 1].receiveTimeMs) {
+                frameTimeUs += (frame->receiveTimeMs - frames[i - 1].receiveTimeMs) * 1000 * 100 / replayConfig.speedPercent;
+            }
+            if (!waitUntil(&feederThread, frameTimeUs)) {
+                return;
+            }
+
+            // Spread the packets out like the network did, but don't overlap the next frame
+            spreadUs = MIN((uint64_t)frame->networkTimeMs * 1000 * 100 / replayConfig.speedPercent, maxSpreadUs);
+        }
+        else {
+            // Apply backpressure so we don't overflow the decode unit queue
+            while (LiGetPendingVideoFrames() >= REPLAY_MAX_PENDING_FRAMES) {
+                if (PltIsThreadInterrupted(&feederThread)) {
+                    return;
+                }
+                PltSleepMsInterruptible(&feederThread, 1);
+            }
+
+            frameTimeUs = PltGetMicroseconds();
+        }
+
+        if (frame->idrFrame) {
+            // This satisfies any outstanding IDR frame request
+            PltAtomicStore32(&idrFrameRequested, 0);
+            lastIdrFrame = i;
+        }
+        else if (lastIdrFrame >= 0 && PltAtomicCompareExchange32(&idrFrameRequested, 1, 0)) {
+            // A host would respond with a new IDR frame, so send the last one again in place of this frame.
+            // The following frames won't reference it properly, but they'll decode with the same cost.
+            frame = &frames[lastIdrFrame];
+            replayStats.idrFramesResent++;
+        }
+
+        if (!sendFrame(frame, frames[i].frameNumber + frameNumberOffset, frameTimeUs, spreadUs)) {
+            return;
+        }
+
+        replayStats.framesSent++;
+    }
+
+    // Deliver any packets still held back for reordering
+    {
+        char* packet;
+        int length;
+
+        while ((packet = PiGetDelayedPacket(&videoImpairment, &length, true)) != NULL) {
+            queueVideoPacket(packet, length);
+        }
+    }
+
+    // Stop the audio and wait for the client to consume the remaining frames
+    PltAtomicStore32(&videoFeedFinished, 1);
+    while (LiGetPendingVideoFrames() > 0 ||
+           (replayConfig.audioPacketDuration > 0 && PltAtomicLoad32(&audioFeedFinished) == 0)) {
+        if (PltIsThreadInterrupted(&feederThread)) {
+            return;
+        }
+        PltSleepMsInterruptible(&feederThread, 1);
+    }
+
+    Limelog("Replay finished: %u of %u frames delivered, %u packets sent, %u packets dropped, %u IDR frames resent\n",
+            replayStats.framesDelivered, replayStats.framesSent, replayStats.packetsSent,
+            replayStats.packetsDropped, replayStats.idrFramesResent);
+    if (replayConfig.audioPacketDuration > 0) {
+        Limelog("Replay audio: %u packets delivered (%u recovered), %u lost, %u corrupted\n",
+                replayStats.audioPacketsDelivered, replayStats.audioPacketsRecovered,
+                replayStats.audioPacketsLost, replayStats.audioPacketsCorrupted);
+    }
+    PltAtomicStore32(&replayFinished, 1);
+}
+
+// Fills an audio payload with data that can be checked after it comes out of the RTP queue
+static void fillAudioPayload(uint8_t* payload, uint16_t sequenceNumber) {
+    int i;
+
+    for (i = 0; i < REPLAY_AUDIO_PAYLOAD_SIZE; i++) {
+        payload[i] = (uint8_t)((sequenceNumber * 0x9E3779B1u) >> (i % 24)) ^ (uint8_t)i;
+    }
+}
+
+static void checkAudioPacket(PRTP_PACKET packet, uint16_t length) {
+    uint8_t expectedPayload[REPLAY_AUDIO_PAYLOAD_SIZE];
+    PREPLAY_AUDIO_STATE state;
+    uint16_t sequenceNumber;
+
+    if (length == 0) {
+        // This is a placeholder for a packet the queue gave up on
+        replayStats.audioPacketsLost++;
+        nextAudioDeliverySequenceNumber++;
+        return;
+    }
+
+    sequenceNumber = packet->sequenceNumber;
+    if (audioDeliveryStarted) {
+        // The queue skips entire FEC blocks that were lost
+        replayStats.audioPacketsLost += U16(sequenceNumber - nextAudioDeliverySequenceNumber);
+    }
+    audioDeliveryStarted = true;
+    nextAudioDeliverySequenceNumber = sequenceNumber + 1;
+
+    replayStats.audioPacketsDelivered++;
+
+    fillAudioPayload(expectedPayload, sequenceNumber);
+    if (length != sizeof(RTP_PACKET) + REPLAY_AUDIO_PAYLOAD_SIZE ||
+            memcmp(packet + 1, expectedPayload, REPLAY_AUDIO_PAYLOAD_SIZE) != 0) {
+        Limelog("Replay audio packet %u was corrupted\n", sequenceNumber);
+        replayStats.audioPacketsCorrupted++;
+    }
+
+    state = &audioStates[sequenceNumber % REPLAY_AUDIO_STATE_COUNT];
+    if (state->sequenceNumber == sequenceNumber) {
+        uint64_t addedLatencyUs = PltGetMicroseconds() - state->sendTimeUs;
+
+        if (!state->received) {
+            replayStats.audioPacketsRecovered++;
+        }
+
+        replayStats.audioTotalAddedLatencyUs += addedLatencyUs;
+        if (addedLatencyUs > replayStats.audioMaxAddedLatencyUs) {
+            replayStats.audioMaxAddedLatencyUs = (uint32_t)addedLatencyUs;
+        }
+    }
+}
+
+static void queueAudioPacket(PRTP_PACKET packet, int length) {
+    PRTP_PACKET queuedPacket;
+    uint16_t queuedLength;
+    uint64_t startTimeUs;
+    int queueStatus;
+
+    if (packet->packetType == REPLAY_AUDIO_PAYLOAD_TYPE) {
+        PREPLAY_AUDIO_STATE state = &audioStates[packet->sequenceNumber % REPLAY_AUDIO_STATE_COUNT];
+        if (state->sequenceNumber == packet->sequenceNumber) {
+            state->received = true;
+        }
+    }
+
+    replayStats.audioPacketsSent++;
+
+    startTimeUs = PltGetMicroseconds();
+    queueStatus = RtpaAddPacket(&replayAudioQueue, packet, (uint16_t)length);
+    replayStats.audioTotalQueueTimeUs += PltGetMicroseconds() - startTimeUs;
+
+    if (RTPQ_HANDLE_NOW(queueStatus)) {
+        checkAudioPacket(packet, (uint16_t)length);
+    }
+    else if (RTPQ_PACKET_READY(queueStatus)) {
+        for (;;) {
+            startTimeUs = PltGetMicroseconds();
+            queuedPacket = RtpaGetQueuedPacket(&replayAudioQueue, 0, &queuedLength);
+            replayStats.audioTotalQueueTimeUs += PltGetMicroseconds() - startTimeUs;
+
+            if (queuedPacket == NULL) {
+                break;
+            }
+
+            checkAudioPacket(queuedPacket, queuedLength);
+            free(queuedPacket);
+        }
+    }
+
+    // The queue copies what it keeps
+    free(packet);
+}
+
+// Sends an audio packet through the simulated network to the RTP queue
+static void impairAudioPacket(PRTP_PACKET packet, int length) {
+    switch (PiProcessPacket(&audioImpairment, packet, length)) {
+    case PI_DROP:
+        replayStats.audioPacketsDropped++;
+        free(packet);
+        break;
+
+    case PI_DELAY:
+        break;
+
+    case PI_DUPLICATE: {
+        PRTP_PACKET duplicatePacket = malloc(length);
+
+        if (duplicatePacket != NULL) {
+            memcpy(duplicatePacket, packet, length);
+        }
+
+        queueAudioPacket(packet, length);
+        if (duplicatePacket != NULL) {
+            queueAudioPacket(duplicatePacket, length);
+        }
+        break;
+    }
+
+    default:
+        queueAudioPacket(packet, length);
+        break;
+    }
+
+    while ((packet = PiGetDelayedPacket(&audioImpairment, &length, false)) != NULL) {
+        queueAudioPacket(packet, length);
+    }
+}
+
+
+static PRTP_PACKET allocateAudioPacket(uint8_t packetType, uint16_t sequenceNumber, uint32_t timestamp, int length) {
+    PRTP_PACKET packet = malloc(length);
+
+    if (packet != NULL) {
+        // The receive thread has already converted these to host byte order
+        packet->header = 0x80;
+        packet->packetType = packetType;
+        packet->sequenceNumber = sequenceNumber;
+        packet->timestamp = timestamp;
+        packet->ssrc = 0;
+    }
+
+    return packet;
+}
+
+// Sends a synthetic audio stream with FEC parity like a host does until all the video
+// has been sent. Each FEC block's parity packets follow its last data packet.
+static void AudioReplayThreadProc(void* context) {
+    int speedPercent = replayConfig.speedPercent > 0 ? replayConfig.speedPercent : 100;
+    uint64_t packetIntervalUs = (uint64_t)replayConfig.audioPacketDuration * 1000 * 100 / speedPercent;
+    uint64_t sendTimeUs = PltGetMicroseconds();
+    uint16_t sequenceNumber = 0;
+    PRTP_PACKET packet;
+    int length;
+
+    while (PltAtomicLoad32(&videoFeedFinished) == 0) {
+        uint8_t payloads[RTPA_TOTAL_SHARDS][REPLAY_AUDIO_PAYLOAD_SIZE];
+        uint8_t* shards[RTPA_TOTAL_SHARDS];
+        uint16_t baseSequenceNumber = sequenceNumber;
+        uint32_t baseTimestamp = baseSequenceNumber * replayConfig.audioPacketDuration;
+        int i;
+
+        // The payloads are known in advance, so we can compute the parity up front
+        for (i = 0; i < RTPA_TOTAL_SHARDS; i++) {
+            if (i < RTPA_DATA_SHARDS) {
+                fillAudioPayload(payloads[i], baseSequenceNumber + i);
+            }
+            shards[i] = payloads[i];
+        }
+        reed_solomon_encode(replayAudioQueue.rs, shards, RTPA_TOTAL_SHARDS, REPLAY_AUDIO_PAYLOAD_SIZE);
+
+        for (i = 0; i < RTPA_DATA_SHARDS; i++) {
+            PREPLAY_AUDIO_STATE state = &audioStates[sequenceNumber % REPLAY_AUDIO_STATE_COUNT];
+
+            if (!waitUntil(&audioThread, sendTimeUs)) {
+                return;
+            }
+
+            state->sequenceNumber = sequenceNumber;
+            state->received = false;
+            state->sendTimeUs = PltGetMicroseconds();
+
+            length = sizeof(RTP_PACKET) + REPLAY_AUDIO_PAYLOAD_SIZE;
+            packet = allocateAudioPacket(REPLAY_AUDIO_PAYLOAD_TYPE, sequenceNumber,
+                                         sequenceNumber * replayConfig.audioPacketDuration, length);
+            if (packet != NULL) {
+                memcpy(packet + 1, payloads[i], REPLAY_AUDIO_PAYLOAD_SIZE);
+                impairAudioPacket(packet, length);
+            }
+
+            sequenceNumber++;
+            sendTimeUs += packetIntervalUs;
+        }
+
+        for (i = 0; i < RTPA_FEC_SHARDS; i++) {
+            PAUDIO_FEC_HEADER fecHeader;
+
+            // The queue finds the FEC block from the FEC header rather than the RTP header
+            length = sizeof(RTP_PACKET) + sizeof(AUDIO_FEC_HEADER) + REPLAY_AUDIO_PAYLOAD_SIZE;
+            packet = allocateAudioPacket(REPLAY_AUDIO_FEC_PAYLOAD_TYPE, baseSequenceNumber + i, baseTimestamp, length);
+            if (packet == NULL) {
+                continue;
+            }
+
+            fecHeader = (PAUDIO_FEC_HEADER)(packet + 1);
+            fecHeader->fecShardIndex = (uint8_t)i;
+            fecHeader->payloadType = REPLAY_AUDIO_PAYLOAD_TYPE;
+            fecHeader->baseSequenceNumber = BE16(baseSequenceNumber);
+            fecHeader->baseTimestamp = BE32(baseTimestamp);
+            fecHeader->ssrc = 0;
+            memcpy(fecHeader + 1, payloads[RTPA_DATA_SHARDS + i], REPLAY_AUDIO_PAYLOAD_SIZE);
+
+            impairAudioPacket(packet, length);
+        }
+    }
+
+    // Deliver any packets still held back for reordering
+    while ((packet = PiGetDelayedPacket(&audioImpairment, &length, true)) != NULL) {
+        queueAudioPacket(packet, length);
+    }
+
+    PltAtomicStore32(&audioFeedFinished, 1);
+}
+
+static void ReplayDecoderThreadProc(void* context) {
+    while (!PltIsThreadInterrupted(&decoderThread)) {
+        VIDEO_FRAME_HANDLE frameHandle;
+        PDECODE_UNIT decodeUnit;
+
+        if (!LiWaitForNextVideoFrame(&frameHandle, &decodeUnit)) {
+            return;
+        }
+
+        LiCompleteVideoFrame(frameHandle, VideoCallbacks.submitDecodeUnit(decodeUnit));
+    }
+}
+
+static void stopAudioThread(void) {
+    if (replayConfig.audioPacketDuration > 0) {
+        PltInterruptThread(&audioThread);
+        PltJoinThread(&audioThread);
+        PltCloseThread(&audioThread);
+    }
+}
+
+// Frees the RTP queues and any packets still held back for reordering
+static void cleanupReplayQueues(void) {
+    void* packet;
+    int length;
+
+    while ((packet = PiGetDelayedPacket(&videoImpairment, &length, true)) != NULL) {
+        freeVideoPacketBuffer(packet);
+    }
+    RtpvCleanupQueue(&replayQueue);
+
+    if (replayConfig.audioPacketDuration > 0) {
+        while ((packet = PiGetDelayedPacket(&audioImpairment, &length, true)) != NULL) {
+            free(packet);
+        }
+        RtpaCleanupQueue(&replayAudioQueue);
+    }
+}
+
+static bool usesDecoderThread(void) {
+    return (VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0;
+}
+
+int LiStartVideoReplay(PVIDEO_REPLAY_CONFIGURATION config, PCONNECTION_LISTENER_CALLBACKS clCallbacks,
+                       PDECODER_RENDERER_CALLBACKS drCallbacks, void* renderContext, int drFlags) {
+    PAUDIO_RENDERER_CALLBACKS arCallbacks = NULL;
+    int err;
+
+    if (drCallbacks != NULL && (drCallbacks->capabilities & CAPABILITY_PULL_RENDERER) && drCallbacks->submitDecodeUnit) {
+        return -1;
+    }
+
+    if (drCallbacks != NULL && (drCallbacks->capabilities & CAPABILITY_PULL_RENDERER) && (drCallbacks->capabilities & CAPABILITY_DIRECT_SUBMIT)) {
+        return -1;
+    }
+
+    // Replace missing callbacks with placeholders
+    fixupMissingCallbacks(&drCallbacks, &arCallbacks, &clCallbacks);
+    memcpy(&VideoCallbacks, drCallbacks, sizeof(VideoCallbacks));
+    memcpy(&ListenerCallbacks, clCallbacks, sizeof(ListenerCallbacks));
+
+    memcpy(&replayConfig, config, sizeof(replayConfig));
+    if (replayConfig.packetSize <= (int)sizeof(NV_VIDEO_PACKET) + REPLAY_FRAME_HEADER_SIZE ||
+            replayConfig.fecPercentage < 0 || replayConfig.speedPercent < 0 || replayConfig.audioPacketDuration < 0 ||
+            replayConfig.impairment.lossPercent < 0 || replayConfig.impairment.lossPercent > 100 ||
+            replayConfig.impairment.reorderPercent < 0 || replayConfig.impairment.reorderPercent > 100 ||
+            replayConfig.impairment.duplicatePercent < 0 || replayConfig.impairment.duplicatePercent > 100) {
+        Limelog("Invalid replay configuration\n");
+        return -1;
+    }
+
+    err = loadRecording();
+    if (err != 0) {
+        goto Cleanup;
+    }
+
+    if (replayConfig.fps <= 0) {
+        Limelog("Replay stream has an invalid frame rate: %d\n", replayConfig.fps);
+        err = -1;
+        goto Cleanup;
+    }
+
+    // Set up the stream like a multi-FEC capable Sunshine host without RFI
+    LiInitializeStreamConfiguration(&StreamConfig);
+    StreamConfig.width = replayConfig.width;
+    StreamConfig.height = replayConfig.height;
+    StreamConfig.fps = replayConfig.fps;
+    StreamConfig.packetSize = replayConfig.packetSize;
+    NegotiatedVideoFormat = replayConfig.videoFormat;
+    AppVersionQuad[0] = 7;
+    AppVersionQuad[1] = 1;
+    AppVersionQuad[2] = 431;
+    AppVersionQuad[3] = -1;
+    ReferenceFrameInvalidationSupported = false;
+    ConnectionInterrupted = false;
+    resetConnectionFrameStats();
+
+    memset(&replayStats, 0, sizeof(replayStats));
+    idrFrameRequested = 0;
+    videoFeedFinished = 0;
+    audioFeedFinished = 0;
+    replayFinished = 0;
+    nextPacketIndex = 0;
+    memset(frameStates, 0, sizeof(frameStates));
+    memset(audioStates, 0, sizeof(audioStates));
+    nextAudioDeliverySequenceNumber = 0;
+    audioDeliveryStarted = false;
+
+    // Video and audio travel over the same network, but each has its own impairments
+    PiInitialize(&videoImpairment, &replayConfig.impairment, 0);
+    PiInitialize(&audioImpairment, &replayConfig.impairment, 1);
+
+    initializeVideoStream();
+    RtpvInitializeQueue(&replayQueue);
+
+    if (replayConfig.audioPacketDuration > 0) {
+        AudioPacketDuration = replayConfig.audioPacketDuration;
+        RtpaInitializeQueue(&replayAudioQueue);
+    }
+
+    err = VideoCallbacks.setup(NegotiatedVideoFormat, StreamConfig.width,
+        StreamConfig.height, StreamConfig.fps, renderContext, drFlags);
+    if (err != 0) {
+        goto CleanupStream;
+    }
+
+    // IDR frame requests must come to us from now on
+    replayActive = true;
+
+    VideoCallbacks.start();
+
+    if (replayConfig.audioPacketDuration > 0) {
+        err = PltCreateThread("AudioReplay", AudioReplayThreadProc, NULL, &audioThread);
+        if (err != 0) {
+            VideoCallbacks.stop();
+            VideoCallbacks.cleanup();
+            goto CleanupStream;
+        }
+    }
+
+    err = PltCreateThread("VideoReplay", VideoReplayThreadProc, NULL, &feederThread);
+    if (err != 0) {
+        VideoCallbacks.stop();
+        stopAudioThread();
+        VideoCallbacks.cleanup();
+        goto CleanupStream;
+    }
+
+    if (usesDecoderThread()) {
+        err = PltCreateThread("VideoDec", ReplayDecoderThreadProc, NULL, &decoderThread);
+        if (err != 0) {
+            VideoCallbacks.stop();
+            stopVideoDepacketizer();
+            PltInterruptThread(&feederThread);
+            PltJoinThread(&feederThread);
+            PltCloseThread(&feederThread);
+            stopAudioThread();
+            VideoCallbacks.cleanup();
+            goto CleanupStream;
+        }
+    }
+
+    return 0;
+
+CleanupStream:
+    replayActive = false;
+    cleanupReplayQueues();
+    destroyVideoStream();
+
+Cleanup:
+    freeRecording();
+    return err;
+}
+
+bool LiIsVideoReplayFinished(void) {
+    return PltAtomicLoad32(&replayFinished) != 0;
+}
+
+void LiGetVideoReplayStats(PVIDEO_REPLAY_STATS stats) {
+    // These are only written by the feeder thread, so a torn snapshot is harmless
+    memcpy(stats, &replayStats, sizeof(*stats));
+}
+
+void LiStopVideoReplay(void) {
+    VideoCallbacks.stop();
+
+    // Wake up client code that may be waiting on the decode unit queue
+    stopVideoDepacketizer();
+
+    PltInterruptThread(&feederThread);
+    if (usesDecoderThread()) {
+        PltInterruptThread(&decoderThread);
+    }
+
+    PltJoinThread(&feederThread);
+    if (usesDecoderThread()) {
+        PltJoinThread(&decoderThread);
+    }
+
+    PltCloseThread(&feederThread);
+    if (usesDecoderThread()) {
+        PltCloseThread(&decoderThread);
+    }
+
+    stopAudioThread();
+
+    VideoCallbacks.cleanup();
+
+    replayActive = false;
+    cleanupReplayQueues();
+    destroyVideoStream();
+
+    if (replayRs != NULL) {
+        reed_solomon_release(replayRs);
+        replayRs = NULL;
+    }
+
+    freeRecording();
+}
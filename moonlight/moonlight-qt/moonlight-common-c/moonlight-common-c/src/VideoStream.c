@@ -1,4 +1,5 @@
 #include "Limelight-internal.h"
+#include "rs.h"
 
 #define FIRST_FRAME_MAX 1500
 #define FIRST_FRAME_TIMEOUT_SEC 10
@@ -7,7 +8,13 @@
 
 #define RTP_RECV_BUFFER (512 * 1024)
 
+// The packet pool must be able to hold every shard of a multi-FEC frame while
+// it's in the RTP queue, plus the packets of frames waiting to be decoded.
+#define PACKET_POOL_FEC_BLOCKS 4
+#define PACKET_POOL_SIZE (2 * PACKET_POOL_FEC_BLOCKS * DATA_SHARDS_MAX)
+
 static RTP_VIDEO_QUEUE rtpQueue;
+static BUFFER_POOL packetPool;
 
 static SOCKET rtpSocket = INVALID_SOCKET;
 static SOCKET firstFrameSocket = INVALID_SOCKET;
@@ -28,6 +35,19 @@ static bool receivedFullFrame;
 
 // Initialize the video stream
 void initializeVideoStream(void) {
+    // Each buffer holds the RTP packet followed by its RTPV_QUEUE_ENTRY
+    if (BpInitializeBufferPool(&packetPool,
+                               StreamConfig.packetSize + MAX_RTP_HEADER_SIZE + sizeof(RTPV_QUEUE_ENTRY),
+                               PACKET_POOL_SIZE) != 0) {
+        // Allocations will fall back to the heap
+        Limelog("Failed to allocate video packet pool\n");
+    }
+
+    if (initializeFrameTrace() != 0) {
+        // Frames just won't be traced
+        Limelog("Failed to allocate frame trace\n");
+    }
+
     initializeVideoDepacketizer(StreamConfig.packetSize);
     RtpvInitializeQueue(&rtpQueue);
     receivedDataFromPeer = false;
@@ -37,8 +57,33 @@ void initializeVideoStream(void) {
 
 // Clean up the video stream
 void destroyVideoStream(void) {
+    unsigned int hits, misses;
+
     destroyVideoDepacketizer();
     RtpvCleanupQueue(&rtpQueue);
+
+    LiGetVideoPacketPoolStats(&hits, &misses);
+    Limelog("Video packet pool: %u hits, %u misses\n", hits, misses);
+    BpCleanupBufferPool(&packetPool);
+
+    destroyFrameTrace();
+}
+
+void* allocateVideoPacketBuffer(void) {
+    return BpAllocateBuffer(&packetPool);
+}
+
+// This also accepts buffers that didn't come from allocateVideoPacketBuffer()
+void freeVideoPacketBuffer(void* buffer) {
+    BpFreeBuffer(&packetPool, buffer);
+}
+
+void LiGetVideoPacketPoolStats(unsigned int* hits, unsigned int* misses) {
+    uint32_t poolHits, poolMisses;
+
+    BpGetStats(&packetPool, &poolHits, &poolMisses);
+    *hits = poolHits;
+    *misses = poolMisses;
 }
 
 // UDP Ping proc
@@ -65,15 +110,16 @@ static void VideoPingThreadProc(void* context) {
 // Receive thread proc
 static void VideoReceiveThreadProc(void* context) {
     int err;
-    int bufferSize, receiveSize;
-    char* buffer;
+    int receiveSize;
+    char* buffers[UDP_RECV_BATCH_MAX];
+    int lengths[UDP_RECV_BATCH_MAX];
     int queueStatus;
     bool useSelect;
     int waitingForVideoMs;
+    int i;
 
     receiveSize = StreamConfig.packetSize + MAX_RTP_HEADER_SIZE;
-    bufferSize = receiveSize + sizeof(RTPV_QUEUE_ENTRY);
-    buffer = NULL;
+    memset(buffers, 0, sizeof(buffers));
 
     if (setNonFatalRecvTimeoutMs(rtpSocket, UDP_RECV_POLL_TIMEOUT_MS) < 0) {
         // SO_RCVTIMEO failed, so use select() to wait
@@ -86,20 +132,22 @@ static void VideoReceiveThreadProc(void* context) {
 
     waitingForVideoMs = 0;
     while (!PltIsThreadInterrupted(&receiveThread)) {
-        PRTP_PACKET packet;
-
-        if (buffer == NULL) {
-            buffer = (char*)malloc(bufferSize);
-            if (buffer == NULL) {
-                Limelog("Video Receive: malloc() failed\n");
-                ListenerCallbacks.connectionTerminated(-1);
-                return;
+        // Replace any buffers that were handed off to the queue in the last batch.
+        // Rejected buffers remain in place and are reused for the next receive.
+        for (i = 0; i < UDP_RECV_BATCH_MAX; i++) {
+            if (buffers[i] == NULL) {
+                buffers[i] = (char*)allocateVideoPacketBuffer();
+                if (buffers[i] == NULL) {
+                    Limelog("Video Receive: allocateVideoPacketBuffer() failed\n");
+                    ListenerCallbacks.connectionTerminated(-1);
+                    goto Exit;
+                }
             }
         }
 
-        err = recvUdpSocket(rtpSocket, buffer, receiveSize, useSelect);
+        err = recvUdpSocketBatch(rtpSocket, buffers, lengths, receiveSize, UDP_RECV_BATCH_MAX, useSelect);
         if (err < 0) {
-            Limelog("Video Receive: recvUdpSocket() failed: %d\n", (int)LastSocketError());
+            Limelog("Video Receive: recvUdpSocketBatch() failed: %d\n", (int)LastSocketError());
             ListenerCallbacks.connectionTerminated(LastSocketFail());
             break;
         }
@@ -136,22 +184,28 @@ static void VideoReceiveThreadProc(void* context) {
             }
         }
 
-        // Convert fields to host byte-order
-        packet = (PRTP_PACKET)&buffer[0];
-        packet->sequenceNumber = BE16(packet->sequenceNumber);
-        packet->timestamp = BE32(packet->timestamp);
-        packet->ssrc = BE32(packet->ssrc);
+        // Feed the whole batch to the RTP queue in one pass
+        for (i = 0; i < err; i++) {
+            PRTP_PACKET packet;
+
+            // Convert fields to host byte-order
+            packet = (PRTP_PACKET)&buffers[i][0];
+            packet->sequenceNumber = BE16(packet->sequenceNumber);
+            packet->timestamp = BE32(packet->timestamp);
+            packet->ssrc = BE32(packet->ssrc);
 
-        queueStatus = RtpvAddPacket(&rtpQueue, packet, err, (PRTPV_QUEUE_ENTRY)&buffer[receiveSize]);
+            queueStatus = RtpvAddPacket(&rtpQueue, packet, lengths[i], (PRTPV_QUEUE_ENTRY)&buffers[i][receiveSize]);
 
-        if (queueStatus == RTPF_RET_QUEUED) {
-            // The queue owns the buffer
-            buffer = NULL;
+            if (queueStatus == RTPF_RET_QUEUED) {
+                // The queue owns the buffer
+                buffers[i] = NULL;
+            }
         }
     }
 
-    if (buffer != NULL) {
-        free(buffer);
+Exit:
+    for (i = 0; i < UDP_RECV_BATCH_MAX; i++) {
+        freeVideoPacketBuffer(buffers[i]);
     }
 }
 
@@ -230,27 +284,48 @@ void stopVideoStream(void) {
     VideoCallbacks.cleanup();
 }
 
-// Start the video stream
-int startVideoStream(void* rendererContext, int drFlags) {
+// Set up the decoder and bind the RTP socket. This is separate from startVideoStream()
+// so it can overlap with the control stream connection. If this succeeds,
+// startVideoStream() or cleanupVideoDecoder() must follow.
+int setupVideoDecoder(void* rendererContext, int drFlags) {
     int err;
 
-    firstFrameSocket = INVALID_SOCKET;
-
     // This must be called before the decoder thread starts submitting
     // decode units
     LC_ASSERT(NegotiatedVideoFormat != 0);
-    err = VideoCallbacks.setup(NegotiatedVideoFormat, StreamConfig.width,
-        StreamConfig.height, StreamConfig.fps, rendererContext, drFlags);
-    if (err != 0) {
-        return err;
-    }
 
+    // Binding only needs the address family, not the control stream
     rtpSocket = bindUdpSocket(RemoteAddr.ss_family, RTP_RECV_BUFFER);
     if (rtpSocket == INVALID_SOCKET) {
-        VideoCallbacks.cleanup();
         return LastSocketError();
     }
 
+    err = VideoCallbacks.setup(NegotiatedVideoFormat, StreamConfig.width,
+        StreamConfig.height, StreamConfig.fps, rendererContext, drFlags);
+    if (err != 0) {
+        closeSocket(rtpSocket);
+        rtpSocket = INVALID_SOCKET;
+    }
+
+    return err;
+}
+
+// Undo setupVideoDecoder() when the video stream won't be started
+void cleanupVideoDecoder(void) {
+    closeSocket(rtpSocket);
+    rtpSocket = INVALID_SOCKET;
+    VideoCallbacks.cleanup();
+}
+
+// Start the video stream after setupVideoDecoder()
+int startVideoStream(void) {
+    int err;
+
+    firstFrameSocket = INVALID_SOCKET;
+
+    // setupVideoDecoder() bound this already
+    LC_ASSERT(rtpSocket != INVALID_SOCKET);
+
     VideoCallbacks.start();
 
     err = PltCreateThread("VideoRecv", VideoReceiveThreadProc, NULL, &receiveThread);